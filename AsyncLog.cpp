@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <pthread.h>
+#include <sys/prctl.h>
+
+#include "AsyncLog.h"
+#include "Metrics.h"
+
+using namespace std;
+
+namespace
+{
+    constexpr size_t RING_BYTES  = 1 << 16;
+    // Longer messages (e.g. PacketSequence dumps) are truncated.
+    constexpr size_t MAX_MESSAGE = RING_BYTES / 4;
+    constexpr uint32_t PADDING   = UINT32_MAX;
+
+    struct Header
+    {
+        uint32_t size;          // Payload bytes, or PADDING to the end
+        uint32_t level;
+        int64_t  time;          // system_clock, ns
+        size_t   thread_id;
+        char     thread_name[16];
+    };
+
+    constexpr size_t record_size(size_t payload)
+    {
+        return (sizeof(Header) + payload + 7) & ~size_t {7};
+    }
+
+    thread_local const char* t_thread_name {nullptr};
+}
+
+struct AsyncSink::Ring
+{
+    atomic<bool>     in_use  {true};
+    atomic<uint64_t> head    {0};   // Bytes written, by the owning thread
+    atomic<uint64_t> tail    {0};   // Bytes read, by the writer
+    atomic<uint64_t> dropped {0};
+    alignas(8) uint8_t buf[RING_BYTES];
+};
+
+AsyncSink::AsyncSink(string logger_name, vector<spdlog::sink_ptr> sinks)
+    : m_logger_name(std::move(logger_name))
+    , m_sinks(std::move(sinks))
+{
+    m_thread = std::thread(&AsyncSink::writer, this);
+    pthread_setname_np(m_thread.native_handle(), "logger");
+}
+
+AsyncSink::~AsyncSink(void)
+{
+    m_running.store(false);
+    m_wake.release();
+    m_thread.join();
+}
+
+const char* AsyncSink::ThreadName(void)
+{
+    return t_thread_name;
+}
+
+AsyncSink::Ring* AsyncSink::ring(void)
+{
+    struct Handle
+    {
+        AsyncSink*       owner {nullptr};
+        shared_ptr<Ring> ring;
+
+        ~Handle(void)
+        {
+            if (ring)
+                ring->in_use.store(false, memory_order_release);
+        }
+    };
+    thread_local Handle t_handle;
+
+    if (t_handle.owner != this) [[unlikely]]
+    {
+        if (t_handle.ring)
+            t_handle.ring->in_use.store(false, memory_order_release);
+        t_handle.ring  = claim();
+        t_handle.owner = this;
+    }
+    return t_handle.ring.get();
+}
+
+shared_ptr<AsyncSink::Ring> AsyncSink::claim(void)
+{
+    scoped_lock lock(m_rings_mutex);
+
+    // The writer keeps draining a ring after its thread exits; the next
+    // thread simply carries on after whatever is still in it.
+    for (auto& ring : m_rings)
+    {
+        bool idle = false;
+        if (ring->in_use.compare_exchange_strong(idle, true,
+                                                 memory_order_acquire))
+            return ring;
+    }
+
+    m_rings.push_back(make_shared<Ring>());
+    return m_rings.back();
+}
+
+void AsyncSink::log(const spdlog::details::log_msg& msg)
+{
+    Ring* ring = this->ring();
+
+    size_t   len  = min(msg.payload.size(), MAX_MESSAGE);
+    size_t   need = record_size(len);
+    uint64_t head = ring->head.load(memory_order_relaxed);
+    size_t   pos  = head % RING_BYTES;
+    size_t   room = RING_BYTES - pos;
+    size_t   total = need > room ? room + need : need;
+
+    if (RING_BYTES - (head - ring->tail.load(memory_order_acquire)) < total)
+    {
+        ring->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    if (need > room)
+    {
+        // Records never wrap.
+        if (room >= sizeof(Header))
+            reinterpret_cast<Header*>(ring->buf + pos)->size = PADDING;
+        head += room;
+        pos = 0;
+    }
+
+    auto* hdr = reinterpret_cast<Header*>(ring->buf + pos);
+    hdr->size      = static_cast<uint32_t>(len);
+    hdr->level     = msg.level;
+    hdr->time      = chrono::duration_cast<chrono::nanoseconds>
+                     (msg.time.time_since_epoch()).count();
+    hdr->thread_id = msg.thread_id;
+    // Unlike pthread_getname_np(), a single syscall.
+    prctl(PR_GET_NAME, hdr->thread_name);
+    memcpy(hdr + 1, msg.payload.data(), len);
+
+    ring->head.store(head + need, memory_order_release);
+
+    if (!m_signalled.exchange(true, memory_order_acq_rel))
+        m_wake.release();
+}
+
+void AsyncSink::flush(void)
+{
+    m_flush.store(true, memory_order_relaxed);
+    if (!m_signalled.exchange(true, memory_order_acq_rel))
+        m_wake.release();
+}
+
+void AsyncSink::set_pattern(const string& pattern)
+{
+    for (auto& sink : m_sinks)
+        sink->set_pattern(pattern);
+}
+
+void AsyncSink::set_formatter(unique_ptr<spdlog::formatter> formatter)
+{
+    for (auto& sink : m_sinks)
+        sink->set_formatter(formatter->clone());
+}
+
+void AsyncSink::write(const spdlog::details::log_msg& msg)
+{
+    for (auto& sink : m_sinks)
+    {
+        if (!sink->should_log(msg.level))
+            continue;
+        try
+        {
+            sink->log(msg);
+        }
+        catch (const exception& err)
+        {
+            cerr << "AsyncSink: " << err.what() << endl;
+        }
+    }
+}
+
+void AsyncSink::drain(void)
+{
+    vector<Ring*> rings;
+    {
+        scoped_lock lock(m_rings_mutex);
+        for (auto& ring : m_rings)
+            rings.push_back(ring.get());
+    }
+
+    for (Ring* ring : rings)
+    {
+        uint64_t tail = ring->tail.load(memory_order_relaxed);
+        uint64_t head = ring->head.load(memory_order_acquire);
+
+        while (tail != head)
+        {
+            size_t pos  = tail % RING_BYTES;
+            size_t room = RING_BYTES - pos;
+            auto*  hdr  = reinterpret_cast<const Header*>(ring->buf + pos);
+            if (room < sizeof(Header) || hdr->size == PADDING)
+            {
+                tail += room;
+                continue;
+            }
+
+            spdlog::details::log_msg msg
+                (spdlog::log_clock::time_point
+                 (chrono::duration_cast<spdlog::log_clock::duration>
+                  (chrono::nanoseconds(hdr->time))),
+                 spdlog::source_loc {}, m_logger_name,
+                 static_cast<spdlog::level::level_enum>(hdr->level),
+                 spdlog::string_view_t
+                 (reinterpret_cast<const char*>(hdr + 1), hdr->size));
+            msg.thread_id = hdr->thread_id;
+
+            t_thread_name = hdr->thread_name;
+            write(msg);
+            t_thread_name = nullptr;
+
+            tail += record_size(hdr->size);
+            ring->tail.store(tail, memory_order_release);
+        }
+    }
+}
+
+void AsyncSink::report_dropped(void)
+{
+    uint64_t dropped = 0;
+    {
+        scoped_lock lock(m_rings_mutex);
+        for (auto& ring : m_rings)
+            dropped += ring->dropped.load(memory_order_relaxed);
+    }
+    if (dropped == m_dropped)
+        return;
+
+    static Metrics::Counter& dropped_total =
+        Metrics::GetCounter("magewell2ts_log_dropped_total",
+                            "Log messages lost to a full async log ring");
+    dropped_total.Inc(dropped - m_dropped);
+
+    string text = fmt::format("Async log: {} messages dropped, "
+                              "the log rings were full",
+                              dropped - m_dropped);
+    m_dropped = dropped;
+    write(spdlog::details::log_msg(m_logger_name, spdlog::level::warn, text));
+}
+
+void AsyncSink::writer(void)
+{
+    for (;;)
+    {
+        // The timeout only matters for messages logged between the
+        // drain and resetting m_signalled; it bounds their delay.
+        m_wake.try_acquire_for(chrono::milliseconds(100));
+        m_signalled.store(false, memory_order_release);
+
+        bool running = m_running.load();
+        drain();
+        report_dropped();
+
+        if (m_flush.exchange(false, memory_order_relaxed) || !running)
+        {
+            for (auto& sink : m_sinks)
+                sink->flush();
+        }
+        if (!running)
+            break;
+    }
+}
+
+bool RateLimit::Allow(uint64_t& suppressed)
+{
+    int64_t window = chrono::steady_clock::now().time_since_epoch() / WINDOW;
+
+    // Races between threads sharing a call site only blur the count.
+    if (m_window.load(memory_order_relaxed) != window)
+    {
+        m_window.store(window, memory_order_relaxed);
+        m_count.store(0, memory_order_relaxed);
+    }
+
+    if (m_count.fetch_add(1, memory_order_relaxed) < BURST)
+    {
+        suppressed = m_suppressed.exchange(0, memory_order_relaxed);
+        return true;
+    }
+    m_suppressed.fetch_add(1, memory_order_relaxed);
+    return false;
+}
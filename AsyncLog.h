@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/sink.h>
+
+/*
+  spdlog sink that hands messages to a writer thread instead of writing
+  them on the thread that logged them.
+
+  Each logging thread gets its own preallocated ring, so logging is a
+  copy into memory only that thread writes; nothing allocates or takes
+  a lock. If a ring is full the message is counted and dropped rather
+  than blocking, and the writer reports how many were lost. Rings are
+  reused once their thread exits, so restarting the copy workers does
+  not grow memory.
+*/
+class AsyncSink : public spdlog::sinks::sink
+{
+  public:
+    AsyncSink(std::string logger_name, std::vector<spdlog::sink_ptr> sinks);
+    ~AsyncSink(void) override;
+
+    void log(const spdlog::details::log_msg& msg) override;
+    void flush(void) override;
+    void set_pattern(const std::string& pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override;
+
+    /*
+      While the writer formats a message, the name of the thread which
+      logged it; otherwise nullptr.
+    */
+    static const char* ThreadName(void);
+
+  private:
+    struct Ring;
+
+    Ring* ring(void);
+    std::shared_ptr<Ring> claim(void);
+    void writer(void);
+    void drain(void);
+    void report_dropped(void);
+    void write(const spdlog::details::log_msg& msg);
+
+    std::string                   m_logger_name;
+    std::vector<spdlog::sink_ptr> m_sinks;
+
+    std::mutex                         m_rings_mutex;
+    std::vector<std::shared_ptr<Ring>> m_rings;
+
+    std::binary_semaphore m_wake      {0};
+    std::atomic<bool>     m_signalled {false};
+    std::atomic<bool>     m_flush     {false};
+    std::atomic<bool>     m_running   {true};
+    uint64_t              m_dropped   {0};    // Writer thread only
+    std::thread           m_thread;
+};
+
+/*
+  Limits how often one call site may log: BURST messages per WINDOW,
+  after which they are counted instead. The count is reported with the
+  next message let through. Use it through LOG_LIMITED().
+*/
+class RateLimit
+{
+  public:
+    static constexpr uint32_t BURST = 5;
+    static constexpr std::chrono::seconds WINDOW {10};
+
+    // False if this message should be suppressed. `suppressed` is how
+    // many were held back since the last one let through.
+    bool Allow(uint64_t& suppressed);
+
+  private:
+    std::atomic<int64_t>  m_window     {-1};
+    std::atomic<uint32_t> m_count      {0};
+    std::atomic<uint64_t> m_suppressed {0};
+};
+
+#define LOG_LIMITED(logger, level, ...)                                   \
+    do                                                                    \
+    {                                                                     \
+        static RateLimit log_limit_;                                      \
+        uint64_t log_suppressed_;                                         \
+        if (log_limit_.Allow(log_suppressed_))                            \
+        {                                                                 \
+            if (log_suppressed_)                                          \
+                (logger)->log(level, "({} similar messages suppressed)",  \
+                              log_suppressed_);                           \
+            (logger)->log(level, __VA_ARGS__);                            \
+        }                                                                 \
+    } while (0)
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/*
+  Sample format conversions on the audio capture path. These are kept
+  free of the Magewell SDK and FFmpeg so they can be benchmarked on
+  their own.
+*/
+namespace AudioConvert
+{
+
+/**
+ * @brief Repack one Magewell audio capture frame.
+ *
+ * The card delivers 32-bit, high bit aligned samples ordered Left0,
+ * Left1, Left2, Left3, Right0, Right1, Right2, Right3. Each channel
+ * pair is written out as interleaved L/R samples of `bytes_per_sample`
+ * bytes.
+ *
+ * @param src             First sample of the capture frame
+ * @param channel_pairs   Number of L/R pairs to extract
+ * @param samples         Samples per channel in the frame
+ * @param stride          Samples between two instants of one channel
+ * @param shift           Right shift applied to each sample
+ * @param swap_bytes      Byte swap 16-bit samples (bitstream audio)
+ * @param bytes_per_sample Bytes written per sample
+ * @param out             Destination, at least
+ *                        `channel_pairs * samples * 2 * bytes_per_sample`
+ * @return One past the last byte written
+ */
+inline uint8_t* Deinterleave(const uint32_t* src, int channel_pairs,
+                             int samples, int stride, int shift,
+                             bool swap_bytes, int bytes_per_sample,
+                             uint8_t* out)
+{
+    const int half_channels = stride / 2;
+
+    for (int pair = 0; pair < channel_pairs; ++pair)
+    {
+        const uint32_t* left_samples  = &src[pair];
+        const uint32_t* right_samples = &src[pair + half_channels];
+
+        for (int sample = 0; sample < samples; ++sample)
+        {
+            uint32_t left_val  = left_samples[sample * stride] >> shift;
+            uint32_t right_val = right_samples[sample * stride] >> shift;
+
+            // Assume bitstream will always be 16bit for
+            // efficient swapping.
+            if (swap_bytes)
+            {
+                left_val  = ((left_val  & 0x00FF) << 8)
+                            | ((left_val  & 0xFF00) >> 8);
+                right_val = ((right_val & 0x00FF) << 8)
+                            | ((right_val & 0xFF00) >> 8);
+            }
+
+            /* For 32-bit samples (LPCM), we copy 4 bytes,
+             * for 16-bit samples (Bitstream), we copy 2 bytes
+             */
+            std::memcpy(out, &left_val, bytes_per_sample);
+            out += bytes_per_sample;
+            std::memcpy(out, &right_val, bytes_per_sample);
+            out += bytes_per_sample;
+        }
+    }
+
+    return out;
+}
+
+/**
+ * @brief Interleaved signed integer PCM to normalized planar float.
+ *
+ * 24-bit audio is delivered in 32-bit containers, so it is treated
+ * as S32.
+ *
+ * @param src       Interleaved S16 (`is_24bit` false) or S32 samples
+ * @param channels  Number of interleaved channels
+ * @param samples   Samples per channel
+ * @param planes    One output plane per channel, `samples` long
+ */
+inline void ToPlanarFloat(const uint8_t* src, int channels, int samples,
+                          bool is_24bit, float* const* planes)
+{
+    if (!is_24bit)
+    {
+        // 16 bits
+        const int16_t* in = reinterpret_cast<const int16_t*>(src);
+
+        constexpr float scale = 1.0f / 32768.0f;
+
+        for (int s = 0; s < samples; ++s)
+        {
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                planes[ch][s] = static_cast<float>
+                                (in[s * channels + ch]) * scale;
+            }
+        }
+    }
+    else
+    {
+        // 24 bits
+        const int32_t* in = reinterpret_cast<const int32_t*>(src);
+
+        constexpr float scale = 1.0f / 2147483648.0f;
+
+        for (int s = 0; s < samples; ++s)
+        {
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                planes[ch][s] =
+                    static_cast<float>(in[s * channels + ch]) * scale;
+            }
+        }
+    }
+}
+
+}
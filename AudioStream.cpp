@@ -22,3 +22,14 @@ AudioStream::AudioStream(OutputTS& parent, int verbose_level,
 AudioStream::~AudioStream(void)
 {
 }
+
+void AudioStream::Suspend(void)
+{
+    m_suspended = true;
+}
+
+void AudioStream::Resume(int64_t timestamp)
+{
+    m_suspended = false;
+    m_pts = timestamp;
+}
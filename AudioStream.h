@@ -18,6 +18,12 @@ class OutputTS;
 class AudioStream
 {
   public:
+    struct Args
+    {
+        bool compat_track   {false};   // Add a stereo AC3 track
+        int  compat_bitrate {192000};
+    };
+
     struct Params
     {
         int        num_channels        {0};
@@ -50,6 +56,18 @@ class AudioStream
 
     virtual void AddSamples(Samples&& audio) = 0;
 
+    /*
+      OutputTS keeps recently used streams around so a source which
+      flips back and forth between formats (e.g. LPCM stereo menus and
+      bitstream 5.1 content) does not pay for rebuilding the encoder
+      and resampler on every flip.
+     */
+    virtual void Suspend(void);
+    virtual void Resume(int64_t timestamp);
+
+    const Params& GetParams(void) const { return m_params; }
+    bool IsSuspended(void) const { return m_suspended; }
+
   protected:
     // spdlog
     std::shared_ptr<spdlog::logger> m_log;
@@ -59,6 +77,7 @@ class AudioStream
     int       m_verbose;
     Params    m_params;
     int64_t   m_pts       {-1};
+    bool      m_suspended {false};
 };
 
 
@@ -1,6 +1,7 @@
 #include "BitStream.h"
 #include "OutputTS.h"
 #include "IEC61937Parser.h"
+#include "SilentFrame.h"
 
 //#define DUMP_RAW
 
@@ -21,10 +22,133 @@ BitStream::BitStream(OutputTS& parent, int verbose_level,
 
 BitStream::~BitStream(void)
 {
+    if (m_verbose > 0)
+    {
+        m_iec61937.LogStats();
+        if (m_silent_frames > 0)
+            m_log->info("Bitstream gap filler: {} silent frames, "
+                        "{} pause bursts", m_silent_frames, m_pause_bursts);
+    }
 }
 
 void BitStream::Reset(void)
 {
+    m_iec61937.Reset();
+    m_next_ts = -1;
+}
+
+void BitStream::Resume(int64_t timestamp)
+{
+    AudioStream::Resume(timestamp);
+
+    // The same Params can carry AC3 or E-AC3, so let the parser
+    // detect the codec again; that generates a new marker.
+    m_iec61937.Reset();
+    m_codec_id = AV_CODEC_ID_NONE;
+    m_codec_bitrate = 0;
+    m_next_ts = -1;
+    m_gap_start = -1;
+
+    if (m_verbose > 1)
+        m_log->info("Resuming bitstream audio");
+}
+
+void BitStream::queue_frame(const std::vector<uint8_t>& payload,
+                            AVCodecID codec_id, int64_t timestamp,
+                            int64_t duration)
+{
+#ifdef DUMP_RAW
+    fraw.write(reinterpret_cast<const char*>(payload.data()),
+               payload.size());
+#endif
+
+    if (CompatStream* compat = m_parent.Compat())
+        compat->AddPacket(codec_id, payload, timestamp);
+
+    PacketPtr pkt = make_packet(payload.size());
+    std::memcpy(pkt->data, payload.data(), payload.size());
+
+    // Preserve original capture timestamp
+    pkt->pts = pkt->dts = timestamp;
+
+    // Codec frame durations
+    if (codec_id == AV_CODEC_ID_AC3 || codec_id == AV_CODEC_ID_EAC3)
+        pkt->duration = duration;
+    else
+        pkt->duration = 0;
+
+    av_packet_rescale_ts(pkt.get(),
+                         TimeBase::Magewell,
+                         TimeBase::MPEG_TS);
+
+    pkt->stream_index = OutputTS::AUDIO_STREAM_ID;
+
+    m_log->trace("Queuing bitstream [{}] "
+                 "pts={} dts={} dur={} : "
+                 "encoder TB:{}/{}; ",
+                 pkt->stream_index,
+                 pkt->pts,
+                 pkt->dts,
+                 pkt->duration,
+                 TimeBase::Magewell.num,
+                 TimeBase::Magewell.den);
+
+    Packet qp {
+        .version      = m_version,
+        .pkt          = std::move(pkt),
+    };
+
+    m_parent.AddAudioPkt(std::move(qp));
+}
+
+/*
+  Keep the audio PID continuous while the source is paused or silent by
+  emitting prebuilt silent frames, on the same cadence the real frames
+  would have had, up to `until`.
+ */
+void BitStream::fill_gap(int64_t until)
+{
+    if (m_next_ts < 0 || m_codec_id == AV_CODEC_ID_NONE || m_codec_rate <= 0)
+        return;
+
+    const int64_t frame_dur = av_rescale_q(SilentFrame::FRAME_SAMPLES,
+                                           AVRational {1, m_codec_rate},
+                                           TimeBase::Magewell);
+
+    // Don't start filling until a whole frame slot has gone by without
+    // audio, allowing some slack for timestamp jitter.
+    if (m_gap_start < 0 && m_next_ts + frame_dur + frame_dur / 2 > until)
+        return;
+
+    if (m_next_ts + frame_dur > until)
+        return;
+
+    const auto& silence = SilentFrame::Get(m_codec_id, m_codec_rate,
+                                           m_codec_channels,
+                                           m_codec_bitrate);
+    if (silence.empty())
+    {
+        // Can't encode this layout; wait for real audio.
+        m_next_ts = -1;
+        return;
+    }
+
+    if (m_gap_start < 0)
+    {
+        m_gap_start = m_next_ts;
+        m_gap_frames = 0;
+        if (m_verbose > 2)
+            m_log->debug("Audio gap: filling with silence");
+    }
+
+    do
+    {
+        queue_frame(silence, m_codec_id, m_next_ts, frame_dur);
+        m_next_ts += frame_dur;
+        ++m_gap_frames;
+        ++m_silent_frames;
+    }
+    while (m_next_ts + frame_dur <= until);
 }
 
 void BitStream::AddSamples(AudioStream::Samples&& samples)
@@ -33,6 +157,11 @@ void BitStream::AddSamples(AudioStream::Samples&& samples)
         m_iec61937.PushSamples(samples.data.data(), samples.data.size(),
                                samples.timestamp,   m_params.sample_rate))
     {
+        m_codec_id       = codecpar->codec_id;
+        m_codec_rate     = codecpar->sample_rate;
+        m_codec_channels = codecpar->ch_layout.nb_channels;
+        m_codec_bitrate  = 0;
+
         Marker marker {
             .stream_id = OutputTS::AUDIO_STREAM_ID,
             .time_base = TimeBase::MPEG_TS,
@@ -42,63 +171,52 @@ void BitStream::AddSamples(AudioStream::Samples&& samples)
         m_version = m_parent.AddMarker(std::move(marker), m_pts);
     }
 
+    const int64_t buffer_dur = av_rescale_q(m_params.buffer_bytes,
+                                            AVRational {1, m_params.sample_rate},
+                                            TimeBase::Magewell);
+
     while(auto frame = m_iec61937.PopFrame())
     {
         if (frame->is_pause)
         {
-#if 0
-            // TODO: If receiving pause frames, maybe track ...
-            m_lastAudioTimestamp =
-                audio.frame.timestamp;
-#endif
+            // Nothing to play; fill_gap() covers the hole below.
+            ++m_pause_bursts;
             m_log->trace("Audio pause burst");
             continue;
         }
 
-#ifdef DUMP_RAW
-        fraw.write(reinterpret_cast<char*>(frame->payload.data()),
-                   frame->payload.size());
-#endif
-
-        PacketPtr pkt = make_packet(frame->payload.size());
-        std::memcpy(pkt->data,
-                    frame->payload.data(),
-                    frame->payload.size());
-
-        // Preserve original capture timestamp
-        pkt->pts = pkt->dts = frame->timestamp;
-
-        // Codec frame durations
-        if (frame->codec_id == AV_CODEC_ID_AC3 ||
-            frame->codec_id == AV_CODEC_ID_EAC3)
-            pkt->duration =
-                av_rescale_q(m_params.buffer_bytes,
-                             AVRational {1, m_params.sample_rate},
-                             TimeBase::Magewell);
-        else
-            pkt->duration = 0;
-
-        av_packet_rescale_ts(pkt.get(),
-                             TimeBase::Magewell,
-                             TimeBase::MPEG_TS);
-
-        pkt->stream_index = OutputTS::AUDIO_STREAM_ID;
-
-        m_log->trace("Queuing bitstream [{}] "
-                     "pts={} dts={} dur={} : "
-                     "encoder TB:{}/{}; ",
-                     pkt->stream_index,
-                     pkt->pts,
-                     pkt->dts,
-                     pkt->duration,
-                     TimeBase::Magewell.num,
-                     TimeBase::Magewell.den);
-
-        Packet qp {
-            .version      = m_version,
-            .pkt          = std::move(pkt),
-        };
+        if (frame->samples > 0 && frame->codec_id == m_codec_id)
+        {
+            if (m_gap_start >= 0)
+            {
+                if (m_verbose > 1)
+                    m_log->info("Audio gap of {:.1f}ms filled with "
+                                "{} silent frames",
+                                (frame->timestamp - m_gap_start) / 10000.0,
+                                m_gap_frames);
+                m_gap_start = -1;
+            }
+
+            if (m_codec_bitrate == 0)
+                m_codec_bitrate = av_rescale(frame->payload.size() * 8,
+                                             m_codec_rate, frame->samples);
+
+            m_next_ts = frame->timestamp +
+                        av_rescale_q(frame->samples,
+                                     AVRational {1, m_codec_rate},
+                                     TimeBase::Magewell);
+        }
 
-        m_parent.AddAudioPkt(std::move(qp));
+        queue_frame(frame->payload, frame->codec_id, frame->timestamp,
+                    buffer_dur);
     }
+
+    // Audio can only be missing up to the start of a burst which is
+    // still being assembled, or the end of this block.
+    int64_t until = m_iec61937.PendingTimestamp().value_or
+                    (samples.timestamp +
+                     av_rescale_q(m_params.samples_per_channel,
+                                  AVRational {1, m_params.sample_rate},
+                                  TimeBase::Magewell));
+    fill_gap(until);
 }
@@ -14,6 +14,24 @@ class BitStream : public AudioStream
 
     void AddSamples(AudioStream::Samples&& audio) override;
 
+    void Resume(int64_t timestamp) override;
+
   private:
+    void queue_frame(const std::vector<uint8_t>& payload,
+                     AVCodecID codec_id, int64_t timestamp,
+                     int64_t duration);
+    void fill_gap(int64_t until);
+
     IEC61937Parser m_iec61937;
+
+    // Gap filling. Timestamps are in Magewell (100ns) units.
+    AVCodecID m_codec_id       {AV_CODEC_ID_NONE};
+    int       m_codec_rate     {0};
+    int       m_codec_channels {0};
+    int64_t   m_codec_bitrate  {0};
+    int64_t   m_next_ts        {-1};  // Where the next frame belongs
+    int64_t   m_gap_start      {-1};
+    uint64_t  m_gap_frames     {0};
+    uint64_t  m_silent_frames  {0};
+    uint64_t  m_pause_bursts   {0};
 };
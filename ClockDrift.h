@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+
+/*
+  Estimates the drift between the audio sample clock and the Magewell
+  card clock (which also timestamps the video).
+
+  Each observation is the difference between where the sample clock
+  says the next block of audio belongs and the card timestamp of that
+  block, both expressed in samples. Observations are averaged into one
+  second buckets, and a least squares fit over the last `window`
+  buckets gives the drift rate. The error is tracked net of any
+  compensation we have already applied, so the fitted slope reflects
+  the real clock difference rather than the residual after correction.
+*/
+class ClockDrift
+{
+  public:
+    explicit ClockDrift(int sample_rate, int window_secs = 120)
+        : m_rate(sample_rate)
+        , m_window(window_secs)
+    {
+    }
+
+    void Reset(void)
+    {
+        m_points.clear();
+        m_bucket_start = -1;
+        m_bucket_cnt   = 0;
+        m_bucket_time  = 0;
+        m_bucket_err   = 0;
+        m_applied      = 0;
+        m_offset       = 0;
+        m_slope        = 0;
+    }
+
+    /*
+      hw_pts : card timestamp of the block, in samples.
+      error  : (sample clock position) - hw_pts, in samples.
+
+      Returns true once per bucket, when a new estimate is available.
+    */
+    bool Update(int64_t hw_pts, int64_t error)
+    {
+        if (m_bucket_start < 0)
+            m_bucket_start = hw_pts;
+
+        m_bucket_time += static_cast<double>(hw_pts - m_bucket_start);
+        m_bucket_err  += static_cast<double>(error - m_applied);
+        ++m_bucket_cnt;
+
+        if (hw_pts - m_bucket_start < m_rate)
+            return false;
+
+        Point pt {
+            .time  = m_bucket_start + m_bucket_time / m_bucket_cnt,
+            .error = m_bucket_err / m_bucket_cnt
+        };
+        m_points.push_back(pt);
+        if (static_cast<int>(m_points.size()) > m_window)
+            m_points.pop_front();
+
+        m_offset = static_cast<double>(error);
+        m_bucket_start = hw_pts;
+        m_bucket_cnt   = 0;
+        m_bucket_time  = 0;
+        m_bucket_err   = 0;
+
+        fit();
+        return true;
+    }
+
+    /*
+      Number of samples to add (positive) or drop (negative) over the
+      next `distance` output samples. Cancels the measured drift and
+      walks any accumulated offset back to zero over `settle_secs`.
+      The result is limited to `max_ppm` so the correction stays
+      inaudible.
+    */
+    int Correction(int distance, double settle_secs = 10.0,
+                   double max_ppm = 1000.0)
+    {
+        double delta = -(m_slope * distance);
+        delta -= m_offset * distance / (settle_secs * m_rate);
+
+        double limit = distance * max_ppm / 1000000.0;
+        delta = std::clamp(delta, -limit, limit);
+
+        int samples = static_cast<int>(std::lround(delta));
+        m_applied += samples;
+        return samples;
+    }
+
+    bool   Valid(void)  const { return m_points.size() >= MIN_POINTS; }
+    double PPM(void)    const { return m_slope * 1000000.0; }
+    double Offset(void) const { return m_offset; }
+    double OffsetMS(void) const { return m_offset * 1000.0 / m_rate; }
+
+  private:
+    static constexpr size_t MIN_POINTS = 10;
+
+    struct Point
+    {
+        double time;
+        double error;
+    };
+
+    void fit(void)
+    {
+        if (!Valid())
+        {
+            m_slope = 0;
+            return;
+        }
+
+        // Center on the first point to keep the sums well conditioned.
+        const double t0 = m_points.front().time;
+        double n = 0, st = 0, se = 0, stt = 0, ste = 0;
+        for (const auto& pt : m_points)
+        {
+            double t = pt.time - t0;
+            n   += 1;
+            st  += t;
+            se  += pt.error;
+            stt += t * t;
+            ste += t * pt.error;
+        }
+
+        double denom = n * stt - st * st;
+        m_slope = (denom > 0) ? (n * ste - st * se) / denom : 0;
+    }
+
+    int                m_rate;
+    int                m_window;
+    std::deque<Point>  m_points;
+
+    int64_t  m_bucket_start {-1};
+    int      m_bucket_cnt   {0};
+    double   m_bucket_time  {0};
+    double   m_bucket_err   {0};
+
+    int64_t  m_applied {0};
+    double   m_offset  {0};
+    double   m_slope   {0};
+};
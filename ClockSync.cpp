@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "ClockSync.h"
+
+using namespace std;
+
+namespace
+{
+    constexpr double TICKS_PER_SEC = 10000000.0;    // Card clock: 100ns
+
+    // Frame loop: critically damped, locked within a few dozen frames.
+    constexpr double PHASE_GAIN  = 1.0 / 16;
+    constexpr double PERIOD_GAIN = PHASE_GAIN * PHASE_GAIN / 4;
+    // How far the period may be pulled from the nominal one.
+    constexpr double MAX_PULL    = 0.005;
+
+    // Rate loop: slow, as it sees the scheduler's jitter as well.
+    constexpr double RATE_PHASE_GAIN = 1.0 / 100;
+    constexpr double RATE_GAIN       = RATE_PHASE_GAIN * RATE_PHASE_GAIN / 4;
+
+    constexpr int64_t STATS_PERIOD = 60 * 10000000LL;
+
+    const vector<double>& jitter_buckets(void)
+    {
+        static const vector<double> bounds {
+            0.000001, 0.0000025, 0.000005, 0.00001, 0.000025, 0.00005,
+            0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01
+        };
+        return bounds;
+    }
+
+    double percentile(vector<double>& values, double pct)
+    {
+        if (values.empty())
+            return 0;
+        size_t idx = min(values.size() - 1,
+                         static_cast<size_t>(pct * values.size()));
+        nth_element(values.begin(), values.begin() + idx, values.end());
+        return values[idx];
+    }
+}
+
+ClockSync::ClockSync(const string& stream, int verbose_level, int input)
+    : m_verbose(verbose_level)
+    , m_stream(stream)
+    , m_jitter_hist(Metrics::GetHistogram
+                    ("magewell2ts_clock_jitter_seconds",
+                     "Card timestamp distance from where the clock "
+                     "recovery loop expected it",
+                     Metrics::WithInput(input, {{"stream", stream}}),
+                     jitter_buckets()))
+    , m_arrival_hist(Metrics::GetHistogram
+                     ("magewell2ts_clock_pickup_jitter_seconds",
+                      "Variation in how long after its card timestamp "
+                      "a frame was picked up",
+                      Metrics::WithInput(input, {{"stream", stream}}),
+                      jitter_buckets()))
+    , m_ppm(Metrics::GetGauge("magewell2ts_card_clock_ppm",
+                              "Card clock rate against CLOCK_MONOTONIC, "
+                              "in parts per million",
+                              Metrics::WithInput(input)))
+{
+    m_log = spdlog::get("app_logger");
+    if (!m_log)
+    {
+        std::cerr << "ClockSync Error: Logger 'app_logger' not found!"
+                  << std::endl;
+    }
+}
+
+void ClockSync::Reset(double period)
+{
+    m_nominal  = period;
+    m_period   = period;
+    m_phase    = -1;
+    m_last_pts = -1;
+    // The card's rate is kept; it does not change with the format.
+    m_mono     = -1;
+}
+
+bool ClockSync::Due(int64_t card_ts) const
+{
+    return Locked() && card_ts >= 0 &&
+        abs(card_ts - (m_phase + m_period)) <= m_period / 2;
+}
+
+int64_t ClockSync::Periods(int64_t card_ts) const
+{
+    return llround((card_ts - (m_phase + m_period)) / m_period);
+}
+
+ClockSync::Frame ClockSync::Update(int64_t card_ts, int64_t mono_ns)
+{
+    Frame frame;
+
+    if (card_ts < 0)
+    {
+        frame.repeat = true;
+        return frame;
+    }
+
+    int64_t step = Locked() ? Periods(card_ts) : 0;
+    if (!Locked() || step < -MAX_STEP || MAX_STEP < step)
+    {
+        frame.relock = Locked();
+        m_phase    = card_ts;
+        m_period   = m_nominal;
+        m_last_pts = card_ts;
+        m_mono     = -1;
+        m_stats_start = -1;
+
+        frame.pts = card_ts;
+        track_rate(card_ts, mono_ns);
+        return frame;
+    }
+
+    if (step < 0)
+    {
+        frame.repeat = true;
+        return frame;
+    }
+
+    double predicted = m_phase + m_period * (1 + step);
+    double error     = card_ts - predicted;
+    frame.lost = step;
+
+    m_phase   = predicted + PHASE_GAIN * error;
+    m_period += PERIOD_GAIN * error;
+    m_period  = clamp(m_period, m_nominal * (1 - MAX_PULL),
+                      m_nominal * (1 + MAX_PULL));
+
+    frame.pts  = max<int64_t>(llround(m_phase), m_last_pts + 1);
+    m_last_pts = frame.pts;
+
+    m_jitter_hist.Observe(abs(error) / TICKS_PER_SEC);
+    m_jitter.push_back(abs(error) / 10);
+
+    track_rate(card_ts, mono_ns);
+    log_stats(card_ts);
+
+    return frame;
+}
+
+void ClockSync::track_rate(int64_t card_ts, int64_t mono_ns)
+{
+    if (mono_ns < 0)
+        return;
+
+    double mono = mono_ns / 100.0;
+    if (m_mono < 0 || card_ts <= m_rate_card)
+    {
+        m_mono      = mono;
+        m_rate_card = card_ts;
+        return;
+    }
+
+    double elapsed   = (card_ts - m_rate_card) / (1 + m_rate);
+    double predicted = m_mono + elapsed;
+    double error     = mono - predicted;
+
+    m_mono = predicted + RATE_PHASE_GAIN * error;
+    // Picked up later than predicted: the card clock is slower.
+    m_rate -= RATE_GAIN * error / elapsed;
+    m_rate_card = card_ts;
+
+    m_ppm.Set(Ppm());
+    m_arrival_hist.Observe(abs(error) / TICKS_PER_SEC);
+    m_arrival.push_back(abs(error) / 10);
+}
+
+void ClockSync::log_stats(int64_t card_ts)
+{
+    if (m_stats_start < 0)
+        m_stats_start = card_ts;
+    if (card_ts - m_stats_start < STATS_PERIOD)
+        return;
+
+    if (m_verbose > 1 && m_log && !m_jitter.empty())
+    {
+        double max_jitter = ranges::max(m_jitter);
+        double p50 = percentile(m_jitter, 0.50);
+        double p99 = percentile(m_jitter, 0.99);
+
+        string pickup;
+        if (!m_arrival.empty())
+            pickup = fmt::format(", pickup p99 {:.0f}us, "
+                                 "card clock {:+.1f}ppm",
+                                 percentile(m_arrival, 0.99), Ppm());
+
+        m_log->info("{} clock: jitter p50 {:.1f}us p99 {:.1f}us "
+                    "max {:.1f}us, period {:.2f}us{}", m_stream, p50, p99,
+                    max_jitter, m_period / 10, pickup);
+    }
+
+    m_jitter.clear();
+    m_arrival.clear();
+    m_stats_start = card_ts;
+}
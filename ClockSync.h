@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "Metrics.h"
+
+/*
+  Clock recovery for a stream of card timestamps (100ns ticks), one per
+  frame.
+
+  A second order PLL predicts when the next frame is due, and each
+  timestamp's distance from that prediction (its phase error) nudges the
+  loop's phase and period. The PTS handed on is the loop's phase: it
+  moves a steady period per frame whatever the jitter on the card's
+  timestamps, tracks the source's real frame rate (59.94 is not a whole
+  number of ticks), and never goes backwards.
+
+  An error of more than half a period is not jitter. Ahead, the
+  timestamp is that many periods on, and the frames in between were
+  lost; behind, it is a frame already seen. Either way the loop steps by
+  whole periods and keeps its lock. Beyond MAX_STEP periods the card
+  clock is taken to have jumped, and the loop starts over.
+
+  When given the CLOCK_MONOTONIC time each timestamp was read, a much
+  slower loop also tracks the card clock's rate against the system
+  clock. The phase error (card jitter), the arrival error (how late the
+  frame was picked up) and the rate are exported as metrics, and logged
+  once a minute.
+*/
+class ClockSync
+{
+  public:
+    struct Frame
+    {
+        int64_t pts     {-1};       // Smoothed, in card ticks
+        int64_t lost    {0};        // Frames missing before this one
+        bool    repeat  {false};    // Already seen, or invalid; drop it
+        bool    relock  {false};    // The card clock jumped
+    };
+
+    ClockSync(const std::string& stream, int verbose_level, int input);
+
+    // Start over, with frames about `period` ticks apart.
+    void Reset(double period);
+
+    /*
+      `mono_ns` is CLOCK_MONOTONIC when `card_ts` was read, or -1 if it
+      was not read as it arrived (one of a burst).
+    */
+    Frame Update(int64_t card_ts, int64_t mono_ns = -1);
+
+    bool Locked(void) const { return m_phase >= 0; }
+
+    // Whether `card_ts` is the frame the loop expects next.
+    bool Due(int64_t card_ts) const;
+
+    // Periods from the next expected frame to `card_ts`, rounded.
+    int64_t Periods(int64_t card_ts) const;
+
+    // How fast the card clock runs, in parts per million.
+    double Ppm(void) const { return m_rate * 1e6; }
+
+    static constexpr int64_t MAX_STEP = 32;
+
+  private:
+    void track_rate(int64_t card_ts, int64_t mono_ns);
+    void log_stats(int64_t card_ts);
+
+    std::shared_ptr<spdlog::logger> m_log;
+    int         m_verbose;
+    std::string m_stream;
+
+    // Frame loop, in card ticks
+    double  m_nominal  {0};
+    double  m_period   {0};
+    double  m_phase    {-1};
+    int64_t m_last_pts {-1};
+
+    // Card against CLOCK_MONOTONIC, in ticks
+    double  m_rate      {0};
+    double  m_mono      {-1};
+    int64_t m_rate_card {-1};
+
+    // This minute's errors, in microseconds
+    std::vector<double> m_jitter;
+    std::vector<double> m_arrival;
+    int64_t             m_stats_start {-1};
+
+    Metrics::Histogram& m_jitter_hist;
+    Metrics::Histogram& m_arrival_hist;
+    Metrics::Gauge&     m_ppm;
+};
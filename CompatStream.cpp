@@ -0,0 +1,447 @@
+#include <iostream>
+
+#include "CompatStream.h"
+#include "CpuPlan.h"
+#include "EAC3Parser.h"
+#include "OutputTS.h"
+
+using namespace std;
+
+CompatStream::CompatStream(OutputTS& parent, int verbose_level, int bit_rate)
+    : m_parent(parent)
+    , m_verbose(verbose_level)
+    , m_bit_rate(bit_rate)
+{
+    m_log = spdlog::get("app_logger");
+    if (!m_log)
+    {
+        std::cerr << "CompatStream Error: Logger 'app_logger' not found!"
+                  << std::endl;
+        return;
+    }
+
+    m_thread = std::thread(&CompatStream::run, this);
+    pthread_setname_np(m_thread.native_handle(), "audcompat");
+    CpuPlan::Apply(m_thread.native_handle(), CpuPlan::AUDIO, "audcompat");
+}
+
+CompatStream::~CompatStream(void)
+{
+    Shutdown();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    av_channel_layout_uninit(&m_coeffs_layout);
+
+    if (m_verbose > 0 && m_dropped > 0)
+        m_log->warn("Compat audio: {} input frames dropped", m_dropped);
+}
+
+void CompatStream::Shutdown(void)
+{
+    m_running.store(false);
+    m_ready.notify_all();
+}
+
+void CompatStream::push(Work&& work)
+{
+    std::scoped_lock lock(m_mutex);
+
+    // Never make the primary audio wait on us.
+    if (m_queue.size() >= MAX_QUEUE)
+    {
+        m_queue.pop_front();
+        if (m_dropped++ % 100 == 0)
+            m_log->warn("Compat audio falling behind; dropped {} frames",
+                        m_dropped);
+    }
+
+    m_queue.push_back(std::move(work));
+    m_ready.notify_one();
+}
+
+void CompatStream::AddPacket(AVCodecID codec_id,
+                             std::span<const uint8_t> payload,
+                             int64_t timestamp)
+{
+    CodecType codec_type = (codec_id == AV_CODEC_ID_EAC3) ? CodecType::EAC3
+                                                           : CodecType::AC3;
+
+    // The independent substream is a complete (up to 5.1) mix, which is
+    // all a stereo downmix needs; skip the dependent substreams.
+    if (EAC3Parser::getFrameSamples(payload, codec_type) == 0)
+        return;
+
+    push(Work {
+            .codec_id  = codec_id,
+            .payload   = std::vector<uint8_t>(payload.begin(), payload.end()),
+            .timestamp = timestamp
+        });
+}
+
+void CompatStream::AddFrame(const AVFrame* frame)
+{
+    // A new reference to the same buffers; no copy.
+    FramePtr ref(av_frame_clone(frame));
+    if (!ref)
+        return;
+
+    push(Work { .frame = std::move(ref) });
+}
+
+void CompatStream::run(void)
+{
+    for (;;)
+    {
+        Work work;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_ready.wait(lock, [this]() {
+                return !m_running.load() || !m_queue.empty();
+            });
+
+            if (!m_running.load())
+                break;
+
+            work = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        if (work.frame)
+        {
+            AVFrame* frame = work.frame.get();
+            mix(frame, av_rescale_q(frame->pts,
+                                    AVRational {1, frame->sample_rate},
+                                    TimeBase::AUDIO48));
+        }
+        else
+            decode(work);
+    }
+
+    m_log->info("Compat audio thread exited.");
+}
+
+bool CompatStream::open_decoder(AVCodecID codec_id)
+{
+    if (m_decoder && m_decoder->codec_id == codec_id)
+        return true;
+
+    const AVCodec* codec = avcodec_find_decoder(codec_id);
+    if (!codec)
+    {
+        m_log->error("Compat audio: decoder not found");
+        return false;
+    }
+
+    m_decoder = make_codec_context(codec);
+    if (!m_decoder)
+        return false;
+
+    int ret = avcodec_open2(m_decoder.get(), codec, nullptr);
+    if (ret < 0)
+    {
+        m_log->error("Compat audio: avcodec_open2(decoder) failed: {}",
+                     AVerr2str(ret));
+        m_decoder.reset();
+        return false;
+    }
+
+    if (m_verbose > 1)
+        m_log->info("Compat audio: decoding {}", codec->name);
+    return true;
+}
+
+void CompatStream::decode(Work& work)
+{
+    if (!open_decoder(work.codec_id))
+        return;
+
+    PacketPtr pkt = make_packet(work.payload.size());
+    if (!pkt)
+        return;
+    std::memcpy(pkt->data, work.payload.data(), work.payload.size());
+
+    int ret = avcodec_send_packet(m_decoder.get(), pkt.get());
+    if (ret < 0)
+    {
+        if (m_verbose > 2)
+            m_log->debug("Compat audio: decode failed: {}", AVerr2str(ret));
+        return;
+    }
+
+    int64_t pts48 = av_rescale_q(work.timestamp, TimeBase::Magewell,
+                                 TimeBase::AUDIO48);
+
+    FramePtr frame = make_frame();
+    while (avcodec_receive_frame(m_decoder.get(), frame.get()) >= 0)
+    {
+        mix(frame.get(), pts48);
+        pts48 += av_rescale_q(frame->nb_samples,
+                              AVRational {1, frame->sample_rate},
+                              TimeBase::AUDIO48);
+        av_frame_unref(frame.get());
+    }
+}
+
+/*
+  ITU-R BS.775 style downmix: centre and surrounds at -3dB, LFE
+  discarded, then normalized so a full scale input cannot clip.
+ */
+void CompatStream::set_coeffs(const AVChannelLayout& layout)
+{
+    if (m_coeffs.channels == layout.nb_channels &&
+        av_channel_layout_compare(&m_coeffs_layout, &layout) == 0)
+        return;
+
+    constexpr float minus3dB = 0.70710678f;
+
+    Downmix::Coeffs coeffs;
+    coeffs.channels = std::min(layout.nb_channels, Downmix::MAX_CHANNELS);
+
+    for (int idx = 0; idx < coeffs.channels; ++idx)
+    {
+        switch (av_channel_layout_channel_from_index(&layout, idx))
+        {
+            case AV_CHAN_FRONT_LEFT:
+              coeffs.left[idx] = 1.0f;
+              break;
+            case AV_CHAN_FRONT_RIGHT:
+              coeffs.right[idx] = 1.0f;
+              break;
+            case AV_CHAN_FRONT_CENTER:
+              coeffs.left[idx] = coeffs.right[idx] =
+                  (layout.nb_channels == 1) ? 1.0f : minus3dB;
+              break;
+            case AV_CHAN_SIDE_LEFT:
+            case AV_CHAN_BACK_LEFT:
+              coeffs.left[idx] = minus3dB;
+              break;
+            case AV_CHAN_SIDE_RIGHT:
+            case AV_CHAN_BACK_RIGHT:
+              coeffs.right[idx] = minus3dB;
+              break;
+            case AV_CHAN_BACK_CENTER:
+              coeffs.left[idx] = coeffs.right[idx] = minus3dB * minus3dB;
+              break;
+            default:
+              break;
+        }
+    }
+
+    float sum_l = 0.0f;
+    float sum_r = 0.0f;
+    for (int idx = 0; idx < coeffs.channels; ++idx)
+    {
+        sum_l += coeffs.left[idx];
+        sum_r += coeffs.right[idx];
+    }
+    float norm = std::max(sum_l, sum_r);
+    if (norm > 1.0f)
+    {
+        for (int idx = 0; idx < coeffs.channels; ++idx)
+        {
+            coeffs.left[idx]  /= norm;
+            coeffs.right[idx] /= norm;
+        }
+    }
+
+    m_coeffs = coeffs;
+    av_channel_layout_uninit(&m_coeffs_layout);
+    av_channel_layout_copy(&m_coeffs_layout, &layout);
+
+    if (m_verbose > 1)
+    {
+        std::array<char, 64> desc {};
+        av_channel_layout_describe(&layout, desc.data(), desc.size());
+        m_log->info("Compat audio: downmixing {} to stereo", desc.data());
+    }
+}
+
+bool CompatStream::open_resampler(int sample_rate)
+{
+    if (sample_rate == m_swr_rate)
+        return true;
+
+    m_swr.reset();
+    m_swr_rate = sample_rate;
+    if (sample_rate == m_encoder->sample_rate)
+        return true;
+
+    SwrContext* swr_raw = nullptr;
+    int ret = swr_alloc_set_opts2(&swr_raw,
+                                  &m_encoder->ch_layout,
+                                  AV_SAMPLE_FMT_FLTP,
+                                  m_encoder->sample_rate,
+                                  &m_encoder->ch_layout,
+                                  AV_SAMPLE_FMT_FLTP,
+                                  sample_rate,
+                                  0, nullptr);
+    if (ret < 0 || !swr_raw)
+    {
+        m_log->error("Compat audio: failed to allocate SwrContext: {}",
+                     AVerr2str(ret));
+        return false;
+    }
+    m_swr.reset(swr_raw);
+
+    if ((ret = swr_init(m_swr.get())) < 0)
+    {
+        m_log->error("Compat audio: failed to initialize SwrContext: {}",
+                     AVerr2str(ret));
+        m_swr.reset();
+        return false;
+    }
+
+    return true;
+}
+
+bool CompatStream::open_encoder(int64_t pts48)
+{
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_AC3);
+    if (!codec)
+    {
+        m_log->error("Compat audio: AC3 encoder not found");
+        return false;
+    }
+
+    m_encoder = make_codec_context(codec);
+    if (!m_encoder)
+        return false;
+
+    m_encoder->sample_rate = 48000;
+    m_encoder->sample_fmt  = AV_SAMPLE_FMT_FLTP;
+    m_encoder->time_base   = { 1, m_encoder->sample_rate };
+    m_encoder->bit_rate    = m_bit_rate;
+    av_channel_layout_default(&m_encoder->ch_layout, 2);
+
+    int ret = avcodec_open2(m_encoder.get(), codec, nullptr);
+    if (ret < 0)
+    {
+        m_log->error("Compat audio: avcodec_open2(encoder) failed: {}",
+                     AVerr2str(ret));
+        m_encoder.reset();
+        return false;
+    }
+
+    AVAudioFifo* raw_fifo = nullptr;
+    if (!(raw_fifo = av_audio_fifo_alloc(AV_SAMPLE_FMT_FLTP, 2,
+                                         AC3_FRAME_SAMPLES * 4)))
+    {
+        m_log->error("Compat audio: failed to allocate audio FIFO.");
+        m_encoder.reset();
+        return false;
+    }
+    m_fifo.reset(raw_fifo);
+
+    CodecParamsPtr codecpar = make_codec_params();
+    avcodec_parameters_from_context(codecpar.get(), m_encoder.get());
+    Marker marker {
+        .stream_id = OutputTS::COMPAT_STREAM_ID,
+        .time_base = m_encoder->time_base,
+        .frame_duration = AVRational {AC3_FRAME_SAMPLES,
+                                      m_encoder->sample_rate},
+        .codec_par = std::move(codecpar)
+    };
+    m_version = m_parent.AddMarker(std::move(marker),
+                                   av_rescale_q(pts48, TimeBase::AUDIO48,
+                                                TimeBase::Magewell));
+
+    m_log->info("Opened compat AC3 : 2ch {}Hz {}bps",
+                m_encoder->sample_rate, m_encoder->bit_rate);
+    return true;
+}
+
+void CompatStream::mix(const AVFrame* frame, int64_t pts48)
+{
+    if (frame->format != AV_SAMPLE_FMT_FLTP || frame->nb_samples <= 0)
+    {
+        m_log->warn("Compat audio: unexpected sample format {}",
+                    av_get_sample_fmt_name
+                    (static_cast<AVSampleFormat>(frame->format)));
+        return;
+    }
+
+    if (!m_encoder && !open_encoder(pts48))
+        return;
+    if (!open_resampler(frame->sample_rate))
+        return;
+
+    set_coeffs(frame->ch_layout);
+
+    size_t samples = frame->nb_samples;
+    if (m_left.size() < samples)
+    {
+        m_left.resize(samples);
+        m_right.resize(samples);
+    }
+
+    Downmix::Stereo(reinterpret_cast<const float* const*>
+                    (frame->extended_data),
+                    m_coeffs, m_left.data(), m_right.data(), samples);
+
+    // Keep our sample clock within 100ms of the source.
+    int64_t queued = av_audio_fifo_size(m_fifo.get());
+    if (m_swr)
+        queued += swr_get_delay(m_swr.get(), m_encoder->sample_rate);
+    if (m_pts == AV_NOPTS_VALUE || std::abs(m_pts + queued - pts48) > 4800)
+        m_pts = pts48 - queued;
+
+    float* planes[2] = { m_left.data(), m_right.data() };
+
+    if (m_swr)
+    {
+        int max_out = swr_get_out_samples(m_swr.get(), samples);
+        uint8_t* out[AV_NUM_DATA_POINTERS] = { nullptr };
+        if (av_samples_alloc(out, nullptr, 2, max_out,
+                             AV_SAMPLE_FMT_FLTP, 0) < 0)
+            return;
+
+        int converted = swr_convert(m_swr.get(), out, max_out,
+                     reinterpret_cast<const uint8_t**>(static_cast<void*>(planes)),
+                                    samples);
+        if (converted > 0)
+            av_audio_fifo_write(m_fifo.get(),
+                                reinterpret_cast<void**>(out), converted);
+        av_freep(&out[0]);
+    }
+    else
+    {
+        av_audio_fifo_write(m_fifo.get(),
+                            reinterpret_cast<void**>(planes), samples);
+    }
+
+    encode_frames();
+}
+
+void CompatStream::encode_frames(void)
+{
+    while (av_audio_fifo_size(m_fifo.get()) >= AC3_FRAME_SAMPLES)
+    {
+        FramePtr frame = make_frame();
+        frame->format      = AV_SAMPLE_FMT_FLTP;
+        frame->sample_rate = m_encoder->sample_rate;
+        frame->nb_samples  = AC3_FRAME_SAMPLES;
+        frame->pts         = m_pts;
+        av_channel_layout_copy(&frame->ch_layout, &m_encoder->ch_layout);
+
+        if (av_frame_get_buffer(frame.get(), 0) < 0)
+        {
+            m_log->error("Compat audio: failed to allocate frame buffer.");
+            return;
+        }
+
+        av_audio_fifo_read(m_fifo.get(),
+                           reinterpret_cast<void**>(frame->data),
+                           AC3_FRAME_SAMPLES);
+
+        if (!m_parent.EncodeFrame(OutputTS::COMPAT_STREAM_ID, m_version,
+                                  m_encoder.get(), frame.get()))
+        {
+            m_log->error("encode_frame(compat audio) failed.");
+            return;
+        }
+
+        m_pts += AC3_FRAME_SAMPLES;
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "Downmix.h"
+#include "ffmpeg_types.h"
+
+class OutputTS;
+
+/*
+  Produces the stereo AC3 "compatibility" audio track which is carried
+  on a second audio PID, for clients which cannot decode the primary
+  track (E-AC3, Atmos or 5.1 AC3).
+
+  Input is either the compressed frames which BitStream passes through
+  (decoded here) or the PCM frames PCMStream feeds to its encoder.
+  Everything happens on this class's own thread, and input is dropped
+  rather than queued without bound, so the primary audio track is
+  never held up by it.
+*/
+class CompatStream
+{
+  public:
+    CompatStream(OutputTS& parent, int verbose_level, int bit_rate);
+    ~CompatStream(void);
+
+    CompatStream(const CompatStream&) = delete;
+    CompatStream& operator=(const CompatStream&) = delete;
+
+    // AC3/E-AC3 frame; timestamp in Magewell (100ns) units
+    void AddPacket(AVCodecID codec_id, std::span<const uint8_t> payload,
+                   int64_t timestamp);
+    // Planar float PCM; pts in 1/sample_rate units
+    void AddFrame(const AVFrame* frame);
+
+    void Shutdown(void);
+
+  private:
+    static constexpr size_t MAX_QUEUE = 64;
+    static constexpr int    AC3_FRAME_SAMPLES = 1536;
+
+    struct Work
+    {
+        AVCodecID            codec_id  {AV_CODEC_ID_NONE};
+        std::vector<uint8_t> payload;
+        int64_t              timestamp {0};
+        FramePtr             frame;
+    };
+
+    void push(Work&& work);
+    void run(void);
+
+    void decode(Work& work);
+    void mix(const AVFrame* frame, int64_t pts48);
+    void encode_frames(void);
+
+    bool open_decoder(AVCodecID codec_id);
+    bool open_encoder(int64_t pts48);
+    bool open_resampler(int sample_rate);
+    void set_coeffs(const AVChannelLayout& layout);
+
+    // spdlog
+    std::shared_ptr<spdlog::logger> m_log;
+
+    OutputTS&         m_parent;
+    int               m_verbose;
+    int               m_bit_rate;
+    int               m_version  {0};
+
+    std::thread             m_thread;
+    std::mutex              m_mutex;
+    std::condition_variable m_ready;
+    std::deque<Work>        m_queue;
+    std::atomic<bool>       m_running {true};
+    uint64_t                m_dropped {0};
+
+    CodecContextPtr   m_decoder;
+    CodecContextPtr   m_encoder;
+    SwrContextPtr     m_swr;
+    int               m_swr_rate {0};
+    AudioFifoPtr      m_fifo;
+    int64_t           m_pts      {AV_NOPTS_VALUE};
+
+    Downmix::Coeffs    m_coeffs;
+    AVChannelLayout    m_coeffs_layout {};
+    std::vector<float> m_left;
+    std::vector<float> m_right;
+};
@@ -0,0 +1,497 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <sched.h>
+
+#include <spdlog/spdlog.h>
+#ifdef SPDLOG_FMT_EXTERNAL
+#include <fmt/format.h>
+#else
+#include <spdlog/fmt/bundled/format.h>
+#endif
+
+#include "CpuPlan.h"
+
+using namespace std;
+
+namespace CpuPlan
+{
+    namespace
+    {
+        using CpuList = vector<int>;
+
+        constexpr const char* MAGEWELL_PCI_VENDOR = "0x1cd7";
+
+        struct Placement
+        {
+            CpuList cpus;
+            bool    has_sched {false};
+            int     policy    {SCHED_OTHER};
+            int     priority  {0};
+        };
+
+        constexpr array<const char*, NUM_ROLES> ROLE_NAMES {
+            "capture", "copy", "encode", "mux", "audio"
+        };
+        constexpr array<const char*, NUM_ROLES> ROLE_THREADS {
+            "vidcap viddma audcap ecocap", "vidmgr vdcpyN", "videnc", "muxN",
+            "audenc audcompat"
+        };
+
+        array<Placement, NUM_ROLES> g_plan;
+        bool                        g_auto    {false};
+        int                         g_verbose {1};
+
+        optional<Role> role_by_name(string_view name)
+        {
+            for (int role = 0; role < NUM_ROLES; ++role)
+                if (name == ROLE_NAMES[role])
+                    return static_cast<Role>(role);
+            return nullopt;
+        }
+
+        // "0-3,8,10-11" as used by taskset and sysfs.
+        bool parse_cpulist(string_view str, CpuList& cpus)
+        {
+            cpus.clear();
+            while (!str.empty())
+            {
+                size_t      comma = str.find(',');
+                string_view item  = str.substr(0, comma);
+                str = comma == string_view::npos
+                      ? string_view() : str.substr(comma + 1);
+
+                int    first = 0;
+                int    last  = 0;
+                size_t dash  = item.find('-');
+                auto   end   = item.data() + item.size();
+
+                auto res = from_chars(item.data(), end, first);
+                if (res.ec != errc() || first < 0)
+                    return false;
+                if (dash == string_view::npos)
+                {
+                    if (res.ptr != end)
+                        return false;
+                    last = first;
+                }
+                else
+                {
+                    res = from_chars(item.data() + dash + 1, end, last);
+                    if (res.ec != errc() || res.ptr != end || last < first)
+                        return false;
+                }
+                for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE;
+                     ++cpu)
+                    cpus.push_back(cpu);
+            }
+            ranges::sort(cpus);
+            auto dups = ranges::unique(cpus);
+            cpus.erase(dups.begin(), dups.end());
+            return !cpus.empty();
+        }
+
+        string format_cpulist(const CpuList& cpus)
+        {
+            string out;
+            for (size_t idx = 0; idx < cpus.size(); )
+            {
+                size_t run = idx;
+                while (run + 1 < cpus.size() && cpus[run + 1] == cpus[run] + 1)
+                    ++run;
+                if (!out.empty())
+                    out += ',';
+                out += run > idx ? fmt::format("{}-{}", cpus[idx], cpus[run])
+                                 : fmt::format("{}", cpus[idx]);
+                idx = run + 1;
+            }
+            return out;
+        }
+
+        string read_line(const filesystem::path& path)
+        {
+            ifstream in(path);
+            string   line;
+            getline(in, line);
+            return line;
+        }
+
+        CpuList read_cpulist(const filesystem::path& path)
+        {
+            CpuList cpus;
+            parse_cpulist(read_line(path), cpus);
+            return cpus;
+        }
+
+        CpuList intersect(const CpuList& a, const CpuList& b)
+        {
+            CpuList out;
+            ranges::set_intersection(a, b, back_inserter(out));
+            return out;
+        }
+
+        CpuList difference(const CpuList& a, const CpuList& b)
+        {
+            CpuList out;
+            ranges::set_difference(a, b, back_inserter(out));
+            return out;
+        }
+
+        CpuList allowed_cpus(void)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) != 0)
+                return {};
+
+            CpuList cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &set))
+                    cpus.push_back(cpu);
+            return cpus;
+        }
+
+        /*
+          CPUs local to the capture card. The SDK does not tell us which
+          PCI device a board is, so if the Magewell boards are on
+          different nodes, assume they enumerate in board index order.
+        */
+        CpuList card_cpus(int board_index, string& where)
+        {
+            vector<filesystem::path> boards;
+            error_code ec;
+            for (const auto& dev : filesystem::directory_iterator
+                     ("/sys/bus/pci/devices", ec))
+            {
+                if (read_line(dev.path() / "vendor") == MAGEWELL_PCI_VENDOR)
+                    boards.push_back(dev.path());
+            }
+            if (boards.empty())
+            {
+                where = "card not found on the PCI bus";
+                return {};
+            }
+            ranges::sort(boards);
+
+            string node = read_line(boards.front() / "numa_node");
+            bool same = ranges::all_of(boards, [&node](const auto& path)
+                        { return read_line(path / "numa_node") == node; });
+
+            filesystem::path board = boards.front();
+            if (!same)
+            {
+                if (board_index < 0 ||
+                    board_index >= static_cast<int>(boards.size()))
+                {
+                    where = "card NUMA node unknown";
+                    return {};
+                }
+                board = boards[board_index];
+                node  = read_line(board / "numa_node");
+            }
+
+            where = node == "-1" || node.empty()
+                    ? "no NUMA" : "card on NUMA node " + node;
+            return read_cpulist(board / "local_cpulist");
+        }
+
+        // Group CPUs into physical cores (SMT siblings), in CPU order.
+        vector<CpuList> cores(const CpuList& cpus)
+        {
+            vector<CpuList> out;
+            CpuList         seen;
+            for (int cpu : cpus)
+            {
+                if (ranges::binary_search(seen, cpu))
+                    continue;
+
+                CpuList siblings = read_cpulist
+                    (fmt::format("/sys/devices/system/cpu/cpu{}/topology/"
+                                 "thread_siblings_list", cpu));
+                siblings = intersect(siblings.empty() ? CpuList {cpu}
+                                                      : siblings, cpus);
+                if (siblings.empty())
+                    siblings = {cpu};
+
+                out.push_back(siblings);
+                seen.insert(seen.end(), siblings.begin(), siblings.end());
+                ranges::sort(seen);
+            }
+            return out;
+        }
+
+        CpuList join(vector<CpuList>::const_iterator first,
+                     vector<CpuList>::const_iterator last)
+        {
+            CpuList out;
+            for (; first != last; ++first)
+                out.insert(out.end(), first->begin(), first->end());
+            ranges::sort(out);
+            return out;
+        }
+
+        string plan_auto(int board_index, const CpuList& allowed)
+        {
+            CpuList isolated = read_cpulist
+                               ("/sys/devices/system/cpu/isolated");
+            CpuList usable   = difference(allowed, isolated);
+            if (usable.empty())
+                usable = allowed;   // We were put on isolated CPUs on purpose
+
+            string  where;
+            CpuList local = intersect(card_cpus(board_index, where), usable);
+            if (local.empty())
+                local = usable;
+
+            string desc = fmt::format("auto: {}, CPUs {}", where,
+                                      format_cpulist(local));
+            if (!isolated.empty())
+                desc += fmt::format("; isolated {} excluded",
+                                    format_cpulist(isolated));
+
+            vector<CpuList> cpu_cores = cores(local);
+            array<CpuList, NUM_ROLES> cpus;
+            if (cpu_cores.size() >= 4)
+            {
+                // Capture alone; encode, mux and audio on the siblings of
+                // the last core; the copy workers get the rest.
+                cpus[CAPTURE] = cpu_cores.front();
+                cpus[COPY]    = join(cpu_cores.begin() + 1,
+                                     cpu_cores.end() - 1);
+                cpus[ENCODE]  = cpu_cores.back();
+            }
+            else if (cpu_cores.size() >= 2)
+            {
+                cpus[CAPTURE] = cpu_cores.front();
+                cpus[COPY]    = join(cpu_cores.begin() + 1, cpu_cores.end());
+                cpus[ENCODE]  = cpus[COPY];
+            }
+            else
+            {
+                cpus[CAPTURE] = cpus[COPY] = cpus[ENCODE] = local;
+            }
+            cpus[MUX] = cpus[AUDIO] = cpus[ENCODE];
+
+            for (int role = 0; role < NUM_ROLES; ++role)
+            {
+                if (g_plan[role].cpus.empty())
+                    g_plan[role].cpus = cpus[role];
+            }
+            return desc;
+        }
+
+        string policy_name(int policy)
+        {
+            switch (policy)
+            {
+                case SCHED_FIFO:
+                  return "fifo";
+                case SCHED_RR:
+                  return "rr";
+                case SCHED_BATCH:
+                  return "batch";
+                case SCHED_IDLE:
+                  return "idle";
+                default:
+                  return "other";
+            }
+        }
+
+        string describe(const Placement& place)
+        {
+            string out = place.cpus.empty()
+                         ? "any CPU" : "CPUs " + format_cpulist(place.cpus);
+            if (place.has_sched)
+            {
+                out += ", " + policy_name(place.policy);
+                if (place.priority)
+                    out += fmt::format(":{}", place.priority);
+            }
+            return out;
+        }
+    }
+
+    bool SetAffinity(string_view spec)
+    {
+        if (spec == "auto")
+        {
+            g_auto = true;
+            return true;
+        }
+
+        size_t eq = spec.find('=');
+        if (eq == string_view::npos)
+            return false;
+
+        auto    role = role_by_name(spec.substr(0, eq));
+        CpuList cpus;
+        if (!role || !parse_cpulist(spec.substr(eq + 1), cpus))
+            return false;
+
+        g_plan[*role].cpus = std::move(cpus);
+        return true;
+    }
+
+    bool SetSched(string_view spec)
+    {
+        size_t eq = spec.find('=');
+        if (eq == string_view::npos)
+            return false;
+
+        auto role = role_by_name(spec.substr(0, eq));
+        if (!role)
+            return false;
+
+        string_view rest   = spec.substr(eq + 1);
+        size_t      colon  = rest.find(':');
+        string_view policy = rest.substr(0, colon);
+
+        Placement place = g_plan[*role];
+        if (policy == "other")
+            place.policy = SCHED_OTHER;
+        else if (policy == "batch")
+            place.policy = SCHED_BATCH;
+        else if (policy == "idle")
+            place.policy = SCHED_IDLE;
+        else if (policy == "fifo")
+            place.policy = SCHED_FIFO;
+        else if (policy == "rr")
+            place.policy = SCHED_RR;
+        else
+            return false;
+
+        place.priority = 0;
+        if (colon != string_view::npos)
+        {
+            string_view prio = rest.substr(colon + 1);
+            auto res = from_chars(prio.data(), prio.data() + prio.size(),
+                                  place.priority);
+            if (res.ec != errc() || res.ptr != prio.data() + prio.size())
+                return false;
+        }
+
+        // Real-time policies need a priority, the others must have 0.
+        bool rt = place.policy == SCHED_FIFO || place.policy == SCHED_RR;
+        if (rt && colon == string_view::npos)
+            place.priority = 20;
+        if (place.priority < sched_get_priority_min(place.policy) ||
+            place.priority > sched_get_priority_max(place.policy))
+            return false;
+
+        place.has_sched = true;
+        g_plan[*role]   = std::move(place);
+        return true;
+    }
+
+    void RealtimeCapture(void)
+    {
+        Placement& place = g_plan[CAPTURE];
+        if (place.has_sched)
+            return;
+
+        place.has_sched = true;
+        place.policy    = SCHED_RR;
+        place.priority  = 20;
+    }
+
+    static void make_plan(int board_index, int verbose)
+    {
+        auto log = spdlog::get("app_logger");
+        g_verbose = verbose;
+
+        CpuList allowed = allowed_cpus();
+        string  desc    = "manual";
+        if (g_auto)
+            desc = plan_auto(board_index, allowed);
+
+        bool any_cpus  = ranges::any_of(g_plan, [](const Placement& place)
+                                        { return !place.cpus.empty(); });
+        bool any_sched = ranges::any_of(g_plan, [](const Placement& place)
+                                        { return place.has_sched; });
+        if (!any_cpus && !any_sched)
+            return;
+
+        /*
+          Threads inherit the placement of whoever started them (e.g.
+          videnc is started by vidmgr), so give every role an explicit
+          one once any role has one.
+        */
+        for (auto& place : g_plan)
+        {
+            if (any_cpus && place.cpus.empty())
+                place.cpus = allowed;
+            else if (!place.cpus.empty())
+            {
+                CpuList usable = intersect(place.cpus, allowed);
+                if (usable.empty() && log)
+                    log->warn("CPUs {} are outside the allowed {}; ignored",
+                              format_cpulist(place.cpus),
+                              format_cpulist(allowed));
+                place.cpus = usable.empty() ? allowed : usable;
+            }
+            if (any_sched && !place.has_sched)
+                place.has_sched = true;     // SCHED_OTHER
+        }
+
+        if (!log || verbose < 1)
+            return;
+
+        string map = fmt::format("CPU plan ({}):", desc);
+        for (int role = 0; role < NUM_ROLES; ++role)
+            map += fmt::format("\n\t{:<8} {:<17} {}", ROLE_NAMES[role],
+                               ROLE_THREADS[role], describe(g_plan[role]));
+        log->info(map);
+    }
+
+    void Plan(int board_index, int verbose)
+    {
+        // Every input shares one plan, made for the first to get here;
+        // the others wait for it.
+        static once_flag planned;
+        call_once(planned, make_plan, board_index, verbose);
+    }
+
+    void Apply(pthread_t thread, Role role, const char* name)
+    {
+        const Placement& place = g_plan[role];
+        if (place.cpus.empty() && !place.has_sched)
+            return;
+
+        auto log = spdlog::get("app_logger");
+
+        if (!place.cpus.empty())
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int cpu : place.cpus)
+                CPU_SET(cpu, &set);
+
+            int ret = pthread_setaffinity_np(thread, sizeof(set), &set);
+            if (ret != 0 && log)
+                log->warn("Failed to set {} thread affinity to {}: {}",
+                          name, format_cpulist(place.cpus), strerror(ret));
+        }
+
+        if (place.has_sched)
+        {
+            sched_param param { .sched_priority = place.priority };
+            int ret = pthread_setschedparam(thread, place.policy, &param);
+            if (ret != 0 && log)
+                log->warn("Failed to set {} thread scheduling to {}:{}. "
+                          "Error: {} Code: {}", name,
+                          policy_name(place.policy), place.priority,
+                          strerror(ret), ret);
+        }
+
+        if (g_verbose > 2 && log)
+            log->debug("{} thread ({}): {}", name, ROLE_NAMES[role],
+                       describe(place));
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string_view>
+
+#include <pthread.h>
+
+/*
+  Where each pipeline thread runs, and at what scheduling policy.
+
+  Threads are grouped by role. A role's CPUs and policy come from
+  --cpu / --sched, or, with "--cpu auto", are planned from the topology:
+  capture and the copy workers stay on the CPUs local to the capture
+  card's NUMA node, with capture on a core of its own, and the encoder,
+  mux and audio threads share the SMT siblings of one core, so packets
+  move between them through a shared L2. Isolated CPUs (isolcpus) are
+  only used if they are all the process is allowed to run on.
+
+  Nothing is changed unless something is configured. Once any role is,
+  the rest are explicitly given every allowed CPU (and SCHED_OTHER), as
+  threads otherwise inherit the placement of the thread that started
+  them.
+*/
+namespace CpuPlan
+{
+    enum Role
+    {
+        CAPTURE,        // vidcap, viddma, audcap, ecocap
+        COPY,           // vidmgr, vdcpyN
+        ENCODE,         // videnc
+        MUX,            // muxN, mux (--mpts)
+        AUDIO,          // audenc, audcompat
+        NUM_ROLES
+    };
+
+    /*
+      "auto", or "<role>=<cpu list>" (e.g. "copy=2-5,10"). Returns false
+      if the spec cannot be parsed.
+    */
+    bool SetAffinity(std::string_view spec);
+
+    /*
+      "<role>=<policy>[:<priority>]", with policy one of other, batch,
+      idle, fifo or rr.
+    */
+    bool SetSched(std::string_view spec);
+
+    // Same as "--sched capture=rr:20", unless capture is already set.
+    void RealtimeCapture(void);
+
+    /*
+      Resolve "auto" for the board with the given index, and log the
+      resulting map. Call once the logger is up, before the pipeline
+      threads start. Only the first call does anything; with several
+      inputs, they share the plan made for the first.
+    */
+    void Plan(int board_index, int verbose);
+
+    // Place `thread` (named `name`, for the log) according to its role.
+    void Apply(pthread_t thread, Role role, const char* name);
+}
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+extern "C" {
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "Deinterlace.h"
+
+namespace
+{
+    using Deinterlace::Mode;
+
+    inline int rebuild(int above, int cur, int below, int threshold,
+                       Mode mode)
+    {
+        int avg = (above + below + 1) >> 1;
+        if (mode == Deinterlace::BOB)
+            return avg;
+
+        int lo = std::min(above, below) - threshold;
+        int hi = std::max(above, below) + threshold;
+        return (lo <= cur && cur <= hi) ? cur : avg;
+    }
+
+    // One missing line from 8 bit samples.
+    void row8(const uint8_t* above, const uint8_t* cur, const uint8_t* below,
+              uint8_t* dst, size_t bytes, Mode mode)
+    {
+        size_t idx = 0;
+
+#if defined(__AVX2__)
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i thresh = _mm256_set1_epi8(Deinterlace::COMB_THRESHOLD);
+        for (; idx + 32 <= bytes; idx += 32)
+        {
+            __m256i a = _mm256_loadu_si256
+                        (reinterpret_cast<const __m256i*>(above + idx));
+            __m256i b = _mm256_loadu_si256
+                        (reinterpret_cast<const __m256i*>(below + idx));
+            __m256i out = _mm256_avg_epu8(a, b);
+            if (mode == Deinterlace::ADAPTIVE)
+            {
+                __m256i c = _mm256_loadu_si256
+                            (reinterpret_cast<const __m256i*>(cur + idx));
+                __m256i lo = _mm256_subs_epu8(_mm256_min_epu8(a, b), thresh);
+                __m256i hi = _mm256_adds_epu8(_mm256_max_epu8(a, b), thresh);
+                __m256i keep = _mm256_cmpeq_epi8
+                               (_mm256_or_si256(_mm256_subs_epu8(lo, c),
+                                                _mm256_subs_epu8(c, hi)),
+                                zero);
+                out = _mm256_blendv_epi8(out, c, keep);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + idx), out);
+        }
+#elif defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i thresh = _mm_set1_epi8(Deinterlace::COMB_THRESHOLD);
+        for (; idx + 16 <= bytes; idx += 16)
+        {
+            __m128i a = _mm_loadu_si128
+                        (reinterpret_cast<const __m128i*>(above + idx));
+            __m128i b = _mm_loadu_si128
+                        (reinterpret_cast<const __m128i*>(below + idx));
+            __m128i out = _mm_avg_epu8(a, b);
+            if (mode == Deinterlace::ADAPTIVE)
+            {
+                __m128i c = _mm_loadu_si128
+                            (reinterpret_cast<const __m128i*>(cur + idx));
+                __m128i lo = _mm_subs_epu8(_mm_min_epu8(a, b), thresh);
+                __m128i hi = _mm_adds_epu8(_mm_max_epu8(a, b), thresh);
+                __m128i keep = _mm_cmpeq_epi8
+                               (_mm_or_si128(_mm_subs_epu8(lo, c),
+                                             _mm_subs_epu8(c, hi)), zero);
+                out = _mm_or_si128(_mm_and_si128(keep, c),
+                                   _mm_andnot_si128(keep, out));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx), out);
+        }
+#endif
+        for (; idx < bytes; ++idx)
+            dst[idx] = rebuild(above[idx], cur[idx], below[idx],
+                               Deinterlace::COMB_THRESHOLD, mode);
+    }
+
+    // One missing line from 16 bit samples (P010: 10 bits, MSB aligned).
+    void row16(const uint8_t* above, const uint8_t* cur,
+               const uint8_t* below, uint8_t* dst, size_t bytes, Mode mode)
+    {
+        constexpr int threshold = Deinterlace::COMB_THRESHOLD << 8;
+        size_t idx = 0;
+
+#if defined(__AVX2__)
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i thresh = _mm256_set1_epi16(threshold);
+        for (; idx + 32 <= bytes; idx += 32)
+        {
+            __m256i a = _mm256_loadu_si256
+                        (reinterpret_cast<const __m256i*>(above + idx));
+            __m256i b = _mm256_loadu_si256
+                        (reinterpret_cast<const __m256i*>(below + idx));
+            __m256i out = _mm256_avg_epu16(a, b);
+            if (mode == Deinterlace::ADAPTIVE)
+            {
+                __m256i c = _mm256_loadu_si256
+                            (reinterpret_cast<const __m256i*>(cur + idx));
+                __m256i lo = _mm256_subs_epu16(_mm256_min_epu16(a, b),
+                                               thresh);
+                __m256i hi = _mm256_adds_epu16(_mm256_max_epu16(a, b),
+                                               thresh);
+                __m256i keep = _mm256_cmpeq_epi16
+                               (_mm256_or_si256(_mm256_subs_epu16(lo, c),
+                                                _mm256_subs_epu16(c, hi)),
+                                zero);
+                out = _mm256_blendv_epi8(out, c, keep);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + idx), out);
+        }
+#elif defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i thresh = _mm_set1_epi16(threshold);
+        for (; idx + 16 <= bytes; idx += 16)
+        {
+            __m128i a = _mm_loadu_si128
+                        (reinterpret_cast<const __m128i*>(above + idx));
+            __m128i b = _mm_loadu_si128
+                        (reinterpret_cast<const __m128i*>(below + idx));
+            __m128i out = _mm_avg_epu16(a, b);
+            if (mode == Deinterlace::ADAPTIVE)
+            {
+                __m128i c = _mm_loadu_si128
+                            (reinterpret_cast<const __m128i*>(cur + idx));
+                // SSE2 has no unsigned 16 bit min/max.
+                __m128i diff = _mm_subs_epu16(a, b);
+                __m128i lo = _mm_subs_epu16(_mm_sub_epi16(a, diff), thresh);
+                __m128i hi = _mm_adds_epu16(_mm_add_epi16(b, diff), thresh);
+                __m128i keep = _mm_cmpeq_epi16
+                               (_mm_or_si128(_mm_subs_epu16(lo, c),
+                                             _mm_subs_epu16(c, hi)), zero);
+                out = _mm_or_si128(_mm_and_si128(keep, c),
+                                   _mm_andnot_si128(keep, out));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + idx), out);
+        }
+#endif
+        for (; idx + 2 <= bytes; idx += 2)
+        {
+            uint16_t a, c, b;
+            std::memcpy(&a, above + idx, 2);
+            std::memcpy(&c, cur + idx, 2);
+            std::memcpy(&b, below + idx, 2);
+            uint16_t out = rebuild(a, c, b, threshold, mode);
+            std::memcpy(dst + idx, &out, 2);
+        }
+    }
+
+    // Sums of the luma of each block of one field, in 8 bit steps.
+    void field_sums(const uint8_t* luma, ptrdiff_t stride, int width,
+                    int height, bool wide, int field, int cols,
+                    uint16_t* sums)
+    {
+        using Deinterlace::MOTION_BLOCK_W;
+        using Deinterlace::MOTION_BLOCK_H;
+        static_assert(MOTION_BLOCK_W == 8, "one PSADBW sum per block");
+
+        for (int line = field; line < height; line += 2)
+        {
+            const uint8_t* in  = luma + line * stride;
+            uint16_t*      out = sums + line / (2 * MOTION_BLOCK_H) * cols;
+            int x = 0;
+
+            if (wide)
+            {
+                for (; x < width; ++x)
+                {
+                    uint16_t sample;
+                    std::memcpy(&sample, in + 2 * x, 2);
+                    out[x / MOTION_BLOCK_W] += sample >> 8;
+                }
+                continue;
+            }
+
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            for (; x + 16 <= width; x += 16)
+            {
+                __m128i sad = _mm_sad_epu8(_mm_loadu_si128
+                                   (reinterpret_cast<const __m128i*>(in + x)),
+                                           zero);
+                out[x / 8]     += _mm_cvtsi128_si32(sad);
+                out[x / 8 + 1] += _mm_extract_epi16(sad, 4);
+            }
+#endif
+            for (; x < width; ++x)
+                out[x / MOTION_BLOCK_W] += in[x];
+        }
+    }
+}
+
+std::shared_ptr<const Deinterlace::MotionMap>
+Deinterlace::Motion::Add(const uint8_t* luma, ptrdiff_t stride, int width,
+                         int height, bool wide)
+{
+    int    cols   = (width + MOTION_BLOCK_W - 1) / MOTION_BLOCK_W;
+    int    rows   = (height + 2 * MOTION_BLOCK_H - 1) / (2 * MOTION_BLOCK_H);
+    size_t blocks = static_cast<size_t>(cols) * rows;
+
+    std::vector<uint16_t> sums(2 * blocks);
+    field_sums(luma, stride, width, height, wide, 0, cols, sums.data());
+    field_sums(luma, stride, width, height, wide, 1, cols,
+               sums.data() + blocks);
+
+    std::shared_ptr<MotionMap> map;
+    if (cols == m_cols && rows == m_rows)
+    {
+        constexpr int limit = MOTION_THRESHOLD * MOTION_BLOCK_W *
+                              MOTION_BLOCK_H;
+
+        map = std::make_shared<MotionMap>();
+        map->cols = cols;
+        map->rows = rows;
+        map->moving.resize(blocks);
+        for (size_t block = 0; block < blocks; ++block)
+        {
+            size_t other = blocks + block;
+            map->moving[block] =
+                std::abs(sums[block] - m_sums[block]) > limit ||
+                std::abs(sums[other] - m_sums[other]) > limit;
+        }
+    }
+
+    m_cols = cols;
+    m_rows = rows;
+    m_sums.swap(sums);
+    return map;
+}
+
+void Deinterlace::Plane(const uint8_t* src, ptrdiff_t src_stride,
+                        uint8_t* dst, ptrdiff_t dst_stride,
+                        size_t row_bytes, int height, int field, bool wide,
+                        Mode mode, const MotionMap* motion, int row_shift)
+{
+    size_t block = MOTION_BLOCK_W * (wide ? 2 : 1);
+
+    for (int line = 0; line < height; ++line)
+    {
+        uint8_t*       out = dst + line * dst_stride;
+        const uint8_t* cur = src + line * src_stride;
+
+        if ((line & 1) == field || height < 2)
+        {
+            std::memcpy(out, cur, row_bytes);
+            continue;
+        }
+
+        // At the top and bottom edge there is only one kept neighbour.
+        int above = line > 0 ? line - 1 : line + 1;
+        int below = line + 1 < height ? line + 1 : line - 1;
+        const uint8_t* pa = src + above * src_stride;
+        const uint8_t* pb = src + below * src_stride;
+
+        if (mode == ADAPTIVE && motion)
+        {
+            // Runs of blocks that moved are averaged, the rest woven.
+            const uint8_t* moving = motion->moving.data() +
+                                    (line >> row_shift) * motion->cols;
+            size_t start = 0;
+            for (int col = 0; col < motion->cols && start < row_bytes; )
+            {
+                uint8_t moved = moving[col];
+                size_t  end   = start;
+                while (col < motion->cols && moving[col] == moved)
+                {
+                    end += block;
+                    ++col;
+                }
+                end = std::min(end, row_bytes);
+
+                if (!moved)
+                    std::memcpy(out + start, cur + start, end - start);
+                else if (wide)
+                    row16(pa + start, cur + start, pb + start, out + start,
+                          end - start, BOB);
+                else
+                    row8(pa + start, cur + start, pb + start, out + start,
+                         end - start, BOB);
+                start = end;
+            }
+            continue;
+        }
+
+        if (wide)
+            row16(pa, cur, pb, out, row_bytes, mode);
+        else
+            row8(pa, cur, pb, out, row_bytes, mode);
+    }
+}
+
+void Deinterlace::Frame(const AVFrame* src, AVFrame* dst, int field,
+                        Mode mode, const MotionMap* motion)
+{
+    auto format = static_cast<AVPixelFormat>(src->format);
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+    int planes = av_pix_fmt_count_planes(format);
+    bool wide  = desc->comp[0].depth > 8;
+
+    for (int plane = 0; plane < planes; ++plane)
+    {
+        int shift  = (plane == 1 || plane == 2) ? desc->log2_chroma_h : 0;
+        int height = AV_CEIL_RSHIFT(src->height, shift);
+        int bytes  = av_image_get_linesize(format, src->width, plane);
+
+        // A motion block is 2 * MOTION_BLOCK_H luma lines.
+        Plane(src->data[plane], src->linesize[plane],
+              dst->data[plane], dst->linesize[plane],
+              bytes, height, field, wide, mode, motion, 2 - shift);
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+/*
+  CPU deinterlacing of woven (field interleaved) captured frames, run by
+  the copy workers before upload.
+
+  One field's lines are kept as they are; each line of the other field
+  is rebuilt from the kept lines above and below it:
+
+  BOB       Always the average of the two: half the vertical resolution,
+            but never any combing.
+  ADAPTIVE  Motion adaptive: the other field's own line where nothing
+            moved since the frame before, so still areas keep their full
+            resolution; the average where something did, which would
+            comb. Without a MotionMap (the first frame, or one still
+            arriving) the other field's line is kept where it lies
+            between the two (give or take COMB_THRESHOLD).
+
+  The MotionMap of each frame is made in capture order, by Motion, from
+  the block means of each field kept from the frame before, so the copy
+  workers can still take the frames in any order. 8 bit (NV12) and 16
+  bit (P010) samples are handled 32 (AVX2) or 16 (SSE2) bytes at a time.
+*/
+namespace Deinterlace
+{
+    enum Mode { BOB, ADAPTIVE };
+
+    // 8 bit steps; scaled up for 16 bit samples.
+    constexpr int COMB_THRESHOLD = 10;
+    // Mean change of a block's samples, in 8 bit steps, that is motion.
+    constexpr int MOTION_THRESHOLD = 3;
+
+    // Samples across, and lines of each field down, of a motion block.
+    constexpr int MOTION_BLOCK_W = 8;
+    constexpr int MOTION_BLOCK_H = 2;
+
+    /*
+      Which blocks of a frame moved since the frame before, in either
+      field: one byte per block of MOTION_BLOCK_W samples by
+      2 * MOTION_BLOCK_H frame lines, nonzero where it moved. The chroma
+      planes use the blocks of the luma they go with.
+    */
+    struct MotionMap
+    {
+        int cols {0};
+        int rows {0};
+        std::vector<uint8_t> moving;
+    };
+
+    /*
+      Makes the MotionMap of each frame, handed the frames in capture
+      order. Only the block means of the frame before are kept, not the
+      frame itself, so its capture buffer can go back to the card.
+    */
+    class Motion
+    {
+      public:
+        // Null for the first frame, or a change of size.
+        std::shared_ptr<const MotionMap> Add(const uint8_t* luma,
+                                             ptrdiff_t stride, int width,
+                                             int height, bool wide);
+
+      private:
+        int m_cols {0};
+        int m_rows {0};
+        std::vector<uint16_t> m_sums;   // Of the frame before's blocks
+    };
+
+    /*
+      One plane of `height` lines of `row_bytes`. `field` is the field
+      kept: 0 for the top (even lines), 1 for the bottom. `motion`
+      (ADAPTIVE only, may be null) has a row per `1 << row_shift` lines.
+    */
+    void Plane(const uint8_t* src, ptrdiff_t src_stride,
+               uint8_t* dst, ptrdiff_t dst_stride,
+               size_t row_bytes, int height, int field, bool wide,
+               Mode mode, const MotionMap* motion = nullptr,
+               int row_shift = 2);
+
+    // Every plane of `src` into `dst`, which has the same format and size.
+    void Frame(const AVFrame* src, AVFrame* dst, int field, Mode mode,
+               const MotionMap* motion = nullptr);
+}
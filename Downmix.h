@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+/*
+  Stereo downmix of planar float audio.
+
+  Every output channel is a weighted sum of the input channels. The
+  coefficients are chosen by the caller (see CompatStream), this file
+  only holds the kernel so it can be benchmarked without FFmpeg.
+
+  The inner loop uses GCC vector extensions, which map onto SSE/AVX
+  (or NEON) depending on the -march the build uses.
+*/
+namespace Downmix
+{
+
+static constexpr int MAX_CHANNELS = 8;
+
+struct Coeffs
+{
+    int channels {0};
+    std::array<float, MAX_CHANNELS> left  {};
+    std::array<float, MAX_CHANNELS> right {};
+};
+
+using v8sf = float __attribute__((vector_size(32)));
+
+/**
+ * @brief Mix `channels` planes down to two.
+ * @param in      Input planes, one per channel
+ * @param coeffs  Per input channel weights for left and right
+ * @param out_l   Left output, `samples` long
+ * @param out_r   Right output, `samples` long
+ */
+inline void Stereo(const float* const* in, const Coeffs& coeffs,
+                   float* out_l, float* out_r, int samples)
+{
+    // Skip channels which contribute nothing (e.g. LFE).
+    std::array<int, MAX_CHANNELS> active {};
+    int num_active = 0;
+    for (int ch = 0; ch < coeffs.channels && ch < MAX_CHANNELS; ++ch)
+    {
+        if (coeffs.left[ch] != 0.0f || coeffs.right[ch] != 0.0f)
+            active[num_active++] = ch;
+    }
+
+    int idx = 0;
+    for (; idx + 8 <= samples; idx += 8)
+    {
+        v8sf left  = {};
+        v8sf right = {};
+
+        for (int act = 0; act < num_active; ++act)
+        {
+            int  ch = active[act];
+            v8sf x;
+            std::memcpy(&x, in[ch] + idx, sizeof(x));
+            left  += x * coeffs.left[ch];
+            right += x * coeffs.right[ch];
+        }
+
+        std::memcpy(out_l + idx, &left, sizeof(left));
+        std::memcpy(out_r + idx, &right, sizeof(right));
+    }
+
+    for (; idx < samples; ++idx)
+    {
+        float left  = 0.0f;
+        float right = 0.0f;
+
+        for (int act = 0; act < num_active; ++act)
+        {
+            int ch = active[act];
+            left  += in[ch][idx] * coeffs.left[ch];
+            right += in[ch][idx] * coeffs.right[ch];
+        }
+
+        out_l[idx] = left;
+        out_r[idx] = right;
+    }
+}
+
+/**
+ * @brief Plain scalar version of Stereo(), for verification.
+ */
+inline void StereoScalar(const float* const* in, const Coeffs& coeffs,
+                         float* out_l, float* out_r, int samples)
+{
+    for (int idx = 0; idx < samples; ++idx)
+    {
+        float left  = 0.0f;
+        float right = 0.0f;
+
+        for (int ch = 0; ch < coeffs.channels; ++ch)
+        {
+            left  += in[ch][idx] * coeffs.left[ch];
+            right += in[ch][idx] * coeffs.right[ch];
+        }
+
+        out_l[idx] = left;
+        out_r[idx] = right;
+    }
+}
+
+}
@@ -12,6 +12,100 @@
 #include "EAC3Parser.h"
 #include "BitReader.h"
 
+namespace
+{
+/*
+  Slice-by-8 tables for the AC-3 CRC-16 (poly 0x8005).
+
+  crc_tables[0] is the classic byte-at-a-time table. crc_tables[k][x]
+  is the CRC contribution of byte x followed by k zero bytes, which
+  lets eight input bytes be folded in with eight independent lookups.
+*/
+constexpr uint16_t CRC16_POLY = 0x8005;
+
+using crc_table_t = std::array<std::array<uint16_t, 256>, 8>;
+
+constexpr crc_table_t make_crc_tables(void)
+{
+    crc_table_t tables {};
+
+    for (uint32_t idx = 0; idx < 256; ++idx)
+    {
+        uint16_t crc = static_cast<uint16_t>(idx << 8);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ CRC16_POLY)
+                                 : static_cast<uint16_t>(crc << 1);
+        tables[0][idx] = crc;
+    }
+
+    for (size_t k = 1; k < tables.size(); ++k)
+    {
+        for (uint32_t idx = 0; idx < 256; ++idx)
+        {
+            uint16_t prev = tables[k - 1][idx];
+            tables[k][idx] = static_cast<uint16_t>(prev << 8) ^
+                             tables[0][prev >> 8];
+        }
+    }
+
+    return tables;
+}
+
+constexpr crc_table_t crc_tables = make_crc_tables();
+
+static_assert(crc_tables[0][1] == CRC16_POLY);
+}
+
+uint16_t EAC3Parser::crc16(std::span<const uint8_t> data, uint16_t crc)
+{
+    const auto& T = crc_tables;
+    const uint8_t* p = data.data();
+    size_t len = data.size();
+
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        uint16_t hi = crc ^ static_cast<uint16_t>((p[0] << 8) | p[1]);
+        crc = T[7][hi >> 8] ^ T[6][hi & 0xFF] ^
+              T[5][p[2]]    ^ T[4][p[3]]     ^
+              T[3][p[4]]    ^ T[2][p[5]]     ^
+              T[1][p[6]]    ^ T[0][p[7]];
+    }
+
+    for (; len > 0; --len, ++p)
+        crc = static_cast<uint16_t>(crc << 8) ^ T[0][(crc >> 8) ^ *p];
+
+    return crc;
+}
+
+CRCResult EAC3Parser::checkCRC(std::span<const uint8_t> frame,
+                               CodecType codec_type)
+{
+    if (frame.size() < 6 || (frame.size() & 1)) [[unlikely]]
+        return CRCResult::BAD_SIZE;
+
+    if (codec_type == CodecType::AC3)
+    {
+        /*
+          crc1 covers the first 5/8 of the frame (after the syncword),
+          crc2 the rest. Both are stored so that the CRC of their
+          region, including the stored value, is zero.
+        */
+        size_t words = frame.size() / 2;
+        size_t frame_58 = ((words >> 1) + (words >> 3)) * 2;
+
+        if (crc16(frame.subspan(2, frame_58 - 2)) != 0)
+            return CRCResult::CRC1_ERROR;
+        if (crc16(frame.subspan(frame_58)) != 0)
+            return CRCResult::CRC2_ERROR;
+        return CRCResult::OK;
+    }
+
+    // E-AC-3 only has crc2, covering the whole frame after the syncword.
+    if (crc16(frame.subspan(2)) != 0)
+        return CRCResult::CRC2_ERROR;
+    return CRCResult::OK;
+}
+
 EAC3Parser::EAC3Parser(void)
 {
     m_log = spdlog::get("app_logger");
@@ -67,6 +161,27 @@ size_t EAC3Parser::getFrameSizeBytes(std::span<const uint8_t> raw_bytes, CodecTy
     return words * 2;
 }
 
+int EAC3Parser::getFrameSamples(std::span<const uint8_t> raw_bytes,
+                                CodecType codec_type)
+{
+    if (codec_type == CodecType::AC3)
+        return 1536;
+
+    if (raw_bytes.size() < 6) [[unlikely]]
+        return 0;
+
+    // strmtyp 1 == dependent substream
+    if ((raw_bytes[2] >> 6) == 1)
+        return 0;
+
+    uint8_t fscod = raw_bytes[4] >> 6;
+    if (fscod == 3)
+        return 1536; // Reduced sample rates always carry 6 blocks
+
+    static constexpr int blocks[4] = { 1, 2, 3, 6 };
+    return blocks[(raw_bytes[4] >> 4) & 0x03] * 256;
+}
+
 std::optional<EAC3MetaData>
 EAC3Parser::processFrame(std::span<const uint8_t> iec_buffer,
                          CodecType codec_type)
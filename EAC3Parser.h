@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <cstdint>
 #include <span>
@@ -25,11 +27,35 @@ struct EAC3MetaData
     bool        is_atmos;
 };
 
+enum class CRCResult
+{
+    OK,
+    CRC1_ERROR,     // AC-3 only; covers the first 5/8 of the frame
+    CRC2_ERROR,     // Covers the remainder (whole frame for E-AC-3)
+    BAD_SIZE
+};
+
 class EAC3Parser
 {
   public:
     EAC3Parser(void);
 
+    /**
+     * @brief CRC-16 (x^16 + x^15 + x^2 + 1), MSB first, as used by
+     * AC-3 and E-AC-3. Processes eight bytes per step.
+     * @param data Bytes to checksum
+     * @param crc  Running CRC, allowing a checksum to be continued
+     * @return Updated CRC
+     */
+    static uint16_t crc16(std::span<const uint8_t> data, uint16_t crc = 0);
+
+    /**
+     * @brief Verify crc1/crc2 of a complete AC-3 or E-AC-3 syncframe.
+     * @param frame The entire syncframe, starting at the syncword
+     */
+    static CRCResult checkCRC(std::span<const uint8_t> frame,
+                              CodecType codec_type);
+
     /**
      * @brief Automatically extracts the frame size for BOTH AC-3 and
      * E-AC-3 streams.
@@ -39,6 +65,15 @@ class EAC3Parser
     static size_t getFrameSizeBytes(std::span<const uint8_t> raw_bytes,
                                     CodecType codec_type);
 
+    /**
+     * @brief Number of PCM samples (per channel) a syncframe decodes to.
+     * @param raw_bytes Minimum 6 raw bytes from the start of the frame
+     * @return Samples, or 0 for E-AC-3 dependent substreams which share
+     * the time slot of their independent frame.
+     */
+    static int getFrameSamples(std::span<const uint8_t> raw_bytes,
+                               CodecType codec_type);
+
     std::optional<EAC3MetaData>
       processFrame(std::span<const uint8_t>iec_buffer, CodecType codec_type);
 
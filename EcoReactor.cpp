@@ -0,0 +1,206 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "EcoReactor.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace
+{
+    constexpr int MAX_EVENTS = 8;
+}
+
+EcoReactor::EcoReactor(int verbose_level, ShutdownCallback shutdown)
+    : m_verbose(verbose_level)
+    , f_shutdown(shutdown)
+{
+    m_log = spdlog::get("app_logger");
+    if (!m_log)
+    {
+        std::cerr << "EcoReactor Error: Logger 'app_logger' not found!"
+                  << std::endl;
+        return;
+    }
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_epoll_fd < 0 || m_timer_fd < 0)
+    {
+        m_log->critical("Failed to create ECO event reactor: {}",
+                        strerror(errno));
+        return;
+    }
+
+    epoll_event event = { .events = EPOLLIN, .data = { .fd = m_timer_fd } };
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_timer_fd, &event) < 0)
+    {
+        m_log->critical("Failed to add ECO reactor timer: {}",
+                        strerror(errno));
+        close(m_timer_fd);
+        m_timer_fd = -1;
+        return;
+    }
+
+    m_thread = std::thread(&EcoReactor::run, this);
+    pthread_setname_np(m_thread.native_handle(), "ecocap");
+}
+
+EcoReactor::~EcoReactor(void)
+{
+    Stop();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_timer_fd >= 0)
+        close(m_timer_fd);
+    if (m_epoll_fd >= 0)
+        close(m_epoll_fd);
+}
+
+void EcoReactor::Run(int fd, Handler handler, chrono::milliseconds idle)
+{
+    std::unique_lock lock(m_mutex);
+    if (m_stopped)
+        return;
+
+    Watch& watch = m_watches[fd] = Watch {
+        .handler = std::move(handler),
+        .idle    = idle,
+        .last    = chrono::steady_clock::now()
+    };
+
+    epoll_event event = { .events = EPOLLIN, .data = { .fd = fd } };
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        m_log->error("Failed to add fd {} to the ECO reactor: {}",
+                     fd, strerror(errno));
+        m_watches.erase(fd);
+        return;
+    }
+    arm_timer(watch.last);
+
+    m_done.wait(lock, [&] { return watch.done || m_stopped; });
+
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    m_watches.erase(fd);
+}
+
+void EcoReactor::Stop(void)
+{
+    m_stopping.store(true);
+    if (m_timer_fd >= 0)
+        wake();
+}
+
+// Expire the timer straight away.
+void EcoReactor::wake(void)
+{
+    itimerspec spec = { .it_interval = {}, .it_value = { 0, 1 } };
+    timerfd_settime(m_timer_fd, 0, &spec, nullptr);
+}
+
+void EcoReactor::dispatch(Watch& watch, bool idle)
+{
+    if (!watch.handler(idle))
+    {
+        watch.done = true;
+        m_done.notify_all();
+    }
+}
+
+/*
+  Called with m_mutex held.
+*/
+void EcoReactor::arm_timer(chrono::steady_clock::time_point now)
+{
+    chrono::nanoseconds next = chrono::nanoseconds::max();
+    for (auto& [fd, watch] : m_watches)
+    {
+        if (!watch.done && watch.idle.count() > 0)
+            next = min(next, watch.last + watch.idle - now);
+    }
+
+    itimerspec spec = {};
+    if (next != chrono::nanoseconds::max())
+    {
+        // Zero would disarm it.
+        next = max(next, chrono::nanoseconds(1));
+        spec.it_value.tv_sec  = next.count() / 1000000000;
+        spec.it_value.tv_nsec = next.count() % 1000000000;
+    }
+    timerfd_settime(m_timer_fd, 0, &spec, nullptr);
+
+    // In case that just undid a Stop().
+    if (m_stopping.load())
+        wake();
+}
+
+void EcoReactor::run(void)
+{
+    epoll_event events[MAX_EVENTS];
+
+    while (!m_stopping.load())
+    {
+        Trace::Span wait_span("capture wait");
+        int count = epoll_wait(m_epoll_fd, events, MAX_EVENTS, -1);
+        wait_span.End();
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            m_log->critical("ECO reactor wait failed: {}", strerror(errno));
+            // The capture loops cannot go on without us.
+            f_shutdown();
+            break;
+        }
+
+        std::scoped_lock lock(m_mutex);
+        if (m_stopping.load())
+            break;
+
+        auto now = chrono::steady_clock::now();
+        for (int idx = 0; idx < count; ++idx)
+        {
+            int fd = events[idx].data.fd;
+            if (fd == m_timer_fd)
+            {
+                uint64_t expirations;
+                read(m_timer_fd, &expirations, sizeof(expirations));
+                continue;
+            }
+
+            eventfd_t value;
+            eventfd_read(fd, &value);
+
+            auto entry = m_watches.find(fd);
+            if (entry == m_watches.end() || entry->second.done)
+                continue;
+            entry->second.last = now;
+            dispatch(entry->second, false);
+        }
+
+        for (auto& [fd, watch] : m_watches)
+        {
+            if (!watch.done && watch.idle.count() > 0 &&
+                now - watch.last >= watch.idle)
+            {
+                watch.last = now;
+                dispatch(watch, true);
+            }
+        }
+        arm_timer(now);
+    }
+
+    std::scoped_lock lock(m_mutex);
+    m_stopped = true;
+    m_done.notify_all();
+    if (m_verbose > 2)
+        m_log->info("ECO reactor finished.");
+}
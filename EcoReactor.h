@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+
+#include <spdlog/spdlog.h>
+
+/*
+  One thread, waiting with epoll, for the eventfds an ECO card signals
+  its video and audio notifications on.
+
+  A capture thread hands its eventfd and a handler to Run(), and sleeps
+  until the handler asks to stop; meanwhile the reactor thread calls the
+  handler each time the eventfd fires. Video and audio frames are so
+  picked up by one thread, which only wakes when there is something to
+  do: the handlers' idle timeouts are kept on one timerfd, set to the
+  earliest of them, rather than being a timeout on every wait.
+
+  Handlers are called with the reactor's lock held, so Run() only
+  returns once its handler is no longer running.
+*/
+class EcoReactor
+{
+  public:
+    /*
+      `idle` is true if the fd has not fired for the idle period given
+      to Run(). Return false to have Run() return.
+    */
+    using Handler = std::function<bool (bool idle)>;
+    using ShutdownCallback = std::function<void (void)>;
+
+    // `shutdown` is called if the reactor fails and can no longer run.
+    EcoReactor(int verbose_level, ShutdownCallback shutdown);
+    ~EcoReactor(void);
+
+    EcoReactor(const EcoReactor&) = delete;
+    EcoReactor& operator=(const EcoReactor&) = delete;
+
+    bool operator!(void) const { return m_epoll_fd < 0 || m_timer_fd < 0; }
+
+    pthread_t Thread(void) { return m_thread.native_handle(); }
+
+    /*
+      Dispatch `fd` to `handler` until the handler returns false or the
+      reactor is stopped. An `idle` of zero never times out.
+    */
+    void Run(int fd, Handler handler,
+             std::chrono::milliseconds idle = std::chrono::milliseconds(0));
+
+    // Make every Run() return. Safe from a signal handler.
+    void Stop(void);
+
+  private:
+    struct Watch
+    {
+        Handler                  handler;
+        std::chrono::nanoseconds idle;
+        std::chrono::steady_clock::time_point last;
+        bool                     done {false};
+    };
+
+    void run(void);
+    void dispatch(Watch& watch, bool idle);
+    void arm_timer(std::chrono::steady_clock::time_point now);
+    void wake(void);
+
+    std::shared_ptr<spdlog::logger> m_log;
+    int                     m_verbose;
+    ShutdownCallback        f_shutdown;
+    int                     m_epoll_fd {-1};
+    int                     m_timer_fd {-1};
+
+    std::mutex              m_mutex;
+    std::condition_variable m_done;
+    std::map<int, Watch>    m_watches;      // By fd
+    bool                    m_stopped  {false};
+    std::atomic<bool>       m_stopping {false};
+    std::thread             m_thread;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+  Fingerprints of raw video frames, for spotting repeated ones.
+
+  Sampled() hashes SAMPLES blocks of 32 bytes spread evenly across the
+  image rather than the whole of it: about 32KB, whatever the
+  resolution, so a 4K frame costs no more than a 720p one. Any real
+  change of picture touches most of the blocks. Full() hashes every
+  byte, for when a change as small as a mouse pointer must not be
+  missed; it runs at about the speed memory can be read.
+
+  Each 32 bit lane of a block is folded into its own running hash
+  (h = h * 33 ^ word), 8 (AVX2) or 4 (SSE2, twice) lanes at a time; the
+  multiply is a shift and an add, so SSE2 has no need of SSE4.1's
+  _mm_mullo_epi32. The lanes are then mixed down to 64 bits. Every path
+  gives the same result.
+*/
+namespace FrameHash
+{
+    constexpr size_t SAMPLES = 1024;
+    constexpr size_t BLOCK   = 32;
+
+    inline uint64_t mix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDULL;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ULL;
+        value ^= value >> 33;
+        return value;
+    }
+
+    // `count` blocks, `step` bytes apart.
+    inline uint64_t blocks(const uint8_t* data, size_t step, size_t count,
+                           uint64_t seed)
+    {
+        alignas(32) uint32_t lanes[8];
+
+#if defined(__AVX2__)
+        __m256i hash = _mm256_set1_epi32(5381);
+        for (size_t idx = 0; idx < count; ++idx)
+        {
+            __m256i block = _mm256_loadu_si256
+                            (reinterpret_cast<const __m256i*>
+                             (data + idx * step));
+            hash = _mm256_xor_si256
+                   (_mm256_add_epi32(_mm256_slli_epi32(hash, 5), hash),
+                    block);
+        }
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), hash);
+#elif defined(__SSE2__)
+        __m128i lo = _mm_set1_epi32(5381);
+        __m128i hi = lo;
+        for (size_t idx = 0; idx < count; ++idx)
+        {
+            const __m128i* ptr = reinterpret_cast<const __m128i*>
+                                 (data + idx * step);
+            lo = _mm_xor_si128(_mm_add_epi32(_mm_slli_epi32(lo, 5), lo),
+                               _mm_loadu_si128(ptr));
+            hi = _mm_xor_si128(_mm_add_epi32(_mm_slli_epi32(hi, 5), hi),
+                               _mm_loadu_si128(ptr + 1));
+        }
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), lo);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes + 4), hi);
+#else
+        for (uint32_t& lane : lanes)
+            lane = 5381;
+        for (size_t idx = 0; idx < count; ++idx)
+        {
+            uint32_t words[8];
+            std::memcpy(words, data + idx * step, sizeof(words));
+            for (int lane = 0; lane < 8; ++lane)
+                lanes[lane] = (lanes[lane] * 33) ^ words[lane];
+        }
+#endif
+
+        uint64_t result = seed;
+        for (int lane = 0; lane < 8; lane += 2)
+        {
+            result = mix(result ^ (static_cast<uint64_t>(lanes[lane]) |
+                                   static_cast<uint64_t>(lanes[lane + 1])
+                                   << 32));
+        }
+        return result;
+    }
+
+    inline uint64_t Sampled(const uint8_t* data, size_t size)
+    {
+        if (size < BLOCK)
+            return 0;
+
+        // Whole blocks, the last one ending at the end of the image.
+        size_t step = (size - BLOCK) / (SAMPLES - 1);
+        if (step == 0)
+            return blocks(data, BLOCK, (size - BLOCK) / BLOCK + 1, size);
+        return blocks(data, step, SAMPLES, size);
+    }
+
+    inline uint64_t Full(const uint8_t* data, size_t size)
+    {
+        size_t count = size / BLOCK;
+        uint64_t result = blocks(data, BLOCK, count, size);
+
+        // The odd bytes at the end
+        uint64_t tail = 0;
+        for (size_t idx = count * BLOCK; idx < size; ++idx)
+            tail = (tail << 8 | tail >> 56) ^ data[idx];
+        return mix(result ^ tail);
+    }
+}
@@ -0,0 +1,249 @@
+#include <cmath>
+#include <iostream>
+
+#include "FrameHash.h"
+#include "FrameRateDetector.h"
+
+using namespace std;
+
+namespace
+{
+    constexpr double  TICKS_PER_SEC = 10000000.0;   // TimeBase::Magewell
+    constexpr int64_t STATS_PERIOD  = 60 * 10000000LL;
+
+    // Runs kept; enough to cover LOCK_FRAMES of the shortest cadence.
+    constexpr size_t MAX_RUNS = 128;
+
+    const FrameRateDetector::Cadence g_cadences[] = {
+        { "3:2", { 3, 2 } },
+        { "2:2", { 2 } }
+    };
+
+    double fps(AVRational duration)
+    {
+        return duration.num ? av_q2d(av_inv_q(duration)) : 0;
+    }
+}
+
+FrameRateDetector::FrameRateDetector(int verbose_level, int input)
+    : m_verbose(verbose_level)
+    , m_dropped(Metrics::GetCounter("magewell2ts_frames_repeated_total",
+                                    "Repeated frames dropped by the "
+                                    "inverse telecine",
+                                    Metrics::WithInput(input)))
+    , m_encoded_fps(Metrics::GetGauge("magewell2ts_encoded_fps",
+                                      "Video frames handed to the encoder "
+                                      "per second, over the last minute",
+                                      Metrics::WithInput(input)))
+    , m_dup_ratio(Metrics::GetGauge("magewell2ts_repeated_frame_ratio",
+                                    "Share of the captured frames that "
+                                    "repeated the one before, over the "
+                                    "last minute",
+                                    Metrics::WithInput(input)))
+{
+    m_log = spdlog::get("app_logger");
+    if (!m_log)
+    {
+        std::cerr << "FrameRateDetector Error: Logger 'app_logger' not found!"
+                  << std::endl;
+    }
+}
+
+void FrameRateDetector::Reset(AVRational frame_duration, size_t image_size)
+{
+    m_frame_duration = frame_duration;
+    m_image_size     = image_size;
+
+    m_index    = -1;
+    m_last_new = -1;
+    m_runs.clear();
+    m_cadence  = nullptr;
+    m_stills   = 0;
+}
+
+AVRational FrameRateDetector::FrameDuration(void) const
+{
+    if (!m_cadence)
+        return m_frame_duration;
+
+    int64_t frames = 0;
+    for (int64_t gap : m_cadence->gaps)
+        frames += gap;
+
+    AVRational duration;
+    av_reduce(&duration.num, &duration.den,
+              m_frame_duration.num * frames,
+              m_frame_duration.den * m_cadence->gaps.size(), INT32_MAX);
+    return duration;
+}
+
+/*
+  Whether the newest runs have followed a cadence for LOCK_FRAMES, and
+  if so, where in it the next one is.
+*/
+const FrameRateDetector::Cadence*
+FrameRateDetector::find_cadence(size_t& phase) const
+{
+    for (const Cadence& cadence : g_cadences)
+    {
+        size_t len = cadence.gaps.size();
+        for (size_t rotation = 0; rotation < len; ++rotation)
+        {
+            int64_t covered = 0;
+            size_t  idx     = 0;
+            for (auto run = m_runs.rbegin(); run != m_runs.rend(); ++run)
+            {
+                if (*run != cadence.gaps[(rotation + len - idx % len) % len])
+                    break;
+                covered += *run;
+                ++idx;
+                if (covered >= LOCK_FRAMES)
+                {
+                    phase = (rotation + 1) % len;
+                    return &cadence;
+                }
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+/*
+  Whether a new picture `gap` frames after the last slot is where the
+  cadence has the next one. A repeat is handed on at every slot, so it
+  is never further than that.
+*/
+bool FrameRateDetector::on_cadence(int64_t gap)
+{
+    if (gap != m_cadence->gaps[m_phase])
+        return false;
+
+    m_phase = (m_phase + 1) % m_cadence->gaps.size();
+    return true;
+}
+
+void FrameRateDetector::unlock(const char* why)
+{
+    if (m_verbose > 0)
+    {
+        m_log->info("Film cadence {} lost after {} frames ({}): "
+                    "encoding every frame", m_cadence->name,
+                    m_index - m_anchor, why);
+    }
+    m_cadence = nullptr;
+}
+
+FrameRateDetector::Result FrameRateDetector::Add(const uint8_t* image,
+                                                 int64_t timestamp)
+{
+    Result result;
+
+    if (image == nullptr || m_image_size < FrameHash::BLOCK)
+        return result;
+
+    ++m_index;
+    ++m_stats_in;
+
+    uint64_t hash = FrameHash::Sampled(image, m_image_size);
+    bool repeat = m_last_new >= 0 && hash == m_last_hash;
+    m_last_hash = hash;
+
+    if (repeat)
+    {
+        ++m_stats_dups;
+        if (m_cadence &&
+            m_index - m_last_slot < m_cadence->gaps[m_phase])
+        {
+            result.drop = true;
+            m_dropped.Inc();
+            log_stats(timestamp);
+            return result;
+        }
+
+        // A new picture was due: hand the repeat on in its place.
+        if (m_cadence)
+        {
+            m_phase = (m_phase + 1) % m_cadence->gaps.size();
+            m_last_slot = m_index;
+            if (++m_stills >= STILL_SLOTS)
+                unlock("no new picture");
+        }
+        ++m_stats_out;
+        log_stats(timestamp);
+        return result;
+    }
+
+    int64_t gap = m_index - m_last_new;
+    if (m_last_new >= 0)
+    {
+        m_runs.push_back(gap);
+        if (m_runs.size() > MAX_RUNS)
+            m_runs.pop_front();
+    }
+    m_last_new = m_index;
+
+    if (m_cadence)
+    {
+        if (on_cadence(m_index - m_last_slot))
+        {
+            m_last_slot = m_index;
+            m_stills    = 0;
+        }
+        else
+            unlock("a new picture off the cadence");
+    }
+    else
+    {
+        size_t phase = 0;
+        const Cadence* cadence = find_cadence(phase);
+        if (cadence)
+        {
+            m_cadence   = cadence;
+            m_phase     = phase;
+            m_anchor    = m_index;
+            m_last_slot = m_index;
+            m_stills    = 0;
+            if (m_verbose > 0)
+            {
+                m_log->info("Film cadence {} found: dropping its repeats, "
+                            "{:.3f} fps of pictures", cadence->name,
+                            fps(FrameDuration()));
+            }
+        }
+    }
+
+    ++m_stats_out;
+    log_stats(timestamp);
+    return result;
+}
+
+void FrameRateDetector::log_stats(int64_t timestamp)
+{
+    if (m_stats_start < 0 || timestamp < m_stats_start)
+    {
+        m_stats_start = timestamp;
+        m_stats_in = m_stats_out = m_stats_dups = 0;
+        return;
+    }
+    if (timestamp - m_stats_start < STATS_PERIOD)
+        return;
+
+    double secs = (timestamp - m_stats_start) / TICKS_PER_SEC;
+    double encoded = m_stats_out / secs;
+    double ratio = m_stats_in ? static_cast<double>(m_stats_dups) /
+                                m_stats_in : 0;
+
+    m_encoded_fps.Set(encoded);
+    m_dup_ratio.Set(ratio);
+    if (m_verbose > 1)
+    {
+        m_log->info("Video: encoding {:.3f} fps, {:.1f}% of frames "
+                    "repeated{}", encoded, ratio * 100,
+                    m_cadence ? fmt::format(" (cadence {})", m_cadence->name)
+                              : "");
+    }
+
+    m_stats_start = timestamp;
+    m_stats_in = m_stats_out = m_stats_dups = 0;
+}
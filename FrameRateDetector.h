@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+extern "C" {
+#include <libavutil/rational.h>
+}
+
+#include "Metrics.h"
+
+/*
+  Inverse telecine: finds film cadences in the captured frames, so the
+  repeated frames can be dropped rather than encoded.
+
+  24p film played out at 59.94 repeats its frames 3, 2, 3, 2... times
+  (3:2 pulldown), and 29.97 content repeats each frame twice. A frame
+  is taken to repeat the one before if its FrameHash matches. The run
+  lengths between new frames are kept, and once they have followed one
+  of the cadences for LOCK_FRAMES frames the detector locks: from then
+  on the repeats the cadence predicts are dropped.
+
+  A frame is still handed on at every slot of the cadence, even if it
+  repeats the one before (a paused film), so the stream never goes
+  quiet. After STILL_SLOTS of those in a row the detector unlocks. A new
+  frame where the cadence says there should be a repeat (an edit, or
+  video content) unlocks it straight away, so no picture is ever lost.
+
+  The encoder stays at the input frame rate whether locked or not, so a
+  change of lock costs nothing: the frames kept keep their timestamps,
+  which are already on the input's frame grid, and the dropped ones
+  just leave gaps.
+*/
+class FrameRateDetector
+{
+  public:
+    struct Result
+    {
+        bool    drop      {false};  // A repeat: do not encode it
+    };
+
+    struct Cadence
+    {
+        const char*          name;
+        std::vector<int64_t> gaps;  // Input frames per picture, in turn
+    };
+
+    FrameRateDetector(int verbose_level, int input);
+
+    // A new input format; starts over, unlocked.
+    void Reset(AVRational frame_duration, size_t image_size);
+
+    Result Add(const uint8_t* image, int64_t timestamp);
+
+    bool Locked(void) const { return m_cadence != nullptr; }
+
+    // Of the pictures in the frames handed on: the input's, unless locked.
+    AVRational FrameDuration(void) const;
+
+    // At least this much cadence before locking on to it.
+    static constexpr int64_t LOCK_FRAMES = 120;
+    // Slots in a row without a new picture before unlocking: about two
+    // seconds of film.
+    static constexpr int64_t STILL_SLOTS = 48;
+
+  private:
+    const Cadence* find_cadence(size_t& phase) const;
+    bool on_cadence(int64_t gap);
+    void unlock(const char* why);
+    void log_stats(int64_t timestamp);
+
+    std::shared_ptr<spdlog::logger> m_log;
+    int         m_verbose;
+
+    AVRational  m_frame_duration {1, 0};
+    size_t      m_image_size {0};
+
+    int64_t     m_index     {-1};   // Input frames since Reset()
+    int64_t     m_last_new  {-1};
+    uint64_t    m_last_hash {0};
+    std::deque<int64_t> m_runs;     // Frames per picture, newest last
+
+    // While locked
+    const Cadence* m_cadence {nullptr};
+    size_t      m_phase       {0};  // Next gap expected
+    int64_t     m_anchor      {-1}; // Input frame of the lock
+    int64_t     m_last_slot   {-1}; // Input frame of the last slot
+    int64_t     m_stills      {0};  // Slots in a row that repeated
+
+    // This minute
+    int64_t     m_stats_start {-1};
+    int64_t     m_stats_in    {0};
+    int64_t     m_stats_out   {0};
+    int64_t     m_stats_dups  {0};
+
+    Metrics::Counter& m_dropped;
+    Metrics::Gauge&   m_encoded_fps;
+    Metrics::Gauge&   m_dup_ratio;
+};
@@ -66,6 +66,25 @@ void IEC61937Parser::Init(void)
     m_codecpar.reset();
 }
 
+/*
+  Forget everything about the previous stream, including any partial
+  burst. The next complete frame will produce fresh codec parameters.
+ */
+void IEC61937Parser::Reset(void)
+{
+    Init();
+
+    m_state = State::FIND_PA;
+    m_frameQ.clear();
+    m_stream.clear();
+    m_streamOffset = 0;
+    m_payload.clear();
+    m_payloadTarget = 0;
+    m_pc = 0;
+    m_pd = 0;
+    m_currentTimestamp = 0;
+}
+
 CodecParamsPtr
   IEC61937Parser::PushSamples(const uint8_t* data,
                               size_t size,
@@ -288,38 +307,65 @@ bool IEC61937Parser::begin_payload(void)
     }
 }
 
+void IEC61937Parser::report_dropped(const char* codec, const Stats& stats,
+                                    const char* reason)
+{
+    // A bad HDMI link can corrupt every burst; don't flood the log.
+    auto now = std::chrono::steady_clock::now();
+    if (m_verbose < 3 && now - m_lastDropReport < std::chrono::seconds(10))
+        return;
+    m_lastDropReport = now;
+
+    m_log->warn("[IEC61937] Dropped {} frame: {}. "
+                "{} corrupted, {} dropped of {} frames.",
+                codec, reason, stats.corrupted, stats.dropped, stats.frames);
+}
+
+void IEC61937Parser::LogStats(void) const
+{
+    static constexpr std::array<const char*, 2> names { "AC3", "EAC3" };
+
+    for (size_t idx = 0; idx < m_stats.size(); ++idx)
+    {
+        const Stats& st = m_stats[idx];
+        if (st.frames == 0)
+            continue;
+        m_log->info("[IEC61937] {}: {} frames, {} corrupted, {} dropped",
+                    names[idx], st.frames, st.corrupted, st.dropped);
+    }
+}
+
 void IEC61937Parser::finalize_frame(void)
 {
-    if (m_payload.size() < 2)
+    if ((m_pc & 0x1F) == TYPE_PAUSE)
     {
+        m_frameQ.push_back(Frame {
+                .timestamp = m_currentTimestamp,
+                .is_pause = true
+            });
         return;
     }
 
-    //
-    // Validate syncword
-    //
-    if (m_payload[0] != 0x0b || m_payload[1] != 0x77)
+    if (m_payload.size() < 2)
     {
-        spdlog::warn("[IEC61937] Invalid syncword");
         return;
     }
 
-    Frame frame {
-        .payload = std::move(m_payload),
-        .timestamp = m_currentTimestamp
-    };
-
+    CodecType codec_type;
+    AVCodecID codec_id;
     switch (m_pc & 0x1F)
     {
         case TYPE_AC3:
         {
-            frame.codec_id = AV_CODEC_ID_AC3;
+            codec_type = CodecType::AC3;
+            codec_id = AV_CODEC_ID_AC3;
             break;
         }
 
         case TYPE_EAC3:
         {
-            frame.codec_id = AV_CODEC_ID_EAC3;
+            codec_type = CodecType::EAC3;
+            codec_id = AV_CODEC_ID_EAC3;
             break;
         }
 
@@ -327,6 +373,53 @@ void IEC61937Parser::finalize_frame(void)
           return;
     }
 
+    const char* codec_name = (codec_type == CodecType::AC3) ? "AC3" : "EAC3";
+    Stats& stats = m_stats[codec_type == CodecType::EAC3 ? 1 : 0];
+    ++stats.frames;
+
+    //
+    // Validate syncword
+    //
+    if (m_payload[0] != 0x0b || m_payload[1] != 0x77)
+    {
+        ++stats.dropped;
+        report_dropped(codec_name, stats, "invalid syncword");
+        return;
+    }
+
+    //
+    // Validate crc1/crc2, so a burst damaged on the HDMI link never
+    // reaches the muxer.
+    //
+    switch (EAC3Parser::checkCRC(m_payload, codec_type))
+    {
+        case CRCResult::OK:
+          break;
+        case CRCResult::CRC1_ERROR:
+          ++stats.corrupted;
+          ++stats.dropped;
+          report_dropped(codec_name, stats, "crc1 mismatch");
+          return;
+        case CRCResult::CRC2_ERROR:
+          ++stats.corrupted;
+          ++stats.dropped;
+          report_dropped(codec_name, stats, "crc2 mismatch");
+          return;
+        case CRCResult::BAD_SIZE:
+          ++stats.dropped;
+          report_dropped(codec_name, stats, "truncated");
+          return;
+    }
+
+    int samples = EAC3Parser::getFrameSamples(m_payload, codec_type);
+
+    Frame frame {
+        .codec_id = codec_id,
+        .payload = std::move(m_payload),
+        .timestamp = m_currentTimestamp,
+        .samples = samples
+    };
+
     if (m_metaNeeded)
     {
         if (frame.codec_id == AV_CODEC_ID_AC3)
@@ -5,6 +5,8 @@
 #include <deque>
 #include <optional>
 #include <utility>
+#include <array>
+#include <chrono>
 #include <spdlog/spdlog.h>
 
 #include "EAC3Parser.h"
@@ -22,15 +24,25 @@ class IEC61937Parser
         AVCodecID codec_id{AV_CODEC_ID_NONE};
         std::vector<uint8_t> payload;
         int64_t timestamp { 0 };
+        int     samples   { 0 };  // Per channel; 0 for dependent frames
 
         bool is_pause { false };
     };
 
+    // Per codec frame accounting
+    struct Stats
+    {
+        uint64_t frames    {0};   // Complete bursts seen
+        uint64_t corrupted {0};   // Failed crc1/crc2
+        uint64_t dropped   {0};   // Not forwarded (corrupt or bad sync)
+    };
+
   public:
 
     IEC61937Parser(int verbose);
 
     void Init(void);
+    void Reset(void);
 
     CodecParamsPtr PushSamples(const uint8_t* data,
                                size_t size,
@@ -39,6 +51,20 @@ class IEC61937Parser
 
     std::optional<Frame> PopFrame(void);
 
+    // Start of the burst currently being assembled, if any.
+    std::optional<int64_t> PendingTimestamp(void) const
+    {
+        if (m_state == State::FIND_PA)
+            return std::nullopt;
+        return m_currentTimestamp;
+    }
+
+    const Stats& GetStats(AVCodecID codec_id) const
+    {
+        return m_stats[codec_id == AV_CODEC_ID_EAC3 ? 1 : 0];
+    }
+    void LogStats(void) const;
+
   private:
 
     enum class State
@@ -58,6 +84,8 @@ class IEC61937Parser
 
     bool begin_payload();
     void finalize_frame();
+    void report_dropped(const char* codec, const Stats& stats,
+                        const char* reason);
 
   private:
     // spdlog
@@ -94,5 +122,9 @@ class IEC61937Parser
     int64_t m_currentTimestamp { 0 };
     CodecParamsPtr m_codecpar;
 
+    // [0] AC3, [1] EAC3
+    std::array<Stats, 2> m_stats;
+    std::chrono::steady_clock::time_point m_lastDropReport;
+
     int m_verbose {0};
 };
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <iostream>
+
+#include <pthread.h>
+
+#include "LanePool.h"
+
+using namespace std;
+
+struct LanePool::Lane
+{
+    enum State { IDLE, READY, RUNNING, WAITING };
+
+    Step    step;
+    State   state   {IDLE};
+    bool    woken   {false};    // While RUNNING
+    bool    removed {false};
+    chrono::steady_clock::time_point due;   // While WAITING
+};
+
+LanePool::LanePool(const string& name, CpuPlan::Role role, int threads,
+                   chrono::milliseconds retry, int verbose_level)
+    : m_name(name)
+    , m_role(role)
+    , m_retry(retry)
+{
+    m_log = spdlog::get("app_logger");
+    if (!m_log)
+    {
+        std::cerr << "LanePool Error: Logger 'app_logger' not found!"
+                  << std::endl;
+    }
+    else if (verbose_level > 1)
+        m_log->info("{} pool: {} threads", m_name, max(threads, 1));
+
+    for (int idx = 0; idx < max(threads, 1); ++idx)
+    {
+        m_threads.emplace_back(&LanePool::run, this);
+        string thread_name = fmt::format("{}{}", m_name, idx);
+        pthread_setname_np(m_threads.back().native_handle(),
+                           thread_name.c_str());
+    }
+}
+
+LanePool::~LanePool(void)
+{
+    {
+        scoped_lock lock(m_mutex);
+        m_running = false;
+    }
+    m_work.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+LanePool::Lane* LanePool::Add(Step step)
+{
+    // The CPU plan is made once the first input starts capturing.
+    if (!m_placed.exchange(true))
+    {
+        for (size_t idx = 0; idx < m_threads.size(); ++idx)
+        {
+            string thread_name = fmt::format("{}{}", m_name, idx);
+            CpuPlan::Apply(m_threads[idx].native_handle(), m_role,
+                           thread_name.c_str());
+        }
+    }
+
+    auto lane = make_unique<Lane>();
+    lane->step = std::move(step);
+
+    scoped_lock lock(m_mutex);
+    m_lanes.push_back(std::move(lane));
+    return m_lanes.back().get();
+}
+
+void LanePool::Remove(Lane* lane)
+{
+    unique_lock lock(m_mutex);
+
+    lane->removed = true;
+    m_stepped.wait(lock, [lane] { return lane->state != Lane::RUNNING; });
+
+    erase(m_ready, lane);
+    erase(m_waiting, lane);
+    erase_if(m_lanes, [lane](const unique_ptr<Lane>& entry)
+                      { return entry.get() == lane; });
+}
+
+void LanePool::Wake(Lane* lane)
+{
+    {
+        scoped_lock lock(m_mutex);
+        switch (lane->state)
+        {
+            case Lane::READY:
+              return;
+            case Lane::RUNNING:
+              lane->woken = true;
+              return;
+            case Lane::WAITING:
+              erase(m_waiting, lane);
+              break;
+            case Lane::IDLE:
+              break;
+        }
+        if (lane->removed)
+            return;
+        lane->state = Lane::READY;
+        m_ready.push_back(lane);
+    }
+    m_work.notify_one();
+}
+
+void LanePool::run(void)
+{
+    unique_lock lock(m_mutex);
+
+    while (m_running)
+    {
+        auto now = chrono::steady_clock::now();
+        while (!m_waiting.empty() && m_waiting.front()->due <= now)
+        {
+            m_waiting.front()->state = Lane::READY;
+            m_ready.push_back(m_waiting.front());
+            m_waiting.pop_front();
+        }
+
+        if (m_ready.empty())
+        {
+            if (m_waiting.empty())
+                m_work.wait(lock);
+            else
+                m_work.wait_until(lock, m_waiting.front()->due);
+            continue;
+        }
+
+        Lane* lane = m_ready.front();
+        m_ready.pop_front();
+        lane->state = Lane::RUNNING;
+        lane->woken = false;
+
+        lock.unlock();
+        Result result = lane->step();
+        lock.lock();
+
+        if (lane->removed)
+        {
+            lane->state = Lane::IDLE;
+            m_stepped.notify_all();
+            continue;
+        }
+
+        if (result == MORE || lane->woken)
+        {
+            lane->state = Lane::READY;
+            m_ready.push_back(lane);
+            // Another thread can take it, or the lane behind it.
+            m_work.notify_one();
+        }
+        else if (result == RETRY)
+        {
+            lane->state = Lane::WAITING;
+            lane->due = chrono::steady_clock::now() + m_retry;
+            // All wait the same interval, so the newest is due last.
+            m_waiting.push_back(lane);
+        }
+        else
+            lane->state = Lane::IDLE;
+    }
+}
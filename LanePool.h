@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "CpuPlan.h"
+
+/*
+  A fixed set of threads shared by every input, in place of threads of
+  each input's own. Each input adds lanes; the work of a lane runs on
+  one pool thread at a time, so it is done in order, and the lanes with
+  work take turns.
+
+  A lane's Step does one unit of work, and says what next:
+
+  MORE   There may be more: back in line, behind the other lanes.
+  IDLE   Nothing to do: not run again until Wake().
+  RETRY  Waiting on something nothing will Wake() it for (a surface the
+         encoder has yet to free, a marker settling): run again after
+         the pool's retry interval, without holding a thread meanwhile.
+
+  A Step that blocks holds its thread, and only its thread, until it
+  returns.
+*/
+class LanePool
+{
+  public:
+    enum Result { MORE, IDLE, RETRY };
+    using Step = std::function<Result (void)>;
+
+    struct Lane;
+
+    LanePool(const std::string& name, CpuPlan::Role role, int threads,
+             std::chrono::milliseconds retry, int verbose_level);
+    ~LanePool(void);
+
+    LanePool(const LanePool&) = delete;
+    LanePool& operator=(const LanePool&) = delete;
+
+    // Idle until woken.
+    Lane* Add(Step step);
+
+    // Waits for a Step that is running to return; never run again.
+    void Remove(Lane* lane);
+
+    // The lane has work. Cheap if it is already in line, or running.
+    void Wake(Lane* lane);
+
+    int Threads(void) const { return static_cast<int>(m_threads.size()); }
+
+  private:
+    void run(void);
+
+    std::shared_ptr<spdlog::logger> m_log;
+    std::string             m_name;
+    CpuPlan::Role           m_role;
+    std::chrono::milliseconds m_retry;
+
+    std::mutex              m_mutex;
+    std::condition_variable m_work;     // A lane is in line, or due
+    std::condition_variable m_stepped;  // A Step returned
+    std::vector<std::unique_ptr<Lane>> m_lanes;
+    std::deque<Lane*>       m_ready;
+    std::deque<Lane*>       m_waiting;  // RETRY, soonest due first
+    bool                    m_running {true};
+
+    std::atomic<bool>       m_placed  {false};
+    std::vector<std::thread> m_threads;
+};
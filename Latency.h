@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <spdlog/spdlog.h>
+#ifdef SPDLOG_FMT_EXTERNAL
+#include <fmt/format.h>
+#else
+#include <spdlog/fmt/bundled/format.h>
+#endif
+
+/*
+  Glass-to-pipe latency of the video frames.
+
+  Every VideoStream::Image carries a set of CLOCK_MONOTONIC stamps, one
+  per pipeline stage, from the moment the card has finished writing it
+  into host memory until its TS packet has been handed to write(). The
+  copy worker parks a frame's stamps here under the pts it gives the
+  encoder, and they are picked back up when the packet with that pts
+  comes out of the encoder, so nothing has to ride through FFmpeg.
+
+  Only the mux thread adds to, reads and resets the histograms.
+*/
+namespace Latency
+{
+    enum Stage
+    {
+        CAPTURE,      // Frame complete in host memory
+        DEQUEUE,      // vidmgr took it off the image queue
+        COPY_START,   // A copy worker picked it up
+        COPY_END,     // Upload to the GPU surface done
+        ENCODE,       // Handed to avcodec_send_frame
+        PACKET,       // Its packet came out of avcodec_receive_packet
+        WRITE,        // av_interleaved_write_frame returned
+        NUM_STAGES
+    };
+
+    inline int64_t Now(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Stamps
+    {
+        std::array<int64_t, NUM_STAGES> ns {};
+
+        void Mark(Stage stage) { ns[stage] = Now(); }
+    };
+
+    // What the histograms measure: the time from `from` to `to`.
+    struct Interval
+    {
+        const char* name;
+        Stage       from;
+        Stage       to;
+    };
+
+    inline constexpr size_t NUM_INTERVALS = 7;
+    inline constexpr std::array<Interval, NUM_INTERVALS> INTERVALS {{
+        { "queue",    CAPTURE,    DEQUEUE    },
+        { "dispatch", DEQUEUE,    COPY_START },
+        { "copy",     COPY_START, COPY_END   },
+        { "wait",     COPY_END,   ENCODE     },
+        { "encode",   ENCODE,     PACKET     },
+        { "mux",      PACKET,     WRITE      },
+        { "total",    CAPTURE,    WRITE      }
+    }};
+
+    /*
+      Log-linear histogram of microseconds. Each power of two is split
+      into SUB buckets, so a quantile is never more than 1/SUB above
+      the true value. Values past ~35 minutes land in the last bucket.
+    */
+    class Histogram
+    {
+      public:
+        void Add(int64_t us)
+        {
+            us = std::clamp<int64_t>(us, 0, MAX_VALUE);
+            ++m_buckets[bucket(us)];
+            ++m_count;
+            m_max = std::max(m_max, us);
+        }
+
+        // Upper bound of the bucket holding the `q` quantile.
+        int64_t Quantile(double q) const
+        {
+            if (m_count == 0)
+                return 0;
+
+            uint64_t rank = static_cast<uint64_t>(q * (m_count - 1)) + 1;
+            uint64_t seen = 0;
+            for (int idx = 0; idx < BUCKETS; ++idx)
+            {
+                seen += m_buckets[idx];
+                if (seen >= rank)
+                    return std::min(upper(idx), m_max);
+            }
+            return m_max;
+        }
+
+        uint64_t Count(void) const { return m_count; }
+        int64_t  Max(void) const { return m_max; }
+
+        void Reset(void)
+        {
+            m_buckets.fill(0);
+            m_count = 0;
+            m_max   = 0;
+        }
+
+      private:
+        static constexpr int     SUB_BITS  = 3;
+        static constexpr int     SUB       = 1 << SUB_BITS;
+        static constexpr int64_t MAX_VALUE = (int64_t{1} << 31) - 1;
+        static constexpr int     BUCKETS   = (31 - SUB_BITS + 1) * SUB;
+
+        static int bucket(int64_t us)
+        {
+            if (us < SUB)
+                return static_cast<int>(us);
+            int shift = std::bit_width(static_cast<uint64_t>(us)) - 1
+                        - SUB_BITS;
+            return (shift + 1) * SUB + static_cast<int>((us >> shift) & (SUB - 1));
+        }
+
+        static int64_t upper(int idx)
+        {
+            if (idx < SUB)
+                return idx;
+            int shift = idx / SUB - 1;
+            int64_t mantissa = idx % SUB + SUB;
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+        std::array<uint64_t, BUCKETS> m_buckets {};
+        uint64_t m_count {0};
+        int64_t  m_max   {0};
+    };
+
+    class Tracker
+    {
+      public:
+        static constexpr std::chrono::seconds REPORT_INTERVAL {60};
+
+        Tracker(void) : m_window_start(std::chrono::steady_clock::now()) {}
+
+        // Copy worker: `stamps` belong to the frame sent with `pts`.
+        void Submit(int64_t pts, const Stamps& stamps)
+        {
+            std::scoped_lock lock(m_mutex);
+            m_pending[pts] = stamps;
+            // Frames the encoder never returned, e.g. across a flush.
+            while (m_pending.size() > MAX_PENDING)
+                m_pending.erase(m_pending.begin());
+        }
+
+        void Encoding(int64_t pts)
+        {
+            int64_t now = Now();
+            std::scoped_lock lock(m_mutex);
+            auto iter = m_pending.find(pts);
+            if (iter != m_pending.end())
+                iter->second.ns[ENCODE] = now;
+        }
+
+        // The packet for `pts` (encoder time base) has been received.
+        std::optional<Stamps> Received(int64_t pts)
+        {
+            int64_t now = Now();
+            std::scoped_lock lock(m_mutex);
+            auto iter = m_pending.find(pts);
+            if (iter == m_pending.end())
+                return std::nullopt;
+            Stamps stamps = iter->second;
+            m_pending.erase(iter);
+            stamps.ns[PACKET] = now;
+            return stamps;
+        }
+
+        /*
+          Mux thread: the packet has been written. Returns true once
+          REPORT_INTERVAL has passed since the last NextWindow().
+        */
+        bool Written(Stamps& stamps)
+        {
+            stamps.Mark(WRITE);
+
+            bool complete = std::ranges::all_of(stamps.ns,
+                                          [](int64_t ns) { return ns > 0; });
+            if (complete)
+            {
+                for (size_t idx = 0; idx < INTERVALS.size(); ++idx)
+                {
+                    const Interval& ival = INTERVALS[idx];
+                    int64_t us = (stamps.ns[ival.to] - stamps.ns[ival.from])
+                                 / 1000;
+                    m_window[idx].Add(us);
+                    m_lifetime[idx].Add(us);
+                }
+            }
+
+            return std::chrono::steady_clock::now() - m_window_start
+                >= REPORT_INTERVAL;
+        }
+
+        void NextWindow(void)
+        {
+            for (auto& hist : m_window)
+                hist.Reset();
+            m_window_start = std::chrono::steady_clock::now();
+        }
+
+        uint64_t Frames(void) const { return m_window.back().Count(); }
+
+        // One line for the stats log, in milliseconds.
+        std::string Summary(void) const
+        {
+            fmt::memory_buffer out;
+            fmt::format_to(std::back_inserter(out),
+                           "Latency over {} frames, p50/p99/max ms:",
+                           Frames());
+            for (size_t idx = 0; idx < INTERVALS.size(); ++idx)
+            {
+                const Histogram& hist = m_window[idx];
+                fmt::format_to(std::back_inserter(out),
+                               " {} {:.2f}/{:.2f}/{:.2f}",
+                               INTERVALS[idx].name,
+                               hist.Quantile(0.50) / 1000.0,
+                               hist.Quantile(0.99) / 1000.0,
+                               hist.Max() / 1000.0);
+            }
+            return fmt::to_string(out);
+        }
+
+        // Current window and lifetime, in microseconds.
+        std::string Json(void) const
+        {
+            fmt::memory_buffer out;
+            auto dump = [&out](const char* name,
+                               const std::array<Histogram, NUM_INTERVALS>& set)
+            {
+                fmt::format_to(std::back_inserter(out), "  \"{}\": {{\n",
+                               name);
+                for (size_t idx = 0; idx < INTERVALS.size(); ++idx)
+                {
+                    const Histogram& hist = set[idx];
+                    fmt::format_to(std::back_inserter(out),
+                                   "    \"{}\": {{ \"count\": {}, "
+                                   "\"p50_us\": {}, \"p99_us\": {}, "
+                                   "\"max_us\": {} }}{}\n",
+                                   INTERVALS[idx].name, hist.Count(),
+                                   hist.Quantile(0.50), hist.Quantile(0.99),
+                                   hist.Max(),
+                                   idx + 1 < INTERVALS.size() ? "," : "");
+                }
+                fmt::format_to(std::back_inserter(out), "  }}");
+            };
+
+            fmt::format_to(std::back_inserter(out),
+                           "{{\n  \"window_secs\": {},\n",
+                           REPORT_INTERVAL.count());
+            dump("window", m_window);
+            fmt::format_to(std::back_inserter(out), ",\n");
+            dump("lifetime", m_lifetime);
+            fmt::format_to(std::back_inserter(out), "\n}}\n");
+            return fmt::to_string(out);
+        }
+
+      private:
+        static constexpr size_t MAX_PENDING = 512;
+
+        std::mutex                  m_mutex;
+        std::map<int64_t, Stamps>   m_pending;
+
+        std::array<Histogram, NUM_INTERVALS> m_window;
+        std::array<Histogram, NUM_INTERVALS> m_lifetime;
+        std::chrono::steady_clock::time_point m_window_start;
+    };
+}
@@ -60,7 +60,11 @@
 #include "LibMWCapture/MWEcoCapture.h"
 
 #include "Magewell.h"
+#include "AudioConvert.h"
 #include "IEC61937Parser.h"
+#include "AsyncLog.h"
+#include "CpuPlan.h"
+#include "Trace.h"
 
 #ifdef USE_LIBFMT_FALLBACK
 #include <fmt/format.h>
@@ -80,6 +84,10 @@ using std::format;
 
 using namespace std;
 
+// The SDK is initialized once for every input in the process.
+static std::mutex s_sdk_mutex;
+static int        s_sdk_users {0};
+
 /**
  * @brief Get video signal status string
  * @param state Video signal state
@@ -320,7 +328,8 @@ static string GetVideoSDStandard(MWCAP_SD_VIDEO_STANDARD type)
  *
  * @note This function calls MWCaptureInitInstance() to initialize the SDK.
  */
-Magewell::Magewell(void)
+Magewell::Magewell(int input)
+    : m_input(input)
 {
     m_log = spdlog::get("app_logger");
     if (!m_log)
@@ -333,13 +342,17 @@ Magewell::Magewell(void)
         return;
     }
 
-    // Initialize the MWCapture SDK instance
-    if (!MWCaptureInitInstance())
+    // Initialize the MWCapture SDK instance, shared by every input
+    std::scoped_lock lock(s_sdk_mutex);
+    if (s_sdk_users == 0 && !MWCaptureInitInstance())
     {
         // If initialization fails, output error and set fatal flag
         m_log->error("Failed to initialize MWCapture.");
         m_fatal = true;
+        return;
     }
+    ++s_sdk_users;
+    m_sdk_user = true;
 }
 
 /**
@@ -355,8 +368,10 @@ Magewell::~Magewell(void)
     if (m_channel)
         MWCloseChannel(m_channel);
 
-    // Exit the MWCapture SDK instance
-    MWCaptureExitInstance();
+    // Exit the MWCapture SDK instance, with the last input
+    std::scoped_lock lock(s_sdk_mutex);
+    if (m_sdk_user && --s_sdk_users == 0)
+        MWCaptureExitInstance();
 }
 
 /**
@@ -596,7 +611,7 @@ void Magewell::ListInputs(void)
  * @param cnt Number of channels to wait for
  * @return true if channels are available, false otherwise
  */
-bool Magewell::WaitForInputs(int cnt) const
+bool Magewell::WaitForInputs(int cnt)
 {
     int idx = 10;
 
@@ -946,7 +961,6 @@ void Magewell::capture_audio_loop(void)
     ULONGLONG notify_status = 0;
     MWCAP_AUDIO_CAPTURE_FRAME macf;
 
-    const int half_channels = MWCAP_AUDIO_MAX_NUM_CHANNELS / 2;
     const int sample_stride = MWCAP_AUDIO_MAX_NUM_CHANNELS;
 
     if (m_verbose > 1)
@@ -1017,6 +1031,9 @@ void Magewell::capture_audio_loop(void)
                                   | (DWORD)MWCAP_NOTIFY_AUDIO_INPUT_RESET);
     }
 
+    constexpr ULONGLONG settle_bits = MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE |
+                                      MWCAP_NOTIFY_AUDIO_INPUT_RESET;
+
     // Main audio capture loop
     AudioStream::Params active_params;
     std::optional<AudioStream::Params> oParams = std::nullopt;
@@ -1027,8 +1044,19 @@ void Magewell::capture_audio_loop(void)
 
         chrono::steady_clock::time_point stable_start
             = chrono::steady_clock::now();
-        std::chrono::milliseconds duration;
+        chrono::steady_clock::time_point quiet_start = stable_start;
         AudioStream::Params params;
+        AudioStream::Params polled;
+
+        // Until the signal is usable, wake as soon as it changes.
+        auto wait_for_signal = [&](int ms)
+        {
+            wait_signal_change(notify_audio, eco_event, notify_event,
+                               settle_bits, chrono::steady_clock::now() +
+                               chrono::milliseconds(ms));
+            stable_start = chrono::steady_clock::now();
+            polled = {};
+        };
 
         while (m_running.load() == true)
         {
@@ -1041,7 +1069,7 @@ void Magewell::capture_audio_loop(void)
                     m_log->warn("cnt {}: can't get audio signal status.",
                                 err_cnt);
                 }
-                this_thread::sleep_for(chrono::milliseconds(m_frame_ms));
+                wait_for_signal(m_frame_ms);
                 continue;
             }
 
@@ -1053,7 +1081,7 @@ void Magewell::capture_audio_loop(void)
                     m_log->info("No audio signal.");
                 }
                 good_signal = false;
-                this_thread::sleep_for(chrono::milliseconds(m_frame_ms));
+                wait_for_signal(m_frame_ms);
                 continue;
             }
             good_signal = true;
@@ -1086,7 +1114,7 @@ void Magewell::capture_audio_loop(void)
                                 params.num_channels);
                 }
 
-                this_thread::sleep_for(chrono::milliseconds(m_frame_half_ms));
+                wait_for_signal(m_frame_half_ms);
                 continue;
             }
 
@@ -1107,13 +1135,22 @@ void Magewell::capture_audio_loop(void)
             if (active_params == params)
                 break;
 
-            duration = chrono::duration_cast<chrono::milliseconds>
-                       (chrono::steady_clock::now() - stable_start);
-            if (duration > m_settle_time)
+            // Settled once unchanged for SETTLE_DEBOUNCE, or regardless
+            // after m_settle_time.
+            auto now = chrono::steady_clock::now();
+            if (params != polled)
+            {
+                polled = params;
+                quiet_start = now;
+            }
+            auto settled = min(quiet_start + SETTLE_DEBOUNCE,
+                               stable_start + m_settle_time);
+            if (now >= settled)
                 break;
 
-            std::this_thread::sleep_for
-                (std::chrono::milliseconds(1));
+            if (wait_signal_change(notify_audio, eco_event, notify_event,
+                                   settle_bits, settled))
+                polled = {};
         }
 
         if (active_params != params)
@@ -1129,6 +1166,16 @@ void Magewell::capture_audio_loop(void)
 
             active_params = params;
             oParams = active_params;
+
+            if (m_recorder)
+            {
+                m_recorder->AudioFormat({
+                        .channel_valid   = audio_signal_status.wChannelValid,
+                        .lpcm            = audio_signal_status.bLPCM,
+                        .bits_per_sample = audio_signal_status.cBitsPerSample,
+                        .sample_rate     = audio_signal_status.dwSampleRate
+                    });
+            }
         }
         else
             m_log->info(" KEEPING:\n   {}", params);
@@ -1136,40 +1183,34 @@ void Magewell::capture_audio_loop(void)
         err_cnt = 0;
         buffered_frame_idx = 512;
 
-        while (m_running.load() == true)
+        if (m_audio_clock)
         {
-            // Wait for notification
-            if (m_isEco)
-            {
-                if (EcoEventWait(eco_event, m_frame_ms2) <= 0)
-                {
-                    if (m_verbose > 3)
-                        m_log->info("Waiting for audio data.");
-                    continue;
-                }
-            }
-            else
+            m_audio_clock->Reset(params.samples_per_channel * 10000000.0 /
+                                 params.sample_rate);
+        }
+
+        // Returns false once the signal has to be settled again.
+        auto on_event = [&](bool idle)
+        {
+            if (idle)
             {
-                if (MWWaitEvent(notify_event, m_frame_ms2) <= 0)
-                {
-                    if (m_verbose > 3)
-                        m_log->info("Waiting for audio data.");
-                    continue;
-                }
+                if (m_verbose > 3)
+                    m_log->info("Waiting for audio data.");
+                return m_running.load();
             }
 
             // Get notification status
             if (MW_SUCCEEDED != MWGetNotifyStatus(m_channel,
                                                   notify_audio,
                                                   &notify_status))
-                continue;
+                return true;
 
             // Can be spurious from "bad" devices (And eco capture cards).
             if (notify_status & MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE)
             {
                 if (m_verbose > 2)
                     m_log->info("AUDIO signal changed.");
-                break;
+                return false;
             }
 
             // Handle input reset
@@ -1177,12 +1218,12 @@ void Magewell::capture_audio_loop(void)
             {
                 if (m_verbose > 0)
                     m_log->info("AUDIO signal reset.");
-                break;
+                return false;
             }
 
             // Check if frame is buffered
             if (!(notify_status & MWCAP_NOTIFY_AUDIO_FRAME_BUFFERED))
-                continue;
+                return true;
 
             while (MW_ENODATA != MWCaptureAudioFrame(m_channel, &macf))
             {
@@ -1209,12 +1250,25 @@ void Magewell::capture_audio_loop(void)
                     }
                 }
 
+                if (m_recorder)
+                    m_recorder->AddAudio(macf.adwSamples, macf.llTimestamp);
+
 #ifdef DUMP_RAW_AUDIO_ALLBITS
                 fraw_all.write(reinterpret_cast<char*>(macf.adwSamples),
                                MWCAP_AUDIO_SAMPLES_PER_FRAME *
                                MWCAP_AUDIO_MAX_NUM_CHANNELS);
 #endif
 
+                // Pro: smoothed by the card clock recovery.
+                int64_t timestamp = macf.llTimestamp;
+                if (m_audio_clock)
+                {
+                    ClockSync::Frame frame = m_audio_clock->Update(timestamp);
+                    if (frame.repeat)
+                        continue;
+                    timestamp = frame.pts;
+                }
+
                 // Create audio frame buffer
 
                 /*
@@ -1226,43 +1280,13 @@ void Magewell::capture_audio_loop(void)
 
                 AudioStream::samples_t samples;
                 samples.resize(active_params.buffer_bytes);
-                uint8_t* output_ptr = samples.data();
-
-                const bool swap_bytes = !params.is_lpcm;
-
-                for (int pair = 0; pair < channel_pairs; ++pair)
-                {
-                    const uint32_t* left_samples = &macf.adwSamples[pair];
-                    const uint32_t* right_samples = &macf.adwSamples[pair + half_channels];
-
-                    for (int sample = 0;
-                         sample < MWCAP_AUDIO_SAMPLES_PER_FRAME; ++sample)
-                    {
-                        uint32_t left_raw = left_samples[sample * sample_stride];
-                        uint32_t right_raw = right_samples[sample * sample_stride];
 
-                        uint32_t left_val = left_raw >> shift;
-                        uint32_t right_val = right_raw >> shift;
-
-                        // Assume bitstream will always be 16bit for
-                        // efficient swapping.
-                        if (swap_bytes)
-                        {
-                            left_val  = ((left_val  & 0x00FF) << 8)
-                                        | ((left_val  & 0xFF00) >> 8);
-                            right_val = ((right_val & 0x00FF) << 8)
-                                        | ((right_val & 0xFF00) >> 8);
-                        }
-
-                        /* For 32-bit samples (LPCM), we copy 4 bytes,
-                         * for 16-bit samples (Bitstream), we copy 2 bytes
-                         */
-                        std::memcpy(output_ptr, &left_val, even_bytes_per_sample);
-                        output_ptr += even_bytes_per_sample;
-                        std::memcpy(output_ptr, &right_val, even_bytes_per_sample);
-                        output_ptr += even_bytes_per_sample;
-                    }
-                }
+                AudioConvert::Deinterleave(macf.adwSamples, channel_pairs,
+                                           MWCAP_AUDIO_SAMPLES_PER_FRAME,
+                                           sample_stride, shift,
+                                           !params.is_lpcm,
+                                           even_bytes_per_sample,
+                                           samples.data());
 
 #if defined(DUMP_RAW_AUDIO)
                 // od --endian=big -t x4
@@ -1271,13 +1295,34 @@ void Magewell::capture_audio_loop(void)
 #endif
                 AudioStream::Samples audio = {
                     .data        = samples,
-                    .timestamp   = macf.llTimestamp,
+                    .timestamp   = timestamp,
                     .oParams = std::move(oParams)
                 };
 
                 m_out2ts->AddAudioSamples(std::move(audio));
                 oParams.reset();
             }
+            return m_running.load();
+        };
+
+        if (m_isEco)
+        {
+            // Picked up by the reactor thread along with the video.
+            m_reactor->Run(eco_event, on_event,
+                           chrono::milliseconds(m_frame_ms2));
+            continue;
+        }
+
+        while (m_running.load() == true)
+        {
+            // Wait for notification
+            if (MWWaitEvent(notify_event, m_frame_ms2) <= 0)
+            {
+                on_event(true);
+                continue;
+            }
+            if (!on_event(false))
+                break;
         }
     }
 
@@ -1317,6 +1362,30 @@ void Magewell::capture_audio(void)
     Shutdown();
 }
 
+/**
+ * @brief Field order of the interlaced input
+ *
+ * The signal status does not carry it, so it is read from the newest
+ * frame the card has buffered. ECO cards have no frame info, and are
+ * taken to be top field first.
+ *
+ * @return true if the top field is captured first
+ */
+bool Magewell::top_field_first(void)
+{
+    if (m_isEco)
+        return true;
+
+    MWCAP_VIDEO_BUFFER_INFO buffer_info;
+    MWCAP_VIDEO_FRAME_INFO  frame_info;
+    if (MWGetVideoBufferInfo(m_channel, &buffer_info) != MW_SUCCEEDED ||
+        MWGetVideoFrameInfo(m_channel, buffer_info.iNewestBufferedFullFrame,
+                            &frame_info) != MW_SUCCEEDED)
+        return true;
+
+    return frame_info.bTopFieldFirst;
+}
+
 bool Magewell::get_colorspace(MWCAP_VIDEO_SIGNAL_STATUS signal_status,
                               VideoStream::ColorSpace& color)
 {
@@ -1616,8 +1685,8 @@ size_t Magewell::AllocateImageBuffers(void)
                  "(aligned to {}), Total allocation: {} KB",
                  m_image_size, m_aligned_image_size, total_bytes / 1024);
 
-    // Use standard byte array allocation
-    m_image_buffer = std::make_unique<uint8_t[]>(total_bytes);
+    // Page aligned, so frames can also be written with O_DIRECT
+    m_image_buffer = RawCapture::AllocAligned(total_bytes);
     if (m_image_buffer == nullptr)
     {
         m_log->critical("Failed to allocate {} bytes for "
@@ -1625,6 +1694,11 @@ size_t Magewell::AllocateImageBuffers(void)
         return 0;
     }
 
+    if (m_recorder)
+        m_image_refs = std::make_unique<std::atomic<int>[]>(m_image_buffers);
+    if (m_low_latency)
+        m_image_rows = std::make_unique<VideoStream::Rows[]>(m_image_buffers);
+
     return total_bytes;
 }
 
@@ -1636,6 +1710,71 @@ uint8_t* Magewell::GetFrameImage(size_t frame_index)
     return m_image_buffer.get() + (frame_index * m_aligned_image_size);
 }
 
+size_t Magewell::image_index(const uint8_t* pbImage) const
+{
+    return (pbImage - m_image_buffer.get()) / m_aligned_image_size;
+}
+
+/**
+ * @brief Return an image buffer once every user is done with it
+ *
+ * When recording, both the encoder and the raw recorder hold the
+ * buffer; the last one to let go returns it to the card. In low-latency
+ * capture the encoder can drop a frame the card is still writing; the
+ * buffer is then returned once the capture is done.
+ *
+ * @param pbImage Pointer to image buffer
+ * @param buf Context buffer
+ */
+void Magewell::release_image(uint8_t* pbImage, void* buf)
+{
+    if (m_recorder && --m_image_refs[image_index(pbImage)] > 0)
+        return;
+
+    if (m_isEco)
+    {
+        eco_image_buffer_available(pbImage, buf);
+        return;
+    }
+
+    if (m_low_latency)
+    {
+        // Still being written to; returned once the card is done.
+        std::scoped_lock lock(m_pro_mutex);
+        for (auto* captures : { &m_pro_captures, &m_pro_late })
+        {
+            auto iter = ranges::find(*captures, pbImage,
+                                     &ProCapture::pbImage);
+            if (iter != captures->end())
+            {
+                iter->released = true;
+                return;
+            }
+        }
+    }
+    pro_image_buffer_available(pbImage, buf);
+}
+
+/**
+ * @brief Hand a captured frame to the raw recorder, if recording
+ *
+ * Must be called before the frame is handed to the encoder.
+ *
+ * @param pbImage Pointer to image buffer
+ * @param timestamp Card timestamp of the frame
+ * @param buf Context buffer
+ */
+void Magewell::record_video(uint8_t* pbImage, int64_t timestamp, void* buf)
+{
+    if (!m_recorder)
+        return;
+
+    std::atomic<int>& refs = m_image_refs[image_index(pbImage)];
+    refs = 2;
+    if (!m_recorder->AddVideo(pbImage, m_image_size, timestamp, buf))
+        refs = 1;
+}
+
 /**
  * @brief Handle available image buffer for PRO capture
  *
@@ -1685,6 +1824,10 @@ void Magewell::free_image_buffers(void)
 {
     m_log->info("free_image_buffers");
 
+    // The recorder may still be writing from them.
+    if (m_recorder)
+        m_recorder->Flush();
+
     std::unique_lock<std::mutex> lock(m_image_buffer_mutex);
 
     // Wait until all buffers are returned from the processing pipeline
@@ -1788,6 +1931,8 @@ bool Magewell::create_eco_image_buffers(void)
         buf->cbFrame   = m_image_size;
         buf->cbStride  = m_min_stride;
         buf->bBottomUp = false;
+        // Interlaced frames stay woven; VideoStream deinterlaces them.
+        buf->deinterlaceMode = MWCAP_VIDEO_DEINTERLACE_WEAVE;
     }
 
     // Allocate memory using the byte-aligned architecture
@@ -2003,6 +2148,9 @@ void Magewell::log_stats(size_t used)
     chrono::steady_clock::time_point current_tm;
     int duration;
 
+    m_buffers_used.Set(used);
+    m_buffers_total.Set(m_image_buffers_total);
+
     if (vidpool_used_1m < used)
         vidpool_used_1m = used;
     if (vidpool_used_5m[vidpool_5m_idx] < used)
@@ -2019,6 +2167,10 @@ void Magewell::log_stats(size_t used)
         vidpool_5m_max  = ranges::max_element(vidpool_used_5m);
         vidpool_10m_max = ranges::max_element(vidpool_used_10m);
 
+        uint temperature;
+        MWGetTemperature(m_channel, &temperature);
+        m_temperature.Set(static_cast<double>(temperature) / 10);
+
         string extra;
         if (tok)
         {
@@ -2030,8 +2182,6 @@ void Magewell::log_stats(size_t used)
         }
         else
         {
-            uint temperature;
-            MWGetTemperature(m_channel, &temperature);
             extra = format("Temp {:.1f}ºC",
                            static_cast<float>(temperature) / 10);
             tok = true;
@@ -2069,7 +2219,9 @@ void Magewell::log_stats(size_t used)
 /**
  * @brief Capture video using ECO capture method
  *
- * Main video capture loop for ECO capture mode.
+ * Main video capture loop for ECO capture mode. The frames are picked
+ * up on the reactor thread; this thread sleeps until the signal is
+ * lost.
  *
  * @param eco_params ECO capture parameters
  * @param eco_event ECO event handle
@@ -2101,25 +2253,22 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
 
     int used        {0};
 
-    // Main capture loop
-    while (m_running.load() == true)
-    {
-        // Wait for notification
-        if (EcoEventWait(eco_event, -1) <= 0)
-        {
-            continue;
-        }
+    bool lost_sync = false;
 
+    // Called by the reactor thread for each notification.
+    auto on_event = [&](bool /*idle*/)
+    {
         // Get notification status
         if (MW_SUCCEEDED != MWGetNotifyStatus(m_channel, video_notify,
                                               &ullStatusBits))
         {
             if (m_verbose > 0)
             {
-                m_log->warn("Failed to get Notify status (frame {})",
+                LOG_LIMITED(m_log, spdlog::level::warn,
+                            "Failed to get Notify status (frame {})",
                             m_frame_cnt);
             }
-            continue;
+            return true;
         }
 
         // Handle signal change
@@ -2127,12 +2276,13 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
         {
             if (m_frame_cnt > 2000)
                 m_log->warn("DAMAGED: Eco lost video sync.");
+            lost_sync = true;
             return false;
         }
 
         if (!(ullStatusBits & MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED))
         {
-            continue;
+            return true;
         }
 
         // Get capture status
@@ -2150,25 +2300,29 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
                     m_log->warn("DAMAGED: Video signal lost lock. (frame {})",
                                 m_frame_cnt);
                 }
-                this_thread::sleep_for(chrono::milliseconds(5));
+                lost_sync = true;
                 return false;
             }
 
-            continue;
+            return true;
         }
 
         // Process frame
+        Latency::Stamps stamps;
+        stamps.Mark(Latency::CAPTURE);
         pbImage = reinterpret_cast<uint8_t *>(eco_status.pvFrame);
         timestamp = eco_status.llTimestamp;
         ++m_frame_cnt;
         --m_image_buffers_avail;
+        m_frames_captured.Inc();
+        first_frame_captured();
         used = m_image_buffers_total - m_image_buffers_avail;
 
         if (m_expected_ts == -1 && timestamp < 0)
         {
             eco_image_buffer_available(pbImage,
                                 reinterpret_cast<void*>(eco_status.pvContext));
-            continue;
+            return true;
         }
         else if (m_expected_ts > 0 &&
                  (timestamp < m_expected_ts - eighth_dur ||
@@ -2177,7 +2331,8 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
             if (timestamp < 0)
             {
                 if (m_verbose > 0)
-                    m_log->warn("Invalid ECO timestamp: {}", timestamp);
+                    LOG_LIMITED(m_log, spdlog::level::warn,
+                                "Invalid ECO timestamp: {}", timestamp);
                 timestamp = m_expected_ts;
             }
             else if (timestamp < m_expected_ts)
@@ -2215,9 +2370,11 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
                         else
                         {
                             skipped_frame_cnt += skipped;
+                            m_frames_skipped.Inc(lround(skipped));
                             if (skipped_frame_cnt > 1 && m_frame_cnt > 2000)
                             {
-                                m_log->warn("DAMAGED: Magewell lost {:.0f} "
+                                LOG_LIMITED(m_log, spdlog::level::warn,
+                                            "DAMAGED: Magewell lost {:.0f} "
                                             "video frames, "
                                             "have skipped {:.0f} (frame {})",
                                             skipped, skipped_frame_cnt,
@@ -2225,7 +2382,8 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
                             }
                             else
                             {
-                                m_log->warn("Magewell lost {:.0f} video "
+                                LOG_LIMITED(m_log, spdlog::level::warn,
+                                            "Magewell lost {:.0f} video "
                                             "frames, have skipped {:.0f} (frame {})",
                                             skipped, skipped_frame_cnt,
                                             m_frame_cnt);
@@ -2238,17 +2396,22 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
                                      skipped);
                 }
                 else
-                    m_log->warn("timestamp {} >>>> {} expected.",
+                    LOG_LIMITED(m_log, spdlog::level::warn,
+                                "timestamp {} >>>> {} expected.",
                                 timestamp, m_expected_ts);
             }
         }
         m_expected_ts = timestamp + eco_params.llFrameDuration;
 
+        record_video(pbImage, eco_status.llTimestamp,
+                     reinterpret_cast<void*>(eco_status.pvContext));
+
         VideoStream::Image image = {
             .pImage = pbImage,
             .timestamp = timestamp + timestamp_adj,
             .pEco = reinterpret_cast<void*>(eco_status.pvContext),
-            .oParams = std::move(oParams)
+            .oParams = std::move(oParams),
+            .stamps = stamps
         };
         oParams.reset();
 
@@ -2256,9 +2419,12 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
         m_out2ts->AddVideoImage(std::move(image));
 
         log_stats(used);
-    }
+        return m_running.load();
+    };
 
-    return true;
+    m_reactor->Run(eco_event, on_event);
+
+    return !lost_sync;
 }
 
 /**
@@ -2269,7 +2435,6 @@ bool Magewell::capture_eco_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
  * @param eco_params ECO capture parameters
  * @param video_notify Video notification handle
  * @param notify_event Notification event handle
- * @param capture_event Capture event handle
  * @param frame_wrap_idx Frame wrap index
  * @param event_mask Event mask
  * @param ullStatusBits Status bits
@@ -2281,29 +2446,20 @@ bool Magewell::capture_pro_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
                                  std::optional<VideoStream::Params>&& oParams,
                                  HNOTIFY video_notify,
                                  MWCAP_PTR notify_event,
-                                 MWCAP_PTR capture_event,
                                  int frame_wrap_idx,
                                  DWORD event_mask,
                                  ULONGLONG ullStatusBits)
 {
     int frame_idx  = -1;
 
-    uint8_t* pbImage = nullptr;
     int64_t  timestamp = -1;
-    int64_t  desired_ts  = -1;
-    int64_t  min_ts = -1;
-    int      min_idx = -1;
-    int      skipped_frame_cnt = 0;
-    int      skipped = 0;
-
-    int      eighth_dur = eco_params.llFrameDuration / 8;
+    int64_t  skipped_frame_cnt = 0;
 
     MWCAP_VIDEO_BUFFER_INFO   videoBufferInfo;
     MWCAP_VIDEO_FRAME_INFO    videoFrameInfo;
     MWCAP_VIDEO_SIGNAL_STATUS videoSignalStatus;
-    MW_RESULT result;
 
-    int used = 0;
+    m_video_clock->Reset(eco_params.llFrameDuration);
 
     // Main capture loop
     while (m_running.load() == true)
@@ -2322,10 +2478,12 @@ bool Magewell::capture_pro_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
         }
 
         // Wait for notification
+        Trace::Span wait_span("capture wait");
         if (MWWaitEvent(notify_event, m_frame_ms) <= 0)
         {
             continue;
         }
+        wait_span.End();
 
         // Get notification status
         if (MW_SUCCEEDED != MWGetNotifyStatus(m_channel, video_notify,
@@ -2333,7 +2491,8 @@ bool Magewell::capture_pro_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
         {
             if (m_verbose > 0)
             {
-                m_log->warn("Failed to get Notify status (frame {})",
+                LOG_LIMITED(m_log, spdlog::level::warn,
+                            "Failed to get Notify status (frame {})",
                             m_frame_cnt);
             }
             continue;
@@ -2351,13 +2510,25 @@ bool Magewell::capture_pro_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
         if ((ullStatusBits & event_mask) == 0)
             continue;
 
+        if (m_low_latency)
+        {
+            // Capture the frame the card is receiving right now.
+            if ((ullStatusBits & MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING) == 0 ||
+                !buffering_frame(eco_params, frame_idx, timestamp))
+                continue;
+            if (!issue_pro_capture(frame_idx, timestamp, oParams, eco_params))
+                return false;
+            continue;
+        }
+
         // Get buffer info
         if (MW_SUCCEEDED != MWGetVideoBufferInfo(m_channel,
                                                  &videoBufferInfo))
         {
             if (m_verbose > 0)
             {
-                m_log->warn("Failed to get video buffer info (frame {})",
+                LOG_LIMITED(m_log, spdlog::level::warn,
+                            "Failed to get video buffer info (frame {})",
                             m_frame_cnt);
             }
             continue;
@@ -2380,154 +2551,630 @@ bool Magewell::capture_pro_video(MWCAP_VIDEO_ECO_CAPTURE_OPEN eco_params,
         {
             if (m_verbose > 0)
             {
-                m_log->warn("Failed to get video frame info (frame {})",
+                LOG_LIMITED(m_log, spdlog::level::warn,
+                            "Failed to get video frame info (frame {})",
                             m_frame_cnt);
             }
             continue;
         }
 
         timestamp = videoFrameInfo.allFieldBufferedTimes[0];
-        if (m_expected_ts >= 0 &&
-            (timestamp == -1 ||
-             (timestamp < m_expected_ts - eighth_dur ||
-              m_expected_ts + eighth_dur < timestamp)))
-        {
-            bool found = false;
-
-            if (timestamp == -1)
-            {
-                min_idx = -1;
-                min_ts  = numeric_limits<std::int64_t>::max();
-            }
-            else
-            {
-                min_idx = frame_idx;
-                min_ts  = timestamp;
-            }
-            desired_ts = m_expected_ts - eighth_dur;
-
-            // Find the earliest, valid TS
-            for (int i = 0; i < frame_wrap_idx; ++i)
-            {
-                // Get frame info
-                if (MWGetVideoFrameInfo(m_channel, i,
-                                        &videoFrameInfo) != MW_SUCCEEDED)
-                {
-                    if (m_verbose > 0)
-                    {
-                        m_log->warn("Failed to get video frame info (frame {})",
-                                    i);
-                    }
-                    continue;
-                }
-                if (videoFrameInfo.allFieldBufferedTimes[0] > desired_ts &&
-                    videoFrameInfo.allFieldBufferedTimes[0] < min_ts)
-                {
-                    min_ts = videoFrameInfo.allFieldBufferedTimes[0];
-                    min_idx = i;
-                    found = true;
-                }
-            }
-            if (!found)
+        if (m_video_clock->Locked() && !m_video_clock->Due(timestamp))
+        {
+            // Not the frame after the last one. How far the newest frame
+            // is from it says which buffer holds it, if any still does.
+            int newest = videoBufferInfo.iNewestBufferedFullFrame;
+            if (MWGetVideoFrameInfo(m_channel, newest,
+                                    &videoFrameInfo) != MW_SUCCEEDED ||
+                videoFrameInfo.allFieldBufferedTimes[0] < 0)
             {
                 if (m_verbose > 3)
                     m_log->info("None of the MW card buffers are valid.");
                 break;
             }
+            frame_idx = newest;
+            timestamp = videoFrameInfo.allFieldBufferedTimes[0];
+
+            int64_t ahead = m_video_clock->Periods(timestamp);
+            if (ahead < 0)
+                continue;       // Nothing new yet
 
-            skipped = (min_ts - m_expected_ts) / eco_params.llFrameDuration;
-            if (skipped > 0)
+            // Frames lost to the ring wrapping are gone; take the oldest.
+            int back = static_cast<int>(min<int64_t>(ahead,
+                                                     frame_wrap_idx - 1));
+            if (back > 0)
             {
-                skipped_frame_cnt += skipped;
-                if (skipped_frame_cnt > 1 && m_frame_cnt > 2000)
+                int idx = (newest - back + frame_wrap_idx) % frame_wrap_idx;
+                if (MWGetVideoFrameInfo(m_channel, idx,
+                                        &videoFrameInfo) == MW_SUCCEEDED &&
+                    videoFrameInfo.allFieldBufferedTimes[0] >= 0 &&
+                    m_video_clock->Periods
+                    (videoFrameInfo.allFieldBufferedTimes[0]) >= 0)
                 {
-                    m_log->warn("DAMAGED: Magewell lost {} video frames. "
-                                "Have skipped {} (frame {})",
-                                skipped, skipped_frame_cnt, m_frame_cnt);
+                    frame_idx = idx;
+                    timestamp = videoFrameInfo.allFieldBufferedTimes[0];
                 }
             }
-
-            frame_idx = min_idx;
-            timestamp = min_ts;
         }
 
-        // Get available buffer
+        ClockSync::Frame frame = m_video_clock->Update(timestamp,
+                                                       Latency::Now());
+        if (frame.repeat)
+            continue;
+        if (frame.relock && m_verbose > 0)
         {
-            unique_lock<mutex> lock(m_image_buffer_mutex);
-            while (m_avail_image_buffers.empty())
+            LOG_LIMITED(m_log, spdlog::level::warn,
+                        "Card clock jumped by {} frames (frame {})",
+                        (timestamp - m_expected_ts) /
+                        eco_params.llFrameDuration, m_frame_cnt);
+        }
+        if (frame.lost > 0)
+        {
+            skipped_frame_cnt += frame.lost;
+            m_frames_skipped.Inc(frame.lost);
+            if (skipped_frame_cnt > 1 && m_frame_cnt > 2000)
             {
-                m_image_returned.wait_for(lock,
-                                          chrono::milliseconds(4));
-                if (m_running.load() == false)
-                    return true;
+                LOG_LIMITED(m_log, spdlog::level::warn,
+                            "DAMAGED: Magewell lost {} video frames. "
+                            "Have skipped {} (frame {})",
+                            frame.lost, skipped_frame_cnt, m_frame_cnt);
             }
-            pbImage = m_avail_image_buffers.front();
-            m_avail_image_buffers.pop_front();
+        }
 
-            used = m_image_buffers_total - m_avail_image_buffers.size();
+        if (!issue_pro_capture(frame_idx, frame.pts, oParams, eco_params))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Low latency: pick the frame the card is receiving now
+ *
+ * @param eco_params ECO capture parameters
+ * @param frame_idx Set to the card's frame index
+ * @param timestamp Set to when its last line will have arrived, which
+ *                  is what a buffered frame is stamped with
+ *
+ * @return false if there is no new frame to capture
+ */
+bool Magewell::buffering_frame(const MWCAP_VIDEO_ECO_CAPTURE_OPEN& eco_params,
+                               int& frame_idx, int64_t& timestamp)
+{
+    MWCAP_VIDEO_BUFFER_INFO videoBufferInfo;
+    MWCAP_VIDEO_FRAME_INFO  videoFrameInfo;
+
+    if (MWGetVideoBufferInfo(m_channel, &videoBufferInfo) != MW_SUCCEEDED ||
+        MWGetVideoFrameInfo(m_channel, videoBufferInfo.iNewestBuffering,
+                            &videoFrameInfo) != MW_SUCCEEDED ||
+        videoFrameInfo.allFieldStartTimes[0] < 0)
+    {
+        if (m_verbose > 0)
+        {
+            LOG_LIMITED(m_log, spdlog::level::warn,
+                        "Failed to get buffering frame info (frame {})",
+                        m_frame_cnt);
         }
+        return false;
+    }
 
-        // Capture frame to virtual address
-        result = MWCaptureVideoFrameToVirtualAddress
+    frame_idx = videoBufferInfo.iNewestBuffering;
+
+    ClockSync::Frame frame = m_video_clock->Update
+                             (videoFrameInfo.allFieldStartTimes[0] +
+                              eco_params.llFrameDuration, Latency::Now());
+    // Notified twice for the same frame.
+    if (frame.repeat)
+        return false;
+    if (frame.lost > 0)
+    {
+        m_frames_skipped.Inc(frame.lost);
+        if (m_frame_cnt > 2000)
+        {
+            LOG_LIMITED(m_log, spdlog::level::warn,
+                        "DAMAGED: Magewell lost {} video frames. "
+                        "(frame {})", frame.lost, m_frame_cnt);
+        }
+    }
+    timestamp = frame.pts;
+
+    return true;
+}
+
+/**
+ * @brief Take an image buffer and start capturing a frame into it
+ *
+ * In low-latency capture the image is handed to the encoder straight
+ * away, and its copy workers follow the lines in as the card writes
+ * them.
+ *
+ * @param frame_idx The card's frame index
+ * @param timestamp Card timestamp of the frame
+ * @param oParams New stream parameters, handed on with the frame
+ * @param eco_params ECO capture parameters
+ *
+ * @return false if the card refused the capture
+ */
+bool Magewell::issue_pro_capture(int frame_idx, int64_t timestamp,
+                                 std::optional<VideoStream::Params>& oParams,
+                                 const MWCAP_VIDEO_ECO_CAPTURE_OPEN& eco_params)
+{
+    uint8_t* pbImage;
+    size_t   used;
+
+    // Get available buffer
+    {
+        unique_lock<mutex> lock(m_image_buffer_mutex);
+        while (m_avail_image_buffers.empty())
+        {
+            m_image_returned.wait_for(lock,
+                                      chrono::milliseconds(4));
+            if (m_running.load() == false)
+                return true;
+        }
+        pbImage = m_avail_image_buffers.front();
+        m_avail_image_buffers.pop_front();
+        --m_image_buffers_avail;
+
+        used = m_image_buffers_total - m_avail_image_buffers.size();
+    }
+
+    ++m_frame_cnt;
+    m_expected_ts = timestamp + eco_params.llFrameDuration;
+
+    VideoStream::Rows* rows = nullptr;
+    if (m_low_latency)
+    {
+        rows = &m_image_rows[image_index(pbImage)];
+        rows->done.store(0, std::memory_order_relaxed);
+    }
+
+    // Start the DMA; the viddma thread picks up its completion, so
+    // this thread is back waiting for the next frame right away.
+    if (!queue_pro_capture(ProCapture {
+                .pbImage   = pbImage,
+                .frame_idx = frame_idx,
+                .timestamp = timestamp,
+                .used      = used,
+                .rows      = static_cast<int>(eco_params.cy),
+                .oParams   = m_low_latency
+                             ? std::optional<VideoStream::Params>()
+                             : std::move(oParams)
+            }, eco_params))
+    {
+        if (m_running.load() == false)
+            return true;
+
+        m_frames_dropped.Inc();
+        if (m_verbose > 0)
+        {
+            m_log->warn("Damaged: Failed to retrieve next frame "
+                        "[{}] (processed {})", frame_idx, m_frame_cnt);
+        }
+        return false;
+    }
+
+    if (m_low_latency)
+    {
+        VideoStream::Image image = {
+            .pImage = pbImage,
+            .timestamp = timestamp,
+            .pEco = nullptr,
+            .oParams = std::move(oParams),
+            .rows = rows
+        };
+        m_out2ts->AddVideoImage(std::move(image));
+    }
+    oParams.reset();
+
+    return true;
+}
+
+/**
+ * @brief Start the DMA of a frame, without waiting for it
+ *
+ * Up to PRO_CAPTURES_MAX captures are kept in flight, so the next one
+ * is already queued on the card while the previous DMA completes. A
+ * sequence number is handed to the card as the capture's context, which
+ * identifies it again when the card reports it complete; the image
+ * buffer would also match a later capture into the same buffer, once a
+ * capture given up on has been reported late. In low-latency
+ * capture the card also reports each slice of LOW_LATENCY_SLICES as it
+ * is written.
+ *
+ * @param capture The frame and the image buffer it goes to
+ * @param eco_params ECO capture parameters
+ *
+ * @return false if not queued: refused, or shutting down. The image
+ *         buffer has been returned.
+ */
+bool Magewell::queue_pro_capture(ProCapture&& capture,
+                                 const MWCAP_VIDEO_ECO_CAPTURE_OPEN& eco_params)
+{
+    uint8_t* pbImage   = capture.pbImage;
+    int      frame_idx = capture.frame_idx;
+    uint64_t seq;
+
+    {
+        unique_lock<mutex> lock(m_pro_mutex);
+        while (m_pro_captures.size() >= PRO_CAPTURES_MAX)
+        {
+            m_pro_done.wait_for(lock, chrono::milliseconds(4));
+            if (m_running.load() == false)
+            {
+                lock.unlock();
+                pro_image_buffer_available(pbImage, nullptr);
+                return false;
+            }
+        }
+
+        // New parameters replace any a lost capture left behind.
+        if (capture.oParams)
+            m_pro_params.reset();
+        else if (m_pro_params)
+            capture.oParams = std::exchange(m_pro_params, std::nullopt);
+
+        capture.issued = chrono::steady_clock::now();
+        capture.seq = seq = ++m_pro_seq;
+        m_pro_captures.push_back(std::move(capture));
+    }
+
+    // May complete on the viddma thread before this even returns.
+    MW_RESULT result;
+    if (m_low_latency || m_interlaced)
+    {
+        // The fields are kept woven; VideoStream deinterlaces them.
+        int slice = m_low_latency
+                    ? (eco_params.cy / LOW_LATENCY_SLICES + 15) & ~15
+                    : 0;
+        result = MWCaptureVideoFrameToVirtualAddressEx
                  (m_channel,
                   frame_idx,
                   reinterpret_cast<MWCAP_PTR>(pbImage),
                   m_image_size,
                   m_min_stride,
                   0,
+                  static_cast<MWCAP_PTR64>(seq),
+                  eco_params.dwFOURCC,
+                  eco_params.cx,
+                  eco_params.cy,
+                  0,                    // No processing
+                  slice,
+                  0, nullptr, 0,        // No OSD
+                  0, 0, 0, 0,           // Contrast, brightness, ...
+                  m_interlaced ? MWCAP_VIDEO_DEINTERLACE_WEAVE
+                               : MWCAP_VIDEO_DEINTERLACE_BLEND,
+                  MWCAP_VIDEO_ASPECT_RATIO_IGNORE,
+                  nullptr, nullptr,     // Whole frame, unscaled
+                  0, 0,
+                  MWCAP_VIDEO_COLOR_FORMAT_UNKNOWN,
+                  MWCAP_VIDEO_QUANTIZATION_UNKNOWN,
+                  MWCAP_VIDEO_SATURATION_UNKNOWN);
+    }
+    else
+    {
+        result = MWCaptureVideoFrameToVirtualAddress
+                 (m_channel,
+                  frame_idx,
+                  reinterpret_cast<MWCAP_PTR>(pbImage),
+                  m_image_size,
+                  m_min_stride,
                   0,
+                  static_cast<MWCAP_PTR64>(seq),
                   eco_params.dwFOURCC,
                   eco_params.cx,
                   eco_params.cy);
+    }
+    if (result == MW_SUCCEEDED)
+        return true;
 
-        ++m_frame_cnt;
-        --m_image_buffers_avail;
+    {
+        scoped_lock lock(m_pro_mutex);
+        auto iter = ranges::find(m_pro_captures, seq, &ProCapture::seq);
+        if (iter != m_pro_captures.end())
+            m_pro_captures.erase(iter);
+    }
+    m_pro_done.notify_all();
+    pro_image_buffer_available(pbImage, nullptr);
+    return false;
+}
+
+/**
+ * @brief Completion thread: hand finished Pro captures to the encoder
+ *
+ * One signal of the capture event may stand for several completed
+ * DMAs, so everything issued before the capture the card reports last
+ * is complete, and so is that one unless only some of its lines are.
+ * A capture still outstanding after PRO_DMA_TIMEOUT is counted lost,
+ * but its buffer is only returned once the card reports that capture,
+ * or a later one, done; until then the card may still write to it.
+ *
+ * @param capture_event Event the card signals as each DMA completes
+ */
+void Magewell::complete_pro_captures(MWCAP_PTR capture_event)
+{
+    MWCAP_VIDEO_CAPTURE_STATUS captureStatus;
+    vector<ProCapture> done;
+    vector<ProCapture> lost;
+    vector<ProCapture> late;
+
+    while (m_dma_running.load())
+    {
+        bool signaled = MWWaitEvent(capture_event, 20) > 0;
 
-        if (result != MW_SUCCEEDED)
+        auto now = chrono::steady_clock::now();
         {
-            if (m_verbose > 0)
+            scoped_lock lock(m_pro_mutex);
+
+            if (signaled &&
+                MWGetVideoCaptureStatus(m_channel,
+                                        &captureStatus) == MW_SUCCEEDED)
             {
+                uint64_t seq = captureStatus.pvContext;
+                while (!m_pro_late.empty() &&
+                       (m_pro_late.front().seq < seq ||
+                        (m_pro_late.front().seq == seq &&
+                         captureStatus.bFrameCompleted)))
                 {
-                    m_log->warn("Damaged: Failed to retrieve next frame "
-                                "[{}] (processed {})", frame_idx, m_frame_cnt);
+                    late.push_back(std::move(m_pro_late.front()));
+                    m_pro_late.pop_front();
+                }
+
+                auto iter = ranges::find(m_pro_captures, seq,
+                                         &ProCapture::seq);
+                // Not found: a late signal for captures already handled.
+                if (iter != m_pro_captures.end())
+                {
+                    if (captureStatus.bFrameCompleted)
+                        ++iter;
+                    else if (m_low_latency)
+                    {
+                        VideoStream::Rows& rows =
+                            m_image_rows[image_index(iter->pbImage)];
+                        rows.done.store(captureStatus.cyCompleted,
+                                        std::memory_order_release);
+                        rows.done.notify_all();
+                    }
+                    move(m_pro_captures.begin(), iter,
+                         back_inserter(done));
+                    m_pro_captures.erase(m_pro_captures.begin(), iter);
                 }
             }
-            pro_image_buffer_available(pbImage, nullptr);
-            return false;
+
+            while (!m_pro_captures.empty() &&
+                   now - m_pro_captures.front().issued > PRO_DMA_TIMEOUT)
+            {
+                ProCapture& capture = m_pro_captures.front();
+
+                // The encoder still needs the new parameters.
+                if (capture.oParams)
+                {
+                    if (m_pro_captures.size() > 1 &&
+                        !m_pro_captures[1].oParams)
+                        m_pro_captures[1].oParams = std::move(capture.oParams);
+                    else
+                        m_pro_params = std::move(capture.oParams);
+                    capture.oParams.reset();
+                }
+                // Only the encoder ever had a low-latency capture.
+                if (!m_low_latency)
+                    capture.released = true;
+                lost.push_back(capture);
+                m_pro_late.push_back(std::move(capture));
+                m_pro_captures.pop_front();
+            }
+        }
+
+        // The card is done with them; the encoder returns the others.
+        for (auto& capture : late)
+        {
+            if (capture.released)
+                pro_image_buffer_available(capture.pbImage, nullptr);
         }
+        late.clear();
+
+        if (done.empty() && lost.empty())
+            continue;
+        m_pro_done.notify_all();
+
+        for (auto& capture : done)
+            finish_pro_capture(std::move(capture));
+        done.clear();
 
-        // Wait for capture completion
-        if (MWWaitEvent(capture_event, 99) <= 0)
+        for (auto& capture : lost)
         {
+            m_frames_dropped.Inc();
+            m_dma_lost.Inc();
             if (m_verbose > 0)
             {
-                m_log->warn("wait capture event error or timeout "
-                            "(frame {})", m_frame_cnt);
+                LOG_LIMITED(m_log, spdlog::level::warn,
+                            "DAMAGED: Capture of card frame {} never "
+                            "completed", capture.frame_idx);
+            }
+            if (!capture.released)
+            {
+                // The encoder has it, and lets go.
+                VideoStream::Rows& rows =
+                    m_image_rows[image_index(capture.pbImage)];
+                rows.done.store(-1, std::memory_order_release);
+                rows.done.notify_all();
             }
-            pro_image_buffer_available(pbImage, nullptr);
-            continue;
         }
-        m_expected_ts = timestamp + eco_params.llFrameDuration;
+        lost.clear();
+    }
+}
 
-        // Get capture status
-        MWCAP_VIDEO_CAPTURE_STATUS captureStatus;
-        MWGetVideoCaptureStatus(m_channel, &captureStatus);
+/**
+ * @brief Queue a completed capture for encoding
+ *
+ * In low-latency capture the encoder already has the image, and is only
+ * told that the last of its lines are in.
+ *
+ * @param capture The completed capture
+ */
+void Magewell::finish_pro_capture(ProCapture&& capture)
+{
+    m_frames_captured.Inc();
+    first_frame_captured();
+
+    if (!m_low_latency)
+    {
+        Latency::Stamps stamps;
+        stamps.Mark(Latency::CAPTURE);
+
+        record_video(capture.pbImage, capture.timestamp, nullptr);
 
         VideoStream::Image image = {
-            .pImage = pbImage,
-            .timestamp = timestamp,
+            .pImage = capture.pbImage,
+            .timestamp = capture.timestamp,
             .pEco = nullptr,
-            .oParams = std::move(oParams)
+            .oParams = std::move(capture.oParams),
+            .stamps = stamps
         };
-        oParams.reset();
 
         // Add frame to output handler
         m_out2ts->AddVideoImage(std::move(image));
+    }
+    else if (capture.released)
+        pro_image_buffer_available(capture.pbImage, nullptr);
+    else
+    {
+        // Before the encoder can finish with it, and let go.
+        record_video(capture.pbImage, capture.timestamp, nullptr);
 
-        log_stats(used);
+        VideoStream::Rows& rows = m_image_rows[image_index(capture.pbImage)];
+        rows.complete_ns.store(Latency::Now(), std::memory_order_relaxed);
+        rows.done.store(capture.rows, std::memory_order_release);
+        rows.done.notify_all();
     }
 
-    return true;
+    auto now = chrono::steady_clock::now();
+    m_dma_latency.Observe(chrono::duration<double>
+                          (now - capture.issued).count());
+    if (Trace::g_enabled)
+    {
+        Trace::Record("dma", chrono::duration_cast<chrono::nanoseconds>
+                      (capture.issued.time_since_epoch()).count(),
+                      chrono::duration_cast<chrono::nanoseconds>
+                      (now.time_since_epoch()).count());
+    }
+    log_stats(capture.used);
+}
+
+/**
+ * @brief Return the buffers of captures given up on
+ *
+ * Capture must be stopped, so the card can no longer write to them.
+ * A buffer the encoder still holds is returned by the encoder.
+ */
+void Magewell::release_late_pro_captures(void)
+{
+    deque<ProCapture> late;
+    {
+        scoped_lock lock(m_pro_mutex);
+        late.swap(m_pro_late);
+    }
+
+    for (auto& capture : late)
+    {
+        if (capture.released)
+            pro_image_buffer_available(capture.pbImage, nullptr);
+    }
+}
+
+/**
+ * @brief Stop and restart capture, if any captures were given up on
+ *
+ * Stopping aborts them, so their buffers can be freed or reused.
+ *
+ * @param capture_event Event the card signals as each DMA completes
+ */
+void Magewell::abort_late_pro_captures(MWCAP_PTR capture_event)
+{
+    {
+        scoped_lock lock(m_pro_mutex);
+        if (m_pro_late.empty())
+            return;
+    }
+
+    MWStopVideoCapture(m_channel);
+    release_late_pro_captures();
+    if (MW_SUCCEEDED != MWStartVideoCapture(m_channel, capture_event))
+    {
+        m_log->critical("Restart Pro Video Capture error!");
+        Shutdown();
+    }
+}
+
+/**
+ * @brief Wait until no Pro capture is in flight
+ *
+ * The completion thread returns or times out every capture, so this
+ * takes at most PRO_DMA_TIMEOUT.
+ */
+void Magewell::drain_pro_captures(void)
+{
+    unique_lock<mutex> lock(m_pro_mutex);
+    m_pro_done.wait(lock, [this] { return m_pro_captures.empty(); });
+}
+
+/**
+ * @brief Wait for a signal change notification
+ *
+ * The event is shared with the frame notifications, so it can wake
+ * without the signal having changed.
+ *
+ * @param notify Notification to check
+ * @param eco_event ECO event the notification is registered on
+ * @param notify_event Pro event the notification is registered on
+ * @param bits Notification bits that count as a change
+ * @param until Give up at
+ *
+ * @return true if the signal changed
+ */
+bool Magewell::wait_signal_change(HNOTIFY notify, int eco_event,
+                                  MWCAP_PTR notify_event, ULONGLONG bits,
+                                  chrono::steady_clock::time_point until)
+{
+    ULONGLONG status = 0;
+
+    while (m_running.load() == true)
+    {
+        auto timeout = chrono::ceil<chrono::milliseconds>
+                       (until - chrono::steady_clock::now());
+        if (timeout.count() <= 0)
+            break;
+
+        int ret = m_isEco ? EcoEventWait(eco_event, timeout.count())
+                          : MWWaitEvent(notify_event, timeout.count());
+        if (ret <= 0)
+            break;
+
+        if (MWGetNotifyStatus(m_channel, notify, &status) == MW_SUCCEEDED &&
+            (status & bits))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Time the first frame captured since the signal locked
+ */
+void Magewell::first_frame_captured(void)
+{
+    int64_t locked = m_signal_locked.exchange(0);
+    if (locked == 0)
+        return;
+
+    chrono::duration<double> elapsed =
+        chrono::steady_clock::now().time_since_epoch() -
+        chrono::nanoseconds(locked);
+
+    m_first_frame.Observe(elapsed.count());
+    if (m_verbose > 1)
+        m_log->info("First frame {:.1f}ms after the signal locked.",
+                    elapsed.count() * 1000);
 }
 
 /**
@@ -2567,6 +3214,13 @@ bool Magewell::capture_video(void)
     if (m_verbose > 0)
         m_log->info("Video capture starting.");
 
+    if (m_isEco && m_low_latency)
+    {
+        m_log->warn("Low-latency capture needs a Pro card; capturing "
+                    "whole frames.");
+        m_low_latency = false;
+    }
+
     if (m_isEco)
     {
         eco_event = eventfd(0, EFD_NONBLOCK);
@@ -2598,6 +3252,13 @@ bool Magewell::capture_video(void)
             m_log->critical("Start Pro Video Capture error!");
             Shutdown();
         }
+
+        m_dma_running.store(true);
+        m_dma_thread = thread(&Magewell::complete_pro_captures, this,
+                              capture_event);
+        pthread_setname_np(m_dma_thread.native_handle(), "viddma");
+        CpuPlan::Apply(m_dma_thread.native_handle(),
+                       CpuPlan::CAPTURE, "viddma");
     }
 
 #if 0
@@ -2610,6 +3271,19 @@ bool Magewell::capture_video(void)
     MWSetVideoFormat(m_channel, &captureSettings);
 #endif
 
+    // Wakes the settle loop as soon as the signal changes. Infoframe
+    // changes count, as they can change the colorspace.
+    constexpr ULONGLONG settle_bits = MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE |
+                                      MWCAP_NOTIFY_INPUT_SPECIFIC_CHANGE;
+    HNOTIFY settle_notify;
+    if (m_isEco)
+        settle_notify = MWRegisterNotify(m_channel, eco_event, settle_bits);
+    else
+        settle_notify = MWRegisterNotify(m_channel, notify_event,
+                                         settle_bits);
+    if (!settle_notify && m_verbose > 0)
+        m_log->warn("Video: Failed to register signal change notify.");
+
     VideoStream::Params active_params;
     std::optional<VideoStream::Params> oParams = std::nullopt;
 
@@ -2618,11 +3292,22 @@ bool Magewell::capture_video(void)
         MWCAP_VIDEO_SIGNAL_STATUS videoSignalStatus;
         chrono::steady_clock::time_point stable_start =
             chrono::steady_clock::now();
-        std::chrono::milliseconds duration;
+        chrono::steady_clock::time_point quiet_start = stable_start;
 
         int         prev_image_size = m_image_size;
 
         VideoStream::Params params;
+        VideoStream::Params polled;
+
+        // Until the signal is usable, wake as soon as it changes.
+        auto wait_for_signal = [&](int ms)
+        {
+            wait_signal_change(settle_notify, eco_event, notify_event,
+                               settle_bits, chrono::steady_clock::now() +
+                               chrono::milliseconds(ms));
+            stable_start = chrono::steady_clock::now();
+            polled = {};
+        };
 
         if (m_verbose > 1)
             m_log->info("Using {} RAM frame buffers.", m_image_buffers);
@@ -2637,7 +3322,7 @@ bool Magewell::capture_video(void)
                     m_log->warn("Input video signal status: Unsupported");
                 locked = false;
                 state = videoSignalStatus.state;
-                this_thread::sleep_for(chrono::milliseconds(m_frame_ms));
+                wait_for_signal(m_frame_ms);
                 continue;
             }
 
@@ -2653,38 +3338,30 @@ bool Magewell::capture_video(void)
                       m_log->warn("Input video signal status: NONE");
                   locked = false;
                   state = videoSignalStatus.state;
-                  this_thread::sleep_for(chrono::milliseconds(m_frame_ms));
+                  wait_for_signal(m_frame_ms);
                   continue;
                 case MWCAP_VIDEO_SIGNAL_LOCKING:
                   if (state != videoSignalStatus.state && m_verbose > 0)
                       m_log->warn("Input video signal status: Locking");
                   locked = false;
                   state = videoSignalStatus.state;
-                  this_thread::sleep_for(chrono::milliseconds(m_frame_ms));
+                  wait_for_signal(m_frame_ms);
                   continue;
                 default:
                   if (m_verbose > 0)
                       m_log->warn("Video signal status: lost locked.");
                   locked = false;
-                  this_thread::sleep_for(chrono::milliseconds(m_frame_ms));
+                  wait_for_signal(m_frame_ms);
                   continue;
             }
 
-            if (videoSignalStatus.bInterlaced)
-            {
-                if (!rejected && m_verbose > 0)
-                    m_log->info("REJECTING interlaced video.");
-                rejected = true;
-                this_thread::sleep_for(chrono::milliseconds(m_frame_half_ms));
-                continue;
-            }
             if (videoSignalStatus.cx < 640 ||
                 videoSignalStatus.cy < 480)
             {
                 if (!rejected && m_verbose > 0)
                     m_log->info("REJECTING invalid video dimensions.");
                 rejected = true;
-                this_thread::sleep_for(chrono::milliseconds(m_frame_half_ms));
+                wait_for_signal(m_frame_half_ms);
                 continue;
             }
 
@@ -2727,17 +3404,35 @@ bool Magewell::capture_video(void)
                 10000000LL
             };
 
+            // Woven fields; deinterlaced by the copy workers.
+            params.interlaced = videoSignalStatus.bInterlaced;
+            params.top_field_first = !params.interlaced ||
+                                     top_field_first();
+            if (params.interlaced && m_video_args.field_rate)
+                params.frame_duration.den *= 2;
+
             if (params == active_params)
                 break;
 
-            duration = chrono::duration_cast<chrono::milliseconds>
-                       (chrono::steady_clock::now() - stable_start);
-            if (duration > m_settle_time)
+            // Settled once unchanged for SETTLE_DEBOUNCE, or regardless
+            // after m_settle_time.
+            auto now = chrono::steady_clock::now();
+            if (params != polled)
+            {
+                polled = params;
+                quiet_start = now;
+            }
+            auto settled = min(quiet_start + SETTLE_DEBOUNCE,
+                               stable_start + m_settle_time);
+            if (now >= settled)
                 break;
 
-            std::this_thread::sleep_for
-                (std::chrono::milliseconds(1));
+            if (wait_signal_change(settle_notify, eco_event, notify_event,
+                                   settle_bits, settled))
+                polled = {};
         }
+        m_signal_locked = chrono::duration_cast<chrono::nanoseconds>
+                          (stable_start.time_since_epoch()).count();
 
         if (params != active_params)
         {
@@ -2752,6 +3447,7 @@ bool Magewell::capture_video(void)
 
             active_params = params;
             oParams = active_params;
+            m_interlaced = params.interlaced;
 
             m_frame_ms = eco_params.llFrameDuration / 10000;
             m_frame_ms2 = m_frame_ms * 2;
@@ -2765,6 +3461,8 @@ bool Magewell::capture_video(void)
 
             event_mask = MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE;
             event_mask |= MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED;
+            if (m_low_latency)
+                event_mask |= MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING;
 
             if (m_isEco)
             {
@@ -2796,6 +3494,7 @@ bool Magewell::capture_video(void)
             {
                 if (prev_image_size != m_image_size)
                 {
+                    abort_late_pro_captures(capture_event);
                     free_image_buffers();
                     if (!create_pro_image_buffers())
                     {
@@ -2804,6 +3503,31 @@ bool Magewell::capture_video(void)
                     }
                 }
             }
+
+            if (m_recorder)
+            {
+                uint8_t eotf = HDMI_EOTF_SDR;
+                if (params.color.trc == AVCOL_TRC_SMPTE2084)
+                    eotf = HDMI_EOTF_ST2084_PQ;
+                else if (params.color.trc == AVCOL_TRC_ARIB_STD_B67)
+                    eotf = HDMI_EOTF_HLG;
+
+                m_recorder->VideoFormat({
+                        .fourcc         = eco_params.dwFOURCC,
+                        .cx             = static_cast<uint16_t>(eco_params.cx),
+                        .cy             = static_cast<uint16_t>(eco_params.cy),
+                        .stride         = static_cast<uint32_t>(m_min_stride),
+                        .image_size     = static_cast<uint32_t>(m_image_size),
+                        .frame_duration = static_cast<uint32_t>
+                                          (eco_params.llFrameDuration),
+                        .interlaced     = videoSignalStatus.bInterlaced,
+                        .hdr_eotf       = eotf,
+                        .color_format   = static_cast<uint8_t>
+                                          (videoSignalStatus.colorFormat),
+                        .quant_range    = static_cast<uint8_t>
+                                          (videoSignalStatus.quantRange)
+                    });
+            }
         }
         else
             m_log->info(" KEEPING:\n   {}", params);
@@ -2839,14 +3563,32 @@ bool Magewell::capture_video(void)
         {
             if (!capture_pro_video(eco_params, std::move(oParams),
                                    video_notify, notify_event,
-                                   capture_event, frame_wrap_idx,
+                                   frame_wrap_idx,
                                    event_mask, ullStatusBits))
                 active_params = {};
+
+            // Buffers may be reallocated for the next format.
+            drain_pro_captures();
         }
     }
 
+    if (m_dma_thread.joinable())
+    {
+        m_dma_running.store(false);
+        m_dma_thread.join();
+    }
+
+    if (!m_isEco)
+    {
+        MWStopVideoCapture(m_channel);
+        release_late_pro_captures();
+    }
+
     free_image_buffers();
 
+    if (settle_notify)
+        MWUnregisterNotify(m_channel, settle_notify);
+
     if (m_isEco)
     {
         close_eco_video();
@@ -2858,7 +3600,6 @@ bool Magewell::capture_video(void)
     }
     else
     {
-        MWStopVideoCapture(m_channel);
         if (video_notify)
             MWUnregisterNotify(m_channel, video_notify);
 
@@ -2883,13 +3624,17 @@ bool Magewell::capture_video(void)
 }
 
 bool Magewell::Capture(VideoStream::Args&& video_args,
+                       AudioStream::Args&& audio_args,
                        bool no_audio, std::chrono::milliseconds settle_time,
-                       int video_buffers, bool realtime)
+                       int video_buffers)
 {
     m_image_buffers = video_buffers;
     m_settle_time   = settle_time;
     m_video_args    = video_args;
 
+    // Before any pipeline thread is started.
+    CpuPlan::Plan(m_channel_info.byBoardIndex, m_verbose);
+
     // Display input information if verbose
     if (m_verbose > 1)
         describe_input(m_channel);
@@ -2908,33 +3653,74 @@ bool Magewell::Capture(VideoStream::Args&& video_args,
         Shutdown();
     }
 
+    if (!m_record_path.empty())
+    {
+        static_assert(RawCapture::AUDIO_FRAME_BYTES ==
+                      sizeof(MWCAP_AUDIO_CAPTURE_FRAME::adwSamples));
+
+        // Leave most of the buffers to the encoder.
+        m_recorder = std::make_unique<RawRecorder>
+                     (m_record_path, m_verbose,
+                      std::max<size_t>(2, m_image_buffers / 4),
+                      [=,this](uint8_t* ib, void* eb)
+                      { this->release_image(ib, eb); });
+        if (!*m_recorder)
+        {
+            m_recorder.reset();
+            return false;
+        }
+    }
+
     // Create output handler based on capture mode
     if (m_isEco)
     {
-        m_out2ts = new OutputTS(m_verbose, true,
+        m_out2ts = new OutputTS(m_verbose, m_input, true, m_output,
                                 std::move(video_args),
+                                std::move(audio_args),
                                 [=,this](void) { this->Shutdown(); },
                                 [=,this](uint8_t* ib, void* eb)
-                                { this->eco_image_buffer_available(ib, eb); });
+                                { this->release_image(ib, eb); });
     }
     else
     {
-        m_out2ts = new OutputTS(m_verbose, false,
+        m_out2ts = new OutputTS(m_verbose, m_input, false, m_output,
                                 std::move(video_args),
+                                std::move(audio_args),
                                 [=,this](void) { this->Shutdown(); },
                                 [=,this](uint8_t* ib, void* eb)
-                                { this->pro_image_buffer_available(ib, eb); });
+                                { this->release_image(ib, eb); });
     }
 
     // Check if output handler was created successfully
-    if (!m_out2ts)
+    if (!m_out2ts || !*m_out2ts)
     {
         m_log->critical("Failed to create OutputTS muxing.");
         Shutdown();
         delete m_out2ts;
+        m_out2ts = nullptr;
         return false;
     }
 
+    if (!m_isEco)
+    {
+        m_video_clock = std::make_unique<ClockSync>("video", m_verbose,
+                                                    m_input);
+        m_audio_clock = std::make_unique<ClockSync>("audio", m_verbose,
+                                                    m_input);
+    }
+
+    if (m_isEco)
+    {
+        m_reactor = std::make_unique<EcoReactor>
+                    (m_verbose, [=,this](void) { this->Shutdown(); });
+        if (!*m_reactor)
+        {
+            Shutdown();
+            return false;
+        }
+        CpuPlan::Apply(m_reactor->Thread(), CpuPlan::CAPTURE, "ecocap");
+    }
+
     // Start audio thread if audio is enabled
     if (!no_audio)
     {
@@ -2950,42 +3736,10 @@ bool Magewell::Capture(VideoStream::Args&& video_args,
                     std::strerror(errno));
     }
 
-    if (realtime)
-    {
-        struct sched_param audio_param;
-        audio_param.sched_priority = 20;
-        int a_result = pthread_setschedparam(m_audio_thread.native_handle(),
-                                             SCHED_RR, &audio_param);
-        if (a_result != 0)
-        {
-            m_log->warn("Failed to set Audio real-time priority. "
-                        "Error: {} Code: {}",
-                        std::strerror(a_result),
-                        a_result);
-        }
-        else
-        {
-            m_log->info("Audio thread isolated at SCHED_RR priority {}.",
-                        audio_param.sched_priority);
-        }
-
-        struct sched_param video_param;
-        video_param.sched_priority = 20;
-        int v_result = pthread_setschedparam(pthread_self(),
-                                             SCHED_RR, &video_param);
-        if (v_result != 0)
-        {
-            m_log->warn("Failed to set Video real-time priority. "
-                        "Error: {} Code: {}",
-                        std::strerror(v_result),
-                        v_result);
-        }
-        else
-        {
-            m_log->info("Video thread isolated at SCHED_RR priority {}.",
-                        video_param.sched_priority);
-        }
-    }
+    if (!no_audio)
+        CpuPlan::Apply(m_audio_thread.native_handle(),
+                       CpuPlan::CAPTURE, "audcap");
+    CpuPlan::Apply(pthread_self(), CpuPlan::CAPTURE, "vidcap");
 
     // Start video capture
     capture_video();
@@ -2994,6 +3748,8 @@ bool Magewell::Capture(VideoStream::Args&& video_args,
     if (!no_audio)
         m_audio_thread.join();
 
+    m_recorder.reset();
+
     // Clean up output handler
     delete m_out2ts;
     m_out2ts = nullptr;
@@ -3016,6 +3772,10 @@ void Magewell::Shutdown(void)
             const char* msg = "Magewell::Shutdown\n";
             write(STDERR_FILENO, msg, strlen(msg));
         }
-        m_out2ts->Shutdown();
+        // Another input may stop this one before it has started.
+        if (m_out2ts)
+            m_out2ts->Shutdown();
+        if (m_reactor)
+            m_reactor->Stop();
     }
 }
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <deque>
 #include <iostream>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <spdlog/spdlog.h>
@@ -16,7 +18,11 @@
 #include <LibMWCapture/MWCapture.h>
 #include "LibMWCapture/MWEcoCapture.h"
 
+#include "ClockSync.h"
+#include "EcoReactor.h"
+#include "Metrics.h"
 #include "OutputTS.h"
+#include "RawRecorder.h"
 
 /**
  * @brief Magewell class for controlling video capture cards using
@@ -47,11 +53,40 @@ class Magewell
     };
 
   public:
-    Magewell(void);
+    explicit Magewell(int input);
     ~Magewell(void);
 
     void Verbose(int v) { m_verbose = v; }
 
+    /**
+     * @brief Also record the raw capture, for replay in the lab
+     * @param path Data file; the index is written to path + ".idx"
+     */
+    void RecordRaw(const std::string& path) { m_record_path = path; }
+
+    /**
+     * @brief Write the transport stream to a file or named pipe
+     * @param path Appended to; empty for stdout
+     * @param mux_pool The mux threads shared by the inputs
+     */
+    void Output(const std::string& path, LanePool* mux_pool)
+        { m_output.path = path; m_output.mux_pool = mux_pool; }
+
+    /**
+     * @brief Mux into a multi-program transport stream instead
+     * @param mpts The MPTS mux shared by the inputs
+     * @param program Program number for this input
+     */
+    void Program(MptsMux* mpts, int program)
+        { m_output.mpts = mpts; m_output.program = program; }
+
+    /**
+     * @brief Pro cards: capture each frame while it is still arriving
+     * @param on Start the DMA and GPU upload of the top of the frame
+     *           before the bottom has been received
+     */
+    void LowLatency(bool on) { m_low_latency = on; }
+
     /**
      * @brief Open a video capture channel
      * @param idx Channel index to open
@@ -76,7 +111,7 @@ class Magewell
      * @param cnt Number of channels to wait for
      * @return true if channels are available, false otherwise
      */
-    bool WaitForInputs(int cnt) const;
+    static bool WaitForInputs(int cnt);
 
     /**
      * @brief Read EDID information from the device
@@ -93,8 +128,9 @@ class Magewell
     bool WriteEDID(const std::string & filepath);
 
     bool Capture(VideoStream::Args&& video_args,
+                 AudioStream::Args&& audio_args,
                  bool no_audio, std::chrono::milliseconds settle_time,
-                 int video_buffers, bool realtime);
+                 int video_buffers);
 
     /**
      * @brief Shutdown the capture process
@@ -117,9 +153,26 @@ class Magewell
 
     bool get_colorspace(MWCAP_VIDEO_SIGNAL_STATUS signal_status,
                         VideoStream::ColorSpace& meta);
+    bool top_field_first(void);
 
     size_t   AllocateImageBuffers(void);
     uint8_t* GetFrameImage(size_t frame_idx);
+    size_t   image_index(const uint8_t* pbImage) const;
+
+    /**
+     * @brief Return an image buffer once every user is done with it
+     * @param pbImage Pointer to image buffer
+     * @param buf Context buffer
+     */
+    void release_image(uint8_t* pbImage, void* buf);
+
+    /**
+     * @brief Hand a captured frame to the raw recorder, if recording
+     * @param pbImage Pointer to image buffer
+     * @param timestamp Card timestamp of the frame
+     * @param buf Context buffer
+     */
+    void record_video(uint8_t* pbImage, int64_t timestamp, void* buf);
 
     /**
      * @brief Handle available image buffer for PRO capture
@@ -185,7 +238,6 @@ class Magewell
      * @param eco_params ECO capture parameters
      * @param video_notify Video notification handle
      * @param notify_event Notification event handle
-     * @param capture_event Capture event handle
      * @param frame_wrap_idx Frame wrap index
      * @param event_mask Event mask
      * @param ullStatusBits Status bits
@@ -195,11 +247,105 @@ class Magewell
                            std::optional<VideoStream::Params>&& pParams,
                            HNOTIFY video_notify,
                            MWCAP_PTR notify_event,
-                           MWCAP_PTR capture_event,
                            int       frame_wrap_idx,
                            DWORD     event_mask,
                            ULONGLONG ullStatusBits);
 
+    /**
+     * @brief A Pro capture handed to the card, waiting on its DMA
+     */
+    struct ProCapture
+    {
+        uint8_t* pbImage   {nullptr};
+        int      frame_idx {-1};
+        int64_t  timestamp {-1};
+        size_t   used      {0};     ///< Image buffers in use when issued
+        int      rows      {0};     ///< Lines in the frame
+        std::optional<VideoStream::Params> oParams;
+        std::chrono::steady_clock::time_point issued;
+        bool     released  {false}; ///< The encoder let go, or never had it
+        uint64_t seq       {0};     ///< Context the card reports it by
+    };
+
+    /**
+     * @brief Low latency: pick the frame the card is receiving now
+     * @param eco_params ECO capture parameters
+     * @param frame_idx Set to the card's frame index
+     * @param timestamp Set to when its last line will have arrived
+     * @return false if there is no new frame to capture
+     */
+    bool buffering_frame(const MWCAP_VIDEO_ECO_CAPTURE_OPEN& eco_params,
+                         int& frame_idx, int64_t& timestamp);
+
+    /**
+     * @brief Take an image buffer and start capturing a frame into it
+     * @param frame_idx The card's frame index
+     * @param timestamp Card timestamp of the frame
+     * @param oParams New stream parameters, handed on with the frame
+     * @param eco_params ECO capture parameters
+     * @return false if the card refused the capture
+     */
+    bool issue_pro_capture(int frame_idx, int64_t timestamp,
+                           std::optional<VideoStream::Params>& oParams,
+                           const MWCAP_VIDEO_ECO_CAPTURE_OPEN& eco_params);
+
+    /**
+     * @brief Start the DMA of a frame, without waiting for it
+     * @param capture The frame and the image buffer it goes to
+     * @param eco_params ECO capture parameters
+     * @return false if not queued: refused, or shutting down
+     */
+    bool queue_pro_capture(ProCapture&& capture,
+                           const MWCAP_VIDEO_ECO_CAPTURE_OPEN& eco_params);
+
+    /**
+     * @brief Return the buffers of captures given up on
+     *
+     * Only once the card can no longer write to them: capture stopped.
+     */
+    void release_late_pro_captures(void);
+
+    /**
+     * @brief Stop and restart capture, if any captures were given up on
+     * @param capture_event Event the card signals as each DMA completes
+     */
+    void abort_late_pro_captures(MWCAP_PTR capture_event);
+
+    /**
+     * @brief Completion thread: hand finished Pro captures to the encoder
+     * @param capture_event Event the card signals as each DMA completes
+     */
+    void complete_pro_captures(MWCAP_PTR capture_event);
+
+    /**
+     * @brief Queue a completed capture for encoding
+     * @param capture The completed capture
+     */
+    void finish_pro_capture(ProCapture&& capture);
+
+    /**
+     * @brief Wait until no Pro capture is in flight
+     */
+    void drain_pro_captures(void);
+
+    /**
+     * @brief Wait for a signal change notification
+     * @param notify Notification to check
+     * @param eco_event ECO event the notification is registered on
+     * @param notify_event Pro event the notification is registered on
+     * @param bits Notification bits that count as a change
+     * @param until Give up at
+     * @return true if the signal changed
+     */
+    bool wait_signal_change(HNOTIFY notify, int eco_event,
+                            MWCAP_PTR notify_event, ULONGLONG bits,
+                            std::chrono::steady_clock::time_point until);
+
+    /**
+     * @brief Time the first frame captured since the signal locked
+     */
+    void first_frame_captured(void);
+
     /**
      * @brief Main video capture loop
      * @return true always
@@ -221,9 +367,15 @@ class Magewell
     HCHANNEL             m_channel {nullptr};    ///< Channel handle
     MWCAP_CHANNEL_INFO   m_channel_info  {0};    ///< Channel information
     int                  m_channel_idx   {0};    ///< Channel index
+    int                  m_input;                ///< Input number, 1 based
     std::chrono::milliseconds m_settle_time   {5000}; ///< signal change timeout
+    /// A signal has settled once it goes this long without changing
+    static constexpr std::chrono::milliseconds SETTLE_DEBOUNCE {20};
+    /// When the signal last locked (steady_clock ns), until its first
+    /// frame is captured. Set on vidcap, claimed on viddma.
+    std::atomic<int64_t> m_signal_locked {0};
 
-    std::unique_ptr<uint8_t[]> m_image_buffer;
+    RawCapture::AlignedBuffer  m_image_buffer;
     size_t                     m_aligned_image_size {0};
     bool                       m_pinned            {false};
 
@@ -235,6 +387,14 @@ class Magewell
     std::mutex   m_image_buffer_mutex;          ///< Mutex for buffer access
     std::condition_variable m_image_returned;   ///< Condition variable for buffer return
 
+    OutputTS::Destination        m_output;
+
+    // Raw recording
+    std::string                  m_record_path;
+    std::unique_ptr<RawRecorder> m_recorder;
+    std::unique_ptr<std::atomic<int>[]> m_image_refs; ///< Users per image buffer
+    std::unique_ptr<VideoStream::Rows[]> m_image_rows; ///< Low latency progress
+
     // Video parameters
     VideoStream::Args        m_video_args;
     VideoStream::EncoderType m_encoderType;
@@ -249,8 +409,78 @@ class Magewell
     int     m_frame_cnt      {0};  ///< Number of frames processed
     int64_t m_expected_ts    {-1}; ///< Expected next timestamp
 
+    // Prometheus series
+    Metrics::Counter& m_frames_captured {
+        Metrics::GetCounter("magewell2ts_frames_captured_total",
+                            "Video frames captured",
+                            Metrics::WithInput(m_input))
+    };
+    Metrics::Counter& m_frames_skipped {
+        Metrics::GetCounter("magewell2ts_frames_skipped_total",
+                            "Video frames missing from the card's timestamps",
+                            Metrics::WithInput(m_input))
+    };
+    Metrics::Counter& m_frames_dropped {
+        Metrics::GetCounter("magewell2ts_frames_dropped_total",
+                            "Video frames that failed to capture",
+                            Metrics::WithInput(m_input))
+    };
+    Metrics::Histogram& m_dma_latency {
+        Metrics::GetHistogram("magewell2ts_pro_dma_seconds",
+                              "Time from issuing a Pro capture until its "
+                              "frame is complete in memory",
+                              Metrics::WithInput(m_input))
+    };
+    Metrics::Histogram& m_first_frame {
+        Metrics::GetHistogram("magewell2ts_signal_to_frame_seconds",
+                              "Time from a video signal locking until its "
+                              "first frame is captured",
+                              Metrics::WithInput(m_input))
+    };
+    Metrics::Counter& m_dma_lost {
+        Metrics::GetCounter("magewell2ts_pro_dma_lost_total",
+                            "Pro captures that never completed",
+                            Metrics::WithInput(m_input))
+    };
+    Metrics::Gauge&   m_buffers_used {
+        Metrics::GetGauge("magewell2ts_video_buffers_used",
+                          "Image buffers in use",
+                          Metrics::WithInput(m_input))
+    };
+    Metrics::Gauge&   m_buffers_total {
+        Metrics::GetGauge("magewell2ts_video_buffers",
+                          "Image buffers allocated",
+                          Metrics::WithInput(m_input))
+    };
+    Metrics::Gauge&   m_temperature {
+        Metrics::GetGauge("magewell2ts_card_temperature_celsius",
+                          "Capture card temperature",
+                          Metrics::WithInput(m_input))
+    };
+
+    // Pro captures in flight, oldest first. The card completes them in
+    // the order they were issued.
+    static constexpr size_t PRO_CAPTURES_MAX = 2;
+    static constexpr int    LOW_LATENCY_SLICES = 8;  ///< Notifies per frame
+    static constexpr std::chrono::milliseconds PRO_DMA_TIMEOUT {99};
+
+    std::deque<ProCapture>  m_pro_captures;
+    // Given up on, but the card may still write to their buffers.
+    std::deque<ProCapture>  m_pro_late;
+    uint64_t                m_pro_seq {0};  ///< Last capture issued
+    std::optional<VideoStream::Params> m_pro_params; ///< From a lost capture
+    std::mutex              m_pro_mutex;
+    std::condition_variable m_pro_done;     ///< A capture left the queue
+    std::thread             m_dma_thread;   ///< Pro capture completion
+    std::atomic<bool>       m_dma_running {false};
+
     // Audio thread
     std::thread       m_audio_thread;  ///< Audio capture thread
+    /// ECO: picks up the video and audio notifications
+    std::unique_ptr<EcoReactor> m_reactor;
+    /// Pro: card clock recovery, for smoothed timestamps
+    std::unique_ptr<ClockSync> m_video_clock;
+    std::unique_ptr<ClockSync> m_audio_clock;
 
     // State flags
     std::atomic<bool> m_running     {true};  ///< Running flag
@@ -260,13 +490,12 @@ class Magewell
 
     // Device flags
     bool m_isEco   {false};  ///< Whether using ECO capture
+    bool m_low_latency {false}; ///< Capture frames as they arrive (Pro)
+    bool m_interlaced  {false}; ///< Current input is interlaced
 
     bool m_fatal   {false};  ///< Fatal error flag
+    bool m_sdk_user {false}; ///< Counted as a user of the SDK instance
     int  m_verbose {1};      ///< Verbose level
 
-#if 0
-    FrameRateDetector m_rateDetector;
-#endif
-
     std::chrono::steady_clock::time_point m_start_tm;
 };
@@ -12,8 +12,10 @@
 #include <cstdint>
 #include <condition_variable>
 #include <concepts>
+#include <span>
 
 #include "ffmpeg_types.h"
+#include "Latency.h"
 
 namespace TimeBase
 {
@@ -37,6 +39,7 @@ struct Packet
     int                   version {0};
     PacketPtr             pkt;
     std::optional<Marker> marker;
+    std::optional<Latency::Stamps> latency;
 };
 
 class MediaQueue
@@ -144,3 +147,29 @@ class MediaQueue
     mutable std::mutex m_mutex;
     bool m_isShutdown{ false };
 };
+
+/**
+ * @brief The queue whose head should be muxed next.
+ * @param queues Candidates in priority order; ties go to the earlier one
+ * @return The non-empty queue with the lowest head DTS, or nullptr if
+ * they are all empty.
+ */
+inline MediaQueue* EarliestQueue(std::span<MediaQueue* const> queues)
+{
+    MediaQueue* target = nullptr;
+    int64_t     target_dts = 0;
+
+    for (MediaQueue* queue : queues)
+    {
+        if (queue->IsEmpty())
+            continue;
+        int64_t dts = queue->PeekDts();
+        if (target == nullptr || dts < target_dts)
+        {
+            target = queue;
+            target_dts = dts;
+        }
+    }
+
+    return target;
+}
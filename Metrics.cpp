@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+#ifdef SPDLOG_FMT_EXTERNAL
+#include <fmt/format.h>
+#else
+#include <spdlog/fmt/bundled/format.h>
+#endif
+
+#include "Metrics.h"
+
+using namespace std;
+
+namespace Metrics
+{
+    namespace
+    {
+        struct Family
+        {
+            string type;
+            string help;
+            // Rendered label set -> series
+            map<string, unique_ptr<Metric>> series;
+        };
+
+        mutex               g_mutex;
+        map<string, Family> g_families;
+
+        string escape(const string& value)
+        {
+            string out;
+            for (char ch : value)
+            {
+                if (ch == '\\' || ch == '"')
+                    out += '\\';
+                if (ch == '\n')
+                    out += "\\n";
+                else
+                    out += ch;
+            }
+            return out;
+        }
+
+        string format_labels(const Labels& labels)
+        {
+            if (labels.empty())
+                return "";
+
+            string out = "{";
+            for (const auto& [key, value] : labels)
+            {
+                if (out.size() > 1)
+                    out += ',';
+                out += fmt::format("{}=\"{}\"", key, escape(value));
+            }
+            return out + "}";
+        }
+
+        // Adds `extra` (e.g. le="0.5") to an already rendered label set.
+        string add_label(const string& labels, const string& extra)
+        {
+            if (labels.empty())
+                return "{" + extra + "}";
+            return labels.substr(0, labels.size() - 1) + "," + extra + "}";
+        }
+
+        string number(double value)
+        {
+            if (std::isinf(value))
+                return value > 0 ? "+Inf" : "-Inf";
+            return fmt::format("{}", value);
+        }
+
+        template <class T, class... Args>
+        T& get(const string& type, const string& name, const string& help,
+               const Labels& labels, Args&&... args)
+        {
+            scoped_lock lock(g_mutex);
+
+            Family& family = g_families[name];
+            if (family.type.empty())
+            {
+                family.type = type;
+                family.help = help;
+            }
+
+            auto& series = family.series[format_labels(labels)];
+            if (!series)
+                series = make_unique<T>(std::forward<Args>(args)...);
+            return static_cast<T&>(*series);
+        }
+    }
+
+    void Counter::Render(string& out, const string& name,
+                         const string& labels) const
+    {
+        out += fmt::format("{}{} {}\n", name, labels, Value());
+    }
+
+    void Gauge::Render(string& out, const string& name,
+                       const string& labels) const
+    {
+        out += fmt::format("{}{} {}\n", name, labels, number(Value()));
+    }
+
+    Histogram::Histogram(vector<double> bounds)
+        : m_bounds(std::move(bounds))
+        , m_buckets(new atomic<uint64_t>[m_bounds.size() + 1])
+    {
+        for (size_t idx = 0; idx <= m_bounds.size(); ++idx)
+            m_buckets[idx].store(0, memory_order_relaxed);
+    }
+
+    void Histogram::Observe(double value)
+    {
+        size_t idx = lower_bound(m_bounds.begin(), m_bounds.end(), value)
+                     - m_bounds.begin();
+        m_buckets[idx].fetch_add(1, memory_order_relaxed);
+        m_sum.fetch_add(value, memory_order_relaxed);
+    }
+
+    void Histogram::Render(string& out, const string& name,
+                           const string& labels) const
+    {
+        // Prometheus buckets are cumulative.
+        uint64_t total = 0;
+        for (size_t idx = 0; idx <= m_bounds.size(); ++idx)
+        {
+            total += m_buckets[idx].load(memory_order_relaxed);
+            double bound = idx < m_bounds.size()
+                           ? m_bounds[idx] : INFINITY;
+            out += fmt::format("{}_bucket{} {}\n", name,
+                               add_label(labels,
+                                         "le=\"" + number(bound) + "\""),
+                               total);
+        }
+        out += fmt::format("{}_sum{} {}\n", name, labels,
+                           number(m_sum.load(memory_order_relaxed)));
+        // The +Inf bucket, so the two agree even mid update.
+        out += fmt::format("{}_count{} {}\n", name, labels, total);
+    }
+
+    const vector<double>& SecondsBuckets(void)
+    {
+        static const vector<double> bounds {
+            0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+            0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1
+        };
+        return bounds;
+    }
+
+    Counter& GetCounter(const string& name, const string& help,
+                        const Labels& labels)
+    {
+        return get<Counter>("counter", name, help, labels);
+    }
+
+    Gauge& GetGauge(const string& name, const string& help,
+                    const Labels& labels)
+    {
+        return get<Gauge>("gauge", name, help, labels);
+    }
+
+    Histogram& GetHistogram(const string& name, const string& help,
+                            const Labels& labels,
+                            const vector<double>& bounds)
+    {
+        return get<Histogram>("histogram", name, help, labels, bounds);
+    }
+
+    string Render(void)
+    {
+        string out;
+        scoped_lock lock(g_mutex);
+
+        for (const auto& [name, family] : g_families)
+        {
+            out += fmt::format("# HELP {} {}\n# TYPE {} {}\n",
+                               name, family.help, name, family.type);
+            for (const auto& [labels, series] : family.series)
+                series->Render(out, name, labels);
+        }
+        return out;
+    }
+
+    Server::Server(const string& address, int verbose_level)
+        : m_verbose(verbose_level)
+    {
+        m_log = spdlog::get("app_logger");
+        if (!m_log)
+        {
+            std::cerr << "Metrics Error: Logger 'app_logger' not found!"
+                      << std::endl;
+            return;
+        }
+
+        bool ok = address.starts_with("unix:")
+                  ? listen_unix(address.substr(5))
+                  : listen_tcp(address);
+        if (!ok)
+        {
+            if (m_listen_fd >= 0)
+                close(m_listen_fd);
+            m_listen_fd = -1;
+            return;
+        }
+
+        m_wake_fd = eventfd(0, EFD_CLOEXEC);
+        m_thread = std::thread(&Server::run, this);
+        pthread_setname_np(m_thread.native_handle(), "metrics");
+
+        if (m_verbose > 0)
+            m_log->info("Serving metrics on {}", address);
+    }
+
+    Server::~Server(void)
+    {
+        if (m_thread.joinable())
+        {
+            uint64_t one = 1;
+            if (write(m_wake_fd, &one, sizeof(one)) < 0)
+                m_log->warn("Unable to stop the metrics server: {}",
+                            strerror(errno));
+            m_thread.join();
+        }
+        if (m_wake_fd >= 0)
+            close(m_wake_fd);
+        if (m_listen_fd >= 0)
+            close(m_listen_fd);
+        if (!m_unix_path.empty())
+            unlink(m_unix_path.c_str());
+    }
+
+    bool Server::listen_tcp(const string& address)
+    {
+        string host = "127.0.0.1";
+        string port = address;
+
+        size_t colon = address.rfind(':');
+        if (colon != string::npos)
+        {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        try
+        {
+            int num = stoi(port);
+            if (num <= 0 || num > 65535)
+                throw out_of_range(port);
+            addr.sin_port = htons(num);
+        }
+        catch (const exception&)
+        {
+            m_log->critical("Invalid metrics port '{}'", port);
+            return false;
+        }
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        {
+            m_log->critical("Invalid metrics address '{}'; expected an "
+                            "IPv4 address", host);
+            return false;
+        }
+
+        m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int reuse = 1;
+        setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR,
+                   &reuse, sizeof(reuse));
+        if (m_listen_fd < 0 ||
+            ::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr),
+                   sizeof(addr)) != 0 ||
+            listen(m_listen_fd, 8) != 0)
+        {
+            m_log->critical("Unable to serve metrics on {}: {}",
+                            address, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool Server::listen_unix(const string& path)
+    {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        {
+            m_log->critical("Invalid metrics socket path '{}'", path);
+            return false;
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size());
+
+        // Left over from a previous run.
+        unlink(path.c_str());
+
+        m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_listen_fd < 0 ||
+            ::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr),
+                   sizeof(addr)) != 0 ||
+            listen(m_listen_fd, 8) != 0)
+        {
+            m_log->critical("Unable to serve metrics on '{}': {}",
+                            path, strerror(errno));
+            return false;
+        }
+        m_unix_path = path;
+        return true;
+    }
+
+    void Server::run(void)
+    {
+        pollfd fds[2] {
+            { .fd = m_listen_fd, .events = POLLIN, .revents = 0 },
+            { .fd = m_wake_fd,   .events = POLLIN, .revents = 0 }
+        };
+
+        for (;;)
+        {
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                m_log->error("Metrics server stopped: {}", strerror(errno));
+                break;
+            }
+            if (fds[1].revents)
+                break;
+            if (!(fds[0].revents & POLLIN))
+                continue;
+
+            int fd = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+                continue;
+            serve(fd);
+            close(fd);
+        }
+    }
+
+    void Server::serve(int fd)
+    {
+        // Don't let a stalled client hold up the next scrape for long.
+        timeval timeout { .tv_sec = 2, .tv_usec = 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        string request;
+        char   buf[1024];
+        while (request.find("\r\n\r\n") == string::npos &&
+               request.size() < 8192)
+        {
+            ssize_t len = recv(fd, buf, sizeof(buf), 0);
+            if (len <= 0)
+                return;
+            request.append(buf, len);
+        }
+
+        string status = "200 OK";
+        string body;
+        if (request.starts_with("GET /metrics ") ||
+            request.starts_with("GET / "))
+            body = Render();
+        else
+        {
+            status = "404 Not Found";
+            body   = "Try /metrics\n";
+        }
+
+        string response = fmt::format("HTTP/1.1 {}\r\n"
+                                      "Content-Type: text/plain; "
+                                      "version=0.0.4\r\n"
+                                      "Content-Length: {}\r\n"
+                                      "Connection: close\r\n\r\n{}",
+                                      status, body.size(), body);
+
+        const char* data   = response.data();
+        size_t      remain = response.size();
+        while (remain > 0)
+        {
+            ssize_t len = send(fd, data, remain, MSG_NOSIGNAL);
+            if (len < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (m_verbose > 2)
+                    m_log->debug("Metrics scrape aborted: {}",
+                                 strerror(errno));
+                return;
+            }
+            data   += len;
+            remain -= len;
+        }
+    }
+}
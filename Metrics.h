@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+/*
+  Process wide metrics, served in the Prometheus text format by
+  Metrics::Server.
+
+  Get*() registers a series on first use and returns the same object
+  for the same name and labels afterwards. Registration takes a lock,
+  so look a series up once (a function local static, or a member) and
+  keep the reference. Updating a series is a relaxed atomic operation,
+  and scraping only reads those atomics, so a scrape never holds up the
+  capture, encode or mux threads.
+*/
+namespace Metrics
+{
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    class Metric
+    {
+      public:
+        virtual ~Metric(void) = default;
+        virtual void Render(std::string& out, const std::string& name,
+                            const std::string& labels) const = 0;
+    };
+
+    class Counter : public Metric
+    {
+      public:
+        void Inc(uint64_t count = 1)
+            { m_value.fetch_add(count, std::memory_order_relaxed); }
+        uint64_t Value(void) const
+            { return m_value.load(std::memory_order_relaxed); }
+
+        void Render(std::string& out, const std::string& name,
+                    const std::string& labels) const override;
+
+      private:
+        std::atomic<uint64_t> m_value {0};
+    };
+
+    class Gauge : public Metric
+    {
+      public:
+        void Set(double value)
+            { m_value.store(value, std::memory_order_relaxed); }
+        void Add(double value)
+            { m_value.fetch_add(value, std::memory_order_relaxed); }
+        double Value(void) const
+            { return m_value.load(std::memory_order_relaxed); }
+
+        void Render(std::string& out, const std::string& name,
+                    const std::string& labels) const override;
+
+      private:
+        std::atomic<double> m_value {0};
+    };
+
+    class Histogram : public Metric
+    {
+      public:
+        // Upper bounds, ascending; +Inf is implied.
+        explicit Histogram(std::vector<double> bounds);
+
+        void Observe(double value);
+
+        void Render(std::string& out, const std::string& name,
+                    const std::string& labels) const override;
+
+      private:
+        std::vector<double>                      m_bounds;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_buckets;
+        std::atomic<double>                      m_sum {0};
+    };
+
+    // `labels`, led by the capture input (1 based) the series belongs to.
+    inline Labels WithInput(int input, Labels labels = {})
+    {
+        labels.insert(labels.begin(), {"input", std::to_string(input)});
+        return labels;
+    }
+
+    // 100us .. 1s, for pipeline stage timings.
+    const std::vector<double>& SecondsBuckets(void);
+
+    Counter&   GetCounter(const std::string& name, const std::string& help,
+                          const Labels& labels = {});
+    Gauge&     GetGauge(const std::string& name, const std::string& help,
+                        const Labels& labels = {});
+    Histogram& GetHistogram(const std::string& name, const std::string& help,
+                            const Labels& labels = {},
+                            const std::vector<double>& bounds =
+                            SecondsBuckets());
+
+    // Every series, in the Prometheus text exposition format.
+    std::string Render(void);
+
+    /*
+      Serves Render() over HTTP, on "[host:]port" (the host defaults to
+      127.0.0.1) or on a Unix socket given as "unix:/path".
+    */
+    class Server
+    {
+      public:
+        Server(const std::string& address, int verbose_level);
+        ~Server(void);
+
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        bool operator!(void) const { return m_listen_fd < 0; }
+
+      private:
+        bool listen_tcp(const std::string& address);
+        bool listen_unix(const std::string& path);
+        void run(void);
+        void serve(int fd);
+
+        std::shared_ptr<spdlog::logger> m_log;
+        int           m_verbose;
+
+        std::string   m_unix_path;
+        int           m_listen_fd {-1};
+        int           m_wake_fd   {-1};
+        std::thread   m_thread;
+    };
+}
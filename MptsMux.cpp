@@ -0,0 +1,279 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "MptsMux.h"
+#include "AsyncLog.h"
+#include "CpuPlan.h"
+#include "OutputTS.h"
+
+using namespace std;
+
+namespace
+{
+    constexpr size_t  TS_PACKET = 188;
+    constexpr uint8_t TS_SYNC   = 0x47;
+    constexpr int     PAT_PID   = 0x0000;
+    constexpr int     SDT_PID   = 0x0011;
+    constexpr int     TS_ID     = 1;      // FFmpeg's default
+
+    constexpr auto PAT_PERIOD    = chrono::milliseconds(100);
+    // Also how often a program waiting out a format change is revisited.
+    constexpr auto POLL_INTERVAL = chrono::milliseconds(20);
+
+    // CRC-32/MPEG-2, as used by PSI sections.
+    uint32_t crc32_mpeg2(const uint8_t* data, size_t size)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t idx = 0; idx < size; ++idx)
+        {
+            crc ^= static_cast<uint32_t>(data[idx]) << 24;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7
+                                         : (crc << 1);
+        }
+        return crc;
+    }
+}
+
+MptsMux::MptsMux(const string& output, int verbose_level)
+    : m_verbose(verbose_level)
+{
+    m_log = spdlog::get("app_logger");
+    if (!m_log)
+    {
+        std::cerr << "MptsMux Error: Logger 'app_logger' not found!"
+                  << std::endl;
+        m_output_fd = -1;
+        return;
+    }
+
+    if (!output.empty() && output != "-")
+    {
+        m_output_fd = open(output.c_str(),
+                           O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_output_fd < 0)
+        {
+            m_log->critical("Failed to open MPTS output '{}': {}",
+                            output, strerror(errno));
+            return;
+        }
+    }
+    // Room for the bursts of several programs.
+    fcntl(m_output_fd, F_SETPIPE_SZ, 4 * 1024 * 1024);
+
+    m_thread = std::thread(&MptsMux::run, this);
+    pthread_setname_np(m_thread.native_handle(), "mux");
+}
+
+MptsMux::~MptsMux(void)
+{
+    m_running.store(false);
+    Wake();
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_output_fd > STDERR_FILENO)
+        close(m_output_fd);
+}
+
+MptsMux::Pids MptsMux::ProgramPids(int program)
+{
+    return Pids {
+        .pmt         = 0x1000 + program - 1,
+        .stream_base = 0x100 + 0x10 * (program - 1)
+    };
+}
+
+void MptsMux::Attach(int program, OutputTS* output)
+{
+    {
+        std::scoped_lock lock(m_programs_mutex);
+        m_programs[program] = Program {
+            .pids   = ProgramPids(program),
+            .output = output
+        };
+        m_pat_changed = true;
+    }
+
+    // The CPU plan is made once the first input starts capturing.
+    if (!m_placed.exchange(true))
+        CpuPlan::Apply(m_thread.native_handle(), CpuPlan::MUX, "mux");
+
+    if (m_verbose > 0)
+    {
+        Pids pids = ProgramPids(program);
+        m_log->info("MPTS program {}: PMT PID {:#x}, video {:#x}, "
+                    "audio {:#x}, compat {:#x}", program, pids.pmt,
+                    pids.Stream(OutputTS::VIDEO_STREAM_ID),
+                    pids.Stream(OutputTS::AUDIO_STREAM_ID),
+                    pids.Stream(OutputTS::COMPAT_STREAM_ID));
+    }
+    Wake();
+}
+
+void MptsMux::Detach(int program, const std::function<void (void)>& flush)
+{
+    {
+        std::scoped_lock lock(m_programs_mutex);
+        auto entry = m_programs.find(program);
+        if (entry == m_programs.end())
+            return;
+
+        flush();
+        m_programs.erase(entry);
+        m_pat_changed = true;
+    }
+
+    if (m_verbose > 0)
+        m_log->info("MPTS program {} removed", program);
+    Wake();
+}
+
+void MptsMux::Wake(void)
+{
+    {
+        std::scoped_lock lock(m_wake_mutex);
+        m_woken = true;
+    }
+    m_wake.notify_one();
+}
+
+bool MptsMux::Write(int number, const uint8_t* data, size_t size)
+{
+    auto entry = m_programs.find(number);
+    if (entry == m_programs.end())
+        return false;
+    Program& program = entry->second;
+
+    // The PAT goes ahead of anything that depends on it.
+    send_pat();
+
+    m_out.clear();
+    auto take = [this](const uint8_t* pkt)
+    {
+        if (pkt[0] != TS_SYNC)
+            return;
+        int pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+        if (pid == PAT_PID || pid == SDT_PID)
+            return;
+        m_out.insert(m_out.end(), pkt, pkt + TS_PACKET);
+    };
+
+    // AVIO hands over whatever it has buffered, which need not end on
+    // a packet boundary.
+    if (!program.partial.empty())
+    {
+        size_t need = min(TS_PACKET - program.partial.size(), size);
+        program.partial.insert(program.partial.end(), data, data + need);
+        data += need;
+        size -= need;
+        if (program.partial.size() < TS_PACKET)
+            return true;
+        take(program.partial.data());
+        program.partial.clear();
+    }
+    for (; size >= TS_PACKET; data += TS_PACKET, size -= TS_PACKET)
+        take(data);
+    program.partial.assign(data, data + size);
+
+    return m_out.empty() || write_out(m_out.data(), m_out.size());
+}
+
+void MptsMux::send_pat(void)
+{
+    auto now = chrono::steady_clock::now();
+    if (!m_pat_changed && now - m_pat_sent < PAT_PERIOD)
+        return;
+    if (m_pat_changed)
+        m_pat_version = (m_pat_version + 1) & 0x1F;
+    m_pat_changed = false;
+    m_pat_sent    = now;
+
+    uint8_t pkt[TS_PACKET];
+    memset(pkt, 0xFF, sizeof(pkt));
+
+    pkt[0] = TS_SYNC;
+    pkt[1] = 0x40 | (PAT_PID >> 8);     // payload_unit_start_indicator
+    pkt[2] = PAT_PID & 0xFF;
+    pkt[3] = 0x10 | m_pat_cc;           // Payload only
+    m_pat_cc = (m_pat_cc + 1) & 0x0F;
+    pkt[4] = 0;                         // pointer_field
+
+    uint8_t* section = pkt + 5;
+    size_t   length  = 5 + 4 * m_programs.size() + 4;  // After the length
+
+    section[0] = 0x00;                  // program_association_section
+    section[1] = 0xB0 | (length >> 8);
+    section[2] = length & 0xFF;
+    section[3] = TS_ID >> 8;
+    section[4] = TS_ID & 0xFF;
+    section[5] = 0xC1 | (m_pat_version << 1);   // current_next_indicator
+    section[6] = 0;                     // section_number
+    section[7] = 0;                     // last_section_number
+
+    uint8_t* pos = section + 8;
+    for (const auto& [number, program] : m_programs)
+    {
+        *pos++ = number >> 8;
+        *pos++ = number & 0xFF;
+        *pos++ = 0xE0 | (program.pids.pmt >> 8);
+        *pos++ = program.pids.pmt & 0xFF;
+    }
+
+    uint32_t crc = crc32_mpeg2(section, pos - section);
+    *pos++ = crc >> 24;
+    *pos++ = (crc >> 16) & 0xFF;
+    *pos++ = (crc >> 8) & 0xFF;
+    *pos++ = crc & 0xFF;
+
+    write_out(pkt, sizeof(pkt));
+}
+
+bool MptsMux::write_out(const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t ret = write(m_output_fd, data, size);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_LIMITED(m_log, spdlog::level::err,
+                        "DAMAGED: MPTS write failed: {}", strerror(errno));
+            return false;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+void MptsMux::run(void)
+{
+    while (m_running.load())
+    {
+        {
+            std::unique_lock lock(m_wake_mutex);
+            m_wake.wait_for(lock, POLL_INTERVAL, [this] {
+                return m_woken || !m_running.load();
+            });
+            m_woken = false;
+        }
+
+        std::scoped_lock lock(m_programs_mutex);
+        send_pat();
+
+        // A packet from each program in turn, until none has one due.
+        for (bool busy = true; busy && m_running.load();)
+        {
+            busy = false;
+            for (auto& [number, program] : m_programs)
+                busy |= program.output->MuxNext();
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+class OutputTS;
+
+/*
+  Multi-program transport stream: the outputs of several inputs muxed,
+  each as a program, into one TS by one thread.
+
+  Every program keeps its own mpegts muxer, and with it its own PMT,
+  its PCR (carried on its video PID) and its handling of format
+  changes: a format change on one input reopens only that program. The
+  muxers' TS packets are merged here a packet at a time. Their PATs
+  and SDTs are dropped, and one PAT listing every program is sent in
+  their place.
+
+  Program n uses PMT PID 0x1000 + n - 1 and stream PIDs 0x100 +
+  0x10 * (n - 1) + stream id, so program 1 has the PIDs a single
+  program stream has.
+*/
+class MptsMux
+{
+  public:
+    static constexpr int MAX_PROGRAMS = 32;   // The PAT fits one packet
+
+    struct Pids
+    {
+        int pmt;
+        int stream_base;
+
+        // PID of OutputTS::VIDEO_STREAM_ID, AUDIO_STREAM_ID, ...
+        int Stream(int stream_id) const { return stream_base + stream_id; }
+    };
+
+    /*
+      `output` is a file or named pipe to append the transport stream
+      to; empty (or "-") for stdout.
+    */
+    MptsMux(const std::string& output, int verbose_level);
+    ~MptsMux(void);
+
+    MptsMux(const MptsMux&) = delete;
+    MptsMux& operator=(const MptsMux&) = delete;
+
+    bool operator!(void) const { return m_output_fd < 0; }
+
+    static Pids ProgramPids(int program);
+
+    /*
+      From Attach() until Detach(), the mux thread calls
+      output->MuxNext() whenever Wake() is called. `flush` is run on
+      the way out, with the mux thread held off, to write out whatever
+      the program's muxer still holds.
+    */
+    void Attach(int program, OutputTS* output);
+    void Detach(int program, const std::function<void (void)>& flush);
+
+    // A program has packets to mux.
+    void Wake(void);
+
+    // TS packets from `program`'s muxer. Only from MuxNext() or flush.
+    bool Write(int program, const uint8_t* data, size_t size);
+
+  private:
+    struct Program
+    {
+        Pids                 pids;
+        OutputTS*            output {nullptr};
+        std::vector<uint8_t> partial;   // Incomplete TS packet
+    };
+
+    void run(void);
+    void send_pat(void);
+    bool write_out(const uint8_t* data, size_t size);
+
+    std::shared_ptr<spdlog::logger> m_log;
+    int                     m_verbose;
+    int                     m_output_fd {1};   // stdout
+
+    std::mutex              m_programs_mutex;
+    // Guards the PAT state and m_out as well; Write() runs under it.
+    std::map<int, Program>  m_programs;        // By program number
+    std::vector<uint8_t>    m_out;
+
+    std::mutex              m_wake_mutex;
+    std::condition_variable m_wake;
+    bool                    m_woken     {false};
+    std::atomic<bool>       m_running   {true};
+    std::atomic<bool>       m_placed    {false};
+    std::thread             m_thread;
+
+    bool                    m_pat_changed {true};
+    uint8_t                 m_pat_version {0};
+    uint8_t                 m_pat_cc      {0};
+    std::chrono::steady_clock::time_point m_pat_sent;
+};
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+/*
+  Splits encoded video packets into NAL units (H.264, HEVC) or OBUs
+  (AV1) and classifies them, for keyframe indexing, segmenting and
+  diagnostics.
+
+  Annex B start codes are found 32 (AVX2) or 16 (SSE2) bytes at a time:
+  the block is compared against 00, 00, 01 at offsets 0, 1 and 2 and the
+  three masks are combined, so the scan only stops on real start codes.
+  Emulation prevention guarantees the slice data never contains one, so
+  a large IDR is crossed at close to memory bandwidth. Without SSE2,
+  memchr() for the 01 does the heavy lifting instead.
+
+  AV1 has no start codes; its OBU headers carry their sizes, so they
+  are simply walked.
+*/
+namespace NalScanner
+{
+    enum Kind : uint8_t
+    {
+        OTHER,
+        DELIMITER,      // AUD, AV1 temporal delimiter
+        VPS,
+        SPS,            // Also the AV1 sequence header
+        PPS,
+        SEI,            // Also AV1 metadata
+        IDR,            // IDR slice, AV1 key frame
+        IRAP,           // HEVC CRA/BLA: random access, but not IDR
+        SLICE,          // Any other coded picture data
+        NUM_KINDS
+    };
+
+    struct Unit
+    {
+        const uint8_t* data {nullptr};   // NAL/OBU header onward
+        size_t         size {0};         // Without the next start code
+        int            type {0};         // Codec specific NAL/OBU type
+        Kind           kind {OTHER};
+    };
+
+    // Bit mask of the Kinds seen, as returned by Classify().
+    constexpr uint32_t Mask(Kind kind) { return 1u << kind; }
+
+    /*
+      First "00 00 01" in [ptr, end), or `end` if there is none. The
+      returned pointer is at the first 00.
+    */
+    inline const uint8_t* FindStartCode(const uint8_t* ptr,
+                                        const uint8_t* end)
+    {
+#if defined(__AVX2__)
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one  = _mm256_set1_epi8(1);
+        while (end - ptr >= 34)
+        {
+            __m256i b0 = _mm256_loadu_si256
+                         (reinterpret_cast<const __m256i*>(ptr));
+            __m256i b1 = _mm256_loadu_si256
+                         (reinterpret_cast<const __m256i*>(ptr + 1));
+            __m256i b2 = _mm256_loadu_si256
+                         (reinterpret_cast<const __m256i*>(ptr + 2));
+            __m256i hit = _mm256_and_si256
+                          (_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero),
+                                            _mm256_cmpeq_epi8(b1, zero)),
+                           _mm256_cmpeq_epi8(b2, one));
+            uint32_t mask = static_cast<uint32_t>
+                            (_mm256_movemask_epi8(hit));
+            if (mask)
+                return ptr + std::countr_zero(mask);
+            ptr += 32;
+        }
+#elif defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one  = _mm_set1_epi8(1);
+        while (end - ptr >= 18)
+        {
+            __m128i b0 = _mm_loadu_si128
+                         (reinterpret_cast<const __m128i*>(ptr));
+            __m128i b1 = _mm_loadu_si128
+                         (reinterpret_cast<const __m128i*>(ptr + 1));
+            __m128i b2 = _mm_loadu_si128
+                         (reinterpret_cast<const __m128i*>(ptr + 2));
+            __m128i hit = _mm_and_si128
+                          (_mm_and_si128(_mm_cmpeq_epi8(b0, zero),
+                                         _mm_cmpeq_epi8(b1, zero)),
+                           _mm_cmpeq_epi8(b2, one));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+            if (mask)
+                return ptr + std::countr_zero(mask);
+            ptr += 16;
+        }
+#else
+        while (end - ptr >= 3)
+        {
+            const uint8_t* one = static_cast<const uint8_t*>
+                                 (std::memchr(ptr + 2, 0x01, end - ptr - 2));
+            if (one == nullptr)
+                return end;
+            if (one[-1] == 0 && one[-2] == 0)
+                return one - 2;
+            ptr = one - 1;
+        }
+#endif
+        for (; end - ptr >= 3; ++ptr)
+        {
+            if (ptr[2] == 1 && ptr[1] == 0 && ptr[0] == 0)
+                return ptr;
+        }
+        return end;
+    }
+
+    inline Kind ClassifyH264(int type)
+    {
+        switch (type)
+        {
+            case 1: case 2: case 3: case 4:
+              return SLICE;
+            case 5:
+              return IDR;
+            case 6:
+              return SEI;
+            case 7:
+              return SPS;
+            case 8:
+              return PPS;
+            case 9:
+              return DELIMITER;
+            default:
+              return OTHER;
+        }
+    }
+
+    inline Kind ClassifyHEVC(int type)
+    {
+        if (type == 19 || type == 20)           // IDR_W_RADL, IDR_N_LP
+            return IDR;
+        if (type >= 16 && type <= 21)           // BLA, CRA
+            return IRAP;
+        if (type < 32)
+            return SLICE;
+        switch (type)
+        {
+            case 32:
+              return VPS;
+            case 33:
+              return SPS;
+            case 34:
+              return PPS;
+            case 35:
+              return DELIMITER;
+            case 39: case 40:
+              return SEI;
+            default:
+              return OTHER;
+        }
+    }
+
+    /*
+      Calls fn(const Unit&) for each NAL unit of an Annex B packet until
+      it returns false.
+    */
+    template <class Fn>
+    void ForEachNal(AVCodecID codec, const uint8_t* data, size_t size, Fn&& fn)
+    {
+        const uint8_t* end = data + size;
+        const uint8_t* ptr = FindStartCode(data, end);
+
+        while (ptr != end)
+        {
+            const uint8_t* nal  = ptr + 3;
+            const uint8_t* next = FindStartCode(nal, end);
+            if (nal == end)
+                break;
+
+            // The 00 in front of a 4 byte start code belongs to it.
+            const uint8_t* nal_end = next;
+            if (next != end && next > nal && next[-1] == 0)
+                --nal_end;
+
+            Unit unit { .data = nal, .size = static_cast<size_t>(nal_end - nal) };
+            if (codec == AV_CODEC_ID_H264)
+            {
+                unit.type = nal[0] & 0x1F;
+                unit.kind = ClassifyH264(unit.type);
+            }
+            else
+            {
+                unit.type = (nal[0] >> 1) & 0x3F;
+                unit.kind = ClassifyHEVC(unit.type);
+            }
+
+            if (!fn(static_cast<const Unit&>(unit)))
+                return;
+            ptr = next;
+        }
+    }
+
+    /*
+      Same for the OBUs of an AV1 temporal unit. A frame OBU is
+      reported as IDR if it starts a key frame; that assumes the usual
+      (not reduced still picture) sequence header.
+    */
+    template <class Fn>
+    void ForEachObu(const uint8_t* data, size_t size, Fn&& fn)
+    {
+        const uint8_t* end = data + size;
+        const uint8_t* ptr = data;
+
+        while (ptr < end)
+        {
+            const uint8_t* obu    = ptr;
+            uint8_t        header = *ptr++;
+            if (header & 0x04)                  // Extension header
+                ++ptr;
+
+            size_t obu_size = end > ptr ? end - ptr : 0;
+            if (header & 0x02)                  // Has size field
+            {
+                uint64_t leb = 0;
+                for (int shift = 0; ptr < end && shift < 56; shift += 7)
+                {
+                    uint8_t byte = *ptr++;
+                    leb |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                    if (!(byte & 0x80))
+                        break;
+                }
+                if (ptr > end || leb > static_cast<uint64_t>(end - ptr))
+                    return;
+                obu_size = leb;
+            }
+
+            Unit unit {
+                .data = obu,
+                .size = static_cast<size_t>(ptr - obu) + obu_size,
+                .type = (header >> 3) & 0x0F
+            };
+            switch (unit.type)
+            {
+                case 1:
+                  unit.kind = SPS;
+                  break;
+                case 2:
+                  unit.kind = DELIMITER;
+                  break;
+                case 5:
+                  unit.kind = SEI;
+                  break;
+                case 3: case 6:                 // Frame header, frame
+                  // show_existing_frame = 0, frame_type = KEY_FRAME
+                  unit.kind = (obu_size > 0 && (*ptr & 0xE0) == 0)
+                              ? IDR : SLICE;
+                  break;
+                case 4:                         // Tile group
+                  unit.kind = SLICE;
+                  break;
+                default:
+                  unit.kind = OTHER;
+                  break;
+            }
+
+            if (!fn(static_cast<const Unit&>(unit)))
+                return;
+            ptr += obu_size;
+        }
+    }
+
+    // Either of the above, by codec. Other codecs have no units.
+    template <class Fn>
+    void ForEach(AVCodecID codec, const uint8_t* data, size_t size, Fn&& fn)
+    {
+        switch (codec)
+        {
+            case AV_CODEC_ID_H264:
+            case AV_CODEC_ID_HEVC:
+              ForEachNal(codec, data, size, std::forward<Fn>(fn));
+              break;
+            case AV_CODEC_ID_AV1:
+              ForEachObu(data, size, std::forward<Fn>(fn));
+              break;
+            default:
+              break;
+        }
+    }
+
+    /*
+      Mask() of every kind of unit in the packet. With `headers_only`,
+      stop at the first picture data, which is enough to tell whether
+      it is an IDR and carries parameter sets.
+    */
+    inline uint32_t Classify(AVCodecID codec, const uint8_t* data,
+                             size_t size, bool headers_only)
+    {
+        auto picture = [](Kind kind)
+        {
+            return kind == SLICE || kind == IDR || kind == IRAP;
+        };
+
+        uint32_t kinds = 0;
+        if (codec == AV_CODEC_ID_AV1)
+        {
+            ForEachObu(data, size, [&](const Unit& unit)
+            {
+                kinds |= Mask(unit.kind);
+                return !(headers_only && picture(unit.kind));
+            });
+            return kinds;
+        }
+        if (codec != AV_CODEC_ID_H264 && codec != AV_CODEC_ID_HEVC)
+            return 0;
+
+        // Only the unit headers are needed, so skip working out sizes.
+        const uint8_t* end = data + size;
+        const uint8_t* ptr = data;
+        while ((ptr = FindStartCode(ptr, end)) != end)
+        {
+            ptr += 3;
+            if (ptr == end)
+                break;
+
+            Kind kind = codec == AV_CODEC_ID_H264
+                        ? ClassifyH264(*ptr & 0x1F)
+                        : ClassifyHEVC((*ptr >> 1) & 0x3F);
+            kinds |= Mask(kind);
+            if (headers_only && picture(kind))
+                break;
+        }
+        return kinds;
+    }
+}
@@ -46,12 +46,18 @@
 
 extern "C" {
 #include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
 }
 
 #include "OutputTS.h"
+#include "MptsMux.h"
+#include "FrameHash.h"
 #include "VideoStream.h"
 #include "PCMStream.h"
 #include "BitStream.h"
+#include "AsyncLog.h"
+#include "CpuPlan.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -170,12 +176,19 @@ inline std::string DumpAVFormat(const AVFormatContext* fmtctx,
     return fmt::to_string(out);
 }
 
-OutputTS::OutputTS(int verbose_level, bool isEco,
+OutputTS::OutputTS(int verbose_level, int input, bool isEco,
+                   const Destination& output,
                    VideoStream::Args&& video_args,
+                   AudioStream::Args&& audio_args,
                    ShutdownCallback shutdown,
                    VideoStream::MagCallback image_buffer_avail)
     : m_verbose(verbose_level)
+    , m_input(input)
+    , m_mpts(output.mpts)
+    , m_mux_pool(output.mpts ? nullptr : output.mux_pool)
+    , m_program(output.program)
     , m_video_args(std::move(video_args))
+    , m_audio_args(std::move(audio_args))
     , f_shutdown(shutdown)
     , f_image_avail(image_buffer_avail)
 {
@@ -194,18 +207,83 @@ OutputTS::OutputTS(int verbose_level, bool isEco,
     else
         av_log_set_level(AV_LOG_QUIET);
 
+    if (!m_mpts && !output.path.empty() && output.path != "-")
+    {
+        /*
+          Opened once, and handed to FFmpeg as "pipe:<fd>", so reopening
+          the container after a format change carries on writing where
+          the last one stopped, exactly as it does on stdout.
+        */
+        m_output_fd = open(output.path.c_str(),
+                           O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_output_fd < 0)
+        {
+            m_log->critical("Failed to open output '{}': {}",
+                            output.path, strerror(errno));
+            m_running.store(false);
+            return;
+        }
+        m_output_url = fmt::format("pipe:{}", m_output_fd);
+    }
+
     // Initialize atomic runtime state machine flags
     m_running.store(true);
 
+    static const std::array<const char*, NUM_STREAM_IDS> stream_names {
+        "video", "audio", "compat"
+    };
+    for (int id = 0; id < NUM_STREAM_IDS; ++id)
+    {
+        Metrics::Labels labels = Metrics::WithInput
+                                 (m_input, {{"stream", stream_names[id]}});
+        m_metrics[id] = StreamMetrics {
+            .queue_depth = &Metrics::GetGauge
+                           ("magewell2ts_packet_queue_depth",
+                            "Encoded packets waiting for the mux", labels),
+            .bytes       = &Metrics::GetCounter
+                           ("magewell2ts_bytes_written_total",
+                            "Packet payload bytes written to the "
+                            "transport stream", labels),
+            .send        = &Metrics::GetHistogram
+                           ("magewell2ts_encoder_send_seconds",
+                            "Time spent in avcodec_send_frame", labels),
+            .receive     = &Metrics::GetHistogram
+                           ("magewell2ts_encoder_receive_seconds",
+                            "Time spent receiving packets from the encoder",
+                            labels)
+        };
+    }
+    for (size_t idx = 0; idx < Latency::NUM_INTERVALS; ++idx)
+        m_stage_metrics[idx] = &Metrics::GetHistogram
+                               ("magewell2ts_video_latency_seconds",
+                                "Per frame time between pipeline stages "
+                                "(see --latency-stats)",
+                                Metrics::WithInput
+                                (m_input,
+                                 {{"stage", Latency::INTERVALS[idx].name}}));
+
+    if (m_audio_args.compat_track)
+        m_compat = std::make_unique<CompatStream>(*this, m_verbose,
+                                            m_audio_args.compat_bitrate);
+    if (m_video_args.inverse_telecine)
+        m_rate_detector = std::make_unique<FrameRateDetector>(m_verbose,
+                                                              m_input);
+
+    // Before the threads that wake it.
+    if (m_mux_pool)
+        m_mux_lane = m_mux_pool->Add([this](void) { return mux_step(); });
+
     // Start up threads last
     m_audio_thread = std::thread(&OutputTS::process_audio, this);
     pthread_setname_np(m_audio_thread.native_handle(), "audenc");
+    CpuPlan::Apply(m_audio_thread.native_handle(), CpuPlan::AUDIO, "audenc");
 
     m_video_thread = std::thread(&OutputTS::process_video, this);
     pthread_setname_np(m_video_thread.native_handle(), "vidmgr");
+    CpuPlan::Apply(m_video_thread.native_handle(), CpuPlan::COPY, "vidmgr");
 
-    m_mux_thread = std::thread(&OutputTS::mux, this);
-    pthread_setname_np(m_mux_thread.native_handle(), "mux");
+    if (m_mpts)
+        m_mpts->Attach(m_program, this);
 }
 
 OutputTS::~OutputTS(void)
@@ -217,6 +295,10 @@ OutputTS::~OutputTS(void)
     m_running.store(false);
     Shutdown();
 
+    // The MPTS mux thread must be done with us before anything goes.
+    if (m_mpts)
+        m_mpts->Detach(m_program, [this] { close_container(); });
+
     while (!m_audioPktQ.IsEmpty())
     {
         auto entry = m_audioPktQ.PopValue();
@@ -232,12 +314,25 @@ OutputTS::~OutputTS(void)
     if (m_video_thread.joinable())
         m_video_thread.join();
 
-    if (m_mux_thread.joinable())
-        m_mux_thread.join();
+    // Its thread encodes into m_compatPktQ, so stop it before the queue
+    // goes away.
+    m_compat.reset();
+
+    // Nothing wakes the lane now. Mux what is left, as our own thread
+    // used to on its way out.
+    if (m_mux_lane)
+    {
+        m_mux_pool->Remove(m_mux_lane);
+        m_mux_lane = nullptr;
+        while (MuxNext())
+            ;
+    }
 
     m_log->info("Releasing core resource footprints...");
 
     close_container();
+    if (m_output_fd > STDERR_FILENO)
+        close(m_output_fd);
 
     if (m_verbose > 2)
         m_log->info("Transport Stream shutdown");
@@ -251,9 +346,31 @@ void OutputTS::Shutdown(void)
 {
     if (m_running.exchange(false))
         f_shutdown();
+    if (m_compat)
+        m_compat->Shutdown();
     m_imageQ_ready.notify_all();
     m_audioQ_ready.notify_all();
-    m_pktQ_ready.notify_all();
+    packets_ready();
+}
+
+void OutputTS::packets_ready(void)
+{
+    if (m_mpts)
+        m_mpts->Wake();
+    else if (m_mux_lane)
+        m_mux_pool->Wake(m_mux_lane);
+}
+
+#if LIBAVFORMAT_VERSION_MAJOR < 61
+int OutputTS::mpts_write(void* opaque, uint8_t* buf, int size)
+#else
+int OutputTS::mpts_write(void* opaque, const uint8_t* buf, int size)
+#endif
+{
+    auto* self = static_cast<OutputTS*>(opaque);
+    if (!self->m_mpts->Write(self->m_program, buf, size))
+        return AVERROR(EIO);
+    return size;
 }
 
 void OutputTS::log_packet(string where,  const AVPacket* pkt, int version)
@@ -280,8 +397,9 @@ void OutputTS::log_packet(string where,  const AVPacket* pkt, int version)
 
 void OutputTS::optimize_mpegts(AVFormatContext* format_ctx)
 {
-    // Give the stdout pipe some room for transient output bursts.
-    fcntl(STDOUT_FILENO, F_SETPIPE_SZ, 1024 * 1024);
+    // Give the output pipe some room for transient output bursts.
+    if (!m_mpts)
+        fcntl(m_output_fd, F_SETPIPE_SZ, 1024 * 1024);
 
     // Flush MPEG-TS output promptly rather than allowing AVIO buffering
     // to introduce additional latency.
@@ -291,7 +409,9 @@ void OutputTS::optimize_mpegts(AVFormatContext* format_ctx)
 // Open Transport Stream container
 bool OutputTS::open_container(void)
 {
+    Trace::Span span("container reopen");
     close_container();
+    m_reopens.Inc();
 
     if (m_verbose > 1)
         m_log->info("================ open container begin ================");
@@ -299,7 +419,9 @@ bool OutputTS::open_container(void)
     // Allocate the fresh transport stream envelope targeting stdout
     // via the "pipe:" protocol
     int ret = avformat_alloc_output_context2(&m_formatContext,
-                                             nullptr, "mpegts", "pipe:1");
+                                             nullptr, "mpegts",
+                                             m_mpts ? nullptr
+                                             : m_output_url.c_str());
     if (ret < 0 || m_formatContext == nullptr)
     {
         m_log->error("Failed to allocate stdout output context: {}",
@@ -337,16 +459,61 @@ bool OutputTS::open_container(void)
             m_audio_marker->marker->frame_duration.den,
             m_audio_marker->marker->frame_duration.num
         };
+
+        // TRACK 2: Stereo compatibility audio. Only valid as the
+        // third stream, so it depends on the primary audio being present.
+        if (m_compat_marker.has_value())
+        {
+            AVStream* c_st = avformat_new_stream(m_formatContext, nullptr);
+            if (c_st == nullptr) return false;
+
+            avcodec_parameters_copy(c_st->codecpar,
+                                    m_compat_marker->marker->codec_par.get());
+            c_st->time_base = m_compat_marker->marker->time_base;
+            c_st->avg_frame_rate = AVRational {
+                m_compat_marker->marker->frame_duration.den,
+                m_compat_marker->marker->frame_duration.num
+            };
+            av_dict_set(&c_st->metadata, "title", "Stereo", 0);
+        }
     }
 
-    // Physical stream commit
-    // Bind FFmpeg's I/O handle back to the active stdout stream descriptor
-    ret = avio_open(&m_formatContext->pb, "pipe:1", AVIO_FLAG_WRITE);
-    if (ret < 0)
+    if (m_mpts)
     {
-        m_log->error("Failed to bind physical stdout descriptor pipe: {}",
-                     AVerr2str(ret));
-        return false;
+        // Our program's PIDs; stream indexes are the stream IDs.
+        MptsMux::Pids pids = MptsMux::ProgramPids(m_program);
+        for (unsigned int idx = 0; idx < m_formatContext->nb_streams; ++idx)
+            m_formatContext->streams[idx]->id = pids.Stream(idx);
+
+        // Packets go to the MPTS mux, to be merged with the others.
+        constexpr int AVIO_BUFFER = 188 * 64;
+        auto* buffer = static_cast<uint8_t*>(av_malloc(AVIO_BUFFER));
+        if (buffer != nullptr)
+            m_formatContext->pb = avio_alloc_context(buffer, AVIO_BUFFER, 1,
+                                                     this, nullptr,
+                                                     &OutputTS::mpts_write,
+                                                     nullptr);
+        if (m_formatContext->pb == nullptr)
+        {
+            av_free(buffer);
+            m_log->error("Failed to allocate MPTS program {} I/O context",
+                         m_program);
+            return false;
+        }
+    }
+    else
+    {
+        // Physical stream commit
+        // Bind FFmpeg's I/O handle back to the active stdout stream
+        // descriptor
+        ret = avio_open(&m_formatContext->pb, m_output_url.c_str(),
+                        AVIO_FLAG_WRITE);
+        if (ret < 0)
+        {
+            m_log->error("Failed to bind physical stdout descriptor "
+                         "pipe: {}", AVerr2str(ret));
+            return false;
+        }
     }
 
     if (m_verbose > 0)
@@ -366,6 +533,17 @@ bool OutputTS::open_container(void)
     // Request PCR insertion at least every 20 ms.
     av_dict_set(&muxer_opts, "pcr_period", "20", 0);
 
+    if (m_mpts)
+    {
+        MptsMux::Pids pids = MptsMux::ProgramPids(m_program);
+        av_dict_set_int(&muxer_opts, "mpegts_service_id", m_program, 0);
+        av_dict_set_int(&muxer_opts, "mpegts_pmt_start_pid", pids.pmt, 0);
+        // The PAT stays the same, so a new PMT version is what tells
+        // receivers the program changed.
+        m_tables_version = (m_tables_version + 1) % 32;
+        av_dict_set_int(&muxer_opts, "tables_version", m_tables_version, 0);
+    }
+
     optimize_mpegts(m_formatContext);
 
     // Commit headers to stream pipeline
@@ -426,6 +604,7 @@ bool OutputTS::queue_packets(int stream_id, int version,
     if (!enc)
         return false;
 
+    Trace::Span span("encode receive");
     int ret = 0;
 
     for (;;)
@@ -478,6 +657,7 @@ bool OutputTS::queue_packets(int stream_id, int version,
         }
 
         pkt->stream_index = stream_id;
+        int64_t enc_pts = pkt->pts;
         av_packet_rescale_ts(pkt.get(),
                              enc->time_base,
                              TimeBase::MPEG_TS);
@@ -507,6 +687,8 @@ bool OutputTS::queue_packets(int stream_id, int version,
             .version      = version,
             .pkt          = std::move(pkt),
         };
+        if (stream_id == VIDEO_STREAM_ID)
+            qp.latency = m_latency.Received(enc_pts);
 
         pktQ.Push(std::move(qp));
     }
@@ -514,15 +696,26 @@ bool OutputTS::queue_packets(int stream_id, int version,
     return true;
 }
 
+MediaQueue& OutputTS::pkt_queue(int stream_id)
+{
+    switch (stream_id)
+    {
+        case AUDIO_STREAM_ID:
+          return m_audioPktQ;
+        case COMPAT_STREAM_ID:
+          return m_compatPktQ;
+        default:
+          return m_videoPktQ;
+    }
+}
+
 bool OutputTS::EncodeFrame(int stream_id, int version,
                            AVCodecContext* enc, AVFrame* frame)
 {
     if (!enc)
         return false;
 
-    MediaQueue& pktQ = (stream_id == AUDIO_STREAM_ID)
-                       ? m_audioPktQ
-                       : m_videoPktQ;
+    MediaQueue& pktQ = pkt_queue(stream_id);
 
     for (;;)
     {
@@ -532,8 +725,16 @@ bool OutputTS::EncodeFrame(int stream_id, int version,
             = chrono::steady_clock::now();
 #endif
 
+        if (stream_id == VIDEO_STREAM_ID && frame)
+            m_latency.Encoding(frame->pts);
+
         // Try to submit the frame
+        Trace::Span send_span("encode send");
+        int64_t send_start = Latency::Now();
         int ret = avcodec_send_frame(enc, frame);
+        int64_t send_end = Latency::Now();
+        send_span.End();
+        m_metrics[stream_id].send->Observe((send_end - send_start) * 1e-9);
 
 #ifdef LOG_ELAPSED
         chrono::steady_clock::time_point encode_end
@@ -546,6 +747,8 @@ bool OutputTS::EncodeFrame(int stream_id, int version,
         {
             ret = queue_packets(stream_id, version,
                                 enc, pktQ, false);
+            m_metrics[stream_id].receive->Observe
+                ((Latency::Now() - send_end) * 1e-9);
 #ifdef LOG_ELAPSED
             chrono::steady_clock::time_point queue_end
                 = chrono::steady_clock::now();
@@ -562,7 +765,7 @@ bool OutputTS::EncodeFrame(int stream_id, int version,
                              encode_dur.count(), queue_dur.count());
             }
 #endif
-            m_pktQ_ready.notify_all();
+            packets_ready();
             return ret;
         }
 
@@ -570,7 +773,8 @@ bool OutputTS::EncodeFrame(int stream_id, int version,
         {
             // A packet needs drained before the encoder can accept
             // another frame.
-            m_log->info("Encoder saturated (EAGAIN). "
+            LOG_LIMITED(m_log, spdlog::level::info,
+                        "Encoder saturated (EAGAIN). "
                         "Flushing packets to clear space.");
 
             if (!queue_packets(stream_id, version,
@@ -609,9 +813,7 @@ bool OutputTS::FlushPackets(int stream_id, int version, AVCodecContext* enc)
         return true;
     }
 
-    MediaQueue& pktQ = (stream_id == AUDIO_STREAM_ID)
-                       ? m_audioPktQ
-                       : m_videoPktQ;
+    MediaQueue& pktQ = pkt_queue(stream_id);
 
     m_log->trace("flush_packets id={} version={} Started, PktQ size {}",
                  stream_id, version, pktQ.GetSize());
@@ -641,9 +843,9 @@ bool OutputTS::FlushPackets(int stream_id, int version, AVCodecContext* enc)
 
 void OutputTS::sync_markers(void)
 {
+    Trace::Span span("marker sync");
     std::optional<Packet> outPkt;
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(150));
     std::scoped_lock lock(m_audio_pktQ_mutex, m_video_pktQ_mutex);
 
     m_log->trace("MARKER received. Video current {} latest {}; "
@@ -660,17 +862,26 @@ void OutputTS::sync_markers(void)
         m_frame_ms = std::chrono::milliseconds(av_rescale_q(1,
                                             outPkt->marker->frame_duration,
                                                             ms_time_base));
-#if 0
-        m_sequence.Push(*outPkt, outPkt->pkt.get());
-#endif
+        if (outPkt->marker->encoder)
+            m_sequence[VIDEO_STREAM_ID].SetCodec
+                (outPkt->marker->encoder->codec_id);
+        m_sequence[VIDEO_STREAM_ID].Push(*outPkt);
         m_video_marker = std::move(outPkt);
     }
     if (m_audioPktQ.PeekMarker())
     {
         outPkt = m_audioPktQ.PopValue();
         m_audio_current_version = outPkt->version;
+        m_sequence[AUDIO_STREAM_ID].Push(*outPkt);
         m_audio_marker = std::move(outPkt);
     }
+    if (m_compatPktQ.PeekMarker())
+    {
+        outPkt = m_compatPktQ.PopValue();
+        m_compat_current_version = outPkt->version;
+        m_sequence[COMPAT_STREAM_ID].Push(*outPkt);
+        m_compat_marker = std::move(outPkt);
+    }
 
     m_log->trace("Pending DTS; audio {} video {}",
                  m_audioPktQ.PeekDts(), m_videoPktQ.PeekDts());
@@ -678,122 +889,205 @@ void OutputTS::sync_markers(void)
     open_container();
 }
 
-void OutputTS::mux(void)
+// Our lane of the shared mux pool.
+LanePool::Result OutputTS::mux_step(void)
+{
+    if (MuxNext())
+        return LanePool::MORE;
+    // Waiting out MARKER_SETTLE, which nothing wakes us for the end of.
+    return m_marker_seen ? LanePool::RETRY : LanePool::IDLE;
+}
+
+bool OutputTS::MuxNext(void)
 {
-    struct StreamState {
-        int64_t pts{AV_NOPTS_VALUE};
-        int64_t dts{AV_NOPTS_VALUE};
+    if (m_videoPktQ.IsEmpty() || (!m_no_audio && m_audioPktQ.IsEmpty()))
+        return false;
+
+    // Never wait on the compat track, just take it when it is due.
+    const std::array<MediaQueue*, NUM_STREAM_IDS> queues {
+        &m_videoPktQ, &m_audioPktQ, &m_compatPktQ
     };
+    MediaQueue* targetQ = EarliestQueue(queues);
+    if (targetQ == nullptr)
+        return false;
+    bool is_audio_next = (targetQ != &m_videoPktQ);
 
-    std::array<StreamState, 2> prev_state;
+    if (targetQ->PeekMarker())
+    {
+        /*
+          Give the other streams' markers time to arrive, without
+          holding up the other inputs sharing the mux thread.
+        */
+        auto now = std::chrono::steady_clock::now();
+        if (!m_marker_seen)
+            m_marker_seen = now;
+        if (now - *m_marker_seen < MARKER_SETTLE)
+            return false;
+        m_marker_seen.reset();
+        sync_markers();
+        return true;
+    }
 
-    for (;;)
+    std::optional<Packet> outPkt = targetQ->PopValue();
+    if (!outPkt || !outPkt->pkt)
     {
-        {
-            std::unique_lock<std::mutex> cv_lock(m_pktQ_mutex);
-            m_pktQ_ready.wait(cv_lock, [this] {
-                return !m_running || !m_videoPktQ.IsEmpty();
-            });
-        }
+        m_log->warn("Mux: Extracted packet payload is null");
+        return true;
+    }
 
-        if (m_videoPktQ.IsEmpty() || (!m_no_audio && m_audioPktQ.IsEmpty()))
-        {
-            if (!m_running.load())
-                break; // shutdown
-            continue; // Catch spurious wakeups
-        }
+    PacketPtr pkt = std::move(outPkt->pkt);
+    int stream_id = pkt->stream_index;
 
-        auto* targetQ = &m_videoPktQ;
-        bool is_audio_next = false;
+    m_log->trace("POST {} pts={} dts={} dur={}",
+                 is_audio_next ? "audio" : "video",
+                 pkt->pts, pkt->dts, pkt->duration);
 
-        if (!m_audioPktQ.IsEmpty())
-        {
-            if (m_audioPktQ.PeekDts() < m_videoPktQ.PeekDts())
-            {
-                targetQ = &m_audioPktQ;
-                is_audio_next = true;
-            }
-        }
+    if (m_formatContext == nullptr ||
+        stream_id >= static_cast<int>(m_formatContext->nb_streams))
+    {
+        // Compat track without a primary audio track to follow.
+        if (m_verbose > 2)
+            m_log->debug("MUX [id{:<2d}] no such stream, dropped",
+                         stream_id);
+        return true;
+    }
 
-        if (targetQ->PeekMarker())
-        {
-            sync_markers();
-            continue;
-        }
+    m_sequence[stream_id].Push(*outPkt);
+    m_metrics[stream_id].queue_depth->Set(targetQ->GetSize());
 
-        std::optional<Packet> outPkt = targetQ->PopValue();
-        if (!outPkt || !outPkt->pkt)
-        {
-            m_log->warn("Mux: Extracted packet payload is null");
-            continue;
-        }
+    if (pkt->dts == AV_NOPTS_VALUE)
+    {
+        LOG_LIMITED(m_log, spdlog::level::warn,
+                    "MUX [id{:<2d} version:{}] Missing DTS timestamp!",
+                    stream_id, outPkt->version);
+        return true;
+    }
 
-        PacketPtr pkt = std::move(outPkt->pkt);
-        int stream_id = pkt->stream_index;
+    // Non-monotonic Timestamp Protection
+    auto& prev = m_prev_state[stream_id];
 
-        m_log->trace("POST {} pts={} dts={} dur={}",
-                     is_audio_next ? "audio" : "video",
-                     pkt->pts, pkt->dts, pkt->duration);
+    if (prev.dts != AV_NOPTS_VALUE && pkt->dts <= prev.dts)
+    {
+        m_log->debug("MUX [{}] DTS delta {} non-monotonic: "
+                     "Fix: {} -> {}",
+                     stream_id,
+                     pkt->dts - prev.dts,
+                     pkt->dts,
+                     prev.dts + 1);
+        dump_sequence(stream_id, false);
+        pkt->dts = prev.dts + 1;
+    }
+    if (pkt->pts < pkt->dts)
+    {
+        m_log->debug("MUX [{}] PTS {} < {} DTS. Fix: Set pts = dts.",
+                    stream_id, pkt->pts, pkt->dts);
+        pkt->pts = pkt->dts;
+    }
 
-        if (pkt->dts == AV_NOPTS_VALUE)
-        {
-            m_log->warn("MUX [id{:<2d} version:{}] Missing DTS timestamp!",
-                        stream_id, outPkt->version);
-            continue;
-        }
+    m_log->trace("MUX [id{:<2d} version:{}] pts:{:#018x} dts:{:#018x} "
+                 "duration:{} size:{}",
+                 stream_id, outPkt->version, pkt->pts, pkt->dts,
+                 pkt->duration, pkt->size);
+
+    StreamState state = StreamState {
+        .pts = pkt->pts,
+        .dts = pkt->dts
+    };
 
-        // Non-monotonic Timestamp Protection
-        auto& prev = prev_state[stream_id];
+    // The muxer takes the payload.
+    int size = pkt->size;
 
-        if (prev.dts != AV_NOPTS_VALUE && pkt->dts <= prev.dts)
+    int ret = av_interleaved_write_frame(m_formatContext, pkt.get());
+    if (ret < 0)
+    {
+        if (ret == AVERROR(EINVAL))
         {
-            m_log->debug("MUX [{}] DTS delta {} non-monotonic: "
-                         "Fix: {} -> {}",
-                         stream_id,
-                         pkt->dts - prev.dts,
-                         pkt->dts,
-                         prev.dts + 1);
-            pkt->dts = prev.dts + 1;
+            LOG_LIMITED(m_log, spdlog::level::warn,
+                        "DAMAGED: Mux rejected packet "
+                        "id={} pts={} -> {} dts={} -> {}: {}",
+                        stream_id, prev.pts, state.pts,
+                        prev.dts, state.dts,
+                        AVerr2str(ret));
         }
-        if (pkt->pts < pkt->dts)
+        else
         {
-            m_log->debug("MUX [{}] PTS {} < {} DTS. Fix: Set pts = dts.",
-                        stream_id, pkt->pts, pkt->dts);
-            pkt->pts = pkt->dts;
+            LOG_LIMITED(m_log, spdlog::level::err,
+                        "DAMAGED: write frame stream {} failed: {}",
+                        stream_id, AVerr2str(ret));
         }
+        dump_sequence(stream_id, true);
+    }
+    else
+    {
+        m_prev_state[stream_id] = state;
+        m_metrics[stream_id].bytes->Inc(size);
 
-        m_log->trace("MUX [id{:<2d} version:{}] pts:{:#018x} dts:{:#018x} "
-                     "duration:{} size:{}",
-                     stream_id, outPkt->version, pkt->pts, pkt->dts,
-                     pkt->duration, pkt->size);
-
-        StreamState state = StreamState {
-            .pts = pkt->pts,
-            .dts = pkt->dts
-        };
-
-        int ret = av_interleaved_write_frame(m_formatContext, pkt.get());
-        if (ret < 0)
+        if (outPkt->latency)
         {
-            if (ret == AVERROR(EINVAL))
-            {
-                m_log->warn("DAMAGED: Mux rejected packet "
-                            "id={} pts={} -> {} dts={} -> {}: {}",
-                            stream_id, prev.pts, state.pts,
-                            prev.dts, state.dts,
-                            AVerr2str(ret));
-            }
-            else
+            bool due = m_latency.Written(*outPkt->latency);
+
+            const auto& ns = outPkt->latency->ns;
+            for (size_t idx = 0; idx < Latency::NUM_INTERVALS; ++idx)
             {
-                m_log->error("DAMAGED: write frame stream {} failed: {}",
-                             stream_id, AVerr2str(ret));
+                const Latency::Interval& ival = Latency::INTERVALS[idx];
+                if (ns[ival.from] > 0 && ns[ival.to] > 0)
+                    m_stage_metrics[idx]->Observe
+                        ((ns[ival.to] - ns[ival.from]) * 1e-9);
             }
+
+            if (due)
+                report_latency();
+        }
+    }
+
+    return true;
+}
+
+void OutputTS::report_latency(void)
+{
+    if (m_latency.Frames() > 0)
+        m_log->debug(m_latency.Summary());
+
+    if (!m_video_args.latency_file.empty())
+    {
+        // Replace it whole, so readers never see a partial file.
+        string tmp = m_video_args.latency_file + ".tmp";
+        FILE* fp = fopen(tmp.c_str(), "w");
+        if (fp == nullptr)
+        {
+            if (m_latency_failed++ % 100 == 0)
+                m_log->warn("Unable to write latency stats '{}': {}",
+                            tmp, strerror(errno));
         }
         else
         {
-            prev_state[stream_id] = state;
+            string json = m_latency.Json();
+            bool ok = fwrite(json.data(), 1, json.size(), fp) == json.size();
+            ok = (fclose(fp) == 0) && ok;
+            if (!ok || rename(tmp.c_str(),
+                              m_video_args.latency_file.c_str()) != 0)
+            {
+                if (m_latency_failed++ % 100 == 0)
+                    m_log->warn("Unable to write latency stats '{}': {}",
+                                m_video_args.latency_file, strerror(errno));
+            }
         }
     }
+
+    m_latency.NextWindow();
+}
+
+void OutputTS::dump_sequence(int stream_id, bool damaged)
+{
+    PacketSequence& seq = m_sequence[stream_id];
+
+    if (!seq.Due())
+        return;
+
+    if (damaged)
+        m_log->warn(seq.DebugStr(stream_id));
+    else if (m_verbose > 1)
+        m_log->info(seq.DebugStr(stream_id));
 }
 
 int OutputTS::AddMarker(Marker&& marker, int64_t timestamp)
@@ -826,19 +1120,114 @@ int OutputTS::AddMarker(Marker&& marker, int64_t timestamp)
                   m_video_latest_version.fetch_add(1, std::memory_order_relaxed) + 1;
         m_videoPktQ.Push(std::move(packet));
     }
-    m_pktQ_ready.notify_one();
+    else if (marker.stream_id == COMPAT_STREAM_ID)
+    {
+        m_log->trace("AddMarker: Compat audio");
+        version = packet.version =
+                  m_compat_latest_version.fetch_add(1, std::memory_order_relaxed) + 1;
+        m_compatPktQ.Push(std::move(packet));
+    }
+    packets_ready();
     return version;
 }
 
 void OutputTS::AddAudioPkt(Packet&& pkt)
 {
     m_audioPktQ.Push(std::move(pkt));
-    m_pktQ_ready.notify_one();
+    packets_ready();
+}
+
+/*
+  Make the stream matching `params` the active one. A suspended stream
+  with identical parameters is resumed if we have one, otherwise a new
+  stream is created and the least recently used one is dropped from the
+  pool.
+ */
+AudioStream* OutputTS::switch_audio(audiopool_t& pool,
+                                    AudioStream::Params&& params,
+                                    int64_t timestamp)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (!pool.empty() && !pool.front()->IsSuspended())
+        pool.front()->Suspend();
+
+    auto iter = std::find_if(pool.begin(), pool.end(),
+                             [&params](const auto& stream) {
+                                 return stream->GetParams() == params;
+                             });
+    bool warm = (iter != pool.end());
+
+    if (warm)
+    {
+        std::unique_ptr<AudioStream> stream = std::move(*iter);
+        pool.erase(iter);
+        stream->Resume(timestamp);
+        pool.push_front(std::move(stream));
+    }
+    else
+    {
+        if (params.is_lpcm)
+            pool.push_front(std::make_unique<PCMStream>(*this, m_verbose,
+                                                        std::move(params),
+                                                        timestamp));
+        else
+            pool.push_front(std::make_unique<BitStream>(*this, m_verbose,
+                                                        std::move(params),
+                                                        timestamp));
+
+        while (pool.size() > AUDIO_POOL_SIZE)
+            pool.pop_back();
+    }
+
+    double elapsed = std::chrono::duration<double, std::milli>
+                     (std::chrono::steady_clock::now() - start).count();
+
+    if (warm)
+    {
+        ++m_audio_switch.warm;
+        m_audio_switches_warm.Inc();
+        m_audio_switch_warm_time.Observe(elapsed / 1000);
+        m_audio_switch.warm_total_ms += elapsed;
+        m_audio_switch.warm_max_ms = std::max(m_audio_switch.warm_max_ms,
+                                              elapsed);
+    }
+    else
+    {
+        ++m_audio_switch.cold;
+        m_audio_switches_cold.Inc();
+        m_audio_switch_cold_time.Observe(elapsed / 1000);
+        m_audio_switch.cold_total_ms += elapsed;
+        m_audio_switch.cold_max_ms = std::max(m_audio_switch.cold_max_ms,
+                                              elapsed);
+    }
+
+    if (m_verbose > 0)
+        m_log->info("Audio switch ({}) to {} took {:.2f}ms",
+                    warm ? "warm" : "cold",
+                    pool.front()->GetParams(), elapsed);
+    if (m_verbose > 1)
+        log_audio_switch_stats();
+
+    return pool.front().get();
+}
+
+void OutputTS::log_audio_switch_stats(void)
+{
+    const auto& st = m_audio_switch;
+
+    m_log->info("Audio switches: warm {} (avg {:.2f}ms, max {:.2f}ms) "
+                "cold {} (avg {:.2f}ms, max {:.2f}ms)",
+                st.warm, st.warm ? st.warm_total_ms / st.warm : 0.0,
+                st.warm_max_ms,
+                st.cold, st.cold ? st.cold_total_ms / st.cold : 0.0,
+                st.cold_max_ms);
 }
 
 // Thread entry
 void OutputTS::process_audio(void)
 {
+    audiopool_t  audioPool;
     AudioStream* audioStream {nullptr};
 
     for (;;)
@@ -866,26 +1255,18 @@ void OutputTS::process_audio(void)
         if (audio.oParams.has_value())
         {
             std::scoped_lock lock(m_audio_pktQ_mutex);
-
-            delete audioStream;
-            if (audio.oParams->is_lpcm)
-            {
-                audioStream = new PCMStream(*this, m_verbose,
-                                            std::move(*audio.oParams),
-                                            audio.timestamp);
-            }
-            else
-            {
-                audioStream = new BitStream(*this, m_verbose,
-                                            std::move(*audio.oParams),
-                                            audio.timestamp);
-            }
+            audioStream = switch_audio(audioPool,
+                                       std::move(*audio.oParams),
+                                       audio.timestamp);
         }
 
         audioStream->AddSamples(std::move(audio));
     }
 
-    delete audioStream;
+    if (m_verbose > 0 && m_audio_switch.warm + m_audio_switch.cold > 1)
+        log_audio_switch_stats();
+
+    audioPool.clear();
     m_log->info("process_audio thread exited.");
 }
 
@@ -899,6 +1280,83 @@ void OutputTS::AddAudioSamples(AudioStream::Samples&& samples)
     return;
 }
 
+// A new input format, from Magewell.
+void OutputTS::video_params(const VideoStream::Params& params)
+{
+    m_video_params = params;
+    m_image_size = max(0, av_image_get_buffer_size(params.pix_fmt,
+                                                   params.width,
+                                                   params.height, 1));
+    m_static_hash.reset();
+    if (m_rate_detector)
+        m_rate_detector->Reset(params.frame_duration, m_image_size);
+}
+
+/*
+  Inverse telecine (--inverse-telecine). Returns false if the image
+  repeats the one before it where the film cadence has a repeat, and
+  has been handed back. The encoder stays at the input frame rate, so
+  the images kept go on as they are.
+*/
+bool OutputTS::filter_repeat(VideoStream::Image& image)
+{
+    // Still arriving (--low-latency): nothing to compare yet.
+    if (image.rows != nullptr || !m_video_params)
+        return true;
+
+    FrameRateDetector::Result result =
+        m_rate_detector->Add(image.pImage, image.timestamp);
+    if (result.drop)
+    {
+        f_image_avail(image.pImage, image.pEco);
+        return false;
+    }
+    return true;
+}
+
+/*
+  Static frames (--skip-static). An image identical to the one handed
+  on before it is marked as a repeat, so it is not uploaded: the
+  encoder is given the last surface again instead.
+*/
+void OutputTS::mark_static(VideoStream::Image& image)
+{
+    if (image.rows != nullptr || m_image_size == 0)
+    {
+        m_static_hash.reset();
+        return;
+    }
+
+    uint64_t hash = FrameHash::Full(image.pImage, m_image_size);
+    // A new VideoStream has nothing to repeat.
+    image.repeat = !image.oParams.has_value() && m_static_hash == hash;
+    m_static_hash = hash;
+
+    ++m_static_checked;
+    if (image.repeat)
+    {
+        ++m_static_skipped;
+        m_static_frames.Inc();
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (now - m_static_window < chrono::seconds(60))
+        return;
+
+    if (m_verbose > 1 && m_static_skipped > 0)
+    {
+        uint64_t saved = m_static_saved.Value();
+        m_log->info("Static frames: {} of {} not uploaded over the last "
+                    "minute, saving about {:.1f}ms of copy thread time",
+                    m_static_skipped, m_static_checked,
+                    (saved - m_static_saved_last) / 1000.0);
+        m_static_saved_last = saved;
+    }
+    m_static_window  = now;
+    m_static_checked = 0;
+    m_static_skipped = 0;
+}
+
 // Thread entry
 void OutputTS::process_video(void)
 {
@@ -922,7 +1380,16 @@ void OutputTS::process_video(void)
 
             image = std::move(m_imageQ.front());
             m_imageQ.pop_front();
+            m_image_queue_depth.Set(m_imageQ.size());
         } // lock scope
+        image.stamps.Mark(Latency::DEQUEUE);
+
+        if (image.oParams.has_value())
+            video_params(*image.oParams);
+        if (m_rate_detector && !filter_repeat(image))
+            continue;
+        if (m_video_args.skip_static)
+            mark_static(image);
 
         if (image.oParams.has_value())
         {
@@ -956,6 +1423,7 @@ void OutputTS::AddVideoImage(VideoStream::Image&& image)
         }
 
         m_imageQ.push_back(std::move(image));
+        m_image_queue_depth.Set(m_imageQ.size());
     }
 
     m_imageQ_ready.notify_one();
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 #include <deque>
@@ -11,6 +13,7 @@
 #include <atomic>
 #include <functional>
 #include <chrono>
+#include <memory>
 
 #include <spdlog/spdlog.h>
 #ifdef SPDLOG_FMT_EXTERNAL
@@ -20,12 +23,15 @@
 #endif
 
 #include "MediaQueue.h"
-#if 0
+#include "Metrics.h"
 #include "PacketSequence.h"
-#endif
 
 #include "VideoStream.h"
 #include "AudioStream.h"
+#include "CompatStream.h"
+#include "FrameRateDetector.h"
+
+class MptsMux;
 
 class OutputTS
 {
@@ -33,18 +39,38 @@ class OutputTS
     using ShutdownCallback = std::function<void (void)>;
 
     enum ID {
-        VIDEO_STREAM_ID = 0,
-        AUDIO_STREAM_ID = 1
+        VIDEO_STREAM_ID  = 0,
+        AUDIO_STREAM_ID  = 1,
+        COMPAT_STREAM_ID = 2,
+        NUM_STREAM_IDS
     };
 
-    OutputTS(int verbose, bool isEco,
+    /*
+      Where the transport stream goes: appended to `path`, a file or
+      named pipe (empty, or "-", for stdout), muxed by a lane of
+      `mux_pool`; or as `program` of `mpts`.
+    */
+    struct Destination
+    {
+        std::string path;
+        LanePool*   mux_pool {nullptr};
+        MptsMux*    mpts    {nullptr};
+        int         program {1};
+    };
+
+    OutputTS(int verbose, int input, bool isEco,
+             const Destination& output,
              VideoStream::Args&& video_args,
+             AudioStream::Args&& audio_args,
              ShutdownCallback shutdown,
              VideoStream::MagCallback image_buffer_avail);
     ~OutputTS(void);
 
     void Shutdown(void);
 
+    // True if the output could not be opened.
+    bool operator!(void) const { return m_output_fd < 0; }
+
     void log_packet(std::string where, const AVPacket* pkt, int version);
 
     void setHaveAudio(void) { m_no_audio = false; }
@@ -62,14 +88,85 @@ class OutputTS
     void AddAudioSamples(AudioStream::Samples&& audio);
     void AddVideoImage(VideoStream::Image&& image);
 
+    // Stereo compatibility track, if enabled
+    CompatStream* Compat(void) { return m_compat.get(); }
+
+    Latency::Tracker& Latency(void) { return m_latency; }
+
+    // The capture input (1 based) this output is for.
+    int Input(void) const { return m_input; }
+
+    // How soon a mux lane waiting out a format change is revisited.
+    static constexpr std::chrono::milliseconds MUX_RETRY {20};
+
+    // Copy thread time static frames did not need (--skip-static).
+    Metrics::Counter& StaticSaved(void) { return m_static_saved; }
+
+    /*
+      Write the next packet, if one is due. Called by our lane of the
+      shared mux pool, or by the MPTS mux thread for every program in
+      turn. Returns false if there was nothing to do.
+    */
+    bool MuxNext(void);
+
   private:
+    // Recently used audio streams, most recent (active) first.
+    using audiopool_t = std::deque<std::unique_ptr<AudioStream>>;
+    static constexpr size_t AUDIO_POOL_SIZE = 3;
+
+    struct AudioSwitchStats
+    {
+        uint64_t warm         {0};
+        uint64_t cold         {0};
+        double   warm_total_ms {0};
+        double   cold_total_ms {0};
+        double   warm_max_ms   {0};
+        double   cold_max_ms   {0};
+    };
+
+    struct StreamState
+    {
+        int64_t pts {AV_NOPTS_VALUE};
+        int64_t dts {AV_NOPTS_VALUE};
+    };
+
+    // How long a format change waits for the other streams' markers.
+    static constexpr std::chrono::milliseconds MARKER_SETTLE {150};
+
+    // Prometheus series for one output stream
+    struct StreamMetrics
+    {
+        Metrics::Gauge*     queue_depth {nullptr};
+        Metrics::Counter*   bytes       {nullptr};
+        Metrics::Histogram* send        {nullptr};
+        Metrics::Histogram* receive     {nullptr};
+    };
+
+    MediaQueue& pkt_queue(int stream_id);
     void sync_markers(void);
-    void mux(void);
+    LanePool::Result mux_step(void);
     bool queue_packets(int stream_id, int version,
                        AVCodecContext* enc,
                        MediaQueue& pktQ, bool flushing);
     void process_video(void);
+    void video_params(const VideoStream::Params& params);
+    bool filter_repeat(VideoStream::Image& image);
+    void mark_static(VideoStream::Image& image);
     void process_audio(void);
+    AudioStream* switch_audio(audiopool_t& pool,
+                              AudioStream::Params&& params,
+                              int64_t timestamp);
+    void log_audio_switch_stats(void);
+    void dump_sequence(int stream_id, bool damaged);
+    void report_latency(void);
+
+    void packets_ready(void);
+
+#if LIBAVFORMAT_VERSION_MAJOR < 61
+    static int mpts_write(void* opaque, uint8_t* buf, int size);
+#else
+    static int mpts_write(void* opaque, const uint8_t* buf, int size);
+#endif
 
     void optimize_mpegts(AVFormatContext* format_ctx);
     bool open_container(void);
@@ -78,6 +175,7 @@ class OutputTS
     // spdlog
     std::shared_ptr<spdlog::logger> m_log;
     int                     m_verbose;
+    int                     m_input;    // 1 based, for metric labels
 
     std::chrono::milliseconds m_frame_ms { 16 };
 
@@ -86,30 +184,53 @@ class OutputTS
 
     std::optional<Packet> m_video_marker;
     std::optional<Packet> m_audio_marker;
+    std::optional<Packet> m_compat_marker;
 
     AVFormatContext* m_formatContext {nullptr};
+    std::string      m_output_url    {"pipe:1"};
+    int              m_output_fd     {1};   // stdout
+    MptsMux*         m_mpts          {nullptr};
+    LanePool*        m_mux_pool      {nullptr};
+    LanePool::Lane*  m_mux_lane      {nullptr};
+    int              m_program       {1};
+    int              m_tables_version {-1};
+    std::optional<std::chrono::steady_clock::time_point> m_marker_seen;
 
     int64_t          m_last_dts      {0};
+    std::array<StreamState, NUM_STREAM_IDS> m_prev_state;
 
     MediaQueue       m_videoPktQ;
     MediaQueue       m_audioPktQ;
+    // Pushed to by the CompatStream thread; MediaQueue's own mutex
+    // covers every push and pop.
+    MediaQueue       m_compatPktQ;
 
     VideoStream::imageque_t m_imageQ;
     AudioStream::audioque_t m_audioQ;
 
     bool                    m_no_audio     {true};
     VideoStream::Args       m_video_args;
+    AudioStream::Args       m_audio_args;
+    std::unique_ptr<CompatStream> m_compat;
+    std::unique_ptr<FrameRateDetector> m_rate_detector;
+    std::optional<VideoStream::Params> m_video_params;
+    int                     m_image_size {0};
+
+    // --skip-static
+    std::optional<uint64_t> m_static_hash;
+    std::chrono::steady_clock::time_point m_static_window
+                            {std::chrono::steady_clock::now()};
+    uint64_t                m_static_checked    {0};
+    uint64_t                m_static_skipped    {0};
+    uint64_t                m_static_saved_last {0};
 
     ShutdownCallback        f_shutdown;
     VideoStream::MagCallback f_image_avail;
-    std::thread             m_mux_thread;
     std::thread             m_audio_thread;
     std::thread             m_video_thread;
 
     std::mutex              m_audio_pktQ_mutex;
     std::mutex              m_video_pktQ_mutex;
-    std::mutex              m_pktQ_mutex;
-    std::condition_variable m_pktQ_ready;
 
     std::mutex              m_imageQ_mutex;
     std::condition_variable m_imageQ_ready;
@@ -121,12 +242,63 @@ class OutputTS
 
     std::atomic<bool>       m_running       {true};
 
-    int                     m_video_current_version {0};
-    int                     m_audio_current_version {0};
-    std::atomic<int>        m_video_latest_version  {0};
-    std::atomic<int>        m_audio_latest_version  {0};
+    AudioSwitchStats        m_audio_switch;
+    Latency::Tracker        m_latency;
+    uint64_t                m_latency_failed {0};
 
-#if 0
-    PacketSequence m_sequence;
-#endif
+    std::array<StreamMetrics, NUM_STREAM_IDS> m_metrics;
+    std::array<Metrics::Histogram*, Latency::NUM_INTERVALS> m_stage_metrics {};
+    Metrics::Gauge&         m_image_queue_depth {
+        Metrics::GetGauge("magewell2ts_image_queue_depth",
+                          "Captured images waiting for the video manager",
+                          Metrics::WithInput(m_input))
+    };
+    Metrics::Counter&       m_static_frames {
+        Metrics::GetCounter("magewell2ts_frames_static_total",
+                            "Frames identical to the one before, "
+                            "not uploaded (--skip-static)",
+                            Metrics::WithInput(m_input))
+    };
+    Metrics::Counter&       m_static_saved {
+        Metrics::GetCounter("magewell2ts_static_copy_saved_microseconds_total",
+                            "Estimated copy thread time not spent uploading "
+                            "static frames", Metrics::WithInput(m_input))
+    };
+    Metrics::Counter&       m_reopens {
+        Metrics::GetCounter("magewell2ts_container_reopens_total",
+                            "Times the transport stream container was "
+                            "(re)opened", Metrics::WithInput(m_input))
+    };
+    Metrics::Counter&       m_audio_switches_warm {
+        Metrics::GetCounter("magewell2ts_audio_switches_total",
+                            "Audio format switches",
+                            Metrics::WithInput(m_input, {{"kind", "warm"}}))
+    };
+    Metrics::Counter&       m_audio_switches_cold {
+        Metrics::GetCounter("magewell2ts_audio_switches_total",
+                            "Audio format switches",
+                            Metrics::WithInput(m_input, {{"kind", "cold"}}))
+    };
+    Metrics::Histogram&     m_audio_switch_warm_time {
+        Metrics::GetHistogram("magewell2ts_audio_switch_seconds",
+                              "Time to switch the audio stream to a new "
+                              "format",
+                              Metrics::WithInput(m_input, {{"kind", "warm"}}))
+    };
+    Metrics::Histogram&     m_audio_switch_cold_time {
+        Metrics::GetHistogram("magewell2ts_audio_switch_seconds",
+                              "Time to switch the audio stream to a new "
+                              "format",
+                              Metrics::WithInput(m_input, {{"kind", "cold"}}))
+    };
+
+    int                     m_video_current_version  {0};
+    int                     m_audio_current_version  {0};
+    int                     m_compat_current_version {0};
+    std::atomic<int>        m_video_latest_version   {0};
+    std::atomic<int>        m_audio_latest_version   {0};
+    std::atomic<int>        m_compat_latest_version  {0};
+
+    // Mux thread only
+    std::array<PacketSequence, NUM_STREAM_IDS> m_sequence;
 };
@@ -1,4 +1,5 @@
 #include "PCMStream.h"
+#include "AudioConvert.h"
 #include "OutputTS.h"
 
 using namespace std;
@@ -26,6 +27,52 @@ void PCMStream::Reset(void)
     open_encoder();
 }
 
+void PCMStream::Suspend(void)
+{
+    AudioStream::Suspend();
+
+    // Less than one AC3 frame worth of audio; it belongs to the
+    // previous segment and would be out of place on resume.
+    if (m_fifo)
+        av_audio_fifo_reset(m_fifo.get());
+}
+
+void PCMStream::Resume(int64_t timestamp)
+{
+    AudioStream::Resume(timestamp);
+
+    if (!m_encoder)
+    {
+        open_encoder();
+        return;
+    }
+
+    // Discard any history held by the resampler. A same-rate resampler
+    // only exists for drift compensation and is recreated on demand.
+    if (m_params.sample_rate == m_encoder->sample_rate)
+        m_swr.reset(nullptr);
+    else if (m_swr)
+    {
+        swr_close(m_swr.get());
+        int ret = swr_init(m_swr.get());
+        if (ret < 0)
+        {
+            m_log->error("Failed to re-initialize SwrContext: {}",
+                         AVerr2str(ret));
+            m_swr.reset();
+            init_resampler();
+        }
+    }
+
+    if (m_verbose > 1)
+        m_log->info("Resuming AC3 : {}ch {}Hz {}bps",
+                    m_encoder->ch_layout.nb_channels,
+                    m_encoder->sample_rate,
+                    m_encoder->bit_rate);
+
+    add_marker();
+}
+
 #if 0
 static bool ac3_sample_rate_supported(const AVCodec* codec, int sample_rate)
 {
@@ -125,38 +172,8 @@ bool PCMStream::open_encoder(void)
     {
         m_swr.reset(nullptr); // No resampling needed
     }
-    else
-    {
-        m_log->info("Initializing resampler: {}Hz -> {}Hz",
-                    m_params.sample_rate, m_encoder->sample_rate);
-
-        AVSampleFormat resample_fmt = AV_SAMPLE_FMT_FLTP;
-        SwrContext* swr_raw = nullptr;
-        ret = swr_alloc_set_opts2(&swr_raw,
-                                  &m_encoder->ch_layout,
-                                  m_encoder->sample_fmt,
-                                  m_encoder->sample_rate,
-                                  &m_encoder->ch_layout,
-                                  resample_fmt,
-                                  m_params.sample_rate,
-                                  0, nullptr);
-
-        if (ret < 0 || !swr_raw)
-        {
-            m_log->error("Failed to allocate SwrContext: {}", AVerr2str(ret));
-            return false;
-        }
-
-        // Reset your modern SwrContextPtr wrapper with the allocated object
-        m_swr.reset(swr_raw);
-
-        if ((ret = swr_init(m_swr.get())) < 0)
-        {
-            m_log->error("Failed to initialize SwrContext: {}", AVerr2str(ret));
-            m_swr.reset();
-            return false;
-        }
-    }
+    else if (!init_resampler())
+        return false;
 
     m_log->trace("fmt={} channels={} frame_size={}",
                  av_get_sample_fmt_name(m_encoder->sample_fmt),
@@ -184,6 +201,12 @@ bool PCMStream::open_encoder(void)
                 m_encoder->sample_rate,
                 m_encoder->bit_rate);
 
+    add_marker();
+    return true;
+}
+
+void PCMStream::add_marker(void)
+{
     CodecParamsPtr codecpar = make_codec_params();
     avcodec_parameters_from_context(codecpar.get(), m_encoder.get());
     Marker marker {
@@ -199,13 +222,54 @@ bool PCMStream::open_encoder(void)
     m_pts = av_rescale_q(m_pts,
                          TimeBase::Magewell,
                          m_encoder->time_base);
+    m_drift.Reset();
+}
+
+bool PCMStream::init_resampler(void)
+{
+    if (m_params.sample_rate == m_encoder->sample_rate)
+        m_log->debug("Initializing resampler for drift compensation");
+    else
+        m_log->info("Initializing resampler: {}Hz -> {}Hz",
+                    m_params.sample_rate, m_encoder->sample_rate);
+
+    AVSampleFormat resample_fmt = AV_SAMPLE_FMT_FLTP;
+    SwrContext* swr_raw = nullptr;
+    int ret = swr_alloc_set_opts2(&swr_raw,
+                                  &m_encoder->ch_layout,
+                                  m_encoder->sample_fmt,
+                                  m_encoder->sample_rate,
+                                  &m_encoder->ch_layout,
+                                  resample_fmt,
+                                  m_params.sample_rate,
+                                  0, nullptr);
+
+    if (ret < 0 || !swr_raw)
+    {
+        m_log->error("Failed to allocate SwrContext: {}", AVerr2str(ret));
+        return false;
+    }
+
+    // Reset your modern SwrContextPtr wrapper with the allocated object
+    m_swr.reset(swr_raw);
+
+    if ((ret = swr_init(m_swr.get())) < 0)
+    {
+        m_log->error("Failed to initialize SwrContext: {}", AVerr2str(ret));
+        m_swr.reset();
+        return false;
+    }
+
     return true;
 }
 
 void PCMStream::close_encoder(void)
 {
-    m_parent.FlushPackets(OutputTS::AUDIO_STREAM_ID, m_version,
-                          m_encoder.get());
+    // A suspended stream has already handed the audio PID to another
+    // stream, so anything left in the encoder is stale.
+    if (!m_suspended)
+        m_parent.FlushPackets(OutputTS::AUDIO_STREAM_ID, m_version,
+                              m_encoder.get());
 
     if (m_verbose > 1)
     {
@@ -256,6 +320,9 @@ void PCMStream::encode_frame(void)
         return;
     }
 
+    if (CompatStream* compat = m_parent.Compat())
+        compat->AddFrame(frame);
+
     if (!m_parent.EncodeFrame(OutputTS::AUDIO_STREAM_ID, m_version,
                               m_encoder.get(), frame))
     {
@@ -291,44 +358,14 @@ void PCMStream::AddSamples(AudioStream::Samples&& audio)
         planes[ch] = planar.data() + (input_samples * ch);
     }
 
-    if (!is_24bit)
-    {
-        // 16 bits
-        const int16_t* src =
-            reinterpret_cast<const int16_t*>(audio.data.data());
+    AudioConvert::ToPlanarFloat(audio.data.data(), channels, input_samples,
+                                is_24bit, planes);
 
-        constexpr float scale = 1.0f / 32768.0f;
-
-        for (int s = 0; s < input_samples; ++s)
-        {
-            for (int ch = 0; ch < channels; ++ch)
-            {
-                planes[ch][s] = static_cast<float>
-                                (src[s * channels + ch]) * scale;
-            }
-        }
-    }
-    else
-    {
-        // 24 bits
-
-        // Magewell 24-bit audio is delivered in 32-bit sample containers.
-        // Treat as signed S32 PCM and normalize directly.
-
-        const int32_t* src =
-            reinterpret_cast<const int32_t*>(audio.data.data());
-
-        constexpr float scale = 1.0f / 2147483648.0f;
-
-        for (int s = 0; s < input_samples; ++s)
-        {
-            for (int ch = 0; ch < channels; ++ch)
-            {
-                planes[ch][s] =
-                    static_cast<float>(src[s * channels + ch]) * scale;
-            }
-        }
-    }
+    // Card timestamp of this block in the encoder (48kHz) timing domain
+    int64_t hw_pts = av_rescale_q(audio.timestamp,
+                                  TimeBase::Magewell,
+                                  TimeBase::AUDIO48);
+    compensate_drift(hw_pts);
 
     if (m_swr)
     {
@@ -389,20 +426,65 @@ void PCMStream::AddSamples(AudioStream::Samples&& audio)
         }
     }
 
-    // Instead of completely overwriting m_pts on every frame block based on
-    // real-world system delivery timestamps (which jitter), establish a linear continuity baseline.
-    int64_t hw_pts = av_rescale_q(audio.timestamp,
-                                  TimeBase::Magewell,
-                                  TimeBase::AUDIO48);
+    // Encode while enough samples exist
+    while (av_audio_fifo_size(m_fifo.get()) >= AC3_FRAME_SAMPLES)
+    {
+        encode_frame();
+    }
+}
+
+void PCMStream::compensate_drift(int64_t hw_pts)
+{
+    /*
+      Instead of completely overwriting m_pts on every block based on
+      the card timestamps (which jitter), keep a linear sample clock
+      and nudge the resampler to keep it locked to the card clock.
+      The card clock is what the video timestamps come from, so this
+      is what keeps the A/V offset bounded over long recordings.
+     */
+    int64_t queued = av_audio_fifo_size(m_fifo.get());
+    if (m_swr)
+        queued += swr_get_delay(m_swr.get(), m_encoder->sample_rate);
+
+    int64_t error = m_pts + queued - hw_pts;
 
     // If stream has just started or drifted massively (> 100ms),
     // hard-sync m_pts
-    if (m_pts == 0 || std::abs(m_pts - hw_pts) > 4800)
-        m_pts = hw_pts;
+    if (m_pts == 0 || std::abs(error) > 4800)
+    {
+        if (m_pts != 0)
+            m_log->warn("Audio clock off by {:.1f}ms, resyncing.",
+                        error * 1000.0 / m_encoder->sample_rate);
+        m_pts = hw_pts - queued;
+        m_drift.Reset();
+        return;
+    }
 
-    // Encode while enough samples exist
-    while (av_audio_fifo_size(m_fifo.get()) >= AC3_FRAME_SAMPLES)
+    if (!m_drift.Update(hw_pts, error))
+        return;
+
+    // Spread the correction over the next second of output.
+    int distance = m_encoder->sample_rate;
+    int delta = m_drift.Correction(distance);
+
+    if (delta != 0 && !m_swr && !init_resampler())
+        return;
+
+    if (m_swr)
     {
-        encode_frame();
+        int ret = swr_set_compensation(m_swr.get(), delta, distance);
+        if (ret < 0)
+            m_log->warn("swr_set_compensation failed: {}", AVerr2str(ret));
     }
+
+    if (!m_drift.Valid())
+        return;
+
+    if (m_verbose > 2)
+        m_log->debug("Audio drift {:.1f}ppm, offset {:.2f}ms, "
+                     "compensation {} samples/s",
+                     m_drift.PPM(), m_drift.OffsetMS(), delta);
+    else if (m_verbose > 0 && m_drift_reports++ % 300 == 0)
+        m_log->info("Audio clock drift {:.1f}ppm vs. capture clock "
+                    "(offset {:.2f}ms)", m_drift.PPM(), m_drift.OffsetMS());
 }
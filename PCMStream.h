@@ -1,6 +1,7 @@
 #pragma once
 
 #include "AudioStream.h"
+#include "ClockDrift.h"
 
 extern "C" {
 #include <libavutil/audio_fifo.h>
@@ -16,13 +17,23 @@ class PCMStream : public AudioStream
 
     void AddSamples(AudioStream::Samples&& audio) override;
 
+    void Suspend(void) override;
+    void Resume(int64_t timestamp) override;
+
   private:
     bool open_encoder(void);
     void close_encoder(void);
+    bool init_resampler(void);
+    void add_marker(void);
     void encode_frame(void);
+    void compensate_drift(int64_t hw_pts);
 
     CodecContextPtr m_encoder;
     AudioFifoPtr    m_fifo;
 
     SwrContextPtr m_swr{nullptr};
+
+    // Audio sample clock vs. Magewell card clock
+    ClockDrift    m_drift         {48000};
+    int           m_drift_reports {0};
 };
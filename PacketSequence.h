@@ -1,250 +1,175 @@
 #pragma once
 
-#include <deque>
-#include <mutex>
-#include <string>
-#include <format>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <string>
 
-#include "MediaQueue.h"
-
-// Forward declarations or include headers matching your codebase
-extern "C" {
-#include <libavcodec/packet.h>
-}
-
+#include <spdlog/spdlog.h>
+#ifdef SPDLOG_FMT_EXTERNAL
+#include <fmt/format.h>
+#else
+#include <spdlog/fmt/bundled/format.h>
+#endif
 
+#include "MediaQueue.h"
+#include "NalScanner.h"
+
+/*
+  Flight recorder of the last HISTORY packets (and markers) of one
+  stream, as they reach the mux. It is always on, so that when the mux
+  reports damage we can see what led up to it.
+
+  Only the mux thread touches it, so it needs no locking. Push() copies
+  a few fields into a fixed ring; the only payload it looks at is the
+  NAL/OBU headers in front of the first slice of a video packet, which
+  is enough to spot IDR/SPS/PPS.
+*/
 class PacketSequence
 {
-  private:
-    struct DebugSnapshot
-    {
-        bool is_marker;
-        int version;
-        int64_t dts;
-        AVRational time_base;
-        bool is_disordered{false};
-
-        // Appended Video Bitstream Properties
-        bool is_keyframe{false};
-        bool has_idr{false};
-        bool has_sps{false};
-        bool has_pps{false};
-    };
-
-    /**
-     * @brief Helper to parse H.264/H.265 Annex B payloads for
-     * specific NAL unit types.
-     */
-    static void ParseNalUnits(const AVPacket* av_pkt, bool& out_idr,
-                              bool& out_sps, bool& out_pps)
-    {
-        out_idr = false;
-        out_sps = false;
-        out_pps = false;
-
-        if (!av_pkt || !av_pkt->data || av_pkt->size < 4)
-        {
-            return;
-        }
-
-        const uint8_t* data = av_pkt->data;
-        const int size = av_pkt->size;
-
-        // Scan payload for 0x000001 or 0x00000001 Annex B boundaries
-        for (int idx = 0; idx < size - 4; ++idx)
-        {
-            if (data[idx] == 0x00 && data[idx + 1] == 0x00)
-            {
-                int nal_index = -1;
-                if (data[idx + 2] == 0x01)
-                {
-                    nal_index = idx + 3;    // 3-byte start code
-                }
-                else if (data[idx + 2] == 0x00 && data[idx + 3] == 0x01)
-                {
-                    nal_index = idx + 4;    // 4-byte start code
-                }
-
-                if (nal_index != -1 && nal_index < size)
-                {
-                    // Sniff the NAL unit type byte
-
-                    // H.264 extraction format
-                    uint8_t nal_type = data[nal_index] & 0x1F;
-
-                    if (nal_type == 5)
-                    {
-                        out_idr = true;    // IDR Slice
-                    }
-                    else if (nal_type == 7)
-                    {
-                        out_sps = true;    // Sequence Parameter Set
-                    }
-                    else if (nal_type == 8)
-                    {
-                        out_pps = true;    // Picture Parameter Set
-                    }
-
-                    // Optional H.265 Sniffing support fallback:
-                    // uint8_t h265_type = (data[nal_index] >> 1) & 0x3F;
-                    // if (h265_type >= 16 && h265_type <= 21) out_idr = true;
-                    // else if (h265_type == 32) out_sps = true;
-                    // else if (h265_type == 33) out_pps = true;
-                }
-            }
-        }
-    }
-
   public:
-    PacketSequence() = default;
-    ~PacketSequence() = default;
+    static constexpr size_t HISTORY = 128;
+
+    PacketSequence(void) = default;
 
     PacketSequence(const PacketSequence&) = delete;
     PacketSequence& operator=(const PacketSequence&) = delete;
 
-    /**
-     * @brief Pushes metadata and evaluates internal frame structure
-     * flags safely via references.
-     * @param pkt Custom wrapper packet container.
-     * @param av_pkt Core raw reference pointer (usually pulled from
-     * pkt.pkt or your active loop step).
-     */
-    bool Push(const Packet& pkt, const AVPacket* av_pkt)
-    {
-        std::scoped_lock lock(m_mutex);
-
-        bool is_chronological = true;
-        bool is_disordered = false;
+    // Video codec, for sniffing NAL units. Audio leaves it as NONE.
+    void SetCodec(AVCodecID codec) { m_codec = codec; }
 
-        // Calculate Chronological DTS Consistency
-        if (!pkt.is_marker && av_pkt->dts != 0)
-        {
-            for (auto it = m_history.rbegin(); it != m_history.rend(); ++it)
-            {
-                if (!it->is_marker && it->dts != 0)
-                {
-                    if (av_pkt->dts < it->dts)
-                    {
-                        is_chronological = false;
-                        is_disordered = true;
-                    }
-                    break;
-                }
-            }
-        }
-
-        // Parse bitstream attributes out of raw container
-        bool is_key = false;
-        bool idr = false, sps = false, pps = false;
-
-        if (av_pkt)
-        {
-            is_key = (av_pkt->flags & AV_PKT_FLAG_KEY) != 0;
-            ParseNalUnits(av_pkt, idr, sps, pps);
-        }
+    void Push(const Packet& pkt)
+    {
+        Entry& entry = m_ring[m_count++ % HISTORY];
 
-        // Commit snapshot to rolling history window
-        m_history.push_back(DebugSnapshot {
-                .is_marker = pkt.is_marker,
-                .version = pkt.version,
-                .dts = av_pkt->dts,
-                .time_base = pkt.time_base,
-                .is_disordered = is_disordered,
-                .is_keyframe = is_key,
-                .has_idr = idr,
-                .has_sps = sps,
-                .has_pps = pps
-            });
-
-        if (m_history.size() > MAX_HISTORY_SIZE)
+        entry.version = pkt.version;
+        entry.marker  = pkt.marker.has_value();
+        if (!pkt.pkt)
         {
-            m_history.pop_front();
+            entry.dts = entry.pts = AV_NOPTS_VALUE;
+            entry.size  = 0;
+            entry.flags = 0;
+            return;
         }
 
-        return is_chronological;
+        const AVPacket* av_pkt = pkt.pkt.get();
+        entry.dts   = av_pkt->dts;
+        entry.pts   = av_pkt->pts;
+        entry.size  = av_pkt->size;
+        entry.flags = 0;
+        if (av_pkt->flags & AV_PKT_FLAG_KEY)
+            entry.flags |= KEY;
+        if (av_pkt->flags & AV_PKT_FLAG_DISCARD)
+            entry.flags |= DISCARD;
+        if (!entry.marker && av_pkt->data)
+            entry.flags |= sniff(av_pkt->data, av_pkt->size);
     }
 
-    /**
-     * @brief Formats current trace tracking history for print dumps.
-     */
-    std::string DebugStr() const
+    /*
+      True if enough has been pushed since the last DebugStr() to be
+      worth dumping again, so a burst of errors is only dumped once.
+    */
+    bool Due(void) const { return m_count - m_dumped >= HISTORY / 2; }
+
+    std::string DebugStr(int stream_id)
     {
-        std::scoped_lock lock(m_mutex);
+        m_dumped = m_count;
 
-        if (m_history.empty())
-        {
-            return "PacketSequence: [Empty]\n";
-        }
+        size_t count = std::min<uint64_t>(m_count, HISTORY);
+        if (count == 0)
+            return fmt::format("PacketSequence [id{}]: empty", stream_id);
 
-        std::string result =
-            std::format("PacketSequence History (Count: {}):\n",
-                        m_history.size());
-        result += "---------------------------------------------------------------------------------------\n";
+        fmt::memory_buffer out;
+        fmt::format_to(std::back_inserter(out),
+                       "PacketSequence [id{}] last {} of {}:",
+                       stream_id, count, m_count);
 
-        for (size_t idx = 0; idx < m_history.size(); ++idx)
+        int64_t prev_dts = AV_NOPTS_VALUE;
+        for (uint64_t idx = m_count - count; idx < m_count; ++idx)
         {
-            const auto& current = m_history[idx];
-            std::string delta_str = "N/A";
+            const Entry& entry = m_ring[idx % HISTORY];
 
-            if (current.is_marker || current.dts == 0)
+            if (entry.marker)
             {
-                delta_str = "[MARKER]";
+                fmt::format_to(std::back_inserter(out),
+                               "\n  [{:3d}] MARKER version {} dts {}",
+                               idx % HISTORY, entry.version, entry.dts);
+                continue;
             }
-            else
+
+            std::string delta = "N/A";
+            bool stalled = false;
+            if (prev_dts != AV_NOPTS_VALUE && entry.dts != AV_NOPTS_VALUE)
             {
-                for (size_t j = idx; j > 0; --j)
-                {
-                    const auto& prev = m_history[j - 1];
-                    if (!prev.is_marker && prev.dts != 0)
-                    {
-                        int64_t delta = current.dts - prev.dts;
-                        delta_str = std::format("{:+d}", delta);
-                        break;
-                    }
-                }
+                delta   = fmt::format("{:+d}", entry.dts - prev_dts);
+                stalled = entry.dts <= prev_dts;
             }
-
-            // Generate a concise flag footprint string block
-            // (e.g. "[K I S P]" or "[. . . .]")
-            std::string flags_str =
-                std::format("[{}{}{}{}]",
-                            current.is_keyframe ? "K" : ".",
-                            current.has_idr ? "I" : ".",
-                            current.has_sps ? "S" : ".",
-                            current.has_pps ? "P" : "."
-                            );
-
-            result +=
-                std::format("[{:2d}] DTS: {:12d} | Delta: {:9} | "
-                            "Flags: {:7} | Marker: {:5} | "
-                            "Ver: {} | TB: {}/{}{}\n",
-                            idx,
-                            current.dts,
-                            delta_str,
-                            flags_str,
-                            current.is_marker ? "TRUE" : "FALSE",
-                            current.version,
-                            current.time_base.num,
-                            current.time_base.den,
-                            current.is_disordered
-                            ? "  <-- !!! DTS DROP/STALL DETECTED !!!"
-                            : ""
-                            );
+            prev_dts = entry.dts;
+
+            fmt::format_to(std::back_inserter(out),
+                           "\n  [{:3d}] dts {:12d} ({:>7}) pts {:12d} "
+                           "size {:7d} [{}{}{}{}{}] version {}{}",
+                           idx % HISTORY, entry.dts, delta, entry.pts,
+                           entry.size,
+                           entry.flags & KEY     ? 'K' : '.',
+                           entry.flags & IDR     ? 'I' : '.',
+                           entry.flags & SPS     ? 'S' : '.',
+                           entry.flags & PPS     ? 'P' : '.',
+                           entry.flags & DISCARD ? 'D' : '.',
+                           entry.version,
+                           stalled ? "  <-- DTS not increasing" : "");
         }
 
-        result += "---------------------------------------------------------------------------------------\n";
-        return result;
+        return fmt::to_string(out);
     }
 
-    void Clear()
+    void Clear(void)
     {
-        std::scoped_lock lock(m_mutex);
-        m_history.clear();
+        m_count  = 0;
+        m_dumped = 0;
     }
 
   private:
-    static constexpr size_t MAX_HISTORY_SIZE = 128;
-    std::deque<DebugSnapshot> m_history;
-    mutable std::mutex m_mutex;
+    enum Flags : uint8_t
+    {
+        KEY     = 1 << 0,
+        IDR     = 1 << 1,
+        SPS     = 1 << 2,
+        PPS     = 1 << 3,
+        DISCARD = 1 << 4
+    };
+
+    struct Entry
+    {
+        int64_t dts;
+        int64_t pts;
+        int32_t size;
+        int32_t version;
+        uint8_t flags;
+        bool    marker;
+    };
+
+    // Parameter sets come first in an access unit; never look further.
+    static constexpr size_t SNIFF_LIMIT = 1024;
+
+    uint8_t sniff(const uint8_t* data, int size) const
+    {
+        uint32_t kinds = NalScanner::Classify(m_codec, data,
+                                              std::min<size_t>(size,
+                                                               SNIFF_LIMIT),
+                                              true);
+        uint8_t flags = 0;
+        if (kinds & NalScanner::Mask(NalScanner::IDR))
+            flags |= IDR;
+        if (kinds & NalScanner::Mask(NalScanner::SPS))
+            flags |= SPS;
+        if (kinds & NalScanner::Mask(NalScanner::PPS))
+            flags |= PPS;
+        return flags;
+    }
+
+    std::array<Entry, HISTORY> m_ring {};
+    uint64_t  m_count  {0};
+    uint64_t  m_dumped {0};
+    AVCodecID m_codec  {AV_CODEC_ID_NONE};
 };
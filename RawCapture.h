@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+/*
+  On-disk layout of a --record-raw capture.
+
+  A recording is two files:
+
+    <name>      Payload. Every video frame starts on an ALIGN boundary
+                and occupies its image size rounded up to ALIGN, so the
+                file can be written with O_DIRECT straight from the
+                capture buffers and mmap'ed for replay. Audio frames are
+                packed AUDIO_BLOCK_FRAMES at a time into ALIGN sized
+                blocks.
+    <name>.idx  A Header followed by fixed size Entry records. Entries
+                are appended as their payload reaches the disk, so they
+                are not necessarily in `seq` order; sort on `seq` to get
+                capture order. A format entry applies to every frame of
+                its kind with a higher `seq`.
+
+  Everything is little endian, timestamps are the card's own clock in
+  100ns units, and video/audio payloads are exactly what the Magewell
+  SDK handed over (MWCAP_AUDIO_CAPTURE_FRAME::adwSamples for audio).
+*/
+
+namespace RawCapture
+{
+    constexpr char     MAGIC[8]   = { 'M', 'W', '2', 'T', 'S', 'R', 'A', 'W' };
+    constexpr uint32_t VERSION    = 1;
+    constexpr size_t   ALIGN      = 4096;
+
+    constexpr int      AUDIO_FRAME_SAMPLES = 192;  // MWCAP_AUDIO_SAMPLES_PER_FRAME
+    constexpr int      AUDIO_CHANNELS      = 8;    // MWCAP_AUDIO_MAX_NUM_CHANNELS
+    constexpr size_t   AUDIO_FRAME_BYTES   =
+        AUDIO_FRAME_SAMPLES * AUDIO_CHANNELS * sizeof(uint32_t);
+    constexpr size_t   AUDIO_BLOCK_FRAMES  = 64;   // ~256ms at 48kHz
+    constexpr size_t   AUDIO_BLOCK_BYTES   =
+        AUDIO_FRAME_BYTES * AUDIO_BLOCK_FRAMES;
+    static_assert(AUDIO_BLOCK_BYTES % ALIGN == 0);
+
+    enum EntryType : uint32_t
+    {
+        VIDEO_FORMAT = 1,
+        AUDIO_FORMAT = 2,
+        VIDEO_FRAME  = 3,
+        AUDIO_FRAME  = 4
+    };
+
+    struct VideoFormat
+    {
+        uint32_t fourcc;
+        uint16_t cx;
+        uint16_t cy;
+        uint32_t stride;
+        uint32_t image_size;
+        uint32_t frame_duration;  // 100ns units
+        uint8_t  interlaced;
+        uint8_t  hdr_eotf;        // HDMI EOTF: 0 SDR, 2 PQ, 3 HLG
+        uint8_t  color_format;    // MWCAP_VIDEO_COLOR_FORMAT
+        uint8_t  quant_range;     // MWCAP_VIDEO_QUANTIZATION_RANGE
+    };
+
+    struct AudioFormat
+    {
+        uint16_t channel_valid;   // MWCAP_AUDIO_SIGNAL_STATUS::wChannelValid
+        uint8_t  lpcm;
+        uint8_t  bits_per_sample;
+        uint32_t sample_rate;
+    };
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+        uint32_t align;
+        uint32_t reserved[11];
+    };
+    static_assert(sizeof(Header) == 64);
+
+    struct Entry
+    {
+        uint32_t type;
+        uint32_t size;            // Payload bytes, without padding
+        uint64_t seq;
+        uint64_t offset;          // Payload position in the data file
+        int64_t  timestamp;
+        union
+        {
+            VideoFormat video;
+            AudioFormat audio;
+            uint8_t     reserved[32];
+        };
+    };
+    static_assert(sizeof(Entry) == 64);
+
+    inline size_t AlignUp(size_t bytes)
+    {
+        return (bytes + ALIGN - 1) & ~(ALIGN - 1);
+    }
+
+    struct FreeDeleter
+    {
+        void operator()(uint8_t* ptr) const { std::free(ptr); }
+    };
+    using AlignedBuffer = std::unique_ptr<uint8_t[], FreeDeleter>;
+
+    // Suitable for O_DIRECT I/O. Null on failure.
+    inline AlignedBuffer AllocAligned(size_t bytes)
+    {
+        return AlignedBuffer(static_cast<uint8_t*>
+                             (std::aligned_alloc(ALIGN, AlignUp(bytes))));
+    }
+}
@@ -0,0 +1,371 @@
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "RawRecorder.h"
+
+using namespace std;
+
+RawRecorder::RawRecorder(const string& path, int verbose_level,
+                         size_t max_pending, release_t release)
+    : m_path(path)
+    , m_verbose(verbose_level)
+    , m_max_pending(max(static_cast<size_t>(1), max_pending))
+    , m_release(std::move(release))
+{
+    m_log = spdlog::get("app_logger");
+    if (!m_log)
+    {
+        std::cerr << "RawRecorder Error: Logger 'app_logger' not found!"
+                  << std::endl;
+        return;
+    }
+
+    m_fd = open(m_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+    if (m_fd < 0 && errno == EINVAL)
+    {
+        m_direct = false;
+        m_log->warn("'{}' does not support O_DIRECT; the raw recording "
+                    "will go through the page cache.", m_path);
+        m_fd = open(m_path.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (m_fd < 0)
+    {
+        m_log->critical("Unable to create raw recording '{}': {}",
+                        m_path, strerror(errno));
+        return;
+    }
+
+    string idx_path = m_path + ".idx";
+    m_idx_fd = open(idx_path.c_str(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_idx_fd < 0)
+    {
+        m_log->critical("Unable to create raw recording index '{}': {}",
+                        idx_path, strerror(errno));
+        return;
+    }
+
+    RawCapture::Header header {};
+    memcpy(header.magic, RawCapture::MAGIC, sizeof(header.magic));
+    header.version    = RawCapture::VERSION;
+    header.entry_size = sizeof(RawCapture::Entry);
+    header.align      = RawCapture::ALIGN;
+    if (write(m_idx_fd, &header, sizeof(header)) != sizeof(header))
+    {
+        m_log->critical("Unable to write raw recording index '{}': {}",
+                        idx_path, strerror(errno));
+        close(m_idx_fd);
+        m_idx_fd = -1;
+        return;
+    }
+
+    m_start = chrono::steady_clock::now();
+
+    for (int idx = 0; idx < WRITER_THREADS; ++idx)
+    {
+        m_writers.emplace_back(&RawRecorder::writer, this);
+        pthread_setname_np(m_writers.back().native_handle(), "rawrec");
+    }
+
+    if (m_verbose > 0)
+        m_log->info("Recording raw capture to '{}'{}", m_path,
+                    m_direct ? " (O_DIRECT)" : "");
+}
+
+RawRecorder::~RawRecorder(void)
+{
+    {
+        scoped_lock lock(m_mutex);
+        if (m_audio_block && !m_audio_entries.empty())
+            queue_audio_block();
+    }
+    Flush();
+
+    {
+        scoped_lock lock(m_mutex);
+        m_running = false;
+    }
+    m_ready.notify_all();
+    for (auto& writer : m_writers)
+        writer.join();
+
+    if (m_fd >= 0)
+    {
+        // Give back whatever was preallocated past the end.
+        if (ftruncate(m_fd, m_offset) != 0 && m_verbose > 1)
+            m_log->warn("Unable to truncate '{}': {}", m_path,
+                        strerror(errno));
+        close(m_fd);
+    }
+    if (m_idx_fd >= 0)
+        close(m_idx_fd);
+
+    if (m_verbose > 0 && m_fd >= 0)
+    {
+        double secs = chrono::duration<double>
+                      (chrono::steady_clock::now() - m_start).count();
+        m_log->info("Raw recording '{}': {} video frames, {} audio frames, "
+                    "{:.2f} GB, {:.0f} MB/s average.", m_path,
+                    m_video_frames, m_audio_frames, m_bytes / 1e9,
+                    secs > 0 ? m_bytes / 1e6 / secs : 0.0);
+        if (m_video_dropped || m_audio_dropped)
+            m_log->warn("Raw recording '{}' is missing {} video and {} "
+                        "audio frames.", m_path, m_video_dropped,
+                        m_audio_dropped);
+    }
+}
+
+void RawRecorder::fail(const string& what, int err)
+{
+    if (!m_failed.exchange(true))
+        m_log->error("Raw recording to '{}' stopped. {}: {}",
+                     m_path, what, strerror(err));
+}
+
+void RawRecorder::VideoFormat(const RawCapture::VideoFormat& format)
+{
+    RawCapture::Entry entry {};
+    entry.type  = RawCapture::VIDEO_FORMAT;
+    entry.video = format;
+    {
+        scoped_lock lock(m_mutex);
+        entry.seq = m_seq++;
+    }
+    write_index(&entry, 1);
+}
+
+void RawRecorder::AudioFormat(const RawCapture::AudioFormat& format)
+{
+    RawCapture::Entry entry {};
+    entry.type  = RawCapture::AUDIO_FORMAT;
+    entry.audio = format;
+    {
+        scoped_lock lock(m_mutex);
+        entry.seq = m_seq++;
+    }
+    write_index(&entry, 1);
+}
+
+bool RawRecorder::AddVideo(uint8_t* image, size_t size, int64_t timestamp,
+                           void* context)
+{
+    if (m_failed.load())
+        return false;
+
+    scoped_lock lock(m_mutex);
+
+    // Never make the encoder wait on the disk.
+    if (m_video_pending >= m_max_pending)
+    {
+        if (m_video_dropped++ % 100 == 0)
+            m_log->warn("Raw recorder falling behind; {} video frames "
+                        "not recorded", m_video_dropped);
+        return false;
+    }
+
+    Job job {
+        .data    = image,
+        .bytes   = RawCapture::AlignUp(size),
+        .offset  = m_offset,
+        .image   = image,
+        .context = context
+    };
+    job.entries.push_back(RawCapture::Entry {
+            .type      = RawCapture::VIDEO_FRAME,
+            .size      = static_cast<uint32_t>(size),
+            .seq       = m_seq++,
+            .offset    = m_offset,
+            .timestamp = timestamp
+        });
+
+    m_offset += job.bytes;
+    ++m_video_pending;
+    m_jobs.push_back(std::move(job));
+    m_ready.notify_one();
+
+    return true;
+}
+
+void RawRecorder::AddAudio(const uint32_t* samples, int64_t timestamp)
+{
+    if (m_failed.load())
+        return;
+
+    scoped_lock lock(m_mutex);
+
+    if (!m_audio_block)
+    {
+        if (!m_blocks.empty())
+        {
+            m_audio_block = std::move(m_blocks.back());
+            m_blocks.pop_back();
+        }
+        else if (m_blocks_allocated < MAX_AUDIO_BLOCKS)
+        {
+            m_audio_block =
+                RawCapture::AllocAligned(RawCapture::AUDIO_BLOCK_BYTES);
+            if (m_audio_block)
+                ++m_blocks_allocated;
+        }
+
+        if (!m_audio_block)
+        {
+            if (m_audio_dropped++ % 100 == 0)
+                m_log->warn("Raw recorder falling behind; {} audio frames "
+                            "not recorded", m_audio_dropped);
+            return;
+        }
+
+        m_audio_offset = m_offset;
+        m_offset += RawCapture::AUDIO_BLOCK_BYTES;
+    }
+
+    size_t pos = m_audio_entries.size() * RawCapture::AUDIO_FRAME_BYTES;
+    memcpy(m_audio_block.get() + pos, samples, RawCapture::AUDIO_FRAME_BYTES);
+    m_audio_entries.push_back(RawCapture::Entry {
+            .type      = RawCapture::AUDIO_FRAME,
+            .size      = RawCapture::AUDIO_FRAME_BYTES,
+            .seq       = m_seq++,
+            .offset    = m_audio_offset + pos,
+            .timestamp = timestamp
+        });
+
+    if (m_audio_entries.size() == RawCapture::AUDIO_BLOCK_FRAMES)
+        queue_audio_block();
+}
+
+void RawRecorder::queue_audio_block(void)
+{
+    // Caller holds m_mutex
+    size_t used = m_audio_entries.size() * RawCapture::AUDIO_FRAME_BYTES;
+    memset(m_audio_block.get() + used, 0,
+           RawCapture::AUDIO_BLOCK_BYTES - used);
+
+    Job job {
+        .data    = m_audio_block.get(),
+        .bytes   = RawCapture::AUDIO_BLOCK_BYTES,
+        .offset  = m_audio_offset,
+        .entries = std::move(m_audio_entries)
+    };
+    job.block = std::move(m_audio_block);
+    m_audio_entries.clear();
+
+    m_jobs.push_back(std::move(job));
+    m_ready.notify_one();
+}
+
+void RawRecorder::Flush(void)
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && m_active == 0; });
+}
+
+void RawRecorder::writer(void)
+{
+    unique_lock<mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_ready.wait(lock, [this] { return !m_jobs.empty() || !m_running; });
+        if (m_jobs.empty())
+            break;
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        ++m_active;
+        lock.unlock();
+
+        bool ok = !m_failed.load() && write_data(job);
+        if (ok)
+            write_index(job.entries.data(), job.entries.size());
+        if (job.image)
+            m_release(job.image, job.context);
+
+        lock.lock();
+        if (ok)
+        {
+            m_bytes += job.bytes;
+            if (job.image)
+                ++m_video_frames;
+            else
+                m_audio_frames += job.entries.size();
+        }
+        if (job.image)
+            --m_video_pending;
+        if (job.block)
+            m_blocks.push_back(std::move(job.block));
+
+        if (--m_active == 0 && m_jobs.empty())
+            m_idle.notify_all();
+    }
+}
+
+bool RawRecorder::write_data(const Job& job)
+{
+    {
+        /*
+          Allocating ahead of the writes keeps the file contiguous and
+          keeps the filesystem from serializing O_DIRECT writes which
+          extend it.
+        */
+        scoped_lock lock(m_prealloc_mutex);
+        while (m_preallocated < job.offset + job.bytes)
+        {
+            if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, m_preallocated,
+                          PREALLOC_BYTES) != 0)
+            {
+                // Not supported here; just write.
+                m_preallocated = numeric_limits<uint64_t>::max();
+                break;
+            }
+            m_preallocated += PREALLOC_BYTES;
+        }
+    }
+
+    const uint8_t* data   = job.data;
+    size_t         remain = job.bytes;
+    off_t          offset = job.offset;
+
+    while (remain > 0)
+    {
+        ssize_t ret = pwrite(m_fd, data, remain, offset);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fail("write", errno);
+            return false;
+        }
+        data   += ret;
+        remain -= ret;
+        offset += ret;
+    }
+
+    return true;
+}
+
+void RawRecorder::write_index(const RawCapture::Entry* entries, size_t count)
+{
+    const char* data   = reinterpret_cast<const char*>(entries);
+    size_t      remain = count * sizeof(RawCapture::Entry);
+
+    scoped_lock lock(m_index_mutex);
+    while (remain > 0 && m_idx_fd >= 0)
+    {
+        ssize_t ret = write(m_idx_fd, data, remain);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            fail("index write", errno);
+            return;
+        }
+        data   += ret;
+        remain -= ret;
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "RawCapture.h"
+
+/*
+  Writes the raw capture (video frames, 8 channel audio frames and
+  their card timestamps) to disk for later replay; see RawCapture.h for
+  the layout.
+
+  Video frames are written with O_DIRECT straight out of the capture
+  buffers, which are handed back through `release` once on disk. At
+  most `max_pending` frames are held at a time; if the disk cannot keep
+  up, frames are left out of the recording rather than starving the
+  encoder of buffers. Several writer threads keep more than one request
+  in flight, which is what NVMe drives need to reach their sequential
+  rate.
+*/
+class RawRecorder
+{
+  public:
+    using release_t = std::function<void (uint8_t* image, void* context)>;
+
+    RawRecorder(const std::string& path, int verbose_level,
+                size_t max_pending, release_t release);
+    ~RawRecorder(void);
+
+    RawRecorder(const RawRecorder&) = delete;
+    RawRecorder& operator=(const RawRecorder&) = delete;
+
+    bool operator!(void) const { return m_fd < 0 || m_idx_fd < 0; }
+
+    void VideoFormat(const RawCapture::VideoFormat& format);
+    void AudioFormat(const RawCapture::AudioFormat& format);
+
+    /*
+      `image` must be RawCapture::ALIGN aligned, and readable up to
+      `size` rounded up to ALIGN. Returns false if the frame was not
+      taken, in which case `release` will not be called for it.
+    */
+    bool AddVideo(uint8_t* image, size_t size, int64_t timestamp,
+                  void* context);
+    void AddAudio(const uint32_t* samples, int64_t timestamp);
+
+    // Wait for every queued write to complete.
+    void Flush(void);
+
+  private:
+    static constexpr int    WRITER_THREADS   = 3;
+    static constexpr size_t MAX_AUDIO_BLOCKS = 8;
+    static constexpr size_t PREALLOC_BYTES   = 1ULL << 30;
+
+    struct Job
+    {
+        const uint8_t*  data    {nullptr};
+        size_t          bytes   {0};
+        uint64_t        offset  {0};
+        std::vector<RawCapture::Entry> entries;
+
+        uint8_t*        image   {nullptr};   // Video: return to capture
+        void*           context {nullptr};
+        RawCapture::AlignedBuffer block;     // Audio: return to m_blocks
+    };
+
+    void writer(void);
+    bool write_data(const Job& job);
+    void write_index(const RawCapture::Entry* entries, size_t count);
+    void queue_audio_block(void);
+    void fail(const std::string& what, int err);
+
+    // spdlog
+    std::shared_ptr<spdlog::logger> m_log;
+
+    std::string       m_path;
+    int               m_verbose;
+    size_t            m_max_pending;
+    release_t         m_release;
+
+    int               m_fd      {-1};
+    int               m_idx_fd  {-1};
+    bool              m_direct  {true};
+    std::atomic<bool> m_failed  {false};
+
+    std::vector<std::thread> m_writers;
+    std::mutex              m_mutex;
+    std::condition_variable m_ready;
+    std::condition_variable m_idle;
+    std::deque<Job>         m_jobs;
+    bool                    m_running  {true};
+    int                     m_active   {0};
+
+    uint64_t          m_offset         {0};    // Next free data position
+    uint64_t          m_seq            {0};
+    size_t            m_video_pending  {0};
+
+    // Audio staging
+    RawCapture::AlignedBuffer              m_audio_block;
+    std::vector<RawCapture::Entry>         m_audio_entries;
+    uint64_t                               m_audio_offset {0};
+    std::vector<RawCapture::AlignedBuffer> m_blocks;   // Free
+    size_t                                 m_blocks_allocated {0};
+
+    std::mutex        m_index_mutex;
+    std::mutex        m_prealloc_mutex;
+    uint64_t          m_preallocated   {0};
+
+    // Stats
+    std::chrono::steady_clock::time_point m_start;
+    uint64_t          m_video_frames   {0};
+    uint64_t          m_audio_frames   {0};
+    uint64_t          m_bytes          {0};
+    uint64_t          m_video_dropped  {0};
+    uint64_t          m_audio_dropped  {0};
+};
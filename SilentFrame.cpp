@@ -0,0 +1,96 @@
+#include "SilentFrame.h"
+
+#include <spdlog/spdlog.h>
+
+const std::vector<uint8_t>& SilentFrame::Get(AVCodecID codec_id,
+                                             int sample_rate,
+                                             int channels,
+                                             int64_t bit_rate)
+{
+    std::scoped_lock lock(m_mutex);
+
+    key_t key { codec_id, sample_rate, channels, bit_rate };
+    auto iter = m_cache.find(key);
+    if (iter != m_cache.end())
+        return iter->second;
+
+    return m_cache.emplace(key, encode(codec_id, sample_rate,
+                                       channels, bit_rate)).first->second;
+}
+
+std::vector<uint8_t> SilentFrame::encode(AVCodecID codec_id,
+                                         int sample_rate,
+                                         int channels,
+                                         int64_t bit_rate)
+{
+    auto log = spdlog::get("app_logger");
+    const char* name = (codec_id == AV_CODEC_ID_EAC3) ? "EAC3" : "AC3";
+
+    const AVCodec* codec = avcodec_find_encoder(codec_id);
+    if (!codec)
+    {
+        log->error("Silent {} frame: encoder not found", name);
+        return {};
+    }
+
+    CodecContextPtr enc;
+    int ret = -1;
+
+    // Match the source bitrate if the encoder accepts it, so the
+    // silent frames are the same size as the real ones.
+    for (int64_t rate : { bit_rate, static_cast<int64_t>(0) })
+    {
+        enc = make_codec_context(codec);
+        if (!enc)
+            return {};
+
+        enc->sample_rate = sample_rate;
+        enc->sample_fmt  = AV_SAMPLE_FMT_FLTP;
+        enc->time_base   = { 1, sample_rate };
+        enc->bit_rate    = rate;
+        av_channel_layout_default(&enc->ch_layout, channels);
+
+        if ((ret = avcodec_open2(enc.get(), codec, nullptr)) >= 0)
+            break;
+    }
+    if (ret < 0)
+    {
+        log->error("Silent {} frame: {}ch {}Hz encoder open failed: {}",
+                   name, channels, sample_rate, AVerr2str(ret));
+        return {};
+    }
+
+    FramePtr frame = make_frame();
+    frame->format      = enc->sample_fmt;
+    frame->sample_rate = enc->sample_rate;
+    frame->nb_samples  = enc->frame_size > 0 ? enc->frame_size
+                                             : FRAME_SAMPLES;
+    av_channel_layout_copy(&frame->ch_layout, &enc->ch_layout);
+
+    if (av_frame_get_buffer(frame.get(), 0) < 0)
+        return {};
+    av_samples_set_silence(frame->data, 0, frame->nb_samples,
+                           channels, enc->sample_fmt);
+
+    PacketPtr pkt = make_packet();
+    if (avcodec_send_frame(enc.get(), frame.get()) < 0)
+        return {};
+
+    ret = avcodec_receive_packet(enc.get(), pkt.get());
+    if (ret == AVERROR(EAGAIN))
+    {
+        avcodec_send_frame(enc.get(), nullptr);
+        ret = avcodec_receive_packet(enc.get(), pkt.get());
+    }
+    if (ret < 0)
+    {
+        log->error("Silent {} frame: encode failed: {}",
+                   name, AVerr2str(ret));
+        return {};
+    }
+
+    log->debug("Built silent {} frame: {}ch {}Hz {}bps, {} bytes",
+               name, channels, sample_rate, enc->bit_rate, pkt->size);
+
+    return std::vector<uint8_t>(pkt->data, pkt->data + pkt->size);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "ffmpeg_types.h"
+
+/*
+  Codec-correct silent AC3/EAC3 frames, used to keep the audio PID
+  continuous while the source is sending pause bursts or nothing at
+  all. Each layout is encoded once and then served from a cache, so
+  emitting a silent frame is just a copy.
+*/
+class SilentFrame
+{
+  public:
+    static constexpr int FRAME_SAMPLES = 1536;
+
+    /**
+     * @brief Fetch (building if needed) a silent frame.
+     * @return The encoded frame, or an empty vector if the layout
+     * cannot be encoded.
+     */
+    static const std::vector<uint8_t>& Get(AVCodecID codec_id,
+                                           int sample_rate,
+                                           int channels,
+                                           int64_t bit_rate);
+
+  private:
+    static std::vector<uint8_t> encode(AVCodecID codec_id,
+                                       int sample_rate,
+                                       int channels,
+                                       int64_t bit_rate);
+
+    using key_t = std::tuple<AVCodecID, int, int, int64_t>;
+
+    static inline std::mutex m_mutex;
+    static inline std::map<key_t, std::vector<uint8_t>> m_cache;
+};
@@ -0,0 +1,214 @@
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+#ifdef SPDLOG_FMT_EXTERNAL
+#include <fmt/format.h>
+#else
+#include <spdlog/fmt/bundled/format.h>
+#endif
+
+#include "Trace.h"
+
+using namespace std;
+
+namespace Trace
+{
+    bool g_enabled {false};
+
+    namespace
+    {
+        constexpr size_t RING_EVENTS = 1 << 15;
+
+        struct Event
+        {
+            const char* name;
+            int64_t     start;
+            int64_t     end;
+        };
+
+        struct Ring
+        {
+            atomic<bool>            in_use {true};
+            pid_t                   tid  {0};
+            char                    name[16] {};
+            atomic<uint64_t>        head {0};   // Events ever recorded
+            array<Event, RING_EVENTS> events;
+        };
+
+        int64_t                  g_origin {0};
+        mutex                    g_rings_mutex;
+        vector<unique_ptr<Ring>> g_rings;
+
+        // Hands the thread's ring back when the thread exits.
+        struct Handle
+        {
+            Ring* ring {nullptr};
+
+            ~Handle(void)
+            {
+                if (ring)
+                    ring->in_use.store(false, memory_order_release);
+            }
+        };
+        thread_local Handle      t_handle;
+
+        /*
+          The ring of a thread which has exited, or a new one. Threads
+          come and go with every VideoStream rebuild, so without reuse
+          the rings would grow for as long as the process runs; the
+          spans of an exited thread are kept until its ring is reused.
+        */
+        Ring* claim_ring(void)
+        {
+            scoped_lock lock(g_rings_mutex);
+
+            for (auto& ring : g_rings)
+            {
+                bool idle = false;
+                if (ring->in_use.compare_exchange_strong
+                    (idle, true, memory_order_acquire))
+                {
+                    ring->tid = gettid();
+                    ring->name[0] = '\0';
+                    ring->head.store(0, memory_order_relaxed);
+                    return ring.get();
+                }
+            }
+
+            auto ring = make_unique<Ring>();
+            ring->tid = gettid();
+            g_rings.push_back(std::move(ring));
+            return g_rings.back().get();
+        }
+
+        // JSON string escaping for thread names.
+        string escape(const char* str)
+        {
+            string out;
+            for (; *str; ++str)
+            {
+                if (*str == '"' || *str == '\\')
+                    out += '\\';
+                if (static_cast<unsigned char>(*str) >= 0x20)
+                    out += *str;
+            }
+            return out;
+        }
+    }
+
+    void Enable(void)
+    {
+        g_origin  = Now();
+        g_enabled = true;
+    }
+
+    void Record(const char* name, int64_t start_ns, int64_t end_ns)
+    {
+        if (t_handle.ring == nullptr) [[unlikely]]
+            t_handle.ring = claim_ring();
+        Ring* ring = t_handle.ring;
+
+        uint64_t head = ring->head.load(memory_order_relaxed);
+
+        // Threads are named by whoever started them, which can be after
+        // their first span.
+        if (head % 1024 <= 1) [[unlikely]]
+            pthread_getname_np(pthread_self(), ring->name,
+                               sizeof(ring->name));
+
+        ring->events[head % RING_EVENTS] = Event {
+            .name  = name,
+            .start = start_ns,
+            .end   = end_ns
+        };
+        ring->head.store(head + 1, memory_order_release);
+    }
+
+    bool Write(const string& path)
+    {
+        auto log = spdlog::get("app_logger");
+
+        FILE* fp = fopen(path.c_str(), "w");
+        if (fp == nullptr)
+        {
+            if (log)
+                log->error("Unable to create trace '{}': {}",
+                           path, strerror(errno));
+            return false;
+        }
+
+        fmt::memory_buffer out;
+        size_t total = 0;
+        pid_t  pid   = getpid();
+
+        fmt::format_to(back_inserter(out), "{{\"traceEvents\":[\n");
+
+        scoped_lock lock(g_rings_mutex);
+        for (const auto& ring : g_rings)
+        {
+            if (total > 0)
+                fmt::format_to(back_inserter(out), ",\n");
+            fmt::format_to(back_inserter(out),
+                           "{{\"ph\":\"M\",\"name\":\"thread_name\","
+                           "\"pid\":{},\"tid\":{},"
+                           "\"args\":{{\"name\":\"{}\"}}}}",
+                           pid, ring->tid, escape(ring->name));
+
+            /*
+              The thread may still be recording. Copy what is there,
+              then throw away anything it overwrote while we were
+              copying.
+            */
+            uint64_t head  = ring->head.load(memory_order_acquire);
+            uint64_t first = head > RING_EVENTS ? head - RING_EVENTS : 0;
+            vector<Event> events;
+            events.reserve(head - first);
+            for (uint64_t idx = first; idx < head; ++idx)
+                events.push_back(ring->events[idx % RING_EVENTS]);
+
+            uint64_t now = ring->head.load(memory_order_acquire);
+            size_t skip = now > RING_EVENTS + first
+                          ? min<uint64_t>(now - RING_EVENTS - first,
+                                          events.size())
+                          : 0;
+
+            for (size_t idx = skip; idx < events.size(); ++idx)
+            {
+                const Event& ev = events[idx];
+                fmt::format_to(back_inserter(out),
+                               ",\n{{\"ph\":\"X\",\"name\":\"{}\","
+                               "\"pid\":{},\"tid\":{},"
+                               "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                               ev.name, pid, ring->tid,
+                               (ev.start - g_origin) / 1000.0,
+                               (ev.end - ev.start) / 1000.0);
+            }
+            total += events.size() - skip + 1;
+        }
+
+        fmt::format_to(back_inserter(out), "\n]}}\n");
+
+        bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+        ok = (fclose(fp) == 0) && ok;
+
+        if (log)
+        {
+            if (ok)
+                log->info("Wrote {} trace events from {} threads to '{}'",
+                          total - g_rings.size(), g_rings.size(), path);
+            else
+                log->error("Unable to write trace '{}': {}",
+                           path, strerror(errno));
+        }
+        return ok;
+    }
+}
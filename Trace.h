@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+  Optional timeline of what the pipeline threads are doing, written as
+  Chrome trace-event JSON which https://ui.perfetto.dev and
+  chrome://tracing both open.
+
+  Every thread records its spans into a ring buffer of its own, which
+  only that thread writes, so recording takes no locks. The rings keep
+  each thread's most recent RING_EVENTS spans and are written out by
+  Write() at exit. The ring of a thread that has exited is reused by
+  the next new thread, so a long run does not keep adding rings. While tracing is off, a Span costs one well predicted
+  branch when it opens and one when it closes.
+
+  Span names must be string literals; only the pointer is kept.
+*/
+namespace Trace
+{
+    extern bool g_enabled;
+
+    // Call before any thread records a span.
+    void Enable(void);
+    bool Write(const std::string& path);
+
+    void Record(const char* name, int64_t start_ns, int64_t end_ns);
+
+    inline int64_t Now(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    class Span
+    {
+      public:
+        explicit Span(const char* name)
+        {
+            if (g_enabled) [[unlikely]]
+            {
+                m_name  = name;
+                m_start = Now();
+            }
+        }
+
+        ~Span(void) { End(); }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        // Close the span before the end of its scope.
+        void End(void)
+        {
+            if (m_name) [[unlikely]]
+            {
+                Record(m_name, m_start, Now());
+                m_name = nullptr;
+            }
+        }
+
+      private:
+        const char* m_name  {nullptr};
+        int64_t     m_start {0};
+    };
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <map>
 
 extern "C" {
 #include <libavutil/opt.h>
@@ -17,9 +18,19 @@ extern "C" {
 
 #include "VideoStream.h"
 #include "OutputTS.h"
+#include "AsyncLog.h"
+#include "CpuPlan.h"
+#include "Metrics.h"
+#include "Trace.h"
 
 using namespace std;
 
+namespace
+{
+    std::mutex g_devices_mutex;
+    std::map<std::pair<AVHWDeviceType, std::string>, BufferRefPtr> g_devices;
+}
+
 VideoStream::VideoStream(OutputTS& parent, int verbose_level, Args& args,
                          Params&& params, MagCallback image_buffer_avail,
                          int64_t timestamp)
@@ -29,6 +40,9 @@ VideoStream::VideoStream(OutputTS& parent, int verbose_level, Args& args,
     , m_params(std::move(params))
     , f_image_avail(image_buffer_avail)
 {
+    if (m_params.interlaced && m_args.field_rate)
+        m_outputs = 2;
+
     m_log = spdlog::get("app_logger");
     if (!m_log)
     {
@@ -73,6 +87,35 @@ void VideoStream::Shutdown()
     m_running.store(false, std::memory_order_release);
 }
 
+int VideoStream::shared_device(BufferRefPtr& ctx, AVHWDeviceType type,
+                               const string& device, AVDictionary* opts)
+{
+    std::scoped_lock lock(g_devices_mutex);
+
+    auto key   = std::make_pair(type, device);
+    auto entry = g_devices.find(key);
+    if (entry == g_devices.end())
+    {
+        AVBufferRef* raw_hw_ctx = nullptr;
+
+        int ret = av_hwdevice_ctx_create(&raw_hw_ctx, type, device.c_str(),
+                                         opts, 0);
+        if (ret < 0 || !raw_hw_ctx)
+            return ret < 0 ? ret : AVERROR(ENOMEM);
+
+        entry = g_devices.emplace(key, BufferRefPtr(raw_hw_ctx)).first;
+    }
+
+    ctx.reset(av_buffer_ref(entry->second.get()));
+    return ctx ? 0 : AVERROR(ENOMEM);
+}
+
+void VideoStream::ReleaseDevices(void)
+{
+    std::scoped_lock lock(g_devices_mutex);
+    g_devices.clear();
+}
+
 void VideoStream::close_encoder(void)
 {
     m_parent.FlushPackets(OutputTS::VIDEO_STREAM_ID, m_version,
@@ -116,44 +159,47 @@ void VideoStream::start_work(void)
         return;
     }
 
-    int num_threads = (m_args.num_threads > 0)
-                      ? m_args.num_threads
-                      : 1;
+    int num_lanes = (m_args.num_threads > 0)
+                    ? m_args.num_threads
+                    : 1;
 
-    m_log->debug("Initializing encoder with {} copy worker threads.",
-                 num_threads);
+    m_log->debug("Initializing encoder with {} copy lanes.", num_lanes);
 
-    // Configure workers before starting threads.
+    // Configure workers before adding them to the pool.
     m_workers.clear();
-    m_workers.resize(num_threads);
 
     m_next_capture_worker = 0;
     m_next_encode_worker  = 0;
+    m_encode_taken        = 0;
 
     m_running.store(true, std::memory_order_release);
-    for (int idx = 0; idx < num_threads; ++idx)
+    for (int idx = 0; idx < num_lanes; ++idx)
     {
-        CopyThread& worker = m_workers[idx];
+        CopyLane& worker = m_workers.emplace_back();
 
-        worker.running.store(true);
         worker.name = format("vdcpy{}", idx);
-
-        worker.cpy_thread =
-            std::thread(&VideoStream::worker_thread_loop,
-                        this,
-                        std::ref(worker));
-
-        pthread_setname_np(worker.cpy_thread.native_handle(),
-                           worker.name.c_str());
+        worker.backlog = &Metrics::GetGauge
+                         ("magewell2ts_worker_backlog",
+                          "Images queued for a copy worker",
+                          Metrics::WithInput
+                          (m_parent.Input(), {{"worker", worker.name}}));
+        worker.last_report = std::chrono::steady_clock::now();
+        worker.lane = m_args.copy_pool->Add([this, &worker](void)
+                                            { return copy_image(worker); });
     }
 
     // The pipeline is now ready to accept images.
 
+    if (m_args.skip_static)
+        m_last_frame = make_frame();
+
     // Start encoder processing thread.
     m_encode_thread =
         std::thread(&VideoStream::encode_frames_loop, this);
 
     pthread_setname_np(m_encode_thread.native_handle(), "videnc");
+    CpuPlan::Apply(m_encode_thread.native_handle(), CpuPlan::ENCODE,
+                   "videnc");
 
     m_log->info("Started frame encoding thread.");
 }
@@ -167,13 +213,9 @@ void VideoStream::stop_work(void)
     {
         std::scoped_lock workers_lock(m_workers_mutex);
 
-        // Wake everybody.
+        // Wake the encoder.
         for (auto& worker : m_workers)
-        {
-            worker.running.store(false);
-            worker.image_avail.notify_all();
             worker.frame_avail.notify_all();
-        }
     }
 
     // Stop the encoder first. It accesses m_workers.
@@ -186,12 +228,12 @@ void VideoStream::stop_work(void)
     // Now the encoder cannot access m_workers anymore.
     for (size_t idx = 0; idx < m_workers.size(); ++idx)
     {
-        m_log->debug("Stopping vidcpy worker {}", idx);
+        m_log->debug("Stopping vidcpy lane {}", idx);
 
-        CopyThread& worker = m_workers[idx];
+        CopyLane& worker = m_workers[idx];
 
-        if (worker.cpy_thread.joinable())
-            worker.cpy_thread.join();
+        // Waits out an image the pool is uploading for it.
+        m_args.copy_pool->Remove(worker.lane);
 
         std::scoped_lock lock(worker.mtx);
 
@@ -410,15 +452,9 @@ bool VideoStream::open_nvidia(const AVCodec* codec, AVDictionary** opt_arg)
     // Create the persistent CUDA device context
     if (m_hw_device_ctx == nullptr)
     {
-        AVBufferRef* raw_hw_ctx = nullptr;
-
-        ret = av_hwdevice_ctx_create(&raw_hw_ctx,
-                                     AV_HWDEVICE_TYPE_CUDA,
-                                     m_args.device.c_str(),
-                                     nullptr,
-                                     0);
-
-        if (ret < 0 || !raw_hw_ctx)
+        ret = shared_device(m_hw_device_ctx, AV_HWDEVICE_TYPE_CUDA,
+                            m_args.device, nullptr);
+        if (ret < 0)
         {
             m_log->error("Failed to acquire persistent Nvidia CUDA Device "
                          "Context on '{}': {}",
@@ -431,8 +467,6 @@ bool VideoStream::open_nvidia(const AVCodec* codec, AVDictionary** opt_arg)
             return false;
         }
 
-        m_hw_device_ctx.reset(raw_hw_ctx);
-
         m_log->trace("nVidia CUDA hardware runtime engine successfully bound.");
     }
 
@@ -473,7 +507,8 @@ bool VideoStream::open_nvidia(const AVCodec* codec, AVDictionary** opt_arg)
     // Maintain a pool of reusable CUDA surfaces.  The extra surfaces give
     // NVENC room for asynchronous operation and lookahead.
     frames_ctx->initial_pool_size = m_args.lookahead
-                                    + (m_args.num_threads * 2) + 16;
+                                    + (m_args.num_threads * 2 * m_outputs)
+                                    + (m_args.skip_static ? 1 : 0) + 16;
 
     ret = av_hwframe_ctx_init(raw_frames_ctx);
 
@@ -606,15 +641,9 @@ bool VideoStream::open_vaapi(const AVCodec* codec, AVDictionary** opt_arg)
     {
         setenv("LIBVA_MESSAGING_LEVEL", "0", 1);
 
-        AVBufferRef* raw_hw_ctx = nullptr;
-
-        ret = av_hwdevice_ctx_create(&raw_hw_ctx,
-                                     AV_HWDEVICE_TYPE_VAAPI,
-                                     child_device.c_str(),
-                                     nullptr,
-                                     0);
-
-        if (ret < 0 || !raw_hw_ctx)
+        ret = shared_device(m_hw_device_ctx, AV_HWDEVICE_TYPE_VAAPI,
+                            child_device, nullptr);
+        if (ret < 0)
         {
             m_log->error("Failed to acquire persistent VAAPI Device "
                          "Context on path '{}': {}",
@@ -626,9 +655,6 @@ bool VideoStream::open_vaapi(const AVCodec* codec, AVDictionary** opt_arg)
             return false;
         }
 
-        // Bind to smart pointer
-        m_hw_device_ctx.reset(raw_hw_ctx);
-
         m_log->trace("VAAPI hardware runtime engine successfully bound.");
     }
 
@@ -653,7 +679,8 @@ bool VideoStream::open_vaapi(const AVCodec* codec, AVDictionary** opt_arg)
     AVHWFramesContext* frames_ctx =
         reinterpret_cast<AVHWFramesContext*>(m_hw_frames_ctx->data);
 
-    frames_ctx->initial_pool_size = (m_args.num_threads * 2)
+    frames_ctx->initial_pool_size = (m_args.num_threads * 2 * m_outputs)
+                                    + (m_args.skip_static ? 1 : 0)
                                     + m_args.extraHWframes;
     frames_ctx->width = m_encoder->width;
     frames_ctx->height = m_encoder->height;
@@ -802,14 +829,9 @@ bool VideoStream::open_qsv(const AVCodec* codec, AVDictionary** opt_arg)
 
         av_dict_set(&opt, "child_device", child_device.c_str(), 0);
 
-        AVBufferRef* raw_hw_ctx = nullptr;
-        // Pass the address of our local raw pointer variable
-        ret = av_hwdevice_ctx_create(&raw_hw_ctx,
-                                     AV_HWDEVICE_TYPE_QSV,
-                                     m_args.device.c_str(), opt, 0);
-
-        // Check the raw output pointer state explicitly
-        if (ret < 0 || !raw_hw_ctx)
+        ret = shared_device(m_hw_device_ctx, AV_HWDEVICE_TYPE_QSV,
+                            m_args.device, opt);
+        if (ret < 0)
         {
             m_log->error("Failed to acquire persistent Intel QSV "
                          "Device Context on device '{}': {}",
@@ -820,9 +842,6 @@ bool VideoStream::open_qsv(const AVCodec* codec, AVDictionary** opt_arg)
             return false;
         }
 
-        // Bind to smart pointer
-        m_hw_device_ctx.reset(raw_hw_ctx);
-
         m_log->trace("Intel QSV hardware runtime engine successfully bound");
     }
 
@@ -853,7 +872,8 @@ bool VideoStream::open_qsv(const AVCodec* codec, AVDictionary** opt_arg)
     frames_ctx->height = m_encoder->height;
     frames_ctx->format = AV_PIX_FMT_QSV;
     frames_ctx->sw_format = m_sw_pix_fmt;
-    frames_ctx->initial_pool_size = (m_args.num_threads * 2)
+    frames_ctx->initial_pool_size = (m_args.num_threads * 2 * m_outputs)
+                                    + (m_args.skip_static ? 1 : 0)
                                     + m_args.extraHWframes
                                     + m_args.lookahead + 4;
 
@@ -908,8 +928,14 @@ void VideoStream::encode_frames_loop(void)
     {
         // Round-robin worker queue to guarantee chronologically
         // correct indexing
-        CopyThread& worker = m_workers[m_next_encode_worker];
-        m_next_encode_worker = (m_next_encode_worker + 1) % m_workers.size();
+        CopyLane& worker = m_workers[m_next_encode_worker];
+        // All the frames of one image come from the same worker.
+        if (++m_encode_taken == m_outputs)
+        {
+            m_encode_taken = 0;
+            m_next_encode_worker = (m_next_encode_worker + 1) %
+                                   m_workers.size();
+        }
 
         FramePtr hw_frame;
 
@@ -929,6 +955,20 @@ void VideoStream::encode_frames_loop(void)
             hw_frame = std::move(worker.frames.front());
             worker.frames.pop_front();
         }
+
+        // The worker dropped this image.
+        if (!hw_frame)
+            continue;
+
+        // A static frame: encode the last surface again.
+        if (!hw_frame->buf[0])
+        {
+            if (!m_last_frame || !m_last_frame->buf[0])
+                continue;
+            int64_t pts = hw_frame->pts;
+            av_frame_ref(hw_frame.get(), m_last_frame.get());
+            hw_frame->pts = pts;
+        }
 #ifdef LOG_ELAPSED
         chrono::steady_clock::time_point work_end =
             chrono::steady_clock::now();
@@ -971,6 +1011,11 @@ void VideoStream::encode_frames_loop(void)
         }
 #endif
 
+        if (m_args.skip_static)
+        {
+            av_frame_unref(m_last_frame.get());
+            av_frame_ref(m_last_frame.get(), hw_frame.get());
+        }
         av_frame_unref(hw_frame.get());
 
         if (!result)
@@ -979,168 +1024,366 @@ void VideoStream::encode_frames_loop(void)
             Shutdown();
         }
     }
+
+    m_last_frame.reset();
 }
 
-void VideoStream::worker_thread_loop(CopyThread& worker)
+/*
+  Hold the image's place in the encoder's round-robin, which otherwise
+  takes the next worker's frames in its stead and sends their
+  timestamps out of order.
+*/
+void VideoStream::drop_image(CopyLane& worker)
 {
-    auto* hw_ctx = reinterpret_cast<AVHWFramesContext*>(m_hw_frames_ctx->data);
-
-    m_log->info("Started {} worker thread", worker.name);
+    {
+        std::scoped_lock lock(worker.mtx);
+        for (int idx = 0; idx < m_outputs; ++idx)
+            worker.frames.push_back(nullptr);
+    }
+    worker.frame_avail.notify_one();
+}
 
-    // Track time and accumulation variables
-    auto last_report_time = std::chrono::steady_clock::now();
-    uint64_t backlog_sum = 0;
-    uint64_t sample_count = 0;
+/*
+ * One step of a copy lane, on a thread of the shared copy pool: upload
+ * the lane's next image. A surface pool the encoder has yet to free
+ * leaves the image where it is, to be tried again, rather than holding
+ * the pool thread.
+ */
+LanePool::Result VideoStream::copy_image(CopyLane& worker)
+{
+    auto* hw_ctx = reinterpret_cast<AVHWFramesContext*>(m_hw_frames_ctx->data);
 
-    while (worker.running.load() && m_running.load())
+    // Stays put until the lane pops it; only AddImage adds to the lane.
+    const Image* next = nullptr;
     {
-        Image image;
-        size_t current_backlog = 0;
+        std::scoped_lock lock(worker.mtx);
+        if (!m_running.load() || worker.images.empty())
+            return LanePool::IDLE;
+        next = &worker.images.front();
+    }
 
+    // Every surface first, so a full pool leaves the image in line.
+    std::array<FramePtr, 2> hw_frames;
+    for (int idx = 0; idx < m_outputs && !next->repeat; ++idx)
+    {
+        FramePtr& hw = hw_frames[idx] = make_frame();
+        int ret = av_hwframe_get_buffer(m_hw_frames_ctx.get(), hw.get(), 0);
+        if (ret == AVERROR(ENOMEM))
         {
-            std::unique_lock lock(worker.mtx);
-            worker.image_avail.wait(lock, [&worker, this] {
-                return !worker.running || !m_running.load() ||
-                    !worker.images.empty();
-            });
-
-            if (!worker.running || !m_running.load() || worker.images.empty())
-                continue;
+            LOG_LIMITED(m_log, spdlog::level::warn,
+                        "{} worker failed to grab hardware pool surface: "
+                        "{}. Will retry.", worker.name, AVerr2str(ret));
+            return LanePool::RETRY;
+        }
+        if (ret < 0)
+        {
+            m_log->error("{} worker failed to grab hardware pool "
+                         "surface: {}", worker.name, AVerr2str(ret));
+            Shutdown();
+            return LanePool::IDLE;
+        }
+    }
 
-            image = std::move(worker.images.front());
-            worker.images.pop_front();
+    Image image;
+    size_t current_backlog = 0;
+    {
+        std::scoped_lock lock(worker.mtx);
+        image = std::move(worker.images.front());
+        worker.images.pop_front();
+        current_backlog = worker.images.size();
+    }
+    worker.backlog->Set(current_backlog);
+    image.stamps.Mark(Latency::COPY_START);
 
-            current_backlog = worker.images.size();
-        }
+    worker.backlog_sum += current_backlog;
+    ++worker.sample_count;
 
-        backlog_sum += current_backlog;
-        ++sample_count;
+    // Check if 60 seconds have passed
+    auto now = std::chrono::steady_clock::now();
+    if (now - worker.last_report >= std::chrono::seconds(60))
+    {
+        double average_backlog = static_cast<double>(worker.backlog_sum)
+                                 / worker.sample_count;
 
-        // Check if 60 seconds have passed
-        auto now = std::chrono::steady_clock::now();
-        if (now - last_report_time >= std::chrono::seconds(60))
+        if (average_backlog > 2.5)
         {
-            double average_backlog = static_cast<double>(backlog_sum)
-                                     / sample_count;
+            m_log->info("{} worker average backlog {:.2f} over "
+                        "the past 60s. Consider increasing '--copy-pool'",
+                        worker.name, average_backlog);
+        }
 
-            if (average_backlog > 2.5)
-            {
-                m_log->info("{} worker average backlog {:.2f} over "
-                            "the past 60s. Consider increasing '--threads'",
-                            worker.name, average_backlog);
-            }
+        // Reset trackers
+        worker.backlog_sum = 0;
+        worker.sample_count = 0;
+        worker.last_report = now;
+    }
 
-            // Reset trackers
-            backlog_sum = 0;
-            sample_count = 0;
-            last_report_time = now;
-        }
+    // Nothing to upload; the encoder sends the last surface again.
+    if (image.repeat)
+    {
+        f_image_avail(image.pImage, image.pEco);
 
-        int ret;
-        FramePtr hw = make_frame();
-        while (worker.running.load() && m_running.load())
+        int64_t pts = av_rescale_q(image.timestamp, TimeBase::Magewell,
+                                   m_encoder->time_base);
+        m_parent.StaticSaved().Inc(llround(worker.upload_us));
         {
-            ret = av_hwframe_get_buffer(m_hw_frames_ctx.get(), hw.get(), 0);
-            if (ret == 0)
-                break;
-
-            if (ret != AVERROR(ENOMEM))
-            {
-                m_log->error("{} worker failed to grab hardware "
-                             "pool surface: {}", worker.name, AVerr2str(ret));
-                Shutdown();
-            }
-            else
+            std::scoped_lock lock(worker.mtx);
+            for (int idx = 0; idx < m_outputs; ++idx)
             {
-                m_log->warn("{} worker failed to grab hardware "
-                            "pool surface: {}. Will retry.",
-                            worker.name, AVerr2str(ret));
+                FramePtr hw = make_frame();
+                hw->pts = pts + idx;
+                worker.frames.push_back(std::move(hw));
             }
-            this_thread::sleep_for(chrono::milliseconds(5));
         }
+        worker.frame_avail.notify_one();
+        return LanePool::MORE;
+    }
 
-        FramePtr cpu_frame = make_frame();
-        if (!cpu_frame)
-        {
-            m_log->warn("Failed to allocate local CPU frame wrapper.");
-            f_image_avail(image.pImage, image.pEco);
-            continue;
-        }
-        cpu_frame->format = m_sw_pix_fmt;
-        cpu_frame->width  = hw_ctx->width;
-        cpu_frame->height = hw_ctx->height;
+    FramePtr cpu_frame = make_frame();
+    if (!cpu_frame)
+    {
+        m_log->warn("Failed to allocate local CPU frame wrapper.");
+        f_image_avail(image.pImage, image.pEco);
+        drop_image(worker);
+        return LanePool::MORE;
+    }
+    cpu_frame->format = m_sw_pix_fmt;
+    cpu_frame->width  = hw_ctx->width;
+    cpu_frame->height = hw_ctx->height;
 
-        int size_bytes = av_image_fill_arrays(cpu_frame->data,
-                                              cpu_frame->linesize,
-                                              image.pImage, m_sw_pix_fmt,
-                                              m_params.width,
-                                              m_params.height, 1);
+    int size_bytes = av_image_fill_arrays(cpu_frame->data,
+                                          cpu_frame->linesize,
+                                          image.pImage, m_sw_pix_fmt,
+                                          m_params.width,
+                                          m_params.height, 1);
 
-        if (size_bytes < 0)
-        {
-            m_log->error("{} av_image_fill_arrays failed: {}",
-                         worker.name, AVerr2str(size_bytes));
-            f_image_avail(image.pImage, image.pEco);
-            Shutdown();
-            break;
-        }
+    if (size_bytes < 0)
+    {
+        m_log->error("{} av_image_fill_arrays failed: {}",
+                     worker.name, AVerr2str(size_bytes));
+        f_image_avail(image.pImage, image.pEco);
+        Shutdown();
+        return LanePool::IDLE;
+    }
 
-        cpu_frame->extended_data = cpu_frame->data;
+    cpu_frame->extended_data = cpu_frame->data;
 
-        ret = av_hwframe_transfer_data(hw.get(), cpu_frame.get(), 0);
-        f_image_avail(image.pImage, image.pEco);
+    int ret = 0;
+    std::array<const AVFrame*, 2> sources { cpu_frame.get(), nullptr };
+    if (m_params.interlaced)
+    {
+        ret = deinterlace(worker, cpu_frame.get(), image);
+        sources = { worker.fields[0].get(), worker.fields[1].get() };
+    }
 
-        if (ret < 0)
-        {
-            m_log->warn("DAMAGED: {} av_hwframe_transfer_data failed: {}",
-                        worker.name, AVerr2str(ret));
-            this_thread::sleep_for(chrono::milliseconds(2));
-            continue;
-        }
+    for (int idx = 0; idx < m_outputs && ret >= 0; ++idx)
+    {
+        Trace::Span span("hwframe upload");
+        if (image.rows && !m_params.interlaced)
+            ret = upload_rows(hw_frames[idx].get(), sources[idx], image);
+        else
+            ret = av_hwframe_transfer_data(hw_frames[idx].get(),
+                                           sources[idx], 0);
+    }
+    f_image_avail(image.pImage, image.pEco);
+
+    // A lost low-latency capture; Magewell has counted it.
+    if (ret == AVERROR(ENODATA))
+    {
+        drop_image(worker);
+        return LanePool::MORE;
+    }
+    if (ret < 0)
+    {
+        m_log->warn("DAMAGED: {} av_hwframe_transfer_data failed: {}",
+                    worker.name, AVerr2str(ret));
+        drop_image(worker);
+        return LanePool::MORE;
+    }
+
+    // At field rate the encoder's time base is a field.
+    int64_t pts = av_rescale_q(image.timestamp, TimeBase::Magewell,
+                               m_encoder->time_base);
+
+    image.stamps.Mark(Latency::COPY_END);
+    m_parent.Latency().Submit(pts, image.stamps);
+    if (!image.rows)
+    {
+        double us = (image.stamps.ns[Latency::COPY_END] -
+                     image.stamps.ns[Latency::COPY_START]) / 1000.0;
+        worker.upload_us = worker.upload_us > 0
+                           ? worker.upload_us + (us - worker.upload_us) / 16
+                           : us;
+    }
+
+    for (int idx = 0; idx < m_outputs; ++idx)
+    {
+        AVFrame* hw = hw_frames[idx].get();
 
         hw->colorspace      = m_params.color.space;
         hw->color_primaries = m_params.color.primaries;
         hw->color_trc       = m_params.color.trc;
         hw->color_range     = m_params.color.range;
-        hw->pts = av_rescale_q(image.timestamp, TimeBase::Magewell,
-                               m_encoder->time_base);
+        hw->pts             = pts + idx;
 
         // Handle HDR metadata attachments
         if (m_params.color.is_HDR)
         {
             if (m_display_primaries)
             {
-                av_frame_remove_side_data(hw.get(),
-                                     AV_FRAME_DATA_MASTERING_DISPLAY_METADATA);
+                av_frame_remove_side_data(hw,
+                                 AV_FRAME_DATA_MASTERING_DISPLAY_METADATA);
                 AVMasteringDisplayMetadata* primaries =
-                    av_mastering_display_metadata_create_side_data(hw.get());
+                    av_mastering_display_metadata_create_side_data(hw);
                 if (primaries)
                     *primaries = *m_display_primaries;
             }
             if (m_content_light)
             {
-                av_frame_remove_side_data(hw.get(),
-                                          AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
+                av_frame_remove_side_data(hw,
+                                        AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
                 AVContentLightMetadata* light =
-                    av_content_light_metadata_create_side_data(hw.get());
+                    av_content_light_metadata_create_side_data(hw);
                 if (light)
                     *light = *m_content_light;
             }
         }
+    }
+
+    {
+        std::scoped_lock lock(worker.mtx);
+        for (int idx = 0; idx < m_outputs; ++idx)
+            worker.frames.push_back(std::move(hw_frames[idx]));
+    }
+    worker.frame_avail.notify_one();
+    return LanePool::MORE;
+}
 
+/*
+ * Deinterlace `src` into the worker's own frames: the field captured
+ * first kept, and at field rate the other field kept after it, so
+ * `fields` (and pts + idx) run in capture order. An image the card is
+ * still writing (--low-latency) is waited for first.
+ */
+int VideoStream::deinterlace(CopyLane& worker, const AVFrame* src,
+                             Image& image)
+{
+    if (image.rows)
+    {
+        Rows& rows = *image.rows;
+        for (;;)
         {
-            std::scoped_lock lock(worker.mtx);
-            worker.frames.push_back(std::move(hw));
+            int done = rows.done.load(std::memory_order_acquire);
+            if (done < 0)
+                return AVERROR(ENODATA);
+            if (done >= m_params.height)
+                break;
+            rows.done.wait(done, std::memory_order_acquire);
         }
-        worker.frame_avail.notify_one();
+        image.stamps.ns[Latency::CAPTURE] =
+            rows.complete_ns.load(std::memory_order_relaxed);
     }
 
-    if (m_verbose > 1)
-        m_log->info("Stopped {} worker thread.", worker.name);
+    Trace::Span span("deinterlace");
+    int first = m_params.top_field_first ? 0 : 1;
+    for (int idx = 0; idx < m_outputs; ++idx)
+    {
+        FramePtr& dst = worker.fields[idx];
+        if (!dst)
+        {
+            dst = make_frame();
+            dst->format = src->format;
+            dst->width  = src->width;
+            dst->height = src->height;
+            int ret = av_frame_get_buffer(dst.get(), 0);
+            if (ret < 0)
+            {
+                dst.reset();
+                return ret;
+            }
+        }
+        Deinterlace::Frame(src, dst.get(), first ^ idx, m_args.deinterlace,
+                           image.motion.get());
+    }
+    return 0;
+}
+
+/*
+ * Upload an image the card is still writing, a slice at a time as its
+ * lines arrive, into the mapped surface. Devices whose surfaces cannot
+ * be mapped (CUDA) get the whole image once it is complete.
+ */
+int VideoStream::upload_rows(AVFrame* hw, const AVFrame* src, Image& image)
+{
+    Rows& rows   = *image.rows;
+    int   height = m_params.height;
+
+    FramePtr mapped = make_frame();
+    int ret = av_hwframe_map(mapped.get(), hw,
+                             AV_HWFRAME_MAP_WRITE | AV_HWFRAME_MAP_OVERWRITE);
+    if (ret < 0)
+        mapped.reset();
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(m_sw_pix_fmt);
+    int planes = av_pix_fmt_count_planes(m_sw_pix_fmt);
+    int copied = 0;
+
+    while (copied < height)
+    {
+        int done = rows.done.load(std::memory_order_acquire);
+        if (done < 0)
+            return AVERROR(ENODATA);
+        if (done == copied || (!mapped && done < height))
+        {
+            rows.done.wait(done, std::memory_order_acquire);
+            continue;
+        }
+        if (!mapped)
+            break;
+
+        for (int plane = 0; plane < planes; ++plane)
+        {
+            int shift = (plane == 1 || plane == 2) ? desc->log2_chroma_h : 0;
+            int from  = copied >> shift;
+            int to    = done == height ? AV_CEIL_RSHIFT(done, shift)
+                                       : done >> shift;
+            if (to <= from)
+                continue;
+            av_image_copy_plane(mapped->data[plane] +
+                                from * mapped->linesize[plane],
+                                mapped->linesize[plane],
+                                src->data[plane] + from * src->linesize[plane],
+                                src->linesize[plane],
+                                av_image_get_linesize(m_sw_pix_fmt,
+                                                      m_params.width, plane),
+                                to - from);
+        }
+        copied = done;
+    }
+
+    image.stamps.ns[Latency::CAPTURE] =
+        rows.complete_ns.load(std::memory_order_relaxed);
+
+    if (!mapped)
+        return av_hwframe_transfer_data(hw, src, 0);
+    return 0;   // Unmapping writes it back, if the map was a copy
 }
 
 void VideoStream::AddImage(Image&& image)
 {
+    // In capture order, before the copy workers take them in any order.
+    if (m_params.interlaced && m_args.deinterlace == Deinterlace::ADAPTIVE
+        && !image.rows && !image.repeat)
+    {
+        Trace::Span span("motion map");
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(m_sw_pix_fmt);
+        image.motion = m_motion.Add(image.pImage,
+                                    av_image_get_linesize(m_sw_pix_fmt,
+                                                          m_params.width, 0),
+                                    m_params.width, m_params.height,
+                                    desc->comp[0].depth > 8);
+    }
+
     std::scoped_lock workers_lock(m_workers_mutex);
 
     if (!m_running.load())
@@ -1149,7 +1392,7 @@ void VideoStream::AddImage(Image&& image)
         return;
     }
 
-    CopyThread& worker = m_workers[m_next_capture_worker];
+    CopyLane& worker = m_workers[m_next_capture_worker];
 
     m_next_capture_worker =
         (m_next_capture_worker + 1) % m_workers.size();
@@ -1159,5 +1402,5 @@ void VideoStream::AddImage(Image&& image)
         worker.images.push_back(std::move(image));
     }
 
-    worker.image_avail.notify_one();
+    m_args.copy_pool->Wake(worker.lane);
 }
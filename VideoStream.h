@@ -7,6 +7,7 @@
 #include <array>
 #include <optional>
 #include <atomic>
+#include <chrono>
 
 #include <string>
 #include <utility>
@@ -28,8 +29,12 @@ extern "C" {
 #include <libavutil/mastering_display_metadata.h>
 }
 
+#include "Deinterlace.h"
+#include "LanePool.h"
 #include "MediaQueue.h"
+#include "Metrics.h"
 #include "ffmpeg_types.h"
+#include "Latency.h"
 
 class OutputTS;
 
@@ -78,6 +83,13 @@ class VideoStream
         float gopSecs       { 1.5 };
         int   idrInterval   {  0  };
         bool  p010          { false };
+        bool  inverse_telecine { false };
+        bool  skip_static   { false };
+        Deinterlace::Mode deinterlace { Deinterlace::ADAPTIVE };
+        bool  field_rate    { false };
+        std::string latency_file { };
+        // Shared by every input; num_threads is the lanes of each.
+        LanePool* copy_pool { nullptr };
     };
 
     struct Params
@@ -91,10 +103,24 @@ class VideoStream
         int width {0};
         int height {0};
         int num_pixels {0};
+        bool interlaced {false};    // Woven fields
+        bool top_field_first {true};    // Field order, when interlaced
 
         bool operator==(const Params&) const = default;
     };
 
+    /*
+      Low-latency capture hands an image over while the card is still
+      writing it. `done` is the number of lines written so far, or -1
+      if the capture was lost. `complete_ns` (Latency::Now()) is set
+      before the last lines are published.
+    */
+    struct Rows
+    {
+        std::atomic<int>     done        {0};
+        std::atomic<int64_t> complete_ns {0};
+    };
+
     struct Image
     {
         uint8_t* pImage {nullptr};
@@ -102,47 +128,50 @@ class VideoStream
         int64_t timestamp {-1};
         void* pEco {nullptr};
         std::optional<Params> oParams;
+        Latency::Stamps stamps;
+        Rows* rows {nullptr};   // Still arriving, see Rows
+        bool repeat {false};    // Same as the image before; not uploaded
+        // Interlaced, adaptive: what moved since the image before.
+        std::shared_ptr<const Deinterlace::MotionMap> motion;
     };
 
     using imageque_t = std::deque<Image>;
     using hw_frame_t = std::deque<FramePtr>;
 
-    struct CopyThread
+    /*
+      A lane of the shared copy pool (see LanePool). Images are handed
+      to the lanes in turn, and the encoder takes the frames back in
+      the same turn, so they stay in capture order however the pool
+      threads run the lanes.
+    */
+    struct CopyLane
     {
-        std::thread cpy_thread;
         std::string name;
+        LanePool::Lane* lane {nullptr};
 
         // Protects both images and frames queues
         std::mutex mtx;
-        // Notifies worker that an image is ready
-        std::condition_variable image_avail;
         // Notifies encoder that a frame is ready
         std::condition_variable frame_avail;
         // Input queue (populated by Capture)
         imageque_t images;
-        // Output queue (consumed by Encoder)
+        // Output queue (consumed by Encoder). A null entry stands in
+        // for a frame that was dropped after its image was taken, so
+        // the encoder's round-robin stays in step.
         hw_frame_t frames;
-        std::atomic<bool> running{true};
-
-        // Default constructor
-        CopyThread() = default;
-
-        CopyThread(CopyThread&& rhs) noexcept
-        {
-            // std::mutex and std::condition_variable cannot be moved;
-            // they are default-constructed for the new location.
-            cpy_thread = std::move(rhs.cpy_thread);
-            images     = std::move(rhs.images);
-            frames     = std::move(rhs.frames);
-            running.store(rhs.running.load());
-        }
-
-        // Disable copying explicitly
-        CopyThread(const CopyThread&) = delete;
-        CopyThread& operator=(const CopyThread&) = delete;
-        CopyThread& operator=(CopyThread&&) = delete;
+        // Deinterlaced images, one per field sent on, in capture order
+        std::array<FramePtr, 2> fields;
+
+        // Only used by the lane's own steps
+        Metrics::Gauge* backlog {nullptr};
+        std::chrono::steady_clock::time_point last_report;
+        uint64_t backlog_sum  {0};
+        uint64_t sample_count {0};
+        // Recent average upload, in microseconds, for what a static
+        // frame saves.
+        double   upload_us    {0};
     };
-    using copythdq_t = std::vector<CopyThread>;
+    using copylanes_t = std::deque<CopyLane>;
 
     VideoStream(OutputTS& parent, int verbose_level, Args& args,
                 Params&& params, MagCallback image_buffer_avail,
@@ -162,6 +191,16 @@ class VideoStream
     std::string ColorSpaceDesc(void) const
         { return m_params.color.description; }
 
+    /*
+      Drop the device contexts shared between streams. Call after every
+      VideoStream is gone, before exit.
+    */
+    static void ReleaseDevices(void);
+
+    // How soon a copy lane tries again for a surface, when the
+    // encoder has yet to free one.
+    static constexpr std::chrono::milliseconds COPY_RETRY {5};
+
   private:
     bool open_encoder(void);
     void close_encoder(void);
@@ -169,10 +208,21 @@ class VideoStream
     bool open_vaapi(const AVCodec* codec, AVDictionary** opt_arg);
     bool open_qsv(const AVCodec* codec, AVDictionary** opt_arg);
 
+    /*
+      One device context per type and device (render node, or CUDA
+      device), shared by every input in the process and kept across
+      format changes. Returns an FFmpeg error code.
+    */
+    static int shared_device(BufferRefPtr& ctx, AVHWDeviceType type,
+                             const std::string& device, AVDictionary* opts);
+
     void start_work(void);
     void stop_work(void);
     void encode_frames_loop(void);
-    void worker_thread_loop(CopyThread& worker);
+    LanePool::Result copy_image(CopyLane& worker);
+    int  upload_rows(AVFrame* hw, const AVFrame* src, Image& image);
+    int  deinterlace(CopyLane& worker, const AVFrame* src, Image& image);
+    void drop_image(CopyLane& worker);
 
     void set_light(const ColorSpace& color);
 
@@ -206,9 +256,18 @@ class VideoStream
 
     std::atomic<bool> m_running      {false};
 
+    // The last surface encoded, to send again for a static frame.
+    FramePtr          m_last_frame;
+
+    // Interlaced, adaptive: the block sums of the image before.
+    Deinterlace::Motion m_motion;
+
+    // Frames sent on per image: both fields at field rate.
+    int    m_outputs {1};
+    int    m_encode_taken {0};
     size_t m_next_encode_worker  {0};
     size_t m_next_capture_worker {0};
-    copythdq_t m_workers;
+    copylanes_t m_workers;
 
     std::mutex m_workers_mutex;
 };
@@ -247,10 +306,13 @@ template <>
         }
 
         return fmt::format_to(ctx.out(),
-                              "Video[{}x{}p{:.4f} {} {} FR:{}/{} {}]",
+                              "Video[{}x{}{}{:.4f}{} {} {} FR:{}/{} {}]",
                               params.width,
                               params.height,
+                              params.interlaced ? "i" : "p",
                               fps,
+                              params.interlaced && !params.top_field_first
+                              ? " BFF" : "",
                               color,
                               av_get_pix_fmt_name(static_cast<AVPixelFormat>(params.pix_fmt)),
                               params.frame_duration.den,
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+  Minimal micro-benchmark harness for magewell2ts_bench.
+
+  Each benchmark registers a setup function. Setup runs once, outside
+  of the timed region, and returns the body to time. The body is asked
+  to perform a given number of operations; the harness grows that
+  number until a run takes long enough to measure, then repeats it and
+  reports the median.
+*/
+namespace Bench
+{
+
+struct Body
+{
+    std::function<void (uint64_t ops)> run;
+    double bytes_per_op {0};   // For MB/s; 0 if not meaningful
+};
+
+using setup_t = std::function<Body (void)>;
+
+struct Case
+{
+    std::string name;
+    setup_t     setup;
+};
+
+std::vector<Case>& Registry(void);
+
+struct Registrar
+{
+    Registrar(const char* name, setup_t setup)
+    {
+        Registry().push_back(Case { name, std::move(setup) });
+    }
+};
+
+// Keep the compiler from discarding a computed value.
+template <class T>
+inline void DoNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory(void)
+{
+    asm volatile("" : : : "memory");
+}
+
+// Deterministic test data; the same on every run and every machine.
+class Random
+{
+  public:
+    explicit Random(uint64_t seed = 0x9E3779B97F4A7C15ULL)
+        : m_state(seed)
+    {
+    }
+
+    uint64_t Next(void)
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 0x2545F4914F6CDD1DULL;
+    }
+
+    void Fill(uint8_t* data, size_t size)
+    {
+        for (size_t idx = 0; idx < size; ++idx)
+            data[idx] = static_cast<uint8_t>(Next() >> 56);
+    }
+
+  private:
+    uint64_t m_state;
+};
+
+}
+
+#define BENCH_CAT2(a, b) a##b
+#define BENCH_CAT(a, b) BENCH_CAT2(a, b)
+#define BENCHMARK(name, ...) \
+    static Bench::Registrar BENCH_CAT(s_bench_, __LINE__) (name, __VA_ARGS__)
@@ -0,0 +1,486 @@
+/*
+  Audio path benchmarks: IEC61937 de-framing, AC-3/E-AC-3 header and
+  CRC parsing, capture de-interleave, PCM conversion and the stereo
+  downmix.
+*/
+
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "Bench.h"
+
+#include "AudioConvert.h"
+#include "Downmix.h"
+#include "EAC3Parser.h"
+#include "IEC61937Parser.h"
+
+namespace
+{
+
+// Magewell capture frame geometry (MWCAP_AUDIO_SAMPLES_PER_FRAME,
+// MWCAP_AUDIO_MAX_NUM_CHANNELS).
+constexpr int CAPTURE_SAMPLES  = 192;
+constexpr int CAPTURE_CHANNELS = 8;
+
+// One capture frame of 16-bit stereo bitstream audio.
+constexpr size_t CAPTURE_BLOCK_BYTES = CAPTURE_SAMPLES * 2 * 2;
+
+constexpr size_t AC3_FRAME_BYTES  = 1792;   // 448kbps @ 48kHz
+constexpr size_t EAC3_FRAME_BYTES = 2560;   // 640kbps @ 48kHz, 6 blocks
+
+class BitWriter
+{
+  public:
+    explicit BitWriter(std::vector<uint8_t>& data) : m_data(data) {}
+
+    void Put(uint32_t value, int bits)
+    {
+        for (int bit = bits - 1; bit >= 0; --bit, ++m_pos)
+        {
+            uint8_t mask = 0x80 >> (m_pos & 7);
+            if ((value >> bit) & 1)
+                m_data[m_pos >> 3] |= mask;
+            else
+                m_data[m_pos >> 3] &= ~mask;
+        }
+    }
+
+  private:
+    std::vector<uint8_t>& m_data;
+    size_t                m_pos {0};
+};
+
+void put_crc(std::vector<uint8_t>& frame, size_t pos, uint16_t crc)
+{
+    frame[pos]     = static_cast<uint8_t>(crc >> 8);
+    frame[pos + 1] = static_cast<uint8_t>(crc & 0xFF);
+}
+
+/*
+  A 5.1 syncframe with a plausible header, pseudo random audio data
+  and valid CRCs, so the parsers take their normal (forwarding) path.
+ */
+std::vector<uint8_t> make_frame(CodecType codec_type)
+{
+    const bool   is_ac3 = (codec_type == CodecType::AC3);
+    const size_t size   = is_ac3 ? AC3_FRAME_BYTES : EAC3_FRAME_BYTES;
+
+    std::vector<uint8_t> frame(size);
+    Bench::Random rnd;
+    rnd.Fill(frame.data() + 32, size - 32);
+
+    BitWriter bw(frame);
+    bw.Put(0x0B77, 16);
+    if (is_ac3)
+    {
+        bw.Put(0, 16);          // crc1, filled in below
+        bw.Put(0, 2);           // fscod: 48kHz
+        bw.Put(28, 6);          // frmsizecod: 448kbps
+        bw.Put(8, 5);           // bsid
+        bw.Put(0, 3);           // bsmod
+        bw.Put(7, 3);           // acmod: 3/2
+        bw.Put(0, 2);           // cmixlev
+        bw.Put(0, 2);           // surmixlev
+        bw.Put(1, 1);           // lfeon
+        bw.Put(27, 5);          // dialnorm
+    }
+    else
+    {
+        bw.Put(0, 2);           // strmtyp: independent
+        bw.Put(0, 3);           // substreamid
+        bw.Put(size / 2 - 1, 11);
+        bw.Put(0, 2);           // fscod: 48kHz
+        bw.Put(3, 2);           // numblkscod: 6 blocks
+        bw.Put(7, 3);           // acmod: 3/2
+        bw.Put(1, 1);           // lfeon
+        bw.Put(16, 5);          // bsid
+        bw.Put(27, 5);          // dialnorm
+    }
+
+    if (!is_ac3)
+    {
+        put_crc(frame, size - 2, EAC3Parser::crc16(
+                    std::span(frame).subspan(2, size - 4)));
+    }
+    else
+    {
+        size_t words = size / 2;
+        size_t frame_58 = ((words >> 1) + (words >> 3)) * 2;
+
+        put_crc(frame, size - 2, EAC3Parser::crc16(
+                    std::span(frame).subspan(frame_58,
+                                             size - frame_58 - 2)));
+
+        /*
+          crc1 sits at the start of the region it protects. The CRC is
+          linear, so find the value whose contribution cancels that of
+          the rest of the region.
+         */
+        std::vector<uint8_t> region(frame.begin() + 2,
+                                    frame.begin() + frame_58);
+        uint16_t target = EAC3Parser::crc16(region);
+
+        std::vector<uint8_t> zeros(region.size(), 0);
+        std::array<uint16_t, 16> basis {};
+        for (int bit = 0; bit < 16; ++bit)
+        {
+            put_crc(zeros, 0, static_cast<uint16_t>(1 << bit));
+            basis[bit] = EAC3Parser::crc16(zeros);
+        }
+
+        for (uint32_t crc1 = 0; crc1 < 0x10000; ++crc1)
+        {
+            uint16_t residue = 0;
+            for (int bit = 0; bit < 16; ++bit)
+            {
+                if ((crc1 >> bit) & 1)
+                    residue ^= basis[bit];
+            }
+            if (residue == target)
+            {
+                put_crc(frame, 2, static_cast<uint16_t>(crc1));
+                break;
+            }
+        }
+    }
+
+    if (EAC3Parser::checkCRC(frame, codec_type) != CRCResult::OK)
+        throw std::runtime_error("bench: failed to build a valid syncframe");
+
+    return frame;
+}
+
+/*
+  IEC61937 bursts as they leave capture_audio_loop: big endian
+  preamble words, the syncframe in natural byte order, zero stuffed
+  to the burst repetition period.
+ */
+std::vector<uint8_t> make_iec61937(CodecType codec_type, int bursts)
+{
+    const bool is_ac3 = (codec_type == CodecType::AC3);
+    const std::vector<uint8_t> frame = make_frame(codec_type);
+
+    // 1536 (AC-3) or 6144 (E-AC-3) stereo 16-bit sample periods
+    const size_t period = is_ac3 ? 1536 * 4 : 6144 * 4;
+    const uint16_t pc = is_ac3 ? 0x0001 : 0x0015;
+    const uint16_t pd = static_cast<uint16_t>(is_ac3 ? frame.size() * 8
+                                                     : frame.size());
+
+    std::vector<uint8_t> stream(period * bursts, 0);
+    for (int burst = 0; burst < bursts; ++burst)
+    {
+        uint8_t* out = stream.data() + burst * period;
+        const uint16_t preamble[4] = { 0xF872, 0x4E1F, pc, pd };
+        for (int idx = 0; idx < 4; ++idx)
+        {
+            out[idx * 2]     = static_cast<uint8_t>(preamble[idx] >> 8);
+            out[idx * 2 + 1] = static_cast<uint8_t>(preamble[idx] & 0xFF);
+        }
+        std::copy(frame.begin(), frame.end(), out + 8);
+    }
+
+    return stream;
+}
+
+Bench::Body iec61937_push(CodecType codec_type)
+{
+    struct State
+    {
+        IEC61937Parser       parser {0};
+        std::vector<uint8_t> stream;
+        size_t               offset    {0};
+        int64_t              timestamp {0};
+    };
+    auto st = std::make_shared<State>();
+    st->stream = make_iec61937(codec_type, 16);
+
+    return Bench::Body {
+        .run = [st](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                st->parser.PushSamples(st->stream.data() + st->offset,
+                                       CAPTURE_BLOCK_BYTES,
+                                       st->timestamp, 48000);
+                while (auto frame = st->parser.PopFrame())
+                    Bench::DoNotOptimize(frame->payload.data());
+
+                st->offset += CAPTURE_BLOCK_BYTES;
+                if (st->offset >= st->stream.size())
+                    st->offset = 0;
+                st->timestamp += 40000;    // 192 samples in 100ns
+            }
+        },
+        .bytes_per_op = CAPTURE_BLOCK_BYTES
+    };
+}
+
+BENCHMARK("iec61937/push_samples_ac3",
+          [] { return iec61937_push(CodecType::AC3); });
+BENCHMARK("iec61937/push_samples_eac3",
+          [] { return iec61937_push(CodecType::EAC3); });
+
+Bench::Body eac3_process(CodecType codec_type)
+{
+    auto parser = std::make_shared<EAC3Parser>();
+    auto frame = std::make_shared<std::vector<uint8_t>>(make_frame(codec_type));
+
+    return Bench::Body {
+        .run = [parser, frame, codec_type](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                auto meta = parser->processFrame(*frame, codec_type);
+                Bench::DoNotOptimize(meta);
+            }
+        }
+    };
+}
+
+BENCHMARK("eac3parser/process_frame_ac3",
+          [] { return eac3_process(CodecType::AC3); });
+BENCHMARK("eac3parser/process_frame_eac3",
+          [] { return eac3_process(CodecType::EAC3); });
+
+BENCHMARK("eac3parser/frame_size_bytes", []
+{
+    auto ac3  = std::make_shared<std::vector<uint8_t>>
+                (make_frame(CodecType::AC3));
+    auto eac3 = std::make_shared<std::vector<uint8_t>>
+                (make_frame(CodecType::EAC3));
+
+    return Bench::Body {
+        .run = [ac3, eac3](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                size_t bytes = (op & 1)
+                    ? EAC3Parser::getFrameSizeBytes(*eac3, CodecType::EAC3)
+                    : EAC3Parser::getFrameSizeBytes(*ac3, CodecType::AC3);
+                Bench::DoNotOptimize(bytes);
+                Bench::ClobberMemory();
+            }
+        }
+    };
+});
+
+// Bit at a time reference, to show what the slice-by-8 tables buy.
+uint16_t crc16_bitwise(std::span<const uint8_t> data)
+{
+    uint16_t crc = 0;
+    for (uint8_t byte : data)
+    {
+        crc ^= static_cast<uint16_t>(byte << 8);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x8005)
+                                 : static_cast<uint16_t>(crc << 1);
+    }
+    return crc;
+}
+
+BENCHMARK("eac3parser/crc16", []
+{
+    auto frame = std::make_shared<std::vector<uint8_t>>
+                 (make_frame(CodecType::EAC3));
+
+    return Bench::Body {
+        .run = [frame](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                Bench::DoNotOptimize(EAC3Parser::crc16(*frame));
+                Bench::ClobberMemory();
+            }
+        },
+        .bytes_per_op = EAC3_FRAME_BYTES
+    };
+});
+
+BENCHMARK("eac3parser/crc16_bitwise", []
+{
+    auto frame = std::make_shared<std::vector<uint8_t>>
+                 (make_frame(CodecType::EAC3));
+
+    if (crc16_bitwise(*frame) != EAC3Parser::crc16(*frame))
+        throw std::runtime_error("bench: crc16 mismatch");
+
+    return Bench::Body {
+        .run = [frame](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                Bench::DoNotOptimize(crc16_bitwise(*frame));
+                Bench::ClobberMemory();
+            }
+        },
+        .bytes_per_op = EAC3_FRAME_BYTES
+    };
+});
+
+Bench::Body check_crc(CodecType codec_type)
+{
+    auto frame = std::make_shared<std::vector<uint8_t>>(make_frame(codec_type));
+
+    return Bench::Body {
+        .run = [frame, codec_type](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                Bench::DoNotOptimize(EAC3Parser::checkCRC(*frame, codec_type));
+                Bench::ClobberMemory();
+            }
+        },
+        .bytes_per_op = static_cast<double>(frame->size())
+    };
+}
+
+BENCHMARK("eac3parser/check_crc_ac3",
+          [] { return check_crc(CodecType::AC3); });
+BENCHMARK("eac3parser/check_crc_eac3",
+          [] { return check_crc(CodecType::EAC3); });
+
+/*
+  The per capture frame repack done in Magewell::capture_audio_loop.
+ */
+Bench::Body deinterleave(int channel_pairs, bool bitstream)
+{
+    struct State
+    {
+        std::vector<uint32_t> src;
+        std::vector<uint8_t>  out;
+    };
+    auto st = std::make_shared<State>();
+
+    st->src.resize(CAPTURE_SAMPLES * CAPTURE_CHANNELS);
+    Bench::Random rnd;
+    for (auto& sample : st->src)
+        sample = static_cast<uint32_t>(rnd.Next());
+
+    const int bytes_per_sample = bitstream ? 2 : 4;
+    const int shift = bitstream ? 16 : 0;
+    st->out.resize(CAPTURE_SAMPLES * channel_pairs * 2 * bytes_per_sample);
+
+    return Bench::Body {
+        .run = [=](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                AudioConvert::Deinterleave(st->src.data(), channel_pairs,
+                                           CAPTURE_SAMPLES, CAPTURE_CHANNELS,
+                                           shift, bitstream,
+                                           bytes_per_sample, st->out.data());
+                Bench::ClobberMemory();
+            }
+        },
+        .bytes_per_op = static_cast<double>(st->out.size())
+    };
+}
+
+BENCHMARK("audio_convert/deinterleave_lpcm_8ch",
+          [] { return deinterleave(4, false); });
+BENCHMARK("audio_convert/deinterleave_bitstream",
+          [] { return deinterleave(1, true); });
+
+/*
+  PCMStream::AddSamples integer to planar float conversion.
+ */
+Bench::Body to_planar(int channels, bool is_24bit)
+{
+    struct State
+    {
+        std::vector<uint8_t> src;
+        std::vector<float>   planar;
+        std::array<float*, 8> planes {};
+    };
+    auto st = std::make_shared<State>();
+
+    const int bytes = is_24bit ? 4 : 2;
+    st->src.resize(CAPTURE_SAMPLES * channels * bytes);
+    Bench::Random().Fill(st->src.data(), st->src.size());
+
+    st->planar.resize(CAPTURE_SAMPLES * channels);
+    for (int ch = 0; ch < channels; ++ch)
+        st->planes[ch] = st->planar.data() + CAPTURE_SAMPLES * ch;
+
+    return Bench::Body {
+        .run = [=](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                AudioConvert::ToPlanarFloat(st->src.data(), channels,
+                                            CAPTURE_SAMPLES, is_24bit,
+                                            st->planes.data());
+                Bench::ClobberMemory();
+            }
+        },
+        .bytes_per_op = static_cast<double>(st->src.size())
+    };
+}
+
+BENCHMARK("audio_convert/to_planar_s32_6ch",
+          [] { return to_planar(6, true); });
+BENCHMARK("audio_convert/to_planar_s16_2ch",
+          [] { return to_planar(2, false); });
+
+/*
+  CompatStream 5.1 -> stereo downmix of one AC-3 frame, with the
+  vector kernel and the scalar reference.
+ */
+Bench::Body downmix(bool use_vector)
+{
+    constexpr int SAMPLES  = 1536;
+    constexpr int CHANNELS = 6;
+
+    struct State
+    {
+        std::vector<float> in;
+        std::array<const float*, CHANNELS> planes {};
+        std::vector<float> left;
+        std::vector<float> right;
+        Downmix::Coeffs    coeffs;
+    };
+    auto st = std::make_shared<State>();
+
+    st->in.resize(SAMPLES * CHANNELS);
+    Bench::Random rnd;
+    for (auto& sample : st->in)
+        sample = static_cast<float>(static_cast<int32_t>(rnd.Next()))
+                 / 2147483648.0f;
+    for (int ch = 0; ch < CHANNELS; ++ch)
+        st->planes[ch] = st->in.data() + SAMPLES * ch;
+    st->left.resize(SAMPLES);
+    st->right.resize(SAMPLES);
+
+    // FL FR FC LFE BL BR, normalized as CompatStream does
+    constexpr float c3 = 0.70710678f;
+    constexpr float norm = 1.0f + c3 + c3;
+    st->coeffs.channels = CHANNELS;
+    st->coeffs.left  = { 1 / norm, 0, c3 / norm, 0, c3 / norm, 0 };
+    st->coeffs.right = { 0, 1 / norm, c3 / norm, 0, 0, c3 / norm };
+
+    return Bench::Body {
+        .run = [=](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                if (use_vector)
+                    Downmix::Stereo(st->planes.data(), st->coeffs,
+                                    st->left.data(), st->right.data(),
+                                    SAMPLES);
+                else
+                    Downmix::StereoScalar(st->planes.data(), st->coeffs,
+                                          st->left.data(), st->right.data(),
+                                          SAMPLES);
+                Bench::ClobberMemory();
+            }
+        },
+        .bytes_per_op = SAMPLES * CHANNELS * sizeof(float)
+    };
+}
+
+BENCHMARK("downmix/stereo_5.1", [] { return downmix(true); });
+BENCHMARK("downmix/stereo_5.1_scalar", [] { return downmix(false); });
+
+}
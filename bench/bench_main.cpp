@@ -0,0 +1,319 @@
+/*
+  magewell2ts_bench: micro-benchmarks for the capture -> mux hot paths.
+
+  Results are written as text (default), JSON or CSV so they can be
+  compared between releases:
+
+    magewell2ts_bench --format json > bench-$(git describe).json
+*/
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#ifdef USE_LIBFMT_FALLBACK
+  #include <fmt/format.h>
+  using fmt::format;
+#else
+  #include <format>
+  using std::format;
+#endif
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/null_sink.h>
+#include <spdlog/sinks/stdout_sinks.h>
+
+#include "Bench.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+using namespace std;
+
+namespace
+{
+
+struct Options
+{
+    string   filter;
+    string   fmt          {"text"};
+    double   min_time     {0.2};   // Seconds per repetition
+    int      repetitions  {5};
+    bool     list         {false};
+    bool     log          {false};
+};
+
+struct Result
+{
+    string   name;
+    uint64_t ops          {0};
+    double   ns_per_op    {0};     // Median
+    double   ns_per_op_min {0};
+    double   ns_per_op_max {0};
+    double   mb_per_s     {0};     // From the median
+};
+
+double time_ops(const Bench::Body& body, uint64_t ops)
+{
+    auto start = chrono::steady_clock::now();
+    body.run(ops);
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double>(end - start).count();
+}
+
+Result run_case(const Bench::Case& bench_case, const Options& opts)
+{
+    Bench::Body body = bench_case.setup();
+
+    // Warm up caches (and any lazy initialization in the code under
+    // test), then grow the op count until a run takes a measurable
+    // amount of time.
+    time_ops(body, 1);
+
+    uint64_t ops = 1;
+    double   secs = time_ops(body, ops);
+    while (secs < opts.min_time / 10 && ops < (1ULL << 40))
+    {
+        ops *= 10;
+        secs = time_ops(body, ops);
+    }
+    if (secs > 0 && secs < opts.min_time)
+        ops = max<uint64_t>(1, static_cast<uint64_t>
+                            (ops * opts.min_time / secs));
+
+    vector<double> ns;
+    for (int rep = 0; rep < opts.repetitions; ++rep)
+        ns.push_back(time_ops(body, ops) * 1e9 / ops);
+    sort(ns.begin(), ns.end());
+
+    Result result {
+        .name          = bench_case.name,
+        .ops           = ops,
+        .ns_per_op     = ns[ns.size() / 2],
+        .ns_per_op_min = ns.front(),
+        .ns_per_op_max = ns.back()
+    };
+    if (body.bytes_per_op > 0 && result.ns_per_op > 0)
+        result.mb_per_s = body.bytes_per_op * 1e3 / result.ns_per_op;
+
+    return result;
+}
+
+string json_escape(string_view str)
+{
+    string out;
+    for (char ch : str)
+    {
+        if (ch == '"' || ch == '\\')
+            out += '\\';
+        out += ch;
+    }
+    return out;
+}
+
+void print_text(const vector<Result>& results)
+{
+    cout << format("{:<40} {:>14} {:>12} {:>12} {:>10}\n",
+                   "benchmark", "ops", "ns/op", "min ns/op", "MB/s");
+    for (const auto& res : results)
+    {
+        cout << format("{:<40} {:>14} {:>12.1f} {:>12.1f} {:>10}\n",
+                       res.name, res.ops, res.ns_per_op, res.ns_per_op_min,
+                       res.mb_per_s > 0 ? format("{:.1f}", res.mb_per_s)
+                                        : string("-"));
+    }
+}
+
+void print_csv(const vector<Result>& results)
+{
+    cout << "name,ops,ns_per_op,ns_per_op_min,ns_per_op_max,mb_per_s\n";
+    for (const auto& res : results)
+    {
+        cout << format("{},{},{:.3f},{:.3f},{:.3f},{:.3f}\n",
+                       res.name, res.ops, res.ns_per_op, res.ns_per_op_min,
+                       res.ns_per_op_max, res.mb_per_s);
+    }
+}
+
+void print_json(const vector<Result>& results, const Options& opts)
+{
+    char host[256] {};
+    gethostname(host, sizeof(host) - 1);
+
+    cout << "{\n"
+         << format("  \"version\": \"{}\",\n", json_escape(BENCH_VERSION))
+         << format("  \"compiler\": \"{}\",\n", json_escape(__VERSION__))
+         << format("  \"host\": \"{}\",\n", json_escape(host))
+         << format("  \"cpus\": {},\n", thread::hardware_concurrency())
+         << format("  \"repetitions\": {},\n", opts.repetitions)
+         << "  \"results\": [\n";
+
+    for (size_t idx = 0; idx < results.size(); ++idx)
+    {
+        const auto& res = results[idx];
+        cout << format("    {{\"name\": \"{}\", \"ops\": {}, "
+                       "\"ns_per_op\": {:.3f}, \"ns_per_op_min\": {:.3f}, "
+                       "\"ns_per_op_max\": {:.3f}, \"mb_per_s\": {:.3f}}}{}\n",
+                       json_escape(res.name), res.ops, res.ns_per_op,
+                       res.ns_per_op_min, res.ns_per_op_max, res.mb_per_s,
+                       idx + 1 < results.size() ? "," : "");
+    }
+
+    cout << "  ]\n}\n";
+}
+
+void show_help(string_view app)
+{
+    clog << format("{} Version: {}\n", app, BENCH_VERSION);
+
+    clog << "\n"
+         << "Defaults in []:\n"
+         << "\n";
+
+    clog << "--filter (-f)      : Only run benchmarks whose name contains this\n"
+         << "--format           : text, json or csv [text]\n"
+         << "--list (-l)        : List the benchmarks\n"
+         << "--log              : Show log messages from the code under test\n"
+         << "--min-time         : Seconds per repetition [0.2]\n"
+         << "--repetitions (-r) : Repetitions per benchmark [5]\n";
+}
+
+bool string_to_number(string_view arg, double& value)
+{
+    try
+    {
+        value = stod(string(arg));
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+}
+
+vector<Bench::Case>& Bench::Registry(void)
+{
+    static vector<Case> registry;
+    return registry;
+}
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    string_view app_name = argv[0];
+
+    vector<string_view> args(argv + 1, argv + argc);
+    for (auto iter = args.begin(); iter != args.end(); ++iter)
+    {
+        auto next = [&](void) -> string_view
+        {
+            if (iter + 1 == args.end())
+            {
+                cerr << format("{} requires a value\n", *iter);
+                exit(1);
+            }
+            return *(++iter);
+        };
+
+        if (*iter == "-h" || *iter == "--help")
+        {
+            show_help(app_name);
+            return 0;
+        }
+        else if (*iter == "-f" || *iter == "--filter")
+            opts.filter = next();
+        else if (*iter == "--format")
+        {
+            opts.fmt = next();
+            if (opts.fmt != "text" && opts.fmt != "json" && opts.fmt != "csv")
+            {
+                cerr << format("Unknown format '{}'\n", opts.fmt);
+                return 1;
+            }
+        }
+        else if (*iter == "-l" || *iter == "--list")
+            opts.list = true;
+        else if (*iter == "--log")
+            opts.log = true;
+        else if (*iter == "--min-time")
+        {
+            if (!string_to_number(next(), opts.min_time) ||
+                opts.min_time <= 0)
+            {
+                cerr << "Invalid --min-time\n";
+                return 1;
+            }
+        }
+        else if (*iter == "-r" || *iter == "--repetitions")
+        {
+            string_view val = next();
+            auto [ptr, ec] = from_chars(val.data(), val.data() + val.size(),
+                                        opts.repetitions);
+            if (ec != errc() || opts.repetitions < 1)
+            {
+                cerr << "Invalid --repetitions\n";
+                return 1;
+            }
+        }
+        else
+        {
+            cerr << format("Unrecognized option '{}'\n", *iter);
+            show_help(app_name);
+            return 1;
+        }
+    }
+
+    // The code under test expects the application logger.
+    shared_ptr<spdlog::logger> logger;
+    if (opts.log)
+        logger = spdlog::stderr_logger_mt("app_logger");
+    else
+        logger = spdlog::create<spdlog::sinks::null_sink_mt>("app_logger");
+    logger->set_level(opts.log ? spdlog::level::info : spdlog::level::off);
+    spdlog::set_default_logger(logger);
+
+    auto& registry = Bench::Registry();
+    sort(registry.begin(), registry.end(),
+         [](const Bench::Case& lhs, const Bench::Case& rhs)
+         { return lhs.name < rhs.name; });
+
+    vector<Result> results;
+    for (const auto& bench_case : registry)
+    {
+        if (!opts.filter.empty() &&
+            bench_case.name.find(opts.filter) == string::npos)
+            continue;
+
+        if (opts.list)
+        {
+            cout << bench_case.name << "\n";
+            continue;
+        }
+
+        if (opts.fmt == "text")
+            clog << "Running " << bench_case.name << "\n";
+        results.push_back(run_case(bench_case, opts));
+    }
+
+    if (opts.list)
+        return 0;
+
+    if (opts.fmt == "json")
+        print_json(results, opts);
+    else if (opts.fmt == "csv")
+        print_csv(results);
+    else
+        print_text(results);
+
+    return 0;
+}
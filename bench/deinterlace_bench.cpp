@@ -0,0 +1,123 @@
+/*
+  Deinterlacing a 1080i NV12 frame in a copy worker, as it is done
+  before upload. A 1080i60 channel delivers 29.97 of these frames a
+  second, so frames/s divided by 29.97 is about the number of channels
+  one core can keep up with (half that with --field-rate, which
+  rebuilds both fields of every frame). The adaptive mode also makes a
+  motion map of each frame on the video manager thread.
+*/
+
+#include <memory>
+#include <vector>
+
+#include "Bench.h"
+
+#include "Deinterlace.h"
+
+namespace
+{
+
+constexpr int    WIDTH  = 1920;
+constexpr int    HEIGHT = 1080;
+constexpr size_t LUMA   = static_cast<size_t>(WIDTH) * HEIGHT;
+constexpr size_t FRAME_1080I = LUMA * 3 / 2;
+
+/*
+  Smooth on the left, where the fields agree and the adaptive mode keeps
+  its lines, and combed noise on the right, where it averages them.
+*/
+std::shared_ptr<std::vector<uint8_t>> woven(void)
+{
+    Bench::Random rnd;
+    auto data = std::make_shared<std::vector<uint8_t>>(FRAME_1080I);
+    uint8_t* line = data->data();
+    for (int row = 0; row < HEIGHT * 3 / 2; ++row, line += WIDTH)
+    {
+        for (int col = 0; col < WIDTH / 2; ++col)
+            line[col] = static_cast<uint8_t>((row + col) / 8);
+        rnd.Fill(line + WIDTH / 2, WIDTH / 2);
+    }
+    return data;
+}
+
+void deinterlace(const uint8_t* src, uint8_t* dst, int field,
+                 Deinterlace::Mode mode, const Deinterlace::MotionMap* motion)
+{
+    Deinterlace::Plane(src, WIDTH, dst, WIDTH, WIDTH, HEIGHT,
+                       field, false, mode, motion, 2);
+    Deinterlace::Plane(src + LUMA, WIDTH, dst + LUMA, WIDTH, WIDTH,
+                       HEIGHT / 2, field, false, mode, motion, 1);
+}
+
+/*
+  The frame before: the same, but with the bottom half changed, so half
+  the blocks have moved.
+*/
+std::shared_ptr<const Deinterlace::MotionMap>
+moved_half(const std::vector<uint8_t>& src)
+{
+    std::vector<uint8_t> before(src);
+    for (size_t idx = LUMA / 2; idx < LUMA; ++idx)
+        before[idx] ^= 0x40;
+
+    Deinterlace::Motion motion;
+    motion.Add(before.data(), WIDTH, WIDTH, HEIGHT, false);
+    return motion.Add(src.data(), WIDTH, WIDTH, HEIGHT, false);
+}
+
+Bench::Body frames(Deinterlace::Mode mode, int fields)
+{
+    auto src = woven();
+    auto dst = std::make_shared<std::vector<uint8_t>>(FRAME_1080I);
+    auto map = mode == Deinterlace::ADAPTIVE ? moved_half(*src) : nullptr;
+
+    return Bench::Body {
+        .run = [src, dst, mode, fields, map](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                for (int field = 0; field < fields; ++field)
+                    deinterlace(src->data(), dst->data(), field, mode,
+                                map.get());
+                Bench::ClobberMemory();
+            }
+        },
+        .bytes_per_op = static_cast<double>(FRAME_1080I)
+    };
+}
+
+BENCHMARK("deinterlace/bob_1080i", []
+{
+    return frames(Deinterlace::BOB, 1);
+});
+
+BENCHMARK("deinterlace/adaptive_1080i", []
+{
+    return frames(Deinterlace::ADAPTIVE, 1);
+});
+
+BENCHMARK("deinterlace/adaptive_1080i_field_rate", []
+{
+    return frames(Deinterlace::ADAPTIVE, 2);
+});
+
+BENCHMARK("deinterlace/motion_map_1080i", []
+{
+    auto src = woven();
+    auto motion = std::make_shared<Deinterlace::Motion>();
+
+    return Bench::Body {
+        .run = [src, motion](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                auto map = motion->Add(src->data(), WIDTH, WIDTH, HEIGHT,
+                                       false);
+                Bench::DoNotOptimize(map);
+            }
+        },
+        .bytes_per_op = static_cast<double>(LUMA)
+    };
+});
+
+}
@@ -0,0 +1,102 @@
+/*
+  Repeated frame detection: the sampled FrameHash the inverse telecine
+  takes of every captured frame and the full one --skip-static takes,
+  against comparing whole frames.
+*/
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "Bench.h"
+
+#include "FrameHash.h"
+
+namespace
+{
+
+// NV12
+constexpr size_t FRAME_1080P = 1920 * 1080 * 3 / 2;
+constexpr size_t FRAME_2160P = 3840 * 2160 * 3 / 2;
+
+std::shared_ptr<std::vector<uint8_t>> frames(size_t size)
+{
+    Bench::Random rnd;
+    auto data = std::make_shared<std::vector<uint8_t>>(size * 2);
+    rnd.Fill(data->data(), size);
+    std::memcpy(data->data() + size, data->data(), size);
+    return data;
+}
+
+// A repeat compared against the frame before it: every byte is read.
+BENCHMARK("frame/memcmp_1080p", []
+{
+    auto data = frames(FRAME_1080P);
+
+    return Bench::Body {
+        .run = [data](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                int same = std::memcmp(data->data(),
+                                       data->data() + FRAME_1080P,
+                                       FRAME_1080P);
+                Bench::DoNotOptimize(same);
+            }
+        },
+        .bytes_per_op = static_cast<double>(FRAME_1080P)
+    };
+});
+
+BENCHMARK("frame/sampled_hash_1080p", []
+{
+    auto data = frames(FRAME_1080P);
+
+    return Bench::Body {
+        .run = [data](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                uint64_t hash = FrameHash::Sampled(data->data(),
+                                                   FRAME_1080P);
+                Bench::DoNotOptimize(hash);
+            }
+        }
+    };
+});
+
+BENCHMARK("frame/full_hash_2160p", []
+{
+    auto data = frames(FRAME_2160P);
+
+    return Bench::Body {
+        .run = [data](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                uint64_t hash = FrameHash::Full(data->data(), FRAME_2160P);
+                Bench::DoNotOptimize(hash);
+            }
+        },
+        .bytes_per_op = static_cast<double>(FRAME_2160P)
+    };
+});
+
+BENCHMARK("frame/sampled_hash_2160p", []
+{
+    auto data = frames(FRAME_2160P);
+
+    return Bench::Body {
+        .run = [data](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                uint64_t hash = FrameHash::Sampled(data->data(),
+                                                   FRAME_2160P);
+                Bench::DoNotOptimize(hash);
+            }
+        }
+    };
+});
+
+}
@@ -0,0 +1,159 @@
+/*
+  Encoded video scanning: finding and classifying the NAL units of a
+  4K HEVC IDR access unit, against the byte at a time loop the
+  PacketSequence flight recorder used to use.
+*/
+
+#include <memory>
+#include <vector>
+
+#include "Bench.h"
+
+#include "NalScanner.h"
+
+namespace
+{
+
+// ~1.2MB: about what hevc_qsv produces for a 2160p IDR at -q 25.
+constexpr size_t SLICES      = 4;
+constexpr size_t SLICE_BYTES = 300 * 1024;
+
+void put_nal(std::vector<uint8_t>& au, bool long_start,
+             std::vector<uint8_t> nal)
+{
+    if (long_start)
+        au.push_back(0);
+    au.insert(au.end(), { 0, 0, 1 });
+    au.insert(au.end(), nal.begin(), nal.end());
+}
+
+// Random slice data, with emulation prevention applied as an encoder
+// would, so that it contains no start codes.
+std::vector<uint8_t> slice_payload(Bench::Random& rnd, uint8_t type)
+{
+    std::vector<uint8_t> raw(SLICE_BYTES);
+    rnd.Fill(raw.data(), raw.size());
+
+    std::vector<uint8_t> nal { static_cast<uint8_t>(type << 1), 1 };
+    int zeros = 0;
+    for (uint8_t byte : raw)
+    {
+        if (zeros >= 2 && byte <= 3)
+        {
+            nal.push_back(3);
+            zeros = 0;
+        }
+        nal.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+    return nal;
+}
+
+std::shared_ptr<std::vector<uint8_t>> hevc_4k_idr(void)
+{
+    Bench::Random rnd;
+    auto au = std::make_shared<std::vector<uint8_t>>();
+
+    put_nal(*au, true, { 35 << 1, 1, 0x10 });                  // AUD
+    put_nal(*au, true, { 32 << 1, 1, 0x0C, 0x01, 0xFF, 0xFF }); // VPS
+    put_nal(*au, false, { 33 << 1, 1, 0x01, 0x01, 0x60, 0x00 });// SPS
+    put_nal(*au, false, { 34 << 1, 1, 0xC1, 0x73, 0xD0, 0x89 });// PPS
+    put_nal(*au, false, { 39 << 1, 1, 0x89, 0x18, 0x3A, 0x80 });// SEI
+    for (size_t idx = 0; idx < SLICES; ++idx)
+        put_nal(*au, false, slice_payload(rnd, 19));          // IDR_W_RADL
+
+    return au;
+}
+
+/*
+  The loop PacketSequence::ParseNalUnits used: look at every byte for
+  a 3 or 4 byte start code, and classify what follows as H.264.
+*/
+void byte_loop(const uint8_t* data, int size,
+               bool& out_idr, bool& out_sps, bool& out_pps)
+{
+    out_idr = out_sps = out_pps = false;
+
+    for (int idx = 0; idx < size - 4; ++idx)
+    {
+        if (data[idx] == 0x00 && data[idx + 1] == 0x00)
+        {
+            int nal_index = -1;
+            if (data[idx + 2] == 0x01)
+                nal_index = idx + 3;
+            else if (data[idx + 2] == 0x00 && data[idx + 3] == 0x01)
+                nal_index = idx + 4;
+
+            if (nal_index != -1 && nal_index < size)
+            {
+                uint8_t nal_type = data[nal_index] & 0x1F;
+                if (nal_type == 5)
+                    out_idr = true;
+                else if (nal_type == 7)
+                    out_sps = true;
+                else if (nal_type == 8)
+                    out_pps = true;
+            }
+        }
+    }
+}
+
+BENCHMARK("nal/byte_loop_4k_idr", []
+{
+    auto au = hevc_4k_idr();
+
+    return Bench::Body {
+        .run = [au](uint64_t ops)
+        {
+            bool idr, sps, pps;
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                byte_loop(au->data(), static_cast<int>(au->size()),
+                          idr, sps, pps);
+                Bench::DoNotOptimize(idr);
+            }
+        },
+        .bytes_per_op = static_cast<double>(au->size())
+    };
+});
+
+// Every NAL unit of the access unit, found and classified.
+BENCHMARK("nal/scan_4k_idr", []
+{
+    auto au = hevc_4k_idr();
+
+    return Bench::Body {
+        .run = [au](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                uint32_t kinds = NalScanner::Classify(AV_CODEC_ID_HEVC,
+                                                      au->data(),
+                                                      au->size(), false);
+                Bench::DoNotOptimize(kinds);
+            }
+        },
+        .bytes_per_op = static_cast<double>(au->size())
+    };
+});
+
+// What the flight recorder does per packet: the first 1KB, headers only.
+BENCHMARK("nal/classify_headers", []
+{
+    auto au = hevc_4k_idr();
+
+    return Bench::Body {
+        .run = [au](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                uint32_t kinds = NalScanner::Classify(AV_CODEC_ID_HEVC,
+                                                      au->data(), 1024,
+                                                      true);
+                Bench::DoNotOptimize(kinds);
+            }
+        }
+    };
+});
+
+}
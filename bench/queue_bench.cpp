@@ -0,0 +1,141 @@
+/*
+  Packet queue and mux scheduling benchmarks.
+*/
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Bench.h"
+
+#include "MediaQueue.h"
+
+namespace
+{
+
+Packet make_queued(int64_t dts)
+{
+    Packet packet { .pkt = make_packet() };
+    packet.pkt->pts = packet.pkt->dts = dts;
+    return packet;
+}
+
+/*
+  Uncontended push/pop. The packets are recycled so only the queue
+  itself is measured.
+ */
+BENCHMARK("mediaqueue/push_pop", []
+{
+    struct State
+    {
+        MediaQueue          queue;
+        std::vector<Packet> pool;
+    };
+    auto st = std::make_shared<State>();
+    for (int idx = 0; idx < 64; ++idx)
+        st->pool.push_back(make_queued(idx));
+
+    return Bench::Body {
+        .run = [st](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                Packet& slot = st->pool[op & 63];
+                st->queue.Push(std::move(slot));
+                slot = std::move(*st->queue.PopValue());
+            }
+        }
+    };
+});
+
+/*
+  The encoder side of OutputTS: a video and an audio thread each
+  allocate and push packets, while the mux thread picks the earliest
+  head and pops it. One op is one packet muxed.
+ */
+BENCHMARK("mediaqueue/contended", []
+{
+    return Bench::Body {
+        .run = [](uint64_t ops)
+        {
+            MediaQueue video;
+            MediaQueue audio;
+            const uint64_t per_stream = (ops + 1) / 2;
+
+            auto producer = [per_stream](MediaQueue& queue, int64_t step)
+            {
+                for (uint64_t idx = 0; idx < per_stream; ++idx)
+                    queue.Push(make_queued(idx * step));
+            };
+
+            std::thread vid_thread(producer, std::ref(video), 1501);
+            std::thread aud_thread(producer, std::ref(audio), 2880);
+
+            const std::array<MediaQueue*, 2> queues { &video, &audio };
+            uint64_t muxed = 0;
+            while (muxed < per_stream * 2)
+            {
+                MediaQueue* target = EarliestQueue(queues);
+                if (target == nullptr)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                auto packet = target->PopValue();
+                Bench::DoNotOptimize(packet->pkt->dts);
+                ++muxed;
+            }
+
+            vid_thread.join();
+            aud_thread.join();
+        }
+    };
+});
+
+/*
+  OutputTS::mux stream selection over the video, audio and compat
+  queues, with the queues kept topped up. One op is one decision plus
+  the pop.
+ */
+BENCHMARK("mux/earliest_queue", []
+{
+    struct State
+    {
+        std::array<MediaQueue, 3>    queues;
+        std::array<MediaQueue*, 3>   ptrs {};
+        std::array<int64_t, 3>       next_dts { 0, 0, 0 };
+    };
+    auto st = std::make_shared<State>();
+
+    // 59.94 fps video, 32ms AC-3 frames on both audio tracks (90kHz)
+    static constexpr std::array<int64_t, 3> step { 1501, 2880, 2880 };
+    for (size_t idx = 0; idx < st->queues.size(); ++idx)
+    {
+        st->ptrs[idx] = &st->queues[idx];
+        for (int cnt = 0; cnt < 8; ++cnt)
+        {
+            st->queues[idx].Push(make_queued(st->next_dts[idx]));
+            st->next_dts[idx] += step[idx];
+        }
+    }
+
+    return Bench::Body {
+        .run = [st](uint64_t ops)
+        {
+            for (uint64_t op = 0; op < ops; ++op)
+            {
+                MediaQueue* target = EarliestQueue(st->ptrs);
+                size_t idx = target - st->queues.data();
+
+                Packet packet = std::move(*target->PopValue());
+                packet.pkt->dts = packet.pkt->pts = st->next_dts[idx];
+                st->next_dts[idx] += step[idx];
+                target->Push(std::move(packet));
+            }
+        }
+    };
+});
+
+}
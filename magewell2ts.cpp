@@ -27,6 +27,8 @@
 #include <charconv>
 #include <csignal>
 #include <memory>
+#include <atomic>
+#include <thread>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -40,17 +42,23 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include "spdlog_format.h"
 
+#include "CpuPlan.h"
+#include "LanePool.h"
 #include "Magewell.h"
+#include "Metrics.h"
+#include "MptsMux.h"
+#include "Trace.h"
 #include "version.h"
 
 using namespace std;
 
 std::shared_ptr<spdlog::logger> logger;
-Magewell* g_mw;
+std::vector<std::unique_ptr<Magewell>> g_inputs;
 
 void Shutdown(void)
 {
-    g_mw->Shutdown();
+    for (auto& mw : g_inputs)
+        mw->Shutdown();
 }
 
 void signal_handler(int signum)
@@ -58,14 +66,15 @@ void signal_handler(int signum)
     if (signum == SIGHUP || signum == SIGUSR1)
     {
 #if 0
-        g_mw->Reset();
+        for (auto& mw : g_inputs)
+            mw->Reset();
 #endif
     }
     else if (signum == SIGINT || signum == SIGTERM)
     {
         const char* msg = "Received SIGINT/SIGTERM.\n";
         write(STDERR_FILENO, msg, strlen(msg));
-        g_mw->Shutdown();
+        Shutdown();
     }
     else
     {
@@ -84,11 +93,15 @@ void show_help(string_view app)
 
     clog << "--board (-b)       : board id, if you have more than one [0]\n"
          << "--device (-d)      : vaapi/qsv device (e.g. renderD129) [renderD128]\n"
-         << "--input (-i)       : input idx, *required*. Starts at 1\n"
-         << "--settle-time      : How long to wait for signal changes to 'settle' [99(ms)]\n"
+         << "--input (-i)       : input idx, *required*. Starts at 1. A list (1,2,3) captures several\n"
+         << "--output           : Append the TS to a file or named pipe; {} is the input number [stdout]\n"
+         << "--mpts             : Mux all the inputs, as programs, into one TS [false]\n"
+         << "--settle-time      : Longest to wait for signal changes to 'settle' [99(ms)]\n"
          << "--list (-l)        : List capture card inputs\n"
          << "--mux (-m)         : capture audio and video and mux into TS [false]\n"
          << "--no-audio (-n)    : Only capture video. [false]\n"
+         << "--compat-audio     : Add a stereo AC3 track alongside the primary audio [false]\n"
+         << "--compat-bitrate   : Bitrate of the stereo AC3 track [192000]\n"
          << "--read-edid (-r)   : Read EDID info for input to file\n"
          << "--logfile          : Also log messages to the given file\n"
          << "--color (-o)       : Use color when logging to the console\n"
@@ -102,12 +115,26 @@ void show_help(string_view app)
          << "--b-frames         : Use B-Frames [0]\n"
          << "--gop_secs (-g)    : GOP size in seconds [1.5] (0 to disable)\n"
          << "--idr-interval     : Frequency that keyframe will be IDR [0]\n"
-         << "--copy-threads (-t) : Number of GPU copy threads [2]\n"
+         << "--copy-threads (-t) : Number of GPU copy lanes per input [2]\n"
+         << "--copy-pool        : Copy threads shared by the inputs [copy lanes or inputs, whichever is more]\n"
+         << "--mux-pool         : Mux threads shared by the inputs [one per two inputs]\n"
          << "--video-buffers    : Video buffers count (RAM) [20]\n"
          << "--extra-hw-frames  : Extra HW frames used for encoding [32]\n"
          << "--write-edid (-w)  : Write EDID info from file to input\n"
          << "--wait-for         : Wait for given number of inputs to be initialized. 10 second timeout\n"
-         << "--realtime         : Enable real-time priority threads.\n";
+         << "--realtime         : Enable real-time priority threads.\n"
+         << "--low-latency      : Pro cards: upload frames to the GPU as the lines arrive\n"
+         << "--inverse-telecine : Drop the repeated frames of 3:2 and 2:2 film cadences\n"
+         << "--skip-static      : Do not upload frames identical to the one before\n"
+         << "--deinterlace      : Interlaced input: 'bob' or 'adaptive' (motion adaptive) [adaptive]\n"
+         << "--field-rate       : Interlaced input: encode a frame per field (e.g. 1080i60 -> 59.94 fps)\n"
+         << "--cpu              : Thread placement: 'auto' or <role>=<cpu list>, may repeat\n"
+         << "--sched            : Thread scheduling: <role>=<other|batch|idle|fifo|rr>[:prio], may repeat\n"
+         << "--async-log        : Write log messages from a background thread\n"
+         << "--record-raw       : Also record the raw capture to file (+ .idx) for replay\n"
+         << "--latency-stats    : Write per stage video latency (JSON) to file every minute\n"
+         << "--trace            : Write a Chrome/Perfetto timeline of the pipeline threads to file on exit\n"
+         << "--metrics          : Serve Prometheus metrics on [host:]port or unix:/path\n";
 
     clog << "\n"
          << "Examples:\n"
@@ -121,7 +148,13 @@ void show_help(string_view app)
          << "\t" << app << " -i 1 -m -n -c h264_vaapi | mpv -\n"
          << "\n"
          << "\tUse Intel quick-sync to encode h.265 video and pipe it to mpv:\n"
-         << "\t" << app << " -b 1 -i 1 -m -n -c hevc_qsv | mpv -\n";
+         << "\t" << app << " -b 1 -i 1 -m -n -c hevc_qsv | mpv -\n"
+         << "\n"
+         << "\tCapture inputs 1 to 4 in one process, each to its own named pipe:\n"
+         << "\t" << app << " -i 1,2,3,4 -m --output /run/magewell/input{}.ts\n"
+         << "\n"
+         << "\tCapture inputs 1 to 4 as the programs of one TS on stdout:\n"
+         << "\t" << app << " -i 1,2,3,4 -m --mpts > headend.ts\n";
 
     clog << "\nIntel notes:\n"
          << "  --extra-hw-frames is equivalent to passing that argument\n"
@@ -160,6 +193,41 @@ bool string_to_float(string_view st, float &value, string_view var)
     return true;
 }
 
+// "1,2,3" to {1, 2, 3}
+bool string_to_inputs(string_view st, vector<int>& inputs)
+{
+    inputs.clear();
+    for (size_t pos = 0; pos <= st.size();)
+    {
+        size_t end = st.find(',', pos);
+        if (end == string_view::npos)
+            end = st.size();
+
+        int input;
+        if (!string_to_int(st.substr(pos, end - pos), input, "input"))
+            return false;
+        if (input < 1 || find(inputs.begin(), inputs.end(), input) !=
+            inputs.end())
+        {
+            cerr << "Invalid input: " << st << endl;
+            return false;
+        }
+        inputs.push_back(input);
+        pos = end + 1;
+    }
+    return true;
+}
+
+// `pattern` with "{}" replaced by the input number.
+string per_input(const string& pattern, int input)
+{
+    string path = pattern;
+    size_t pos  = path.find("{}");
+    if (pos != string::npos)
+        path.replace(pos, 2, to_string(input));
+    return path;
+}
+
 void set_custom_pattern(std::shared_ptr<spdlog::sinks::sink> sink,
                         const std::string& pattern)
 {
@@ -170,8 +238,18 @@ void set_custom_pattern(std::shared_ptr<spdlog::sinks::sink> sink,
 }
 
 void setup_logging(int verbose_level, bool color,
-                   bool thread_name, const string& logpath)
+                   bool thread_name, const string& logpath, bool async)
 {
+    auto make_logger = [async](std::vector<spdlog::sink_ptr> sinks)
+    {
+        // Keep slow sinks off the capture, encode and mux threads.
+        if (async)
+            sinks = { std::make_shared<AsyncSink>("app_logger",
+                                                  std::move(sinks)) };
+        return std::make_shared<spdlog::logger>("app_logger",
+                                                begin(sinks), end(sinks));
+    };
+
     // Create console sink
     std::shared_ptr<spdlog::sinks::sink> console_sink;
 
@@ -231,9 +309,7 @@ void setup_logging(int verbose_level, bool color,
                 file_sink->set_pattern("%Y-%m-%d %H:%M:%S.%e [%l] %v");
 
             // Combine sinks into a vector
-            std::vector<spdlog::sink_ptr> sinks {console_sink, file_sink};
-            logger = std::make_shared<spdlog::logger>("app_logger",
-                                                      begin(sinks), end(sinks));
+            logger = make_logger({console_sink, file_sink});
         }
         catch (const filesystem::filesystem_error& e)
         {
@@ -242,8 +318,7 @@ void setup_logging(int verbose_level, bool color,
     }
     else
     {
-        logger = std::make_shared<spdlog::logger>("app_logger",
-                      spdlog::sinks_init_list{console_sink});
+        logger = make_logger({console_sink});
     }
 
     // Set logger level based on verbose level
@@ -268,7 +343,7 @@ int main(int argc, char* argv[])
 {
     int    ret = 0;
     int    boardId  = -1;
-    int    devIndex = -1;
+    vector<int> inputs;
     chrono::milliseconds settle_time {99};
 
     string      logpath;
@@ -276,18 +351,28 @@ int main(int argc, char* argv[])
     bool        color = false;
     bool        thread_name = false;
     bool        realtime = false;
+    bool        async_log = false;
+    bool        low_latency = false;
 
     string_view app_name = argv[0];
     string      edid_file;
+    string      record_path;
+    string      output_path;
+    string      trace_path;
+    string      metrics_addr;
 
     bool        list_inputs = false;
     bool        do_capture  = false;
     bool        read_edid   = false;
     bool        write_edid  = false;
     bool        no_audio      = false;
+    bool        mpts          = false;
 
     int         video_buffers = 20;
+    int         copy_pool_threads = 0;
+    int         mux_pool_threads  = 0;
     VideoStream::Args  video_args;
+    AudioStream::Args  audio_args;
 
 
     // Attempt to set output PIPE to 1 Megabyte
@@ -332,6 +417,30 @@ int main(int argc, char* argv[])
         {
             logpath = *(++iter);
         }
+        else if (*iter == "--output")
+        {
+            output_path = *(++iter);
+        }
+        else if (*iter == "--mpts")
+        {
+            mpts = true;
+        }
+        else if (*iter == "--record-raw")
+        {
+            record_path = *(++iter);
+        }
+        else if (*iter == "--latency-stats")
+        {
+            video_args.latency_file = *(++iter);
+        }
+        else if (*iter == "--trace")
+        {
+            trace_path = *(++iter);
+        }
+        else if (*iter == "--metrics")
+        {
+            metrics_addr = *(++iter);
+        }
         else if (*iter == "-l" || *iter == "--list")
         {
             list_inputs = true;
@@ -373,7 +482,7 @@ int main(int argc, char* argv[])
         }
         else if (*iter == "-i" || *iter == "--input")
         {
-            if (!string_to_int(*(++iter), devIndex, "device index"))
+            if (!string_to_inputs(*(++iter), inputs))
                 exit(1);
         }
         else if (*iter == "-b" || *iter == "--board")
@@ -399,6 +508,16 @@ int main(int argc, char* argv[])
         {
             no_audio = true;
         }
+        else if (*iter == "--compat-audio")
+        {
+            audio_args.compat_track = true;
+        }
+        else if (*iter == "--compat-bitrate")
+        {
+            if (!string_to_int(*(++iter), audio_args.compat_bitrate,
+                               "Compat bitrate"))
+                exit(1);
+        }
         else if (*iter == "--p010")
         {
             video_args.p010 = true;
@@ -420,6 +539,18 @@ int main(int argc, char* argv[])
                                "Copy threads"))
                 exit(1);
         }
+        else if (*iter == "--copy-pool")
+        {
+            if (!string_to_int(*(++iter), copy_pool_threads,
+                               "Copy pool threads"))
+                exit(1);
+        }
+        else if (*iter == "--mux-pool")
+        {
+            if (!string_to_int(*(++iter), mux_pool_threads,
+                               "Mux pool threads"))
+                exit(1);
+        }
         else if (*iter == "--video-buffers")
         {
             if (!string_to_int(*(++iter), video_buffers,
@@ -437,7 +568,7 @@ int main(int argc, char* argv[])
             int input_count;
             if (!string_to_int(*(++iter), input_count, "input count"))
                 exit(1);
-            g_mw->WaitForInputs(input_count);
+            Magewell::WaitForInputs(input_count);
         }
         else if (*iter == "-o" || *iter == "--color")
         {
@@ -468,6 +599,55 @@ int main(int argc, char* argv[])
         {
             realtime = true;
         }
+        else if (*iter == "--cpu")
+        {
+            if (!CpuPlan::SetAffinity(*(++iter)))
+            {
+                cerr << "Invalid cpu: " << *iter << endl;
+                exit(1);
+            }
+        }
+        else if (*iter == "--sched")
+        {
+            if (!CpuPlan::SetSched(*(++iter)))
+            {
+                cerr << "Invalid sched: " << *iter << endl;
+                exit(1);
+            }
+        }
+        else if (*iter == "--async-log")
+        {
+            async_log = true;
+        }
+        else if (*iter == "--low-latency")
+        {
+            low_latency = true;
+        }
+        else if (*iter == "--inverse-telecine")
+        {
+            video_args.inverse_telecine = true;
+        }
+        else if (*iter == "--skip-static")
+        {
+            video_args.skip_static = true;
+        }
+        else if (*iter == "--deinterlace")
+        {
+            string_view mode = *(++iter);
+            if (mode == "bob")
+                video_args.deinterlace = Deinterlace::BOB;
+            else if (mode == "adaptive")
+                video_args.deinterlace = Deinterlace::ADAPTIVE;
+            else
+            {
+                cerr << "Invalid deinterlace mode: " << mode << endl;
+                exit(1);
+            }
+        }
+        else if (*iter == "--field-rate")
+        {
+            video_args.field_rate = true;
+        }
         else
         {
             cerr << "Unrecognized option " << *iter << endl;
@@ -475,8 +655,46 @@ int main(int argc, char* argv[])
         }
     }
 
+    if (mpts)
+    {
+        if (output_path.find("{}") != string::npos)
+        {
+            cerr << "With --mpts, all inputs go to one --output" << endl;
+            exit(1);
+        }
+        if (!inputs.empty() &&
+            *max_element(inputs.begin(), inputs.end()) >
+            MptsMux::MAX_PROGRAMS)
+        {
+            cerr << "Invalid input: --mpts takes inputs up to "
+                 << MptsMux::MAX_PROGRAMS << endl;
+            exit(1);
+        }
+    }
+    if (inputs.size() > 1)
+    {
+        // Each input needs files of its own.
+        for (const string* path : {&output_path, &record_path, &edid_file,
+                                   &video_args.latency_file})
+        {
+            if (mpts && path == &output_path)
+                continue;
+            if (!path->empty() && path->find("{}") == string::npos)
+            {
+                cerr << "With several inputs, " << *path
+                     << " needs a {} for the input number" << endl;
+                exit(1);
+            }
+        }
+        if (do_capture && output_path.empty() && !mpts)
+        {
+            cerr << "With several inputs, --output is required" << endl;
+            exit(1);
+        }
+    }
+
     // Initialize logging
-    setup_logging(verbose_level, color, thread_name, logpath);
+    setup_logging(verbose_level, color, thread_name, logpath, async_log);
 
     string argstr;
     for (int idx = 0; idx < argc; ++idx)
@@ -484,44 +702,151 @@ int main(int argc, char* argv[])
     argstr += format("[version {}]", project::version::full_version);
     logger->critical(argstr);
 
-    g_mw = new Magewell;
-    if (!g_mw)
-        return -1;
-    g_mw->Verbose(verbose_level);
+    if (!trace_path.empty())
+        Trace::Enable();
+
+    std::unique_ptr<Metrics::Server> metrics;
+    if (!metrics_addr.empty())
+    {
+        metrics = std::make_unique<Metrics::Server>(metrics_addr,
+                                                    verbose_level);
+        if (!*metrics)
+            return -1;
+    }
+
+    if (realtime)
+        CpuPlan::RealtimeCapture();
 
     if (list_inputs)
-        g_mw->ListInputs();
+    {
+        Magewell mw(0);
+        mw.Verbose(verbose_level);
+        mw.ListInputs();
+    }
 
-    if (devIndex < 1)
+    if (inputs.empty())
         return 0;
 
-    if (!g_mw->OpenChannel(devIndex - 1, boardId))
-        return -1;
+    std::unique_ptr<MptsMux> mpts_mux;
+    if (mpts && do_capture)
+    {
+        mpts_mux = std::make_unique<MptsMux>(output_path, verbose_level);
+        if (!*mpts_mux)
+            return -1;
+    }
 
-    if (!edid_file.empty())
+    /*
+      The copy and mux threads are shared by the inputs: each input
+      adds its own lanes. A low-latency upload waits on the card as the
+      lines arrive, holding its thread, so then every lane gets one.
+    */
+    std::unique_ptr<LanePool> copy_pool;
+    std::unique_ptr<LanePool> mux_pool;
+    if (do_capture)
     {
-        if (read_edid)
-        {
-            if (!g_mw->ReadEDID(edid_file))
-                return -1;
+        int lanes = max(video_args.num_threads, 1);
+        int total = static_cast<int>(inputs.size());
+        if (copy_pool_threads < 1)
+            copy_pool_threads = low_latency ? lanes * total
+                                            : max(lanes, total);
+        copy_pool = std::make_unique<LanePool>("vdcpy", CpuPlan::COPY,
+                                               copy_pool_threads,
+                                               VideoStream::COPY_RETRY,
+                                               verbose_level);
+        video_args.copy_pool = copy_pool.get();
+
+        if (!mpts_mux)
+        {
+            if (mux_pool_threads < 1)
+                mux_pool_threads = (total + 1) / 2;
+            mux_pool = std::make_unique<LanePool>("mux", CpuPlan::MUX,
+                                                  mux_pool_threads,
+                                                  OutputTS::MUX_RETRY,
+                                                  verbose_level);
         }
-        else if (write_edid)
+    }
+
+    // One Magewell per input. They share the SDK instance, the logger,
+    // the metrics, the hardware device contexts and the thread pools.
+    g_inputs.reserve(inputs.size());
+    for (int input : inputs)
+    {
+        auto mw = std::make_unique<Magewell>(input);
+        if (!*mw)
+            return -1;
+        mw->Verbose(verbose_level);
+        mw->LowLatency(low_latency);
+        if (mpts_mux)
+            mw->Program(mpts_mux.get(), input);
+        else
+            mw->Output(per_input(output_path, input), mux_pool.get());
+        if (!record_path.empty())
+            mw->RecordRaw(per_input(record_path, input));
+
+        if (!mw->OpenChannel(input - 1, boardId))
+            return -1;
+
+        if (!edid_file.empty())
         {
-            if (!g_mw->WriteEDID(edid_file))
-                return -1;
+            if (read_edid)
+            {
+                if (!mw->ReadEDID(per_input(edid_file, input)))
+                    return -1;
+            }
+            else if (write_edid)
+            {
+                if (!mw->WriteEDID(per_input(edid_file, input)))
+                    return -1;
+            }
         }
+
+        g_inputs.push_back(std::move(mw));
     }
 
     if (do_capture)
     {
-        if (!g_mw->Capture(std::move(video_args), no_audio,
-                           settle_time, video_buffers, realtime))
+        std::atomic<bool> failed {false};
+        auto capture = [&](Magewell& mw, int input)
+        {
+            VideoStream::Args args(video_args);
+            args.latency_file = per_input(video_args.latency_file, input);
+            if (!mw.Capture(std::move(args),
+                            AudioStream::Args(audio_args),
+                            no_audio, settle_time, video_buffers))
+            {
+                // Don't leave the other inputs running on their own.
+                failed = true;
+                Shutdown();
+            }
+        };
+
+        // The first input captures on this thread, the others on their own.
+        vector<thread> threads;
+        for (size_t idx = 1; idx < g_inputs.size(); ++idx)
+            threads.emplace_back(capture, std::ref(*g_inputs[idx]),
+                                 inputs[idx]);
+        capture(*g_inputs[0], inputs[0]);
+        for (auto& thd : threads)
+            thd.join();
+
+        if (failed)
+        {
+            if (!trace_path.empty())
+                Trace::Write(trace_path);
             return -2;
+        }
     }
 
     std::fflush(stdout);
 
-    delete g_mw;
+    g_inputs.clear();
+    mux_pool.reset();
+    copy_pool.reset();
+    mpts_mux.reset();
+    VideoStream::ReleaseDevices();
+    if (!trace_path.empty())
+        Trace::Write(trace_path);
+    metrics.reset();
     spdlog::shutdown();
     return ret;
 }
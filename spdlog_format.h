@@ -24,6 +24,8 @@
 #include <string>
 #include <cstring>
 
+#include "AsyncLog.h"
+
 class linux_thread_name_flag : public spdlog::custom_flag_formatter
 {
   private:
@@ -51,9 +53,16 @@ class linux_thread_name_flag : public spdlog::custom_flag_formatter
         std::array<char, 16> name_buffer{};
         std::string raw_name = "unnamed";
 
+        // With --async-log this runs on the writer thread; use the name
+        // of the thread which logged the message instead.
+        if (const char* name = AsyncSink::ThreadName())
+        {
+            if (name[0] != '\0')
+                raw_name = name;
+        }
         // Pull the native OS thread name
-        if (pthread_getname_np(pthread_self(), name_buffer.data(),
-                               name_buffer.size()) == 0 && name_buffer[0] != '\0')
+        else if (pthread_getname_np(pthread_self(), name_buffer.data(),
+                                    name_buffer.size()) == 0 && name_buffer[0] != '\0')
         {
             raw_name = name_buffer.data();
         }
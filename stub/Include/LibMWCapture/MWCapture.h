@@ -0,0 +1,531 @@
+#pragma once
+
+/*
+  Stub of the Magewell LibMWCapture API.
+
+  Declares the subset of the SDK used by magewell2ts, with the same
+  names and signatures. The implementation in stub/MWCaptureStub.cpp
+  simulates a capture card, so magewell2ts can be built and run on a
+  machine without the SDK or a card. See stub/MWCaptureStub.cpp for
+  how the simulated input is configured.
+*/
+
+#include <WinTypes.h>
+
+typedef uint64_t    MWCAP_PTR;
+typedef uint64_t    MWCAP_PTR64;
+typedef void*       HCHANNEL;
+typedef MWCAP_PTR   HNOTIFY;
+
+typedef enum _MW_RESULT
+{
+    MW_SUCCEEDED        = 0x00,
+    MW_FAILED,
+    MW_ENODATA,
+    MW_INVALID_PARAMS
+} MW_RESULT;
+
+// ---------------------------------------------------------------------------
+// Channel information
+// ---------------------------------------------------------------------------
+
+typedef struct _MWCAP_CHANNEL_INFO
+{
+    WORD    wFamilyID;
+    WORD    wProductID;
+    char    chHardwareVersion;
+    BYTE    byFirmwareID;
+    DWORD   dwFirmwareVersion;
+    DWORD   dwDriverVersion;
+    char    szFamilyName[64];
+    char    szProductName[64];
+    char    szFirmwareName[64];
+    char    szBoardSerialNo[16];
+    BYTE    byBoardIndex;
+    BYTE    byChannelIndex;
+} MWCAP_CHANNEL_INFO;
+
+// ---------------------------------------------------------------------------
+// Input sources
+// ---------------------------------------------------------------------------
+
+typedef enum _MWCAP_VIDEO_INPUT_TYPE
+{
+    MWCAP_VIDEO_INPUT_TYPE_NONE         = 0x00,
+    MWCAP_VIDEO_INPUT_TYPE_HDMI         = 0x01,
+    MWCAP_VIDEO_INPUT_TYPE_VGA          = 0x02,
+    MWCAP_VIDEO_INPUT_TYPE_SDI          = 0x04,
+    MWCAP_VIDEO_INPUT_TYPE_COMPONENT    = 0x08,
+    MWCAP_VIDEO_INPUT_TYPE_CVBS         = 0x10,
+    MWCAP_VIDEO_INPUT_TYPE_YC           = 0x20
+} MWCAP_VIDEO_INPUT_TYPE;
+
+typedef enum _MWCAP_AUDIO_INPUT_TYPE
+{
+    MWCAP_AUDIO_INPUT_TYPE_NONE         = 0x00,
+    MWCAP_AUDIO_INPUT_TYPE_HDMI         = 0x01,
+    MWCAP_AUDIO_INPUT_TYPE_SDI          = 0x02,
+    MWCAP_AUDIO_INPUT_TYPE_LINE_IN      = 0x04,
+    MWCAP_AUDIO_INPUT_TYPE_MIC_IN       = 0x08
+} MWCAP_AUDIO_INPUT_TYPE;
+
+#define INPUT_SOURCE(type, index)   (((type) << 8) | ((index) & 0xFF))
+#define INPUT_TYPE(source)          (((source) >> 8) & 0xFF)
+#define INPUT_INDEX(source)         ((source) & 0xFF)
+
+// ---------------------------------------------------------------------------
+// Input specific status
+// ---------------------------------------------------------------------------
+
+typedef enum _SDI_TYPE
+{
+    SDI_TYPE_SD,
+    SDI_TYPE_HD,
+    SDI_TYPE_3GA,
+    SDI_TYPE_3GB_DL,
+    SDI_TYPE_3GB_DS,
+    SDI_TYPE_DL_CH1,
+    SDI_TYPE_DL_CH2,
+    SDI_TYPE_6G_MODE1,
+    SDI_TYPE_6G_MODE2
+} SDI_TYPE;
+
+typedef enum _SDI_SCANNING_FORMAT
+{
+    SDI_SCANING_INTERLACED          = 0,
+    SDI_SCANING_SEGMENTED_FRAME     = 1,
+    SDI_SCANING_PROGRESSIVE         = 3
+} SDI_SCANNING_FORMAT;
+
+typedef enum _SDI_BIT_DEPTH
+{
+    SDI_BIT_DEPTH_8BIT              = 0,
+    SDI_BIT_DEPTH_10BIT             = 1,
+    SDI_BIT_DEPTH_12BIT             = 2
+} SDI_BIT_DEPTH;
+
+typedef enum _SDI_SAMPLING_STRUCT
+{
+    SDI_SAMPLING_422_YCbCr          = 0x00,
+    SDI_SAMPLING_444_YCbCr          = 0x01,
+    SDI_SAMPLING_444_RGB            = 0x02,
+    SDI_SAMPLING_420_YCbCr          = 0x03,
+    SDI_SAMPLING_4224_YCbCrA        = 0x04,
+    SDI_SAMPLING_4444_YCbCrA        = 0x05,
+    SDI_SAMPLING_4444_RGBA          = 0x06,
+    SDI_SAMPLING_4224_YCbCrD        = 0x08,
+    SDI_SAMPLING_4444_YCbCrD        = 0x09,
+    SDI_SAMPLING_4444_RGBD          = 0x0A,
+    SDI_SAMPLING_444_XYZ            = 0x0E
+} SDI_SAMPLING_STRUCT;
+
+typedef enum _MWCAP_SD_VIDEO_STANDARD
+{
+    MWCAP_SD_VIDEO_NONE,
+    MWCAP_SD_VIDEO_NTSC_M,
+    MWCAP_SD_VIDEO_NTSC_433,
+    MWCAP_SD_VIDEO_PAL_M,
+    MWCAP_SD_VIDEO_PAL_60,
+    MWCAP_SD_VIDEO_PAL_COMBN,
+    MWCAP_SD_VIDEO_PAL_BGHID,
+    MWCAP_SD_VIDEO_SECAM,
+    MWCAP_SD_VIDEO_SECAM_60
+} MWCAP_SD_VIDEO_STANDARD;
+
+#define VIDEO_SYNC_ALL          0x07
+#define VIDEO_SYNC_HS_VS        0x01
+#define VIDEO_SYNC_CS           0x02
+#define VIDEO_SYNC_EMBEDDED     0x04
+
+typedef struct _MWCAP_VIDEO_SYNC_INFO
+{
+    BYTE    bySyncType;
+    BOOLEAN bHSPolarity;
+    BOOLEAN bVSPolarity;
+    BOOLEAN bInterlaced;
+    DWORD   dwFrameDuration;
+    WORD    wVSyncLineCount;
+    WORD    wFrameLineCount;
+} MWCAP_VIDEO_SYNC_INFO;
+
+typedef struct _HDMI_VIDEO_INPUT_STATUS
+{
+    BOOLEAN bHDMIMode;
+    BOOLEAN bHDCP;
+    BYTE    byBitDepth;
+} HDMI_VIDEO_INPUT_STATUS;
+
+typedef struct _SDI_VIDEO_INPUT_STATUS
+{
+    SDI_TYPE            sdiType;
+    SDI_SCANNING_FORMAT sdiScanningFormat;
+    SDI_BIT_DEPTH       sdiBitDepth;
+    SDI_SAMPLING_STRUCT sdiSamplingStruct;
+    BOOLEAN             bST352DataValid;
+    DWORD               dwST352Data;
+} SDI_VIDEO_INPUT_STATUS;
+
+typedef struct _VGA_COMPONENT_INPUT_STATUS
+{
+    BOOLEAN                 bScanning;
+    MWCAP_VIDEO_SYNC_INFO   syncInfo;
+} VGA_COMPONENT_INPUT_STATUS;
+
+typedef struct _CVBS_YC_INPUT_STATUS
+{
+    MWCAP_SD_VIDEO_STANDARD standard;
+    BOOLEAN                 b50Hz;
+} CVBS_YC_INPUT_STATUS;
+
+typedef struct _MWCAP_INPUT_SPECIFIC_STATUS
+{
+    BOOLEAN bValid;
+    DWORD   dwVideoInputType;
+    union
+    {
+        HDMI_VIDEO_INPUT_STATUS     hdmiStatus;
+        SDI_VIDEO_INPUT_STATUS      sdiStatus;
+        VGA_COMPONENT_INPUT_STATUS  vgaComponentStatus;
+        CVBS_YC_INPUT_STATUS        cvbsYcStatus;
+    };
+} MWCAP_INPUT_SPECIFIC_STATUS;
+
+// ---------------------------------------------------------------------------
+// Video signal
+// ---------------------------------------------------------------------------
+
+typedef enum _MWCAP_VIDEO_SIGNAL_STATE
+{
+    MWCAP_VIDEO_SIGNAL_NONE,
+    MWCAP_VIDEO_SIGNAL_UNSUPPORTED,
+    MWCAP_VIDEO_SIGNAL_LOCKING,
+    MWCAP_VIDEO_SIGNAL_LOCKED
+} MWCAP_VIDEO_SIGNAL_STATE;
+
+typedef enum _MWCAP_VIDEO_FRAME_TYPE
+{
+    MWCAP_VIDEO_FRAME_2D                = 0x00,
+    MWCAP_VIDEO_FRAME_3D_TOP_AND_BOTTOM_FULL,
+    MWCAP_VIDEO_FRAME_3D_TOP_AND_BOTTOM_HALF,
+    MWCAP_VIDEO_FRAME_3D_SIDE_BY_SIDE_FULL,
+    MWCAP_VIDEO_FRAME_3D_SIDE_BY_SIDE_HALF
+} MWCAP_VIDEO_FRAME_TYPE;
+
+typedef enum _MWCAP_VIDEO_COLOR_FORMAT
+{
+    MWCAP_VIDEO_COLOR_FORMAT_UNKNOWN,
+    MWCAP_VIDEO_COLOR_FORMAT_RGB,
+    MWCAP_VIDEO_COLOR_FORMAT_YUV601,
+    MWCAP_VIDEO_COLOR_FORMAT_YUV709,
+    MWCAP_VIDEO_COLOR_FORMAT_YUV2020,
+    MWCAP_VIDEO_COLOR_FORMAT_YUV2020C
+} MWCAP_VIDEO_COLOR_FORMAT;
+
+typedef enum _MWCAP_VIDEO_QUANTIZATION_RANGE
+{
+    MWCAP_VIDEO_QUANTIZATION_UNKNOWN,
+    MWCAP_VIDEO_QUANTIZATION_FULL,
+    MWCAP_VIDEO_QUANTIZATION_LIMITED
+} MWCAP_VIDEO_QUANTIZATION_RANGE;
+
+typedef enum _MWCAP_VIDEO_SATURATION_RANGE
+{
+    MWCAP_VIDEO_SATURATION_UNKNOWN,
+    MWCAP_VIDEO_SATURATION_FULL,
+    MWCAP_VIDEO_SATURATION_LIMITED,
+    MWCAP_VIDEO_SATURATION_EXTENDED_GAMUT
+} MWCAP_VIDEO_SATURATION_RANGE;
+
+typedef struct _MWCAP_VIDEO_SIGNAL_STATUS
+{
+    MWCAP_VIDEO_SIGNAL_STATE        state;
+    int                             x;
+    int                             y;
+    int                             cx;
+    int                             cy;
+    int                             cxTotal;
+    int                             cyTotal;
+    BOOLEAN                         bInterlaced;
+    DWORD                           dwFrameDuration;    // 100ns units
+    int                             nAspectX;
+    int                             nAspectY;
+    BOOLEAN                         bSegmentedFrame;
+    MWCAP_VIDEO_FRAME_TYPE          frameType;
+    MWCAP_VIDEO_COLOR_FORMAT        colorFormat;
+    MWCAP_VIDEO_QUANTIZATION_RANGE  quantRange;
+    MWCAP_VIDEO_SATURATION_RANGE    satRange;
+} MWCAP_VIDEO_SIGNAL_STATUS;
+
+// ---------------------------------------------------------------------------
+// Audio signal and capture
+// ---------------------------------------------------------------------------
+
+#define MWCAP_AUDIO_SAMPLES_PER_FRAME   192
+#define MWCAP_AUDIO_MAX_NUM_CHANNELS    8
+
+typedef struct _MWCAP_AUDIO_SIGNAL_STATUS
+{
+    WORD    wChannelValid;
+    BOOLEAN bLPCM;
+    BYTE    cBitsPerSample;
+    DWORD   dwSampleRate;
+    BOOLEAN bChannelStatusValid;
+} MWCAP_AUDIO_SIGNAL_STATUS;
+
+typedef struct _MWCAP_AUDIO_CAPTURE_FRAME
+{
+    DWORD       cFrameCount;
+    DWORD       iFrame;
+    DWORD       dwSyncCode;
+    DWORD       dwReserved;
+    LONGLONG    llTimestamp;
+    DWORD       adwSamples[MWCAP_AUDIO_SAMPLES_PER_FRAME *
+                           MWCAP_AUDIO_MAX_NUM_CHANNELS];
+} MWCAP_AUDIO_CAPTURE_FRAME;
+
+// ---------------------------------------------------------------------------
+// Notifications
+// ---------------------------------------------------------------------------
+
+#define MWCAP_NOTIFY_INPUT_SPECIFIC_CHANGE          0x0010ULL
+#define MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE            0x0020ULL
+#define MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE            0x0040ULL
+#define MWCAP_NOTIFY_VIDEO_FIELD_BUFFERING          0x0080ULL
+#define MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING          0x0100ULL
+#define MWCAP_NOTIFY_VIDEO_FIELD_BUFFERED           0x0200ULL
+#define MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED           0x0400ULL
+#define MWCAP_NOTIFY_AUDIO_FRAME_BUFFERED           0x1000ULL
+#define MWCAP_NOTIFY_AUDIO_INPUT_RESET              0x2000ULL
+
+// ---------------------------------------------------------------------------
+// Pro video capture
+// ---------------------------------------------------------------------------
+
+typedef enum _MWCAP_VIDEO_FRAME_STATE
+{
+    MWCAP_VIDEO_FRAME_STATE_INITIAL,
+    MWCAP_VIDEO_FRAME_STATE_F0_BUFFERING,
+    MWCAP_VIDEO_FRAME_STATE_F1_BUFFERING,
+    MWCAP_VIDEO_FRAME_STATE_BUFFERED
+} MWCAP_VIDEO_FRAME_STATE;
+
+typedef struct _MWCAP_VIDEO_BUFFER_INFO
+{
+    DWORD   cMaxFrames;
+    BYTE    iNewestBuffering;
+    BYTE    iBufferingFieldIndex;
+    BYTE    iNewestBuffered;
+    BYTE    iBufferedFieldIndex;
+    BYTE    iNewestBufferedFullFrame;
+    DWORD   cBufferedFullFrames;
+} MWCAP_VIDEO_BUFFER_INFO;
+
+typedef struct _MWCAP_VIDEO_FRAME_INFO
+{
+    MWCAP_VIDEO_FRAME_STATE state;
+    BOOLEAN     bInterlaced;
+    BOOLEAN     bSegmentedFrame;
+    BOOLEAN     bTopFieldFirst;
+    BOOLEAN     bTopFieldInverted;
+    int         cx;
+    int         cy;
+    int         nAspectX;
+    int         nAspectY;
+    LONGLONG    allFieldStartTimes[2];
+    LONGLONG    allFieldBufferedTimes[2];
+} MWCAP_VIDEO_FRAME_INFO;
+
+typedef enum _MWCAP_VIDEO_DEINTERLACE_MODE
+{
+    MWCAP_VIDEO_DEINTERLACE_WEAVE,
+    MWCAP_VIDEO_DEINTERLACE_BLEND,
+    MWCAP_VIDEO_DEINTERLACE_TOP_FIELD,
+    MWCAP_VIDEO_DEINTERLACE_BOTTOM_FIELD
+} MWCAP_VIDEO_DEINTERLACE_MODE;
+
+typedef enum _MWCAP_VIDEO_ASPECT_RATIO_CONVERT_MODE
+{
+    MWCAP_VIDEO_ASPECT_RATIO_IGNORE,
+    MWCAP_VIDEO_ASPECT_RATIO_CROPPING,
+    MWCAP_VIDEO_ASPECT_RATIO_PADDING
+} MWCAP_VIDEO_ASPECT_RATIO_CONVERT_MODE;
+
+typedef MWCAP_PTR   HOSD;
+
+typedef struct _MWCAP_VIDEO_CAPTURE_STATUS
+{
+    MWCAP_PTR64 pvContext;
+    BOOLEAN     bPhysicalAddress;
+    MWCAP_PTR64 pvFrame;
+    int         iFrame;
+    BOOLEAN     bFrameCompleted;
+    WORD        cyCompleted;
+    WORD        cyCompletedPrev;
+} MWCAP_VIDEO_CAPTURE_STATUS;
+
+// ---------------------------------------------------------------------------
+// HDMI InfoFrames
+// ---------------------------------------------------------------------------
+
+typedef enum _MWCAP_HDMI_INFOFRAME_ID
+{
+    MWCAP_HDMI_INFOFRAME_ID_AVI         = 0,
+    MWCAP_HDMI_INFOFRAME_ID_AUDIO,
+    MWCAP_HDMI_INFOFRAME_ID_SPD,
+    MWCAP_HDMI_INFOFRAME_ID_MS,
+    MWCAP_HDMI_INFOFRAME_ID_VS,
+    MWCAP_HDMI_INFOFRAME_ID_ACP,
+    MWCAP_HDMI_INFOFRAME_ID_ISRC1,
+    MWCAP_HDMI_INFOFRAME_ID_ISRC2,
+    MWCAP_HDMI_INFOFRAME_ID_GAMUT,
+    MWCAP_HDMI_INFOFRAME_ID_VBI,
+    MWCAP_HDMI_INFOFRAME_ID_HDR,
+    MWCAP_HDMI_INFOFRAME_COUNT
+} MWCAP_HDMI_INFOFRAME_ID;
+
+#define MWCAP_HDMI_INFOFRAME_MASK_AVI   (1 << MWCAP_HDMI_INFOFRAME_ID_AVI)
+#define MWCAP_HDMI_INFOFRAME_MASK_HDR   (1 << MWCAP_HDMI_INFOFRAME_ID_HDR)
+
+typedef struct _HDMI_INFOFRAME_HEADER
+{
+    BYTE    byPacketType;
+    BYTE    byVersion;
+    BYTE    byLength : 5;
+    BYTE             : 3;
+} HDMI_INFOFRAME_HEADER;
+
+typedef struct _HDMI_HDR_INFOFRAME_PAYLOAD
+{
+    BYTE    byEOTF : 3;
+    BYTE           : 5;
+    BYTE    byMetadataDescriptorID : 3;
+    BYTE                           : 5;
+
+    BYTE    display_primaries_lsb_x0;
+    BYTE    display_primaries_msb_x0;
+    BYTE    display_primaries_lsb_y0;
+    BYTE    display_primaries_msb_y0;
+    BYTE    display_primaries_lsb_x1;
+    BYTE    display_primaries_msb_x1;
+    BYTE    display_primaries_lsb_y1;
+    BYTE    display_primaries_msb_y1;
+    BYTE    display_primaries_lsb_x2;
+    BYTE    display_primaries_msb_x2;
+    BYTE    display_primaries_lsb_y2;
+    BYTE    display_primaries_msb_y2;
+    BYTE    white_point_lsb_x;
+    BYTE    white_point_msb_x;
+    BYTE    white_point_lsb_y;
+    BYTE    white_point_msb_y;
+    BYTE    max_display_mastering_lsb_luminance;
+    BYTE    max_display_mastering_msb_luminance;
+    BYTE    min_display_mastering_lsb_luminance;
+    BYTE    min_display_mastering_msb_luminance;
+    BYTE    maximum_content_light_level_lsb;
+    BYTE    maximum_content_light_level_msb;
+    BYTE    maximum_frame_average_light_level_lsb;
+    BYTE    maximum_frame_average_light_level_msb;
+} HDMI_HDR_INFOFRAME_PAYLOAD;
+
+typedef struct _HDMI_INFOFRAME_PACKET
+{
+    HDMI_INFOFRAME_HEADER header;
+    union
+    {
+        HDMI_HDR_INFOFRAME_PAYLOAD  hdrInfoFramePayload;
+        BYTE                        abyPayload[27];
+    };
+} HDMI_INFOFRAME_PACKET;
+
+// ---------------------------------------------------------------------------
+// API
+// ---------------------------------------------------------------------------
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+BOOL      MWCaptureInitInstance(void);
+void      MWCaptureExitInstance(void);
+
+MW_RESULT MWRefreshDevice(void);
+int       MWGetChannelCount(void);
+MW_RESULT MWGetDevicePath(int nIndex, char* pDevicePath);
+
+HCHANNEL  MWOpenChannel(int nBoardValue, int nChannelIndex);
+HCHANNEL  MWOpenChannelByPath(const char* pszDevicePath);
+void      MWCloseChannel(HCHANNEL hChannel);
+
+MW_RESULT MWGetChannelInfo(HCHANNEL hChannel, MWCAP_CHANNEL_INFO* pChannelInfo);
+MW_RESULT MWGetTemperature(HCHANNEL hChannel, unsigned int* pnTemp);
+
+MW_RESULT MWGetVideoInputSource(HCHANNEL hChannel, DWORD* pdwSource);
+MW_RESULT MWGetAudioInputSource(HCHANNEL hChannel, DWORD* pdwSource);
+MW_RESULT MWGetAudioInputSourceArray(HCHANNEL hChannel, DWORD* pdwInputSource,
+                                     DWORD* pdwInputCount);
+
+MW_RESULT MWGetInputSpecificStatus(HCHANNEL hChannel,
+                                   MWCAP_INPUT_SPECIFIC_STATUS* pInputStatus);
+MW_RESULT MWGetVideoSignalStatus(HCHANNEL hChannel,
+                                 MWCAP_VIDEO_SIGNAL_STATUS* pSignalStatus);
+MW_RESULT MWGetAudioSignalStatus(HCHANNEL hChannel,
+                                 MWCAP_AUDIO_SIGNAL_STATUS* pSignalStatus);
+
+MW_RESULT MWGetEDID(HCHANNEL hChannel, BYTE* pbyData, ULONG* pulSize);
+MW_RESULT MWSetEDID(HCHANNEL hChannel, BYTE* pbyData, ULONG ulSize);
+
+MW_RESULT MWGetHDMIInfoFrameValidFlag(HCHANNEL hChannel, DWORD* pdwValidFlag);
+MW_RESULT MWGetHDMIInfoFramePacket(HCHANNEL hChannel,
+                                   MWCAP_HDMI_INFOFRAME_ID id,
+                                   HDMI_INFOFRAME_PACKET* pPacket);
+
+MWCAP_PTR MWCreateEvent(void);
+MW_RESULT MWCloseEvent(MWCAP_PTR hEvent);
+int       MWWaitEvent(MWCAP_PTR hEvent, int nTimeout);
+
+HNOTIFY   MWRegisterNotify(HCHANNEL hChannel, MWCAP_PTR hEvent,
+                           DWORD dwEnableBits);
+MW_RESULT MWUnregisterNotify(HCHANNEL hChannel, HNOTIFY hNotify);
+MW_RESULT MWGetNotifyStatus(HCHANNEL hChannel, HNOTIFY hNotify,
+                            ULONGLONG* pullStatus);
+
+MW_RESULT MWStartAudioCapture(HCHANNEL hChannel);
+MW_RESULT MWStopAudioCapture(HCHANNEL hChannel);
+MW_RESULT MWCaptureAudioFrame(HCHANNEL hChannel,
+                              MWCAP_AUDIO_CAPTURE_FRAME* pAudioCaptureFrame);
+
+MW_RESULT MWStartVideoCapture(HCHANNEL hChannel, MWCAP_PTR hEvent);
+MW_RESULT MWStopVideoCapture(HCHANNEL hChannel);
+MW_RESULT MWGetVideoBufferInfo(HCHANNEL hChannel,
+                               MWCAP_VIDEO_BUFFER_INFO* pVideoBufferInfo);
+MW_RESULT MWGetVideoFrameInfo(HCHANNEL hChannel, BYTE i,
+                              MWCAP_VIDEO_FRAME_INFO* pVideoFrameInfo);
+MW_RESULT MWPinVideoBuffer(HCHANNEL hChannel, MWCAP_PTR pbFrame,
+                           DWORD cbFrame);
+MW_RESULT MWUnpinVideoBuffer(HCHANNEL hChannel, LPBYTE pbFrame);
+MW_RESULT MWCaptureVideoFrameToVirtualAddress(HCHANNEL hChannel, int iFrame,
+                                              MWCAP_PTR pbFrame, DWORD cbFrame,
+                                              DWORD cbStride,
+                                              BOOLEAN bBottomUp,
+                                              MWCAP_PTR64 pvContext,
+                                              DWORD dwFOURCC,
+                                              int cx, int cy);
+MW_RESULT MWCaptureVideoFrameToVirtualAddressEx
+    (HCHANNEL hChannel, int iFrame, MWCAP_PTR pbFrame, DWORD cbFrame,
+     DWORD cbStride, BOOLEAN bBottomUp, MWCAP_PTR64 pvContext,
+     DWORD dwFOURCC, int cx, int cy, DWORD dwProcessSwitchs,
+     int cyParitalNotify, HOSD hOSDImage, const RECT* pOSDRects,
+     int cOSDRects, SHORT sContrast, SHORT sBrightness, SHORT sSaturation,
+     SHORT sHue, MWCAP_VIDEO_DEINTERLACE_MODE deinterlaceMode,
+     MWCAP_VIDEO_ASPECT_RATIO_CONVERT_MODE aspectRatioConvertMode,
+     const RECT* pRectSrc, const RECT* pRectDest, int nAspectX,
+     int nAspectY, MWCAP_VIDEO_COLOR_FORMAT colorFormat,
+     MWCAP_VIDEO_QUANTIZATION_RANGE quantRange,
+     MWCAP_VIDEO_SATURATION_RANGE satRange);
+MW_RESULT MWGetVideoCaptureStatus(HCHANNEL hChannel,
+                                  MWCAP_VIDEO_CAPTURE_STATUS* pStatus);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+  Stub of the Magewell Eco capture API. See MWCapture.h.
+*/
+
+#include <LibMWCapture/MWCapture.h>
+
+typedef struct _MWCAP_VIDEO_ECO_CAPTURE_OPEN
+{
+    MWCAP_PTR64 hEvent;             // eventfd signaled per completed frame
+    DWORD       dwFOURCC;
+    WORD        cx;
+    WORD        cy;
+    LONGLONG    llFrameDuration;    // 100ns units, -1 for the input rate
+} MWCAP_VIDEO_ECO_CAPTURE_OPEN;
+
+typedef struct _MWCAP_VIDEO_ECO_CAPTURE_FRAME
+{
+    MWCAP_PTR64 pvFrame;
+    DWORD       cbFrame;
+    DWORD       cbStride;
+    BOOLEAN     bBottomUp;
+    MWCAP_VIDEO_DEINTERLACE_MODE deinterlaceMode;
+    MWCAP_PTR64 pvContext;
+} MWCAP_VIDEO_ECO_CAPTURE_FRAME;
+
+typedef struct _MWCAP_VIDEO_ECO_CAPTURE_STATUS
+{
+    MWCAP_PTR64 pvContext;
+    MWCAP_PTR64 pvFrame;
+    LONGLONG    llTimestamp;
+} MWCAP_VIDEO_ECO_CAPTURE_STATUS;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+MW_RESULT MWStartVideoEcoCapture(HCHANNEL hChannel,
+                                 MWCAP_VIDEO_ECO_CAPTURE_OPEN* pEcoCaptureOpen);
+MW_RESULT MWCaptureSetVideoEcoFrame(HCHANNEL hChannel,
+                                    MWCAP_VIDEO_ECO_CAPTURE_FRAME* pFrame);
+MW_RESULT MWGetVideoEcoCaptureStatus(HCHANNEL hChannel,
+                                     MWCAP_VIDEO_ECO_CAPTURE_STATUS* pStatus);
+MW_RESULT MWStopVideoEcoCapture(HCHANNEL hChannel);
+
+#ifdef __cplusplus
+}
+#endif
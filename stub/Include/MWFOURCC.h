@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+  FOURCC helpers from the Magewell SDK, limited to the formats
+  magewell2ts captures.
+*/
+
+#include <WinTypes.h>
+
+#define MWFOURCC(ch0, ch1, ch2, ch3)                                    \
+    ((DWORD)(BYTE)(ch0) | ((DWORD)(BYTE)(ch1) << 8) |                   \
+     ((DWORD)(BYTE)(ch2) << 16) | ((DWORD)(BYTE)(ch3) << 24))
+
+#define MWFOURCC_UNK    MWFOURCC('U', 'N', 'K', 'N')
+#define MWFOURCC_NV12   MWFOURCC('N', 'V', '1', '2')
+#define MWFOURCC_P010   MWFOURCC('P', '0', '1', '0')
+
+inline int FOURCC_GetBpp(DWORD dwFOURCC)
+{
+    switch (dwFOURCC)
+    {
+        case MWFOURCC_NV12:
+          return 12;
+        case MWFOURCC_P010:
+          return 24;
+        default:
+          return 0;
+    }
+}
+
+inline DWORD FOURCC_CalcMinStride(DWORD dwFOURCC, int cx, DWORD dwAlign)
+{
+    DWORD cbLine;
+
+    switch (dwFOURCC)
+    {
+        case MWFOURCC_NV12:
+          cbLine = cx;
+          break;
+        case MWFOURCC_P010:
+          cbLine = cx * 2;
+          break;
+        default:
+          return 0;
+    }
+
+    return (cbLine + dwAlign - 1) & ~(dwAlign - 1);
+}
+
+inline DWORD FOURCC_CalcImageSize(DWORD dwFOURCC, int /* cx */, int cy,
+                                  DWORD cbStride)
+{
+    switch (dwFOURCC)
+    {
+        case MWFOURCC_NV12:
+        case MWFOURCC_P010:
+          // Luma plane plus a half height, interleaved chroma plane.
+          return cbStride * cy * 3 / 2;
+        default:
+          return 0;
+    }
+}
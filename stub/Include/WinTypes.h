@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+  Windows style integer types used by the Magewell SDK headers. Only
+  what the stub LibMWCapture needs.
+*/
+
+#include <cstdint>
+
+typedef int                 BOOL;
+typedef unsigned char       BOOLEAN;
+typedef unsigned char       BYTE;
+typedef BYTE*               LPBYTE;
+typedef short               SHORT;
+typedef unsigned short      WORD;
+typedef unsigned int        DWORD;
+typedef unsigned int        ULONG;
+typedef int64_t             LONGLONG;
+typedef uint64_t            ULONGLONG;
+
+typedef struct tagRECT
+{
+    int left;
+    int top;
+    int right;
+    int bottom;
+} RECT;
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
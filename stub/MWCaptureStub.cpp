@@ -0,0 +1,1861 @@
+/*
+  Simulated Magewell capture card.
+
+  Implements the part of LibMWCapture used by magewell2ts, so the real
+  Magewell class can be exercised (throughput, latency, signal
+  handling) on a machine without the SDK or a card. Each open channel
+  runs a generator thread which "buffers" video frames and audio
+  frames at real-time cadence, timestamps them and raises the same
+  notifications the driver does.
+
+  The simulated input is configured with environment variables:
+
+    MWSTUB_CHANNELS    Number of channels                      [1]
+    MWSTUB_ECO         1 to present an "Eco Capture" card       [0]
+    MWSTUB_VIDEO       <width>x<height><p|i><rate>  [1920x1080p59.94]
+    MWSTUB_VIDEO_FILE  Raw NV12 or P010 frames to loop, instead of the
+                       moving color bars. The frame size must match
+                       what magewell2ts asks for.
+    MWSTUB_HDR         pq or hlg to signal BT.2020 with an HDR InfoFrame
+    MWSTUB_AUDIO       lpcm, bitstream or none                  [lpcm]
+    MWSTUB_AUDIO_CHANNELS  2, 4, 6 or 8 LPCM channels           [2]
+    MWSTUB_AUDIO_BITS  16 or 24 bits per LPCM sample            [16]
+    MWSTUB_AUDIO_RATE  Sample rate                              [48000]
+    MWSTUB_AUDIO_FILE  Raw capture frames to loop, as found in
+                       MWCAP_AUDIO_CAPTURE_FRAME::adwSamples (192 x 8
+                       32-bit words per frame). Required for bitstream.
+    MWSTUB_CLOCK_PPM   Card clock error relative to CLOCK_MONOTONIC [0]
+    MWSTUB_REPLAY      A magewell2ts --record-raw recording to loop
+                       instead of all of the above: the recorded
+                       frames, formats (including format changes) and
+                       card timestamp cadence are played back as
+                       captured.
+
+  Timestamps are CLOCK_MONOTONIC in 100ns units (scaled by
+  MWSTUB_CLOCK_PPM), like the card clock they stand in for.
+
+  Pro captures are "DMA"d in order by a thread of their own, and
+  complete asynchronously through the capture event. A capture of the
+  frame still being received (MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING) is
+  paced by its lines arriving over the frame period, with a capture
+  event every cyParitalNotify lines.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <MWFOURCC.h>
+#include <LibMWCapture/MWCapture.h>
+#include <LibMWCapture/MWEcoCapture.h>
+
+#include "RawCapture.h"
+
+using namespace std;
+
+namespace
+{
+
+constexpr int kProFrames   = 4;    // Frame buffers "on the card"
+constexpr int kAudioFrames = 32;   // Audio capture ring
+constexpr int kAudioWords  = MWCAP_AUDIO_SAMPLES_PER_FRAME *
+                             MWCAP_AUDIO_MAX_NUM_CHANNELS;
+
+using clock_type = chrono::steady_clock;
+
+struct VideoMode
+{
+    int      cx              {1920};
+    int      cy              {1080};
+    bool     interlaced      {false};
+    DWORD    frame_duration  {166833};    // 100ns units
+    int      hdr_eotf        {0};         // 0 SDR, 2 PQ, 3 HLG
+};
+
+struct AudioMode
+{
+    bool     enabled         {true};
+    bool     lpcm            {true};
+    int      channels        {2};
+    int      bits            {16};
+    int      rate            {48000};
+};
+
+/**
+ * @brief A --record-raw recording, mapped for playback.
+ */
+struct Replay
+{
+    struct Format
+    {
+        VideoMode mode;
+        DWORD     fourcc  {0};
+        DWORD     stride  {0};
+    };
+
+    struct Frame
+    {
+        LONGLONG  timestamp;
+        uint64_t  offset;
+        uint32_t  size;
+        size_t    format;     // Index into video_formats/audio_formats
+    };
+
+    const uint8_t*    data    {nullptr};
+    size_t            size    {0};
+    vector<Format>    video_formats;
+    vector<AudioMode> audio_formats;
+    vector<Frame>     video;
+    vector<Frame>     audio;
+    LONGLONG          start   {0};    // Earliest timestamp
+    LONGLONG          length  {0};    // Loop period
+};
+
+/**
+ * @brief Simulated input, read once from the environment.
+ */
+struct Config
+{
+    int      channels        {1};
+    bool     eco             {false};
+
+    VideoMode video;
+    string   rate_name       {"59.94"};
+    AudioMode audio;
+
+    double   clock_ppm       {0};
+
+    const uint8_t* video_data       {nullptr};
+    size_t         video_data_size  {0};
+    vector<uint32_t> audio_data;          // Whole capture frames
+
+    Replay   replay;
+
+    static const Config& Get(void);
+
+  private:
+    Config(void);
+    void parse_video(const char* spec);
+    void load_video_file(const char* path);
+    void load_audio_file(const char* path);
+    void load_replay(const char* path);
+};
+
+int env_int(const char* name, int def)
+{
+    const char* val = getenv(name);
+    if (val == nullptr || *val == '\0')
+        return def;
+    return atoi(val);
+}
+
+Config::Config(void)
+{
+    channels = max(1, env_int("MWSTUB_CHANNELS", channels));
+    eco      = env_int("MWSTUB_ECO", 0) != 0;
+
+    const char* val;
+    if ((val = getenv("MWSTUB_VIDEO")) != nullptr)
+        parse_video(val);
+
+    if ((val = getenv("MWSTUB_HDR")) != nullptr)
+    {
+        if (strcmp(val, "pq") == 0)
+            video.hdr_eotf = 2;
+        else if (strcmp(val, "hlg") == 0)
+            video.hdr_eotf = 3;
+        else
+            fprintf(stderr, "MWCapture stub: Unknown MWSTUB_HDR '%s'\n", val);
+    }
+
+    if ((val = getenv("MWSTUB_AUDIO")) != nullptr)
+    {
+        if (strcmp(val, "none") == 0)
+            audio.enabled = false;
+        else if (strcmp(val, "bitstream") == 0)
+            audio.lpcm = false;
+        else if (strcmp(val, "lpcm") != 0)
+            fprintf(stderr, "MWCapture stub: Unknown MWSTUB_AUDIO '%s'\n",
+                    val);
+    }
+
+    audio.channels = env_int("MWSTUB_AUDIO_CHANNELS", audio.channels);
+    if (audio.channels < 2 || audio.channels > 8 || audio.channels % 2)
+    {
+        fprintf(stderr, "MWCapture stub: Invalid MWSTUB_AUDIO_CHANNELS\n");
+        audio.channels = 2;
+    }
+    audio.bits = env_int("MWSTUB_AUDIO_BITS", audio.bits) > 16 ? 24 : 16;
+    audio.rate = env_int("MWSTUB_AUDIO_RATE", audio.rate);
+    if (audio.rate <= 0)
+        audio.rate = 48000;
+
+    if ((val = getenv("MWSTUB_CLOCK_PPM")) != nullptr)
+        clock_ppm = atof(val);
+
+    if ((val = getenv("MWSTUB_VIDEO_FILE")) != nullptr)
+        load_video_file(val);
+    if ((val = getenv("MWSTUB_AUDIO_FILE")) != nullptr)
+        load_audio_file(val);
+
+    if ((val = getenv("MWSTUB_REPLAY")) != nullptr)
+        load_replay(val);
+
+    if (!audio.lpcm && replay.audio.empty())
+    {
+        // IEC 61937 is carried as 16-bit stereo.
+        audio.channels = 2;
+        audio.bits = 16;
+        if (audio_data.empty())
+        {
+            fprintf(stderr, "MWCapture stub: MWSTUB_AUDIO=bitstream needs "
+                    "MWSTUB_AUDIO_FILE; using LPCM.\n");
+            audio.lpcm = true;
+        }
+    }
+
+    fprintf(stderr, "MWCapture stub: %d %s channel(s), %dx%d%c%s%s, "
+            "audio %s\n", channels, eco ? "Eco" : "Pro", video.cx, video.cy,
+            video.interlaced ? 'i' : 'p', rate_name.c_str(),
+            video.hdr_eotf == 2 ? " PQ" : video.hdr_eotf == 3 ? " HLG" : "",
+            !audio.enabled ? "none" : !replay.audio.empty() ? "replay" :
+            !audio.lpcm ? "bitstream" :
+            audio_data.empty() ? "tone" : "file");
+}
+
+const Config& Config::Get(void)
+{
+    static const Config config;
+    return config;
+}
+
+void Config::parse_video(const char* spec)
+{
+    int    width  = 0;
+    int    height = 0;
+    char   scan   = 0;
+    double rate   = 0;
+
+    if (sscanf(spec, "%dx%d%c%lf", &width, &height, &scan, &rate) != 4 ||
+        (scan != 'p' && scan != 'i') || width < 16 || height < 16 ||
+        rate <= 0)
+    {
+        fprintf(stderr, "MWCapture stub: Invalid MWSTUB_VIDEO '%s'\n", spec);
+        return;
+    }
+
+    video.cx = width & ~1;
+    video.cy = height & ~1;
+    video.interlaced = (scan == 'i');
+
+    const char* rate_str = strpbrk(spec, "pi") + 1;
+    rate_name = rate_str;
+
+    // Interlaced rates are given in fields per second.
+    double frame_rate = video.interlaced ? rate / 2 : rate;
+
+    // Snap NTSC style rates to exactly N/1.001
+    double ntsc = round(frame_rate * 1.001);
+    if (fabs(ntsc / 1.001 - frame_rate) < 0.005)
+        video.frame_duration = static_cast<DWORD>(10000000.0 * 1.001 / ntsc);
+    else
+        video.frame_duration = static_cast<DWORD>
+                               (round(10000000.0 / frame_rate));
+}
+
+void Config::load_video_file(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "MWCapture stub: Unable to open '%s': %s\n",
+                path, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            video_data = static_cast<const uint8_t*>(data);
+            video_data_size = st.st_size;
+        }
+    }
+    close(fd);
+
+    if (video_data == nullptr)
+        fprintf(stderr, "MWCapture stub: Unable to map '%s'\n", path);
+}
+
+void Config::load_audio_file(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "MWCapture stub: Unable to open '%s': %s\n",
+                path, strerror(errno));
+        return;
+    }
+
+    vector<uint32_t> frame(kAudioWords);
+    while (fread(frame.data(), sizeof(uint32_t), kAudioWords, file) ==
+           static_cast<size_t>(kAudioWords))
+        audio_data.insert(audio_data.end(), frame.begin(), frame.end());
+    fclose(file);
+
+    if (audio_data.empty())
+        fprintf(stderr, "MWCapture stub: '%s' holds no complete "
+                "audio frames\n", path);
+}
+
+void Config::load_replay(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "MWCapture stub: Unable to open '%s': %s\n",
+                path, strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            replay.data = static_cast<const uint8_t*>(data);
+            replay.size = st.st_size;
+        }
+    }
+    close(fd);
+
+    string idx_path = string(path) + ".idx";
+    FILE* file = fopen(idx_path.c_str(), "rb");
+    if (replay.data == nullptr || file == nullptr)
+    {
+        fprintf(stderr, "MWCapture stub: Unable to load recording '%s'\n",
+                path);
+        if (file)
+            fclose(file);
+        return;
+    }
+
+    RawCapture::Header header {};
+    vector<RawCapture::Entry> entries;
+    if (fread(&header, sizeof(header), 1, file) == 1 &&
+        memcmp(header.magic, RawCapture::MAGIC, sizeof(header.magic)) == 0 &&
+        header.version == RawCapture::VERSION &&
+        header.entry_size == sizeof(RawCapture::Entry))
+    {
+        RawCapture::Entry entry;
+        while (fread(&entry, sizeof(entry), 1, file) == 1)
+            entries.push_back(entry);
+    }
+    else
+        fprintf(stderr, "MWCapture stub: '%s' is not a raw recording "
+                "index\n", idx_path.c_str());
+    fclose(file);
+
+    // Written as each write completed; put back in capture order.
+    sort(entries.begin(), entries.end(),
+         [](const RawCapture::Entry& lhs, const RawCapture::Entry& rhs)
+         { return lhs.seq < rhs.seq; });
+
+    LONGLONG end = 0;
+    for (const auto& entry : entries)
+    {
+        // A recording cut short may index past the end of the data.
+        bool in_file = entry.offset + entry.size <= replay.size;
+
+        switch (entry.type)
+        {
+            case RawCapture::VIDEO_FORMAT:
+              replay.video_formats.push_back(Replay::Format {
+                      .mode   = VideoMode {
+                          .cx             = entry.video.cx,
+                          .cy             = entry.video.cy,
+                          .interlaced     = entry.video.interlaced != 0,
+                          .frame_duration = entry.video.frame_duration,
+                          .hdr_eotf       = entry.video.hdr_eotf
+                      },
+                      .fourcc = entry.video.fourcc,
+                      .stride = entry.video.stride
+                  });
+              break;
+            case RawCapture::AUDIO_FORMAT:
+              replay.audio_formats.push_back(AudioMode {
+                      .enabled  = entry.audio.channel_valid != 0,
+                      .lpcm     = entry.audio.lpcm != 0,
+                      .channels = 2 * __builtin_popcount
+                                  (entry.audio.channel_valid & 0xF),
+                      .bits     = entry.audio.bits_per_sample,
+                      .rate     = static_cast<int>(entry.audio.sample_rate)
+                  });
+              break;
+            case RawCapture::VIDEO_FRAME:
+              if (replay.video_formats.empty() || !in_file)
+                  break;
+              replay.video.push_back(Replay::Frame {
+                      entry.timestamp, entry.offset, entry.size,
+                      replay.video_formats.size() - 1
+                  });
+              end = max<LONGLONG>(end, entry.timestamp +
+                                  replay.video_formats.back().mode
+                                  .frame_duration);
+              break;
+            case RawCapture::AUDIO_FRAME:
+              if (replay.audio_formats.empty() || !in_file ||
+                  entry.size != sizeof(uint32_t) * kAudioWords)
+                  break;
+              replay.audio.push_back(Replay::Frame {
+                      entry.timestamp, entry.offset, entry.size,
+                      replay.audio_formats.size() - 1
+                  });
+              end = max<LONGLONG>(end, entry.timestamp + 10000000LL *
+                                  MWCAP_AUDIO_SAMPLES_PER_FRAME /
+                                  max(1, replay.audio_formats.back().rate));
+              break;
+        }
+    }
+
+    if (replay.video.empty() && replay.audio.empty())
+    {
+        fprintf(stderr, "MWCapture stub: '%s' holds no frames\n", path);
+        return;
+    }
+
+    replay.start = numeric_limits<LONGLONG>::max();
+    if (!replay.video.empty())
+    {
+        replay.start = replay.video.front().timestamp;
+        video = replay.video_formats[replay.video.front().format].mode;
+        char rate[32];
+        snprintf(rate, sizeof(rate), "%.3g", 1e7 / video.frame_duration);
+        rate_name = rate;
+    }
+    if (!replay.audio.empty())
+    {
+        replay.start = min(replay.start, replay.audio.front().timestamp);
+        audio = replay.audio_formats[replay.audio.front().format];
+    }
+    else
+        audio.enabled = false;
+    replay.length = max<LONGLONG>(1, end - replay.start);
+
+    fprintf(stderr, "MWCapture stub: Replaying '%s': %zu video frames, "
+            "%zu audio frames, %.1f seconds\n", path, replay.video.size(),
+            replay.audio.size(), replay.length / 1e7);
+}
+
+/**
+ * @brief Event object handed out by MWCreateEvent.
+ */
+class Event
+{
+  public:
+    void Set(void)
+    {
+        {
+            scoped_lock lock(m_mutex);
+            m_signaled = true;
+        }
+        m_cond.notify_all();
+    }
+
+    int Wait(int timeout_ms)
+    {
+        unique_lock<mutex> lock(m_mutex);
+        auto signaled = [this] { return m_signaled; };
+
+        if (timeout_ms < 0)
+            m_cond.wait(lock, signaled);
+        else if (!m_cond.wait_for(lock, chrono::milliseconds(timeout_ms),
+                                  signaled))
+            return 0;
+
+        m_signaled = false;
+        return 1;
+    }
+
+  private:
+    mutex              m_mutex;
+    condition_variable m_cond;
+    bool               m_signaled {false};
+};
+
+mutex                           g_event_mutex;
+map<MWCAP_PTR, shared_ptr<Event>> g_events;
+
+shared_ptr<Event> find_event(MWCAP_PTR handle)
+{
+    scoped_lock lock(g_event_mutex);
+    auto iter = g_events.find(handle);
+    return iter == g_events.end() ? nullptr : iter->second;
+}
+
+/**
+ * @brief Wake whoever waits on an event handle.
+ *
+ * Pro capture waits on handles from MWCreateEvent, Eco capture on an
+ * eventfd.
+ */
+void signal_event(MWCAP_PTR handle)
+{
+    if (auto event = find_event(handle))
+        event->Set();
+    else if (handle != 0)
+        eventfd_write(static_cast<int>(handle), 1);
+}
+
+struct Notify
+{
+    MWCAP_PTR event  {0};
+    ULONGLONG mask   {0};
+    ULONGLONG status {0};
+};
+
+mutex                      g_edid_mutex;
+map<int, vector<BYTE>>     g_edid;
+
+/**
+ * @brief One open channel of the simulated card.
+ */
+class Channel
+{
+  public:
+    explicit Channel(int index);
+    ~Channel(void);
+
+    int Index(void) const { return m_index; }
+
+    VideoMode Video(void) const;
+    AudioMode Audio(void) const;
+    void GetSignalStatus(MWCAP_VIDEO_SIGNAL_STATUS* status) const;
+
+    HNOTIFY   RegisterNotify(MWCAP_PTR event, DWORD mask);
+    MW_RESULT UnregisterNotify(HNOTIFY notify);
+    MW_RESULT GetNotifyStatus(HNOTIFY notify, ULONGLONG* status);
+
+    MW_RESULT StartAudio(bool start);
+    MW_RESULT CaptureAudioFrame(MWCAP_AUDIO_CAPTURE_FRAME* frame);
+
+    MW_RESULT StartVideo(bool start, MWCAP_PTR event);
+    MW_RESULT GetBufferInfo(MWCAP_VIDEO_BUFFER_INFO* info);
+    MW_RESULT GetFrameInfo(int idx, MWCAP_VIDEO_FRAME_INFO* info);
+    MW_RESULT CaptureFrame(int idx, uint8_t* dst, DWORD size, DWORD stride,
+                           MWCAP_PTR64 context, DWORD fourcc,
+                           int cx, int cy, int partial_rows);
+    MW_RESULT GetCaptureStatus(MWCAP_VIDEO_CAPTURE_STATUS* status);
+
+    MW_RESULT StartEco(const MWCAP_VIDEO_ECO_CAPTURE_OPEN* params);
+    MW_RESULT StopEco(void);
+    MW_RESULT SetEcoFrame(const MWCAP_VIDEO_ECO_CAPTURE_FRAME* frame);
+    MW_RESULT GetEcoStatus(MWCAP_VIDEO_ECO_CAPTURE_STATUS* status);
+
+  private:
+    struct EcoDone
+    {
+        MWCAP_VIDEO_ECO_CAPTURE_FRAME frame;
+        LONGLONG                      timestamp;
+    };
+
+    struct Dma
+    {
+        uint8_t*    dst;
+        DWORD       stride;
+        MWCAP_PTR64 context;
+        DWORD       fourcc;
+        int         idx;
+        int         cx;
+        int         cy;
+        int         partial_rows;     // 0: notify once, when complete
+        uint64_t    frame_num;
+        bool        buffering;        // Lines still arriving
+        clock_type::time_point start; // First line arrived
+        clock_type::duration   scan;  // Time to receive the frame
+    };
+
+    void run(void);
+    void dma(void);
+    LONGLONG card_time(clock_type::time_point when) const;
+    void video_tick(LONGLONG timestamp, uint64_t source);
+    void audio_tick(LONGLONG timestamp, uint64_t source);
+    void raise(ULONGLONG bits);
+    void render(uint8_t* dst, DWORD fourcc, DWORD stride, int cx, int cy,
+                uint64_t frame_num, int y_begin = 0, int y_end = -1);
+    void fill_audio(MWCAP_AUDIO_CAPTURE_FRAME& frame, uint64_t source);
+
+    const Config&  m_config;
+    const Replay&  m_replay;
+    int            m_index;
+
+    // Current input, changes during a replay.
+    VideoMode      m_video;
+    AudioMode      m_audio;
+    size_t         m_video_format   {0};
+    size_t         m_audio_format   {0};
+    atomic<bool>   m_replay_warned  {false};
+
+    mutable mutex  m_mutex;
+    condition_variable m_wake;
+    thread         m_thread;
+    bool           m_stop           {false};
+
+    clock_type::time_point m_start;
+    LONGLONG       m_start_ts       {0};
+
+    vector<unique_ptr<Notify>> m_notifies;
+
+    // Pro video
+    bool           m_pro_started    {false};
+    MWCAP_PTR      m_capture_event  {0};
+    uint64_t       m_frame_num      {0};
+    LONGLONG       m_slot_ts[kProFrames];
+    LONGLONG       m_slot_start[kProFrames];
+    uint64_t       m_slot_frame[kProFrames] {};
+    int            m_newest_slot    {0};
+    int            m_buffering_slot {-1};
+    clock_type::time_point m_buffering_since;
+    MWCAP_VIDEO_CAPTURE_STATUS m_capture_status {};
+    deque<Dma>     m_dma_queue;       // Front is being "DMA"d
+    condition_variable m_dma_wake;
+    condition_variable m_dma_done;
+    thread         m_dma_thread;
+
+    // Eco video
+    bool           m_eco_started    {false};
+    bool           m_eco_rendering  {false};
+    condition_variable m_eco_rendered;
+    MWCAP_VIDEO_ECO_CAPTURE_OPEN        m_eco_params {};
+    deque<MWCAP_VIDEO_ECO_CAPTURE_FRAME> m_eco_free;
+    deque<EcoDone> m_eco_done;
+
+    // Audio
+    bool           m_audio_started  {false};
+    vector<MWCAP_AUDIO_CAPTURE_FRAME> m_audio_ring;
+    uint64_t       m_audio_written  {0};
+    uint64_t       m_audio_read     {0};
+    uint64_t       m_audio_pos      {0};   // Samples or file frames
+
+    // Color bars, built once per format.
+    mutex          m_pattern_mutex;
+    vector<uint8_t> m_pattern;
+    DWORD          m_pattern_fourcc {0};
+    DWORD          m_pattern_stride {0};
+    int            m_pattern_cx     {0};
+    int            m_pattern_cy     {0};
+};
+
+Channel::Channel(int index)
+    : m_config(Config::Get())
+    , m_replay(m_config.replay)
+    , m_index(index)
+    , m_video(m_config.video)
+    , m_audio(m_config.audio)
+    , m_audio_ring(kAudioFrames)
+{
+    if (!m_replay.video.empty())
+        m_video_format = m_replay.video.front().format;
+    if (!m_replay.audio.empty())
+        m_audio_format = m_replay.audio.front().format;
+
+    fill(begin(m_slot_ts), end(m_slot_ts), -1);
+    fill(begin(m_slot_start), end(m_slot_start), -1);
+
+    m_start = clock_type::now();
+    m_start_ts = chrono::duration_cast<chrono::nanoseconds>
+                 (m_start.time_since_epoch()).count() / 100;
+
+    m_thread = thread(&Channel::run, this);
+    pthread_setname_np(m_thread.native_handle(), "mwstub");
+    m_dma_thread = thread(&Channel::dma, this);
+    pthread_setname_np(m_dma_thread.native_handle(), "mwstubdma");
+}
+
+Channel::~Channel(void)
+{
+    {
+        scoped_lock lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_dma_wake.notify_all();
+    m_thread.join();
+    m_dma_thread.join();
+}
+
+LONGLONG Channel::card_time(clock_type::time_point when) const
+{
+    double elapsed = chrono::duration_cast<chrono::nanoseconds>
+                     (when - m_start).count() / 100.0;
+    return m_start_ts + static_cast<LONGLONG>
+        (elapsed * (1.0 + m_config.clock_ppm / 1e6));
+}
+
+/**
+ * @brief Generator: buffer video and audio frames on schedule.
+ */
+void Channel::run(void)
+{
+    // Card time runs `clock_ppm` fast, so its frames arrive early.
+    double rate = 1.0 + m_config.clock_ppm / 1e6;
+    auto video_step = chrono::duration<double, nano>
+                      (m_config.video.frame_duration * 100.0 / rate);
+    auto audio_step = chrono::duration<double, nano>
+                      (1e9 * MWCAP_AUDIO_SAMPLES_PER_FRAME /
+                       m_config.audio.rate / rate);
+
+    // A replay keeps the recorded timestamps, shifted to now and looped.
+    auto replay_due = [this](const vector<Replay::Frame>& frames,
+                             uint64_t cnt, LONGLONG& timestamp)
+    {
+        LONGLONG elapsed = frames[cnt % frames.size()].timestamp -
+                           m_replay.start + m_replay.length *
+                           static_cast<LONGLONG>(cnt / frames.size());
+        timestamp = m_start_ts + elapsed;
+        return m_start + chrono::nanoseconds(elapsed * 100);
+    };
+
+    uint64_t video_cnt = 0;
+    uint64_t audio_cnt = 0;
+
+    unique_lock<mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        clock_type::time_point next_video;
+        clock_type::time_point next_audio;
+        LONGLONG video_ts;
+        LONGLONG audio_ts;
+
+        if (m_replay.video.empty())
+        {
+            next_video = m_start + chrono::duration_cast<clock_type::duration>
+                         (video_step * (video_cnt + 1));
+            video_ts = card_time(next_video);
+        }
+        else
+            next_video = replay_due(m_replay.video, video_cnt, video_ts);
+
+        if (m_replay.audio.empty())
+        {
+            next_audio = m_start + chrono::duration_cast<clock_type::duration>
+                         (audio_step * (audio_cnt + 1));
+            audio_ts = card_time(next_audio);
+        }
+        else
+            next_audio = replay_due(m_replay.audio, audio_cnt, audio_ts);
+
+        auto next = min(next_video, next_audio);
+
+        if (m_wake.wait_until(lock, next, [this] { return m_stop; }))
+            break;
+
+        auto now = clock_type::now();
+        if (now >= next_video)
+        {
+            uint64_t source = video_cnt++;
+            lock.unlock();
+            video_tick(video_ts, source);
+            lock.lock();
+        }
+        if (now >= next_audio)
+            audio_tick(audio_ts, audio_cnt++);
+    }
+}
+
+void Channel::raise(ULONGLONG bits)
+{
+    // Caller holds m_mutex
+    for (auto& notify : m_notifies)
+    {
+        if ((notify->mask & bits) == 0)
+            continue;
+        notify->status |= notify->mask & bits;
+        signal_event(notify->event);
+    }
+}
+
+void Channel::video_tick(LONGLONG timestamp, uint64_t source)
+{
+    MWCAP_VIDEO_ECO_CAPTURE_FRAME eco_frame;
+    MWCAP_VIDEO_ECO_CAPTURE_OPEN  eco_params;
+
+    {
+        scoped_lock lock(m_mutex);
+
+        if (!m_replay.video.empty())
+        {
+            size_t format = m_replay.video[source % m_replay.video.size()]
+                            .format;
+            if (format != m_video_format)
+            {
+                m_video_format = format;
+                m_video = m_replay.video_formats[format].mode;
+                raise(MWCAP_NOTIFY_VIDEO_SIGNAL_CHANGE);
+            }
+        }
+
+        uint64_t frame_num = ++m_frame_num;
+        m_newest_slot = frame_num % kProFrames;
+        m_slot_ts[m_newest_slot] = timestamp;
+        m_slot_start[m_newest_slot] = -1;
+        m_slot_frame[m_newest_slot] = source;
+
+        // The next frame starts arriving in the next slot.
+        m_buffering_slot = (frame_num + 1) % kProFrames;
+        m_buffering_since = clock_type::now();
+        m_slot_ts[m_buffering_slot] = -1;
+        m_slot_start[m_buffering_slot] = timestamp;
+        m_slot_frame[m_buffering_slot] = source + 1;
+
+        if (!m_eco_started)
+        {
+            raise(MWCAP_NOTIFY_VIDEO_FIELD_BUFFERED |
+                  MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED |
+                  MWCAP_NOTIFY_VIDEO_FRAME_BUFFERING);
+            return;
+        }
+
+        // Eco: no free frame means the frame is dropped, as on the card.
+        if (m_eco_free.empty())
+            return;
+        eco_frame  = m_eco_free.front();
+        eco_params = m_eco_params;
+        m_eco_free.pop_front();
+        m_eco_rendering = true;
+    }
+
+    // "DMA" the frame without holding up the capture thread.
+    render(reinterpret_cast<uint8_t*>(eco_frame.pvFrame),
+           eco_params.dwFOURCC, eco_frame.cbStride,
+           eco_params.cx, eco_params.cy, source);
+
+    scoped_lock lock(m_mutex);
+    m_eco_rendering = false;
+    m_eco_rendered.notify_all();
+    if (!m_eco_started)
+        return;
+    m_eco_done.push_back(EcoDone { eco_frame, timestamp });
+    raise(MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED);
+    signal_event(m_eco_params.hEvent);
+}
+
+void Channel::audio_tick(LONGLONG timestamp, uint64_t source)
+{
+    // Caller holds m_mutex
+    if (!m_replay.audio.empty())
+    {
+        size_t format = m_replay.audio[source % m_replay.audio.size()].format;
+        if (format != m_audio_format)
+        {
+            m_audio_format = format;
+            m_audio = m_replay.audio_formats[format];
+            raise(MWCAP_NOTIFY_AUDIO_SIGNAL_CHANGE);
+        }
+    }
+
+    if (!m_audio_started)
+        return;
+
+    auto& frame = m_audio_ring[m_audio_written % kAudioFrames];
+    frame.cFrameCount = kAudioFrames;
+    frame.iFrame      = m_audio_written % kAudioFrames;
+    frame.llTimestamp = timestamp;
+    fill_audio(frame, source);
+
+    ++m_audio_written;
+    raise(MWCAP_NOTIFY_AUDIO_FRAME_BUFFERED);
+}
+
+void Channel::fill_audio(MWCAP_AUDIO_CAPTURE_FRAME& frame, uint64_t source)
+{
+    if (!m_replay.audio.empty())
+    {
+        const auto& recorded = m_replay.audio[source % m_replay.audio.size()];
+        memcpy(frame.adwSamples, m_replay.data + recorded.offset,
+               sizeof(frame.adwSamples));
+        return;
+    }
+
+    if (!m_config.audio_data.empty())
+    {
+        size_t frames = m_config.audio_data.size() / kAudioWords;
+        memcpy(frame.adwSamples,
+               &m_config.audio_data[(m_audio_pos++ % frames) * kAudioWords],
+               sizeof(frame.adwSamples));
+        return;
+    }
+
+    /*
+      A different tone per channel, at -12 dBFS. Samples are high bit
+      aligned in 32 bits, ordered Left0..Left3, Right0..Right3.
+     */
+    const int pairs = MWCAP_AUDIO_MAX_NUM_CHANNELS / 2;
+    const uint32_t mask = m_audio.bits > 16 ? 0xFFFFFF00 : 0xFFFF0000;
+
+    memset(frame.adwSamples, 0, sizeof(frame.adwSamples));
+    for (int sample = 0; sample < MWCAP_AUDIO_SAMPLES_PER_FRAME; ++sample)
+    {
+        double t = static_cast<double>(m_audio_pos + sample) /
+                   m_audio.rate;
+        for (int ch = 0; ch < m_audio.channels; ++ch)
+        {
+            double value = 0.25 * sin(2 * M_PI * 250.0 * (ch + 1) * t);
+            int32_t pcm = static_cast<int32_t>(value * INT32_MAX);
+            int slot = (ch / 2) + (ch % 2 ? pairs : 0);
+            frame.adwSamples[sample * MWCAP_AUDIO_MAX_NUM_CHANNELS + slot] =
+                static_cast<uint32_t>(pcm) & mask;
+        }
+    }
+    m_audio_pos += MWCAP_AUDIO_SAMPLES_PER_FRAME;
+}
+
+/**
+ * @brief Copy lines [y_begin, y_end) of a 4:2:0 two plane frame.
+ */
+void copy_rows(uint8_t* dst, const uint8_t* src, DWORD stride, int cy,
+               int y_begin, int y_end)
+{
+    memcpy(dst + y_begin * stride, src + y_begin * stride,
+           (y_end - y_begin) * stride);
+
+    // A chroma line covers two luma lines.
+    size_t chroma = static_cast<size_t>(stride) * cy;
+    int    c_end  = y_end == cy ? (cy + 1) / 2 : y_end / 2;
+    if (c_end > y_begin / 2)
+        memcpy(dst + chroma + (y_begin / 2) * stride,
+               src + chroma + (y_begin / 2) * stride,
+               (c_end - y_begin / 2) * stride);
+}
+
+/**
+ * @brief Render lines [y_begin, y_end) of a frame; all of it by default.
+ */
+void Channel::render(uint8_t* dst, DWORD fourcc, DWORD stride,
+                     int cx, int cy, uint64_t frame_num,
+                     int y_begin, int y_end)
+{
+    const DWORD size = FOURCC_CalcImageSize(fourcc, cx, cy, stride);
+
+    if (y_end < 0)
+        y_end = cy;
+
+    if (!m_replay.video.empty())
+    {
+        const auto& recorded = m_replay.video[frame_num % m_replay.video.size()];
+        const auto& format   = m_replay.video_formats[recorded.format];
+        if (format.fourcc == fourcc && format.stride == stride &&
+            recorded.size == size)
+        {
+            copy_rows(dst, m_replay.data + recorded.offset, stride, cy,
+                      y_begin, y_end);
+            return;
+        }
+        if (!m_replay_warned.exchange(true))
+            fprintf(stderr, "MWCapture stub: The recording is %.4s, %u "
+                    "bytes per line, but %.4s, %u bytes per line was asked "
+                    "for; showing color bars instead. Replay with the same "
+                    "options it was recorded with.\n",
+                    reinterpret_cast<const char*>(&format.fourcc),
+                    format.stride, reinterpret_cast<const char*>(&fourcc),
+                    stride);
+    }
+
+    if (m_config.video_data && m_config.video_data_size >= size &&
+        size > 0)
+    {
+        size_t frames = m_config.video_data_size / size;
+        copy_rows(dst, m_config.video_data + (frame_num % frames) * size,
+                  stride, cy, y_begin, y_end);
+        return;
+    }
+
+    const bool wide = (fourcc == MWFOURCC_P010);
+
+    scoped_lock lock(m_pattern_mutex);
+    if (m_pattern_fourcc != fourcc || m_pattern_stride != stride ||
+        m_pattern_cx != cx || m_pattern_cy != cy)
+    {
+        // 75% color bars, BT.709 limited range: Y, Cb, Cr
+        static const uint8_t bars[8][3] = {
+            { 180, 128, 128 }, { 168,  44, 136 }, { 145, 147,  44 },
+            { 133,  63,  52 }, {  63, 193, 204 }, {  51, 109, 212 },
+            {  28, 212, 120 }, {  16, 128, 128 }
+        };
+
+        m_pattern.assign(size, 0);
+        uint8_t* luma   = m_pattern.data();
+        uint8_t* chroma = luma + stride * cy;
+
+        auto put = [wide](uint8_t* row, int idx, uint8_t value)
+        {
+            if (wide)
+            {
+                uint16_t word = value << 8;   // 10 bits, MSB aligned
+                memcpy(row + idx * 2, &word, 2);
+            }
+            else
+                row[idx] = value;
+        };
+
+        for (int x = 0; x < cx; ++x)
+            put(luma, x, bars[x * 8 / cx][0]);
+        for (int x = 0; x < cx; x += 2)
+        {
+            put(chroma, x,     bars[x * 8 / cx][1]);
+            put(chroma, x + 1, bars[x * 8 / cx][2]);
+        }
+        for (int y = 1; y < cy; ++y)
+            memcpy(luma + y * stride, luma, stride);
+        for (int y = 1; y < cy / 2; ++y)
+            memcpy(chroma + y * stride, chroma, stride);
+
+        m_pattern_fourcc = fourcc;
+        m_pattern_stride = stride;
+        m_pattern_cx = cx;
+        m_pattern_cy = cy;
+    }
+
+    copy_rows(dst, m_pattern.data(), stride, cy, y_begin, y_end);
+
+    // A white box moving across the frame, so the encoder has work.
+    const int box = min(cy / 8, cx / 8) & ~1;
+    const int bpp = wide ? 2 : 1;
+    const int x0  = static_cast<int>((frame_num * 8) % (cx - box)) & ~1;
+    const int y0  = (cy / 2 - box / 2) & ~1;
+    uint8_t*  chroma = dst + stride * cy;
+
+    for (int y = max(y0, y_begin); y < min(y0 + box, y_end); ++y)
+    {
+        uint8_t* row = dst + y * stride + x0 * bpp;
+        if (wide)
+        {
+            for (int x = 0; x < box; ++x)
+            {
+                uint16_t word = 235 << 8;
+                memcpy(row + x * 2, &word, 2);
+            }
+        }
+        else
+            memset(row, 235, box);
+
+        if (y % 2 == 0)
+        {
+            uint8_t* crow = chroma + (y / 2) * stride + x0 * bpp;
+            if (wide)
+            {
+                for (int x = 0; x < box; ++x)
+                {
+                    uint16_t word = 128 << 8;
+                    memcpy(crow + x * 2, &word, 2);
+                }
+            }
+            else
+                memset(crow, 128, box);
+        }
+    }
+}
+
+VideoMode Channel::Video(void) const
+{
+    scoped_lock lock(m_mutex);
+    return m_video;
+}
+
+AudioMode Channel::Audio(void) const
+{
+    scoped_lock lock(m_mutex);
+    return m_audio;
+}
+
+void Channel::GetSignalStatus(MWCAP_VIDEO_SIGNAL_STATUS* status) const
+{
+    const VideoMode video = Video();
+    int aspect = gcd(video.cx, video.cy);
+
+    *status = MWCAP_VIDEO_SIGNAL_STATUS {
+        .state           = MWCAP_VIDEO_SIGNAL_LOCKED,
+        .x               = 0,
+        .y               = 0,
+        .cx              = video.cx,
+        .cy              = video.cy,
+        .cxTotal         = video.cx + video.cx / 7,
+        .cyTotal         = video.cy + video.cy / 24,
+        .bInterlaced     = video.interlaced,
+        .dwFrameDuration = video.frame_duration,
+        .nAspectX        = video.cx / aspect,
+        .nAspectY        = video.cy / aspect,
+        .bSegmentedFrame = false,
+        .frameType       = MWCAP_VIDEO_FRAME_2D,
+        .colorFormat     = video.hdr_eotf
+                           ? MWCAP_VIDEO_COLOR_FORMAT_YUV2020
+                           : MWCAP_VIDEO_COLOR_FORMAT_YUV709,
+        .quantRange      = MWCAP_VIDEO_QUANTIZATION_LIMITED,
+        .satRange        = MWCAP_VIDEO_SATURATION_LIMITED
+    };
+}
+
+HNOTIFY Channel::RegisterNotify(MWCAP_PTR event, DWORD mask)
+{
+    scoped_lock lock(m_mutex);
+    auto& notify = m_notifies.emplace_back(make_unique<Notify>());
+    notify->event = event;
+    notify->mask  = mask;
+    return reinterpret_cast<HNOTIFY>(notify.get());
+}
+
+MW_RESULT Channel::UnregisterNotify(HNOTIFY handle)
+{
+    scoped_lock lock(m_mutex);
+    auto iter = find_if(m_notifies.begin(), m_notifies.end(),
+                        [handle](const unique_ptr<Notify>& notify)
+                        { return reinterpret_cast<HNOTIFY>(notify.get())
+                                 == handle; });
+    if (iter == m_notifies.end())
+        return MW_INVALID_PARAMS;
+    m_notifies.erase(iter);
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::GetNotifyStatus(HNOTIFY handle, ULONGLONG* status)
+{
+    scoped_lock lock(m_mutex);
+    for (auto& notify : m_notifies)
+    {
+        if (reinterpret_cast<HNOTIFY>(notify.get()) == handle)
+        {
+            *status = notify->status;
+            notify->status = 0;
+            return MW_SUCCEEDED;
+        }
+    }
+    return MW_INVALID_PARAMS;
+}
+
+MW_RESULT Channel::StartAudio(bool start)
+{
+    scoped_lock lock(m_mutex);
+    if (start && !m_config.audio.enabled)
+        return MW_FAILED;
+    m_audio_started = start;
+    m_audio_read = m_audio_written;
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::CaptureAudioFrame(MWCAP_AUDIO_CAPTURE_FRAME* frame)
+{
+    scoped_lock lock(m_mutex);
+    if (m_audio_read == m_audio_written)
+        return MW_ENODATA;
+
+    // Overrun: the oldest frames have been overwritten.
+    if (m_audio_written - m_audio_read > kAudioFrames)
+        m_audio_read = m_audio_written - kAudioFrames;
+
+    *frame = m_audio_ring[m_audio_read++ % kAudioFrames];
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::StartVideo(bool start, MWCAP_PTR event)
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_pro_started   = start;
+    m_capture_event = start ? event : 0;
+
+    // The caller may free the frames as soon as this returns.
+    if (!start)
+        m_dma_done.wait(lock, [this] { return m_dma_queue.empty(); });
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::GetBufferInfo(MWCAP_VIDEO_BUFFER_INFO* info)
+{
+    scoped_lock lock(m_mutex);
+    *info = MWCAP_VIDEO_BUFFER_INFO {
+        .cMaxFrames               = kProFrames,
+        .iNewestBuffering         = static_cast<BYTE>
+                                    ((m_newest_slot + 1) % kProFrames),
+        .iBufferingFieldIndex     = 0,
+        .iNewestBuffered          = static_cast<BYTE>(m_newest_slot),
+        .iBufferedFieldIndex      = 1,
+        .iNewestBufferedFullFrame = static_cast<BYTE>(m_newest_slot),
+        .cBufferedFullFrames      = static_cast<DWORD>
+                                    (min<uint64_t>(m_frame_num, kProFrames))
+    };
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::GetFrameInfo(int idx, MWCAP_VIDEO_FRAME_INFO* info)
+{
+    if (idx < 0 || idx >= kProFrames)
+        return MW_INVALID_PARAMS;
+
+    scoped_lock lock(m_mutex);
+    LONGLONG ts = m_slot_ts[idx];
+    LONGLONG field = m_video.frame_duration / 2;
+
+    if (ts < 0 && m_slot_start[idx] >= 0)
+    {
+        LONGLONG start = m_slot_start[idx];
+        *info = MWCAP_VIDEO_FRAME_INFO {
+            .state             = MWCAP_VIDEO_FRAME_STATE_F0_BUFFERING,
+            .bInterlaced       = m_video.interlaced,
+            .bSegmentedFrame   = false,
+            .bTopFieldFirst    = true,
+            .bTopFieldInverted = false,
+            .cx                = m_video.cx,
+            .cy                = m_video.cy,
+            .nAspectX          = 16,
+            .nAspectY          = 9,
+            .allFieldStartTimes    = { start, start + field },
+            .allFieldBufferedTimes = { -1, -1 }
+        };
+        return MW_SUCCEEDED;
+    }
+
+    *info = MWCAP_VIDEO_FRAME_INFO {
+        .state             = ts < 0 ? MWCAP_VIDEO_FRAME_STATE_INITIAL
+                                    : MWCAP_VIDEO_FRAME_STATE_BUFFERED,
+        .bInterlaced       = m_video.interlaced,
+        .bSegmentedFrame   = false,
+        .bTopFieldFirst    = true,
+        .bTopFieldInverted = false,
+        .cx                = m_video.cx,
+        .cy                = m_video.cy,
+        .nAspectX          = 16,
+        .nAspectY          = 9,
+        .allFieldStartTimes    = { ts < 0 ? -1 : ts - 2 * field,
+                                   ts < 0 ? -1 : ts - field },
+        .allFieldBufferedTimes = { ts, ts }
+    };
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::CaptureFrame(int idx, uint8_t* dst, DWORD size,
+                                DWORD stride, MWCAP_PTR64 context,
+                                DWORD fourcc, int cx, int cy,
+                                int partial_rows)
+{
+    if (idx < 0 || idx >= kProFrames || dst == nullptr ||
+        size < FOURCC_CalcImageSize(fourcc, cx, cy, stride) ||
+        stride < FOURCC_CalcMinStride(fourcc, cx, 1) || partial_rows < 0)
+        return MW_INVALID_PARAMS;
+
+    scoped_lock lock(m_mutex);
+    bool buffering = (idx == m_buffering_slot && m_slot_ts[idx] < 0);
+    if (!m_pro_started || (m_slot_ts[idx] < 0 && !buffering))
+        return MW_FAILED;
+
+    m_dma_queue.push_back(Dma {
+            .dst          = dst,
+            .stride       = stride,
+            .context      = context,
+            .fourcc       = fourcc,
+            .idx          = idx,
+            .cx           = cx,
+            .cy           = cy,
+            .partial_rows = partial_rows,
+            .frame_num    = m_slot_frame[idx],
+            .buffering    = buffering,
+            .start        = m_buffering_since,
+            .scan         = chrono::duration_cast<clock_type::duration>
+                            (chrono::nanoseconds(m_video.frame_duration * 100))
+        });
+    m_dma_wake.notify_one();
+    return MW_SUCCEEDED;
+}
+
+/**
+ * @brief DMA engine: complete the queued Pro captures in order.
+ */
+void Channel::dma(void)
+{
+    unique_lock<mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_dma_wake.wait(lock, [this] {
+            return m_stop || !m_dma_queue.empty();
+        });
+        if (m_stop)
+            break;
+
+        Dma job = m_dma_queue.front();
+        lock.unlock();
+
+        int step = job.partial_rows > 0 ? job.partial_rows : job.cy;
+        for (int y = 0; y < job.cy;)
+        {
+            int end = min(job.cy, y + step);
+
+            // A line can only be moved once it has arrived.
+            if (job.buffering)
+                this_thread::sleep_until(job.start + job.scan * end / job.cy);
+
+            render(job.dst, job.fourcc, job.stride, job.cx, job.cy,
+                   job.frame_num, y, end);
+
+            MWCAP_PTR event;
+            {
+                scoped_lock status_lock(m_mutex);
+                m_capture_status = MWCAP_VIDEO_CAPTURE_STATUS {
+                    .pvContext        = job.context,
+                    .bPhysicalAddress = false,
+                    .pvFrame          = reinterpret_cast<MWCAP_PTR64>(job.dst),
+                    .iFrame           = job.idx,
+                    .bFrameCompleted  = end == job.cy,
+                    .cyCompleted      = static_cast<WORD>(end),
+                    .cyCompletedPrev  = static_cast<WORD>(y)
+                };
+                event = m_capture_event;
+            }
+            signal_event(event);
+            y = end;
+        }
+
+        lock.lock();
+        m_dma_queue.pop_front();
+        m_dma_done.notify_all();
+    }
+}
+
+MW_RESULT Channel::GetCaptureStatus(MWCAP_VIDEO_CAPTURE_STATUS* status)
+{
+    scoped_lock lock(m_mutex);
+    *status = m_capture_status;
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::StartEco(const MWCAP_VIDEO_ECO_CAPTURE_OPEN* params)
+{
+    if (params == nullptr ||
+        FOURCC_CalcMinStride(params->dwFOURCC, params->cx, 1) == 0 ||
+        params->cx == 0 || params->cy == 0)
+        return MW_INVALID_PARAMS;
+
+    scoped_lock lock(m_mutex);
+    if (m_eco_started)
+        return MW_FAILED;
+
+    m_eco_params  = *params;
+    m_eco_started = true;
+    m_eco_free.clear();
+    m_eco_done.clear();
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::StopEco(void)
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_eco_started = false;
+
+    // The caller may free the frames as soon as this returns.
+    m_eco_rendered.wait(lock, [this] { return !m_eco_rendering; });
+    m_eco_free.clear();
+    m_eco_done.clear();
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::SetEcoFrame(const MWCAP_VIDEO_ECO_CAPTURE_FRAME* frame)
+{
+    if (frame == nullptr || frame->pvFrame == 0)
+        return MW_INVALID_PARAMS;
+
+    scoped_lock lock(m_mutex);
+    if (!m_eco_started)
+        return MW_SUCCEEDED;    // Dropped, like the driver does on stop
+
+    if (frame->cbFrame < FOURCC_CalcImageSize(m_eco_params.dwFOURCC,
+                                              m_eco_params.cx,
+                                              m_eco_params.cy,
+                                              frame->cbStride))
+        return MW_INVALID_PARAMS;
+
+    // A frame handed back twice is only queued once.
+    for (const auto& queued : m_eco_free)
+    {
+        if (queued.pvFrame == frame->pvFrame)
+            return MW_SUCCEEDED;
+    }
+
+    m_eco_free.push_back(*frame);
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT Channel::GetEcoStatus(MWCAP_VIDEO_ECO_CAPTURE_STATUS* status)
+{
+    scoped_lock lock(m_mutex);
+    if (m_eco_done.empty())
+    {
+        *status = MWCAP_VIDEO_ECO_CAPTURE_STATUS {};
+        return MW_SUCCEEDED;
+    }
+
+    const EcoDone& done = m_eco_done.front();
+    *status = MWCAP_VIDEO_ECO_CAPTURE_STATUS {
+        .pvContext   = done.frame.pvContext,
+        .pvFrame     = done.frame.pvFrame,
+        .llTimestamp = done.timestamp
+    };
+    m_eco_done.pop_front();
+
+    // The eventfd only counts wake ups; make sure the rest get seen.
+    if (!m_eco_done.empty())
+    {
+        raise(MWCAP_NOTIFY_VIDEO_FRAME_BUFFERED);
+        signal_event(m_eco_params.hEvent);
+    }
+
+    return MW_SUCCEEDED;
+}
+
+Channel* to_channel(HCHANNEL handle)
+{
+    return static_cast<Channel*>(handle);
+}
+
+vector<BYTE>& channel_edid(int index)
+{
+    // Caller holds g_edid_mutex
+    auto& edid = g_edid[index];
+    if (edid.empty())
+    {
+        edid.assign(256, 0);
+        static const BYTE header[8] = {
+            0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00
+        };
+        copy(begin(header), end(header), edid.begin());
+    }
+    return edid;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// API
+// ---------------------------------------------------------------------------
+
+#define CHANNEL_OR_FAIL(handle)                                         \
+    Channel* channel = to_channel(handle);                              \
+    if (channel == nullptr)                                             \
+        return MW_INVALID_PARAMS
+
+BOOL MWCaptureInitInstance(void)
+{
+    Config::Get();
+    return TRUE;
+}
+
+void MWCaptureExitInstance(void)
+{
+}
+
+MW_RESULT MWRefreshDevice(void)
+{
+    return MW_SUCCEEDED;
+}
+
+int MWGetChannelCount(void)
+{
+    return Config::Get().channels;
+}
+
+MW_RESULT MWGetDevicePath(int nIndex, char* pDevicePath)
+{
+    if (nIndex < 0 || nIndex >= MWGetChannelCount() || pDevicePath == nullptr)
+        return MW_INVALID_PARAMS;
+    snprintf(pDevicePath, 128, "/dev/mwstub/%d", nIndex);
+    return MW_SUCCEEDED;
+}
+
+HCHANNEL MWOpenChannel(int nBoardValue, int nChannelIndex)
+{
+    if (nBoardValue != 0 || nChannelIndex < 0 ||
+        nChannelIndex >= MWGetChannelCount())
+        return nullptr;
+    return new Channel(nChannelIndex);
+}
+
+HCHANNEL MWOpenChannelByPath(const char* pszDevicePath)
+{
+    int index = -1;
+    if (pszDevicePath == nullptr ||
+        sscanf(pszDevicePath, "/dev/mwstub/%d", &index) != 1)
+        return nullptr;
+    return MWOpenChannel(0, index);
+}
+
+void MWCloseChannel(HCHANNEL hChannel)
+{
+    delete to_channel(hChannel);
+}
+
+MW_RESULT MWGetChannelInfo(HCHANNEL hChannel, MWCAP_CHANNEL_INFO* pChannelInfo)
+{
+    CHANNEL_OR_FAIL(hChannel);
+
+    *pChannelInfo = MWCAP_CHANNEL_INFO {};
+    pChannelInfo->dwFirmwareVersion = 0x00010000;
+    pChannelInfo->dwDriverVersion   = 0x00010000;
+    pChannelInfo->byBoardIndex      = 0;
+    pChannelInfo->byChannelIndex    = static_cast<BYTE>(channel->Index());
+
+    bool eco = Config::Get().eco;
+    snprintf(pChannelInfo->szFamilyName, sizeof(pChannelInfo->szFamilyName),
+             "%s", eco ? "Eco Capture" : "Pro Capture");
+    snprintf(pChannelInfo->szProductName, sizeof(pChannelInfo->szProductName),
+             "%s", eco ? "Eco Capture HDMI (stub)" : "Pro Capture HDMI (stub)");
+    snprintf(pChannelInfo->szFirmwareName,
+             sizeof(pChannelInfo->szFirmwareName), "stub");
+    snprintf(pChannelInfo->szBoardSerialNo,
+             sizeof(pChannelInfo->szBoardSerialNo), "STUB-0000");
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetTemperature(HCHANNEL hChannel, unsigned int* pnTemp)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    *pnTemp = 450;
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetVideoInputSource(HCHANNEL hChannel, DWORD* pdwSource)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    *pdwSource = INPUT_SOURCE(MWCAP_VIDEO_INPUT_TYPE_HDMI, 0);
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetAudioInputSource(HCHANNEL hChannel, DWORD* pdwSource)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    *pdwSource = INPUT_SOURCE(MWCAP_AUDIO_INPUT_TYPE_HDMI, 0);
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetAudioInputSourceArray(HCHANNEL hChannel, DWORD* pdwInputSource,
+                                     DWORD* pdwInputCount)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    if (pdwInputCount == nullptr)
+        return MW_INVALID_PARAMS;
+
+    *pdwInputCount = Config::Get().audio.enabled ? 1 : 0;
+    if (pdwInputSource != nullptr && *pdwInputCount)
+        pdwInputSource[0] = INPUT_SOURCE(MWCAP_AUDIO_INPUT_TYPE_HDMI, 0);
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetInputSpecificStatus(HCHANNEL hChannel,
+                                   MWCAP_INPUT_SPECIFIC_STATUS* pInputStatus)
+{
+    CHANNEL_OR_FAIL(hChannel);
+
+    *pInputStatus = MWCAP_INPUT_SPECIFIC_STATUS {};
+    pInputStatus->bValid = TRUE;
+    pInputStatus->dwVideoInputType = MWCAP_VIDEO_INPUT_TYPE_HDMI;
+    pInputStatus->hdmiStatus.bHDMIMode  = TRUE;
+    pInputStatus->hdmiStatus.bHDCP      = FALSE;
+    pInputStatus->hdmiStatus.byBitDepth = channel->Video().hdr_eotf ? 10 : 8;
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetVideoSignalStatus(HCHANNEL hChannel,
+                                 MWCAP_VIDEO_SIGNAL_STATUS* pSignalStatus)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    channel->GetSignalStatus(pSignalStatus);
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetAudioSignalStatus(HCHANNEL hChannel,
+                                 MWCAP_AUDIO_SIGNAL_STATUS* pSignalStatus)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    const AudioMode audio = channel->Audio();
+
+    *pSignalStatus = MWCAP_AUDIO_SIGNAL_STATUS {
+        .wChannelValid  = static_cast<WORD>
+                          (audio.enabled
+                           ? (1 << (audio.channels / 2)) - 1 : 0),
+        .bLPCM          = audio.lpcm,
+        .cBitsPerSample = static_cast<BYTE>(audio.bits),
+        .dwSampleRate   = static_cast<DWORD>(audio.rate),
+        .bChannelStatusValid = audio.enabled
+    };
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetEDID(HCHANNEL hChannel, BYTE* pbyData, ULONG* pulSize)
+{
+    CHANNEL_OR_FAIL(hChannel);
+
+    scoped_lock lock(g_edid_mutex);
+    auto& edid = channel_edid(channel->Index());
+    ULONG size = min<ULONG>(*pulSize, edid.size());
+    memcpy(pbyData, edid.data(), size);
+    *pulSize = size;
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWSetEDID(HCHANNEL hChannel, BYTE* pbyData, ULONG ulSize)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    if (ulSize == 0 || ulSize % 128)
+        return MW_INVALID_PARAMS;
+
+    scoped_lock lock(g_edid_mutex);
+    g_edid[channel->Index()].assign(pbyData, pbyData + ulSize);
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetHDMIInfoFrameValidFlag(HCHANNEL hChannel, DWORD* pdwValidFlag)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    *pdwValidFlag = MWCAP_HDMI_INFOFRAME_MASK_AVI;
+    if (channel->Video().hdr_eotf)
+        *pdwValidFlag |= MWCAP_HDMI_INFOFRAME_MASK_HDR;
+    return MW_SUCCEEDED;
+}
+
+MW_RESULT MWGetHDMIInfoFramePacket(HCHANNEL hChannel,
+                                   MWCAP_HDMI_INFOFRAME_ID id,
+                                   HDMI_INFOFRAME_PACKET* pPacket)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    int eotf = channel->Video().hdr_eotf;
+    if (id != MWCAP_HDMI_INFOFRAME_ID_HDR || eotf == 0)
+        return MW_ENODATA;
+
+    *pPacket = HDMI_INFOFRAME_PACKET {};
+    pPacket->header.byPacketType = 0x87;
+    pPacket->header.byVersion    = 1;
+    pPacket->header.byLength     = 26;
+
+    auto& hdr = pPacket->hdrInfoFramePayload;
+    hdr.byEOTF = eotf;
+
+    auto put = [](BYTE& lsb, BYTE& msb, uint16_t value)
+    {
+        lsb = value & 0xFF;
+        msb = value >> 8;
+    };
+
+    // Display P3 mastering display, D65, 1000 nits
+    put(hdr.display_primaries_lsb_x0, hdr.display_primaries_msb_x0, 13250);
+    put(hdr.display_primaries_lsb_y0, hdr.display_primaries_msb_y0, 34500);
+    put(hdr.display_primaries_lsb_x1, hdr.display_primaries_msb_x1, 7500);
+    put(hdr.display_primaries_lsb_y1, hdr.display_primaries_msb_y1, 3000);
+    put(hdr.display_primaries_lsb_x2, hdr.display_primaries_msb_x2, 34000);
+    put(hdr.display_primaries_lsb_y2, hdr.display_primaries_msb_y2, 16000);
+    put(hdr.white_point_lsb_x, hdr.white_point_msb_x, 15635);
+    put(hdr.white_point_lsb_y, hdr.white_point_msb_y, 16450);
+    put(hdr.max_display_mastering_lsb_luminance,
+        hdr.max_display_mastering_msb_luminance, 1000);
+    put(hdr.min_display_mastering_lsb_luminance,
+        hdr.min_display_mastering_msb_luminance, 50);
+    put(hdr.maximum_content_light_level_lsb,
+        hdr.maximum_content_light_level_msb, 1000);
+    put(hdr.maximum_frame_average_light_level_lsb,
+        hdr.maximum_frame_average_light_level_msb, 400);
+    return MW_SUCCEEDED;
+}
+
+MWCAP_PTR MWCreateEvent(void)
+{
+    auto event = make_shared<Event>();
+    MWCAP_PTR handle = reinterpret_cast<MWCAP_PTR>(event.get());
+
+    scoped_lock lock(g_event_mutex);
+    g_events[handle] = std::move(event);
+    return handle;
+}
+
+MW_RESULT MWCloseEvent(MWCAP_PTR hEvent)
+{
+    scoped_lock lock(g_event_mutex);
+    return g_events.erase(hEvent) ? MW_SUCCEEDED : MW_INVALID_PARAMS;
+}
+
+int MWWaitEvent(MWCAP_PTR hEvent, int nTimeout)
+{
+    auto event = find_event(hEvent);
+    if (!event)
+        return -1;
+    return event->Wait(nTimeout);
+}
+
+HNOTIFY MWRegisterNotify(HCHANNEL hChannel, MWCAP_PTR hEvent,
+                         DWORD dwEnableBits)
+{
+    Channel* channel = to_channel(hChannel);
+    if (channel == nullptr)
+        return 0;
+    return channel->RegisterNotify(hEvent, dwEnableBits);
+}
+
+MW_RESULT MWUnregisterNotify(HCHANNEL hChannel, HNOTIFY hNotify)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->UnregisterNotify(hNotify);
+}
+
+MW_RESULT MWGetNotifyStatus(HCHANNEL hChannel, HNOTIFY hNotify,
+                            ULONGLONG* pullStatus)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->GetNotifyStatus(hNotify, pullStatus);
+}
+
+MW_RESULT MWStartAudioCapture(HCHANNEL hChannel)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->StartAudio(true);
+}
+
+MW_RESULT MWStopAudioCapture(HCHANNEL hChannel)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->StartAudio(false);
+}
+
+MW_RESULT MWCaptureAudioFrame(HCHANNEL hChannel,
+                              MWCAP_AUDIO_CAPTURE_FRAME* pAudioCaptureFrame)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->CaptureAudioFrame(pAudioCaptureFrame);
+}
+
+MW_RESULT MWStartVideoCapture(HCHANNEL hChannel, MWCAP_PTR hEvent)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->StartVideo(true, hEvent);
+}
+
+MW_RESULT MWStopVideoCapture(HCHANNEL hChannel)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->StartVideo(false, 0);
+}
+
+MW_RESULT MWGetVideoBufferInfo(HCHANNEL hChannel,
+                               MWCAP_VIDEO_BUFFER_INFO* pVideoBufferInfo)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->GetBufferInfo(pVideoBufferInfo);
+}
+
+MW_RESULT MWGetVideoFrameInfo(HCHANNEL hChannel, BYTE i,
+                              MWCAP_VIDEO_FRAME_INFO* pVideoFrameInfo)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->GetFrameInfo(i, pVideoFrameInfo);
+}
+
+MW_RESULT MWPinVideoBuffer(HCHANNEL hChannel, MWCAP_PTR pbFrame,
+                           DWORD cbFrame)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return (pbFrame == 0 || cbFrame == 0) ? MW_INVALID_PARAMS : MW_SUCCEEDED;
+}
+
+MW_RESULT MWUnpinVideoBuffer(HCHANNEL hChannel, LPBYTE pbFrame)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return pbFrame == nullptr ? MW_INVALID_PARAMS : MW_SUCCEEDED;
+}
+
+MW_RESULT MWCaptureVideoFrameToVirtualAddress(HCHANNEL hChannel, int iFrame,
+                                              MWCAP_PTR pbFrame, DWORD cbFrame,
+                                              DWORD cbStride,
+                                              BOOLEAN bBottomUp,
+                                              MWCAP_PTR64 pvContext,
+                                              DWORD dwFOURCC,
+                                              int cx, int cy)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    if (bBottomUp)
+        return MW_INVALID_PARAMS;
+    return channel->CaptureFrame(iFrame, reinterpret_cast<uint8_t*>(pbFrame),
+                                 cbFrame, cbStride, pvContext, dwFOURCC,
+                                 cx, cy, 0);
+}
+
+MW_RESULT MWCaptureVideoFrameToVirtualAddressEx
+    (HCHANNEL hChannel, int iFrame, MWCAP_PTR pbFrame, DWORD cbFrame,
+     DWORD cbStride, BOOLEAN bBottomUp, MWCAP_PTR64 pvContext,
+     DWORD dwFOURCC, int cx, int cy, DWORD dwProcessSwitchs,
+     int cyParitalNotify, HOSD hOSDImage, const RECT* pOSDRects,
+     int cOSDRects, SHORT sContrast, SHORT sBrightness, SHORT sSaturation,
+     SHORT sHue, MWCAP_VIDEO_DEINTERLACE_MODE deinterlaceMode,
+     MWCAP_VIDEO_ASPECT_RATIO_CONVERT_MODE aspectRatioConvertMode,
+     const RECT* pRectSrc, const RECT* pRectDest, int nAspectX,
+     int nAspectY, MWCAP_VIDEO_COLOR_FORMAT colorFormat,
+     MWCAP_VIDEO_QUANTIZATION_RANGE quantRange,
+     MWCAP_VIDEO_SATURATION_RANGE satRange)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    // No processing, OSD or scaling is simulated.
+    if (bBottomUp || dwProcessSwitchs != 0 || hOSDImage != 0 ||
+        pRectSrc != nullptr || pRectDest != nullptr)
+        return MW_INVALID_PARAMS;
+    return channel->CaptureFrame(iFrame, reinterpret_cast<uint8_t*>(pbFrame),
+                                 cbFrame, cbStride, pvContext, dwFOURCC,
+                                 cx, cy, cyParitalNotify);
+}
+
+MW_RESULT MWGetVideoCaptureStatus(HCHANNEL hChannel,
+                                  MWCAP_VIDEO_CAPTURE_STATUS* pStatus)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->GetCaptureStatus(pStatus);
+}
+
+MW_RESULT MWStartVideoEcoCapture(HCHANNEL hChannel,
+                                 MWCAP_VIDEO_ECO_CAPTURE_OPEN* pEcoCaptureOpen)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->StartEco(pEcoCaptureOpen);
+}
+
+MW_RESULT MWCaptureSetVideoEcoFrame(HCHANNEL hChannel,
+                                    MWCAP_VIDEO_ECO_CAPTURE_FRAME* pFrame)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->SetEcoFrame(pFrame);
+}
+
+MW_RESULT MWGetVideoEcoCaptureStatus(HCHANNEL hChannel,
+                                     MWCAP_VIDEO_ECO_CAPTURE_STATUS* pStatus)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->GetEcoStatus(pStatus);
+}
+
+MW_RESULT MWStopVideoEcoCapture(HCHANNEL hChannel)
+{
+    CHANNEL_OR_FAIL(hChannel);
+    return channel->StopEco();
+}